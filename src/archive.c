@@ -0,0 +1,520 @@
+/**
+ * @file archive.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * @brief Single-file output. Instead of writing one <file>.xml per header,
+ *        every XML document is compressed by a pool of worker threads and
+ *        appended to one archive. The layout of the archive is:
+ *
+ *        header:   "SC2XMLAR", u32 version, u32 reserved
+ *        entries:  one gzip member per document
+ *        toc:      per entry: u32 name length, name, u64 offset,
+ *                  u64 compressed size, u64 size, u32 crc32
+ *        footer:   u64 toc offset, u32 number of entries, "SC2XMLTC"
+ *
+ *        All the integers are little endian. The toc is sorted by name.
+ *        Since every entry is an independent gzip member, one document can
+ *        be extracted by reading the toc and inflating only that member.
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+#include <zlib.h>
+
+#include "config.h"
+#include "sc2xml.h"
+#include "misc.h"
+#include "archive.h"
+
+#define ARCHIVE_QUEUE_PER_THREAD	4	/**< Documents waiting per worker */
+
+typedef struct archive_entry_st {
+	char *name;					/**< Name of the document */
+	char *data;					/**< Uncompressed document, freed once compressed */
+	guint64 offset;				/**< Offset of the gzip member in the archive */
+	guint64 csize;				/**< Compressed size */
+	guint64 size;				/**< Uncompressed size */
+	guint32 crc;				/**< crc32 of the uncompressed document */
+} SCArchiveEntry;
+
+typedef struct archive_st {
+	FILE *fd;					/**< The archive being written */
+	guint64 offset;				/**< Where the next entry is appended */
+	GThreadPool *pool;			/**< Compression workers */
+	GPtrArray *entries;			/**< Entries already appended */
+	GPtrArray *aliases;			/**< Pairs of alias, target names */
+	GMutex lock;				/**< Protects everything below pool */
+	GCond done;					/**< Signaled every time an entry is appended */
+	int pending;				/**< Documents queued or being compressed */
+	int max_pending;			/**< Limit of documents kept in memory */
+	int failed;					/**< A worker could not compress or write */
+} SCArchive;
+
+static SCArchive *archive = NULL;
+
+static void free_entry(gpointer data)
+{
+	SCArchiveEntry *entry = (SCArchiveEntry *)data;
+
+	g_free(entry->name);
+	g_free(entry->data);
+	g_free(entry);
+}
+
+static gint compare_entries(gconstpointer a, gconstpointer b)
+{
+	const SCArchiveEntry *e1 = *(SCArchiveEntry **)a;
+	const SCArchiveEntry *e2 = *(SCArchiveEntry **)b;
+
+	return strcmp(e1->name, e2->name);
+}
+
+/**
+ * @brief Worker thread: compress a document as a gzip member and append it
+ *        to the archive.
+ * @param data The SCArchiveEntry to compress
+ * @param user_data NULL
+ */
+static void archive_compress(gpointer data, gpointer user_data)
+{
+	SCArchiveEntry	*entry = (SCArchiveEntry *)data;
+	z_stream		strm;
+	guchar			*out = NULL;
+	uLong			bound;
+	int				rc;
+
+	memset(&strm, 0, sizeof(strm));
+
+	/* windowBits + 16 writes a gzip header and trailer */
+	rc = deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+		Z_DEFAULT_STRATEGY);
+	if (rc != Z_OK)
+		goto error;
+
+	bound = deflateBound(&strm, entry->size);
+	out = g_new(guchar, bound);
+
+	strm.next_in = (Bytef *)entry->data;
+	strm.avail_in = entry->size;
+	strm.next_out = out;
+	strm.avail_out = bound;
+
+	rc = deflate(&strm, Z_FINISH);
+	entry->csize = strm.total_out;
+	deflateEnd(&strm);
+	if (rc != Z_STREAM_END)
+		goto error;
+
+	entry->crc = crc32(0L, (Bytef *)entry->data, entry->size);
+
+	g_free(entry->data);
+	entry->data = NULL;
+
+	g_mutex_lock(&archive->lock);
+	entry->offset = archive->offset;
+	if (fwrite(out, 1, entry->csize, archive->fd) != entry->csize) {
+		log_error(LOG_ERR, "%s(): Could not append '%s' to the archive",
+			__func__, entry->name);
+		archive->failed++;
+		free_entry(entry);
+	}
+	else {
+		archive->offset += entry->csize;
+		g_ptr_array_add(archive->entries, entry);
+	}
+	archive->pending--;
+	g_cond_signal(&archive->done);
+	g_mutex_unlock(&archive->lock);
+
+	g_free(out);
+	return;
+
+error:
+	log_error(LOG_ERR, "%s(): Could not compress '%s'", __func__, entry->name);
+	g_free(out);
+	free_entry(entry);
+
+	g_mutex_lock(&archive->lock);
+	archive->failed++;
+	archive->pending--;
+	g_cond_signal(&archive->done);
+	g_mutex_unlock(&archive->lock);
+}
+
+/**
+ * @brief Create an archive and start the compression workers
+ * @param filename The archive
+ * @param threads Number of workers, 0 for one per processor
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult archive_open(const char *filename, int threads)
+{
+	guchar	header[ARCHIVE_HEADER_SIZE];
+	GError	*error = NULL;
+
+	if (threads <= 0)
+		threads = g_get_num_processors();
+
+	archive = g_new0(SCArchive, 1);
+
+	archive->fd = fopen(filename, "wb");
+	if (archive->fd == NULL) {
+		log_error(LOG_ERR, "%s(): Could not create the archive '%s'",
+			__func__, filename);
+		g_free(archive);
+		archive = NULL;
+		return SC_FAIL;
+	}
+
+	memset(header, 0, sizeof(header));
+	memcpy(header, ARCHIVE_MAGIC, 8);
+	put_u32(header + 8, ARCHIVE_VERSION);
+	fwrite(header, 1, sizeof(header), archive->fd);
+	archive->offset = sizeof(header);
+
+	archive->entries = g_ptr_array_new_with_free_func(free_entry);
+	archive->aliases = g_ptr_array_new_with_free_func(g_free);
+	archive->max_pending = threads * ARCHIVE_QUEUE_PER_THREAD;
+	g_mutex_init(&archive->lock);
+	g_cond_init(&archive->done);
+
+	archive->pool = g_thread_pool_new(archive_compress, NULL, threads, TRUE, &error);
+	if (archive->pool == NULL) {
+		log_error(LOG_ERR, "%s(): Could not start the workers: %s",
+			__func__, error->message);
+		g_error_free(error);
+		fclose(archive->fd);
+		g_ptr_array_free(archive->entries, TRUE);
+		g_ptr_array_free(archive->aliases, TRUE);
+		g_free(archive);
+		archive = NULL;
+		return SC_FAIL;
+	}
+
+	return SC_OK;
+}
+
+/**
+ * @brief Queue a document for compression. Blocks while too many documents
+ *        are waiting, so memory stays bounded when the parser is faster
+ *        than the workers.
+ * @param name Name of the entry
+ * @param data The document, it is copied
+ * @param size Size of the document
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult archive_add(const char *name, const char *data, unsigned long size)
+{
+	SCArchiveEntry *entry;
+
+	if (archive == NULL)
+		return SC_FAIL;
+
+	entry = g_new0(SCArchiveEntry, 1);
+	entry->name = g_strdup(name);
+	entry->size = size;
+	entry->data = g_new(char, size + 1);
+	memcpy(entry->data, data, size);
+
+	g_mutex_lock(&archive->lock);
+	while (archive->pending >= archive->max_pending)
+		g_cond_wait(&archive->done, &archive->lock);
+	archive->pending++;
+	g_mutex_unlock(&archive->lock);
+
+	g_thread_pool_push(archive->pool, entry, NULL);
+
+	return SC_OK;
+}
+
+/**
+ * @brief Add an entry that shares the data of another one. The toc entry
+ *        of the alias points to the same gzip member as the target.
+ * @param name Name of the alias
+ * @param target Name of an entry already added
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult archive_add_alias(const char *name, const char *target)
+{
+	if (archive == NULL)
+		return SC_FAIL;
+
+	/* The target may be still in the queue, aliases are resolved at the end */
+	g_ptr_array_add(archive->aliases, g_strdup(name));
+	g_ptr_array_add(archive->aliases, g_strdup(target));
+
+	return SC_OK;
+}
+
+/**
+ * @brief Create the toc entries of the aliases
+ */
+static void archive_resolve_aliases(void)
+{
+	GHashTable	*names;
+	guint		i;
+
+	names = g_hash_table_new(g_str_hash, g_str_equal);
+	for (i = 0; i < archive->entries->len; i++) {
+		SCArchiveEntry *entry = g_ptr_array_index(archive->entries, i);
+		g_hash_table_insert(names, entry->name, entry);
+	}
+
+	for (i = 0; i < archive->aliases->len; i += 2) {
+		const char *name = g_ptr_array_index(archive->aliases, i);
+		const char *target = g_ptr_array_index(archive->aliases, i + 1);
+		SCArchiveEntry *entry, *alias;
+
+		entry = g_hash_table_lookup(names, target);
+		if (entry == NULL) {
+			log_error(LOG_ERR, "%s(): '%s' is an alias of the missing entry '%s'",
+				__func__, name, target);
+			archive->failed++;
+			continue;
+		}
+
+		alias = g_new0(SCArchiveEntry, 1);
+		*alias = *entry;
+		alias->name = g_strdup(name);
+		g_ptr_array_add(archive->entries, alias);
+	}
+
+	g_hash_table_destroy(names);
+}
+
+/**
+ * @brief Wait for the workers, write the toc and the footer
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult archive_close(void)
+{
+	guchar		buff[ARCHIVE_FOOTER_SIZE];
+	guint64		toc_offset;
+	guint		i;
+	SCResult	rc = SC_OK;
+
+	if (archive == NULL)
+		return SC_FAIL;
+
+	/* Wait until every queued document is compressed */
+	g_thread_pool_free(archive->pool, FALSE, TRUE);
+
+	archive_resolve_aliases();
+	g_ptr_array_sort(archive->entries, compare_entries);
+
+	toc_offset = archive->offset;
+	for (i = 0; i < archive->entries->len; i++) {
+		SCArchiveEntry *entry = g_ptr_array_index(archive->entries, i);
+		guint32 len = strlen(entry->name);
+
+		put_u32(buff, len);
+		fwrite(buff, 1, 4, archive->fd);
+		fwrite(entry->name, 1, len, archive->fd);
+		put_u64(buff, entry->offset);
+		put_u64(buff + 8, entry->csize);
+		fwrite(buff, 1, 16, archive->fd);
+		put_u64(buff, entry->size);
+		put_u32(buff + 8, entry->crc);
+		fwrite(buff, 1, 12, archive->fd);
+	}
+
+	put_u64(buff, toc_offset);
+	put_u32(buff + 8, archive->entries->len);
+	memcpy(buff + 12, ARCHIVE_TOC_MAGIC, 8);
+	fwrite(buff, 1, ARCHIVE_FOOTER_SIZE, archive->fd);
+
+	if (fclose(archive->fd) != 0 || archive->failed) {
+		log_error(LOG_ERR, "%s(): The archive is incomplete", __func__);
+		rc = SC_FAIL;
+	}
+
+	log_error(LOG_INFO, "%u documents archived", archive->entries->len);
+
+	g_ptr_array_free(archive->entries, TRUE);
+	g_ptr_array_free(archive->aliases, TRUE);
+	g_mutex_clear(&archive->lock);
+	g_cond_clear(&archive->done);
+	g_free(archive);
+	archive = NULL;
+
+	return rc;
+}
+
+/**
+ * @brief Read the toc of an archive
+ * @param fd The archive
+ * @return The entries, NULL if the file is not an archive
+ */
+static GPtrArray * archive_read_toc(FILE *fd)
+{
+	guchar		buff[ARCHIVE_FOOTER_SIZE];
+	guint64		toc_offset;
+	guint32		count, i;
+	GPtrArray	*entries;
+
+	if (fseek(fd, -ARCHIVE_FOOTER_SIZE, SEEK_END) != 0 ||
+		fread(buff, 1, ARCHIVE_FOOTER_SIZE, fd) != ARCHIVE_FOOTER_SIZE ||
+		memcmp(buff + 12, ARCHIVE_TOC_MAGIC, 8) != 0)
+		return NULL;
+
+	toc_offset = get_u64(buff);
+	count = get_u32(buff + 8);
+
+	if (fseek(fd, toc_offset, SEEK_SET) != 0)
+		return NULL;
+
+	entries = g_ptr_array_new_with_free_func(free_entry);
+
+	for (i = 0; i < count; i++) {
+		SCArchiveEntry *entry;
+		guint32 len;
+
+		if (fread(buff, 1, 4, fd) != 4)
+			goto error;
+		len = get_u32(buff);
+
+		entry = g_new0(SCArchiveEntry, 1);
+		entry->name = g_new0(char, len + 1);
+		g_ptr_array_add(entries, entry);
+
+		if (fread(entry->name, 1, len, fd) != len || fread(buff, 1, 16, fd) != 16)
+			goto error;
+		entry->offset = get_u64(buff);
+		entry->csize = get_u64(buff + 8);
+
+		if (fread(buff, 1, 12, fd) != 12)
+			goto error;
+		entry->size = get_u64(buff);
+		entry->crc = get_u32(buff + 8);
+	}
+
+	return entries;
+
+error:
+	g_ptr_array_free(entries, TRUE);
+	return NULL;
+}
+
+/**
+ * @brief Print the entries of an archive
+ * @param filename The archive
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult archive_list(const char *filename)
+{
+	FILE		*fd;
+	GPtrArray	*entries;
+	guint		i;
+
+	fd = fopen(filename, "rb");
+	if (fd == NULL) {
+		log_error(LOG_ERR, "%s(): Could not open '%s'", __func__, filename);
+		return SC_FAIL;
+	}
+
+	entries = archive_read_toc(fd);
+	fclose(fd);
+	if (entries == NULL) {
+		log_error(LOG_ERR, "%s(): '%s' is not an archive", __func__, filename);
+		return SC_FAIL;
+	}
+
+	for (i = 0; i < entries->len; i++) {
+		SCArchiveEntry *entry = g_ptr_array_index(entries, i);
+
+		printf("%10" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT " %s\n",
+			entry->size, entry->csize, entry->name);
+	}
+
+	g_ptr_array_free(entries, TRUE);
+
+	return SC_OK;
+}
+
+/**
+ * @brief Extract a single document. Only its gzip member is inflated.
+ * @param filename The archive
+ * @param name The entry to extract
+ * @param out Where the document is written
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult archive_extract(const char *filename, const char *name, FILE *out)
+{
+	FILE			*fd;
+	GPtrArray		*entries;
+	SCArchiveEntry	*entry = NULL;
+	guchar			*cdata = NULL,
+					*data = NULL;
+	z_stream		strm;
+	guint			i;
+	SCResult		rc = SC_FAIL;
+
+	fd = fopen(filename, "rb");
+	if (fd == NULL) {
+		log_error(LOG_ERR, "%s(): Could not open '%s'", __func__, filename);
+		return SC_FAIL;
+	}
+
+	entries = archive_read_toc(fd);
+	if (entries == NULL) {
+		log_error(LOG_ERR, "%s(): '%s' is not an archive", __func__, filename);
+		fclose(fd);
+		return SC_FAIL;
+	}
+
+	for (i = 0; i < entries->len; i++) {
+		entry = g_ptr_array_index(entries, i);
+		if (!strcmp(entry->name, name))
+			break;
+		entry = NULL;
+	}
+
+	if (entry == NULL) {
+		log_error(LOG_ERR, "%s(): '%s' is not in the archive", __func__, name);
+		goto clean;
+	}
+
+	cdata = g_new(guchar, entry->csize);
+	data = g_new(guchar, entry->size + 1);
+
+	if (fseek(fd, entry->offset, SEEK_SET) != 0 ||
+		fread(cdata, 1, entry->csize, fd) != entry->csize) {
+		log_error(LOG_ERR, "%s(): Could not read '%s'", __func__, name);
+		goto clean;
+	}
+
+	memset(&strm, 0, sizeof(strm));
+	if (inflateInit2(&strm, 15 + 16) != Z_OK)
+		goto clean;
+
+	strm.next_in = cdata;
+	strm.avail_in = entry->csize;
+	strm.next_out = data;
+	strm.avail_out = entry->size + 1;
+
+	if (inflate(&strm, Z_FINISH) != Z_STREAM_END || strm.total_out != entry->size ||
+		crc32(0L, data, entry->size) != entry->crc) {
+		log_error(LOG_ERR, "%s(): '%s' is corrupted", __func__, name);
+		inflateEnd(&strm);
+		goto clean;
+	}
+	inflateEnd(&strm);
+
+	fwrite(data, 1, entry->size, out);
+	rc = SC_OK;
+
+clean:
+	g_free(cdata);
+	g_free(data);
+	g_ptr_array_free(entries, TRUE);
+	fclose(fd);
+
+	return rc;
+}
@@ -0,0 +1,33 @@
+/**
+ * @file archive.h
+ *
+ * @brief Defines for archive.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#ifndef _ARCHIVE_H
+#define _ARCHIVE_H
+
+#include <stdio.h>
+
+#include "sc2xml.h"
+
+#define ARCHIVE_MAGIC		"SC2XMLAR"	/**< First bytes of an archive */
+#define ARCHIVE_TOC_MAGIC	"SC2XMLTC"	/**< Last bytes of an archive */
+#define ARCHIVE_VERSION		1			/**< Archive format version */
+#define ARCHIVE_HEADER_SIZE	16			/**< magic + version + reserved */
+#define ARCHIVE_FOOTER_SIZE	20			/**< toc offset + count + magic */
+
+SCResult	archive_open(const char *, int);
+SCResult	archive_add(const char *, const char *, unsigned long);
+SCResult	archive_add_alias(const char *, const char *);
+SCResult	archive_close(void);
+SCResult	archive_list(const char *);
+SCResult	archive_extract(const char *, const char *, FILE *);
+
+#endif	/* _ARCHIVE_H */
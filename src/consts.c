@@ -0,0 +1,709 @@
+/**
+ * @file consts.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * @brief Integer constants found while scanning: object-like #define
+ *        macros and enum values. They are kept in a hash table by name,
+ *        so the array sizes and bit widths written with them can be
+ *        evaluated without running the preprocessor, e.g.:
+ *
+ *        #define BUTTONS_NUMBER 20
+ *        int raw[(BUTTONS_NUMBER / 8) + 1];	-> 3
+ *
+ *        Every header parsed has its own constants. A name not defined in
+ *        it is looked up in the headers of the tree it #includes, so a
+ *        header never sees the constants of a header it does not include.
+ *
+ *        The evaluator follows the C rules for integer constant
+ *        expressions, but everything is computed as a signed 64 bits
+ *        value. Casts, sizeof and function-like macros are not supported.
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "config.h"
+#include "sc2xml.h"
+#include "misc.h"
+#include "consts.h"
+
+#define CONSTS_MAX_DEPTH	32	/**< Nesting of macros and parentheses */
+
+/** State of the evaluation of one expression */
+typedef struct {
+	const char	*p;			/**< Next character */
+	int			depth;		/**< Current nesting */
+	int			error;		/**< Set on a syntax error or an unknown name */
+} SCEval;
+
+/** The constants of a header */
+typedef struct {
+	gchar		*header;	/**< The header */
+	GHashTable	*table;		/**< Name -> replacement text */
+	GPtrArray	*includes;	/**< Names given to its #include lines */
+} SCConsts;
+
+static GHashTable	*headers = NULL;	/**< Header -> SCConsts */
+static SCConsts		*current = NULL;	/**< Where constants are recorded and looked up */
+
+static gint64 consts_cond(SCEval *);
+
+static void consts_free(gpointer data)
+{
+	SCConsts *consts = (SCConsts *)data;
+
+	g_hash_table_destroy(consts->table);
+	g_ptr_array_free(consts->includes, TRUE);
+	g_free(consts->header);
+	g_free(consts);
+}
+
+/**
+ * @brief Start the constants of a header, forgetting the ones it had. The
+ *        constants found while scanning are recorded in it.
+ * @param header The header
+ */
+void consts_begin(const char *header)
+{
+	if (headers == NULL)
+		headers = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, consts_free);
+
+	current = g_new0(SCConsts, 1);
+	current->header = g_strdup(header);
+	current->table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	current->includes = g_ptr_array_new_with_free_func(g_free);
+	g_hash_table_replace(headers, current->header, current);
+}
+
+/**
+ * @brief Evaluate the next expressions with the constants of a header
+ * @param header The header, NULL for no constants at all
+ * @return The header used before, to give back to consts_use() afterwards
+ */
+const char * consts_use(const char *header)
+{
+	const char *previous = current ? current->header : NULL;
+
+	current = header && headers ? g_hash_table_lookup(headers, header) : NULL;
+
+	return previous;
+}
+
+/**
+ * @brief Record a constant, replacing any previous definition
+ * @param name The name
+ * @param text The replacement text
+ */
+static void consts_set(const char *name, const char *text)
+{
+	if (current == NULL)
+		consts_begin("");
+
+	g_hash_table_replace(current->table, g_strdup(name), g_strdup(text));
+}
+
+/**
+ * @brief Get the header named by an #include line
+ * @param line The line after '#include'
+ * @return The name, NULL if there is none
+ */
+static gchar * consts_include_name(const char *line)
+{
+	const char	*p = line,
+				*end;
+
+	while (g_ascii_isspace(*p))
+		p++;
+	if (*p != '"' && *p != '<')
+		return NULL;
+
+	end = strchr(p + 1, *p == '"' ? '"' : '>');
+	if (end == NULL || end == p + 1)
+		return NULL;
+
+	return g_strndup(p + 1, end - p - 1);
+}
+
+/**
+ * @brief Record the header named by an #include line
+ * @param line The line after '#include'
+ */
+void consts_include(const char *line)
+{
+	gchar *name = consts_include_name(line);
+
+	if (name == NULL)
+		return;
+
+	if (current == NULL)
+		consts_begin("");
+	g_ptr_array_add(current->includes, name);
+}
+
+/**
+ * @brief Find the header of the tree named by an #include: the one next to
+ *        the including header, otherwise the first one, by path, whose path
+ *        ends with the name
+ * @param from The including header
+ * @param name The name given to #include
+ * @return The constants of the header, NULL if it was not parsed
+ */
+static SCConsts * consts_included(const char *from, const char *name)
+{
+	GHashTableIter	iter;
+	gpointer		key,
+					value;
+	SCConsts		*found;
+	gchar			*dir,
+					*path;
+	gsize			length = strlen(name);
+
+	if (headers == NULL)
+		return NULL;
+
+	dir = g_path_get_dirname(from);
+	path = g_build_filename(dir, name, NULL);
+	found = g_hash_table_lookup(headers, path);
+	g_free(path);
+	g_free(dir);
+	if (found)
+		return found;
+
+	g_hash_table_iter_init(&iter, headers);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		const char	*header = key;
+		gsize		size = strlen(header);
+
+		if (size < length || strcmp(header + size - length, name) != 0)
+			continue;
+		if (size > length && header[size - length - 1] != '/')
+			continue;
+		if (found == NULL || strcmp(header, found->header) < 0)
+			found = value;
+	}
+
+	return found;
+}
+
+/**
+ * @brief Look up a constant in a header, then in the headers it includes
+ * @param consts The constants of the header
+ * @param name The name
+ * @param seen The headers looked up already
+ * @return The replacement text, NULL if the name is unknown
+ */
+static const char * consts_lookup(SCConsts *consts, const char *name, GHashTable *seen)
+{
+	const char	*text;
+	guint		i;
+
+	if (consts == NULL || g_hash_table_lookup(seen, consts))
+		return NULL;
+	g_hash_table_insert(seen, consts, consts);
+
+	if ((text = g_hash_table_lookup(consts->table, name)) != NULL)
+		return text;
+
+	for (i = 0; i < consts->includes->len; i++) {
+		text = consts_lookup(consts_included(consts->header, g_ptr_array_index(consts->includes, i)),
+				name, seen);
+		if (text)
+			return text;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Record an object-like macro
+ * @param line The line after '#define', without the line continuations
+ */
+void consts_define(const char *line)
+{
+	const char	*p = line,
+				*start;
+	gchar		*name,
+				*text,
+				*comment;
+
+	while (g_ascii_isspace(*p))
+		p++;
+
+	start = p;
+	while (g_ascii_isalnum(*p) || *p == '_')
+		p++;
+
+	/* Function-like macros are not constants */
+	if (p == start || *p == '(')
+		return;
+
+	name = g_strndup(start, p - start);
+	text = g_strdup(p);
+
+	/* Comments after the value */
+	while ((comment = strstr(text, "/*")) != NULL) {
+		gchar *end = strstr(comment + 2, "*/");
+
+		if (end == NULL) {
+			*comment = '\0';
+			break;
+		}
+		memmove(comment, end + 2, strlen(end + 2) + 1);
+	}
+	if ((comment = strstr(text, "//")) != NULL)
+		*comment = '\0';
+
+	consts_set(name, g_strstrip(text));
+	debug_info("%s(): %s = '%s'\n", __func__, name, text);
+
+	g_free(name);
+	g_free(text);
+}
+
+/**
+ * @brief Record the values of an enum
+ * @param tokens Tokens of the statement that contains the enum
+ */
+void consts_enum(GList *tokens)
+{
+	GList	*ptr;
+	gint64	value = 0;
+	int		known = 1;
+
+	for (ptr = tokens; ptr; ptr = ptr->next)
+		if (strcmp(ptr->data, "enum") == 0)
+			break;
+	if (ptr == NULL)
+		return;
+
+	/* The tag is optional */
+	ptr = ptr->next;
+	if (ptr && strcmp(ptr->data, "{") != 0)
+		ptr = ptr->next;
+	if (ptr == NULL || strcmp(ptr->data, "{") != 0)
+		return;
+
+	ptr = ptr->next;
+	while (ptr && strcmp(ptr->data, "}") != 0) {
+		const char *name = ptr->data;
+
+		ptr = ptr->next;
+
+		/* An explicit value, up to the next ',' outside parentheses */
+		if (ptr && strcmp(ptr->data, "=") == 0) {
+			GString	*expr = g_string_new(NULL);
+			int		level = 0;
+
+			for (ptr = ptr->next; ptr; ptr = ptr->next) {
+				const char *token = ptr->data;
+
+				if (level == 0 && (strcmp(token, ",") == 0 || strcmp(token, "}") == 0))
+					break;
+				if (strcmp(token, "(") == 0)
+					level++;
+				else if (strcmp(token, ")") == 0)
+					level--;
+				g_string_append_printf(expr, "%s ", token);
+			}
+
+			known = consts_eval(expr->str, &value) == SC_OK;
+			g_string_free(expr, TRUE);
+		}
+
+		if (known) {
+			gchar *text = g_strdup_printf("%" G_GINT64_FORMAT, value);
+
+			consts_set(name, text);
+			g_free(text);
+			value++;
+		}
+
+		if (ptr && strcmp(ptr->data, ",") == 0)
+			ptr = ptr->next;
+	}
+}
+
+/**
+ * @brief Record the constants of a header that is not parsed, a duplicate
+ *        whose outputs were copied, for the headers that include it. Only
+ *        its #define and #include lines are read, not its enums.
+ * @param header The header
+ * @param contents The contents of the header, NUL terminated
+ */
+void consts_scan(const char *header, const gchar *contents)
+{
+	gchar	**lines = g_strsplit(contents, "\n", -1);
+	GString	*line = g_string_new(NULL);
+	guint	i;
+
+	consts_begin(header);
+	for (i = 0; lines[i] != NULL; i++) {
+		const char *p;
+
+		/* The line continuations */
+		g_string_assign(line, lines[i]);
+		while (line->len && line->str[line->len - 1] == '\\' && lines[i + 1] != NULL) {
+			g_string_truncate(line, line->len - 1);
+			g_string_append(line, lines[++i]);
+		}
+
+		p = line->str;
+		while (g_ascii_isspace(*p))
+			p++;
+		if (*p++ != '#')
+			continue;
+		while (g_ascii_isspace(*p))
+			p++;
+		if (strncmp(p, "define", 6) == 0 && g_ascii_isspace(p[6]))
+			consts_define(p + 6);
+		else if (strncmp(p, "include", 7) == 0)
+			consts_include(p + 7);
+	}
+
+	g_string_free(line, TRUE);
+	g_strfreev(lines);
+}
+
+/**
+ * @brief Add the constants of an included header, then of the headers it
+ *        includes, to a checksum
+ * @param checksum The checksum
+ * @param consts The constants of the included header
+ * @param seen The headers added already
+ */
+static void consts_checksum_add(GChecksum *checksum, SCConsts *consts, GHashTable *seen)
+{
+	GList	*names,
+			*ptr;
+	guint	i;
+
+	if (consts == NULL || g_hash_table_lookup(seen, consts))
+		return;
+	g_hash_table_insert(seen, consts, consts);
+
+	names = g_list_sort(g_hash_table_get_keys(consts->table), (GCompareFunc)strcmp);
+	for (ptr = names; ptr; ptr = ptr->next) {
+		gchar *line = g_strdup_printf("%s=%s\n", (char *)ptr->data,
+						(char *)g_hash_table_lookup(consts->table, ptr->data));
+
+		g_checksum_update(checksum, (const guchar *)line, -1);
+		g_free(line);
+	}
+	g_list_free(names);
+	g_checksum_update(checksum, (const guchar *)"\n", 1);
+
+	for (i = 0; i < consts->includes->len; i++)
+		consts_checksum_add(checksum, consts_included(consts->header,
+			g_ptr_array_index(consts->includes, i)), seen);
+}
+
+/**
+ * @brief Add to a checksum the constants a header would see through its
+ *        #include lines if it was parsed now, so headers with the same
+ *        contents but different included constants get different sums
+ * @param checksum The checksum
+ * @param header The header
+ * @param contents The contents of the header, NUL terminated
+ */
+void consts_checksum(GChecksum *checksum, const char *header, const gchar *contents)
+{
+	GHashTable	*seen = g_hash_table_new(g_direct_hash, g_direct_equal);
+	gchar		**lines = g_strsplit(contents, "\n", -1),
+				*name;
+	guint		i;
+
+	for (i = 0; lines[i] != NULL; i++) {
+		const char *p = lines[i];
+
+		while (g_ascii_isspace(*p))
+			p++;
+		if (*p++ != '#')
+			continue;
+		while (g_ascii_isspace(*p))
+			p++;
+		if (strncmp(p, "include", 7) != 0 || (name = consts_include_name(p + 7)) == NULL)
+			continue;
+
+		consts_checksum_add(checksum, consts_included(header, name), seen);
+		g_free(name);
+	}
+
+	g_strfreev(lines);
+	g_hash_table_destroy(seen);
+}
+
+/**
+ * @brief Forget the constants of every header
+ */
+void consts_reset(void)
+{
+	if (headers)
+		g_hash_table_destroy(headers);
+	headers = NULL;
+	current = NULL;
+}
+
+/**
+ * @brief Skip the blanks
+ * @param ev The evaluation
+ */
+static void consts_blank(SCEval *ev)
+{
+	while (g_ascii_isspace(*ev->p))
+		ev->p++;
+}
+
+/**
+ * @brief Check for an operator and consume it
+ * @param ev The evaluation
+ * @param op The operator
+ * @return 1 if the next token is op
+ */
+static int consts_accept(SCEval *ev, const char *op)
+{
+	size_t len = strlen(op);
+
+	consts_blank(ev);
+	if (strncmp(ev->p, op, len) != 0)
+		return 0;
+
+	/* '<' is not '<<' nor '<=', '&' is not '&&', ... */
+	if (len == 1 && ev->p[1] != '\0' && strchr("<>=&|", ev->p[1]) &&
+			(ev->p[1] == op[0] || ev->p[1] == '='))
+		return 0;
+	if (len == 2 && (strcmp(op, "<<") == 0 || strcmp(op, ">>") == 0) && ev->p[2] == '=')
+		return 0;
+
+	ev->p += len;
+	return 1;
+}
+
+/**
+ * @brief Evaluate a number, a character, a constant or a parenthesized
+ *        expression
+ * @param ev The evaluation
+ * @return The value
+ */
+static gint64 consts_primary(SCEval *ev)
+{
+	gint64 value = 0;
+
+	consts_blank(ev);
+
+	if (ev->error)
+		return 0;
+
+	if (g_ascii_isdigit(*ev->p)) {
+		gchar *end;
+
+		value = (gint64)g_ascii_strtoull(ev->p, &end, 0);
+		while (*end == 'u' || *end == 'U' || *end == 'l' || *end == 'L')
+			end++;
+		ev->p = end;
+	}
+	else if (*ev->p == '\'') {
+		if (ev->p[1] == '\\' && ev->p[2] != '\0' && ev->p[3] == '\'') {
+			switch (ev->p[2]) {
+			case 'n':	value = '\n'; break;
+			case 't':	value = '\t'; break;
+			case 'r':	value = '\r'; break;
+			case '0':	value = 0; break;
+			default:	value = ev->p[2]; break;
+			}
+			ev->p += 4;
+		}
+		else if (ev->p[1] != '\0' && ev->p[2] == '\'') {
+			value = ev->p[1];
+			ev->p += 3;
+		}
+		else
+			ev->error = 1;
+	}
+	else if (g_ascii_isalpha(*ev->p) || *ev->p == '_') {
+		const char	*start = ev->p,
+					*text,
+					*saved;
+		gchar		*name;
+
+		while (g_ascii_isalnum(*ev->p) || *ev->p == '_')
+			ev->p++;
+		name = g_strndup(start, ev->p - start);
+		text = NULL;
+		if (current) {
+			GHashTable *seen = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+			text = consts_lookup(current, name, seen);
+			g_hash_table_destroy(seen);
+		}
+		g_free(name);
+
+		if (text == NULL || *text == '\0' || ev->depth >= CONSTS_MAX_DEPTH) {
+			ev->error = 1;
+			return 0;
+		}
+
+		/* The replacement text is an expression of its own */
+		saved = ev->p;
+		ev->p = text;
+		ev->depth++;
+		value = consts_cond(ev);
+		consts_blank(ev);
+		if (*ev->p != '\0')
+			ev->error = 1;
+		ev->depth--;
+		ev->p = saved;
+	}
+	else if (consts_accept(ev, "(")) {
+		if (++ev->depth > CONSTS_MAX_DEPTH) {
+			ev->error = 1;
+			return 0;
+		}
+		value = consts_cond(ev);
+		ev->depth--;
+		if (!consts_accept(ev, ")"))
+			ev->error = 1;
+	}
+	else
+		ev->error = 1;
+
+	return value;
+}
+
+/**
+ * @brief Evaluate the unary operators
+ * @param ev The evaluation
+ * @return The value
+ */
+static gint64 consts_unary(SCEval *ev)
+{
+	if (consts_accept(ev, "-"))
+		return -consts_unary(ev);
+	if (consts_accept(ev, "+"))
+		return consts_unary(ev);
+	if (consts_accept(ev, "~"))
+		return ~consts_unary(ev);
+	if (consts_accept(ev, "!"))
+		return !consts_unary(ev);
+
+	return consts_primary(ev);
+}
+
+/**
+ * @brief Evaluate the binary operators from a precedence level on
+ * @param ev The evaluation
+ * @param level The precedence level, 0 is '||'
+ * @return The value
+ */
+static gint64 consts_binary(SCEval *ev, int level)
+{
+	/* From the lowest to the highest precedence, two-character operators
+	 * first so '<' does not take the first half of '<<' */
+	static const char *ops[][5] = {
+		{ "||", NULL },
+		{ "&&", NULL },
+		{ "|", NULL },
+		{ "^", NULL },
+		{ "&", NULL },
+		{ "==", "!=", NULL },
+		{ "<=", ">=", "<", ">", NULL },
+		{ "<<", ">>", NULL },
+		{ "+", "-", NULL },
+		{ "*", "/", "%", NULL },
+	};
+	gint64	left,
+			right;
+	int		i;
+
+	if (level == G_N_ELEMENTS(ops))
+		return consts_unary(ev);
+
+	left = consts_binary(ev, level + 1);
+
+	while (!ev->error) {
+		const char *op = NULL;
+
+		for (i = 0; ops[level][i] != NULL; i++)
+			if (consts_accept(ev, ops[level][i])) {
+				op = ops[level][i];
+				break;
+			}
+		if (op == NULL)
+			break;
+
+		right = consts_binary(ev, level + 1);
+
+		if (strcmp(op, "||") == 0)			left = left || right;
+		else if (strcmp(op, "&&") == 0)		left = left && right;
+		else if (strcmp(op, "|") == 0)		left |= right;
+		else if (strcmp(op, "^") == 0)		left ^= right;
+		else if (strcmp(op, "&") == 0)		left &= right;
+		else if (strcmp(op, "==") == 0)		left = left == right;
+		else if (strcmp(op, "!=") == 0)		left = left != right;
+		else if (strcmp(op, "<=") == 0)		left = left <= right;
+		else if (strcmp(op, ">=") == 0)		left = left >= right;
+		else if (strcmp(op, "<") == 0)		left = left < right;
+		else if (strcmp(op, ">") == 0)		left = left > right;
+		else if (strcmp(op, "<<") == 0)		left = right < 0 || right > 63 ? 0 : (gint64)((guint64)left << right);
+		else if (strcmp(op, ">>") == 0)		left = right < 0 || right > 63 ? 0 : left >> right;
+		else if (strcmp(op, "+") == 0)		left = (gint64)((guint64)left + (guint64)right);
+		else if (strcmp(op, "-") == 0)		left = (gint64)((guint64)left - (guint64)right);
+		else if (strcmp(op, "*") == 0)		left = (gint64)((guint64)left * (guint64)right);
+		else if (right == 0)				ev->error = 1;
+		else if (strcmp(op, "/") == 0)		left = right == -1 ? -left : left / right;
+		else								left = right == -1 ? 0 : left % right;
+	}
+
+	return left;
+}
+
+/**
+ * @brief Evaluate the conditional operator
+ * @param ev The evaluation
+ * @return The value
+ */
+static gint64 consts_cond(SCEval *ev)
+{
+	gint64	cond = consts_binary(ev, 0),
+			yes,
+			no;
+
+	if (!consts_accept(ev, "?"))
+		return cond;
+
+	yes = consts_cond(ev);
+	if (!consts_accept(ev, ":"))
+		ev->error = 1;
+	no = consts_cond(ev);
+
+	return cond ? yes : no;
+}
+
+/**
+ * @brief Evaluate an integer constant expression
+ * @param expr The expression, e.g. "( BUTTONS_NUMBER / 8 ) + 1"
+ * @param value Set to the value
+ * @return SC_OK if every name in the expression is a known constant
+ */
+SCResult consts_eval(const char *expr, gint64 *value)
+{
+	SCEval ev;
+
+	if (expr == NULL)
+		return SC_FAIL;
+
+	ev.p = expr;
+	ev.depth = 0;
+	ev.error = 0;
+
+	*value = consts_cond(&ev);
+	consts_blank(&ev);
+
+	return ev.error || *ev.p != '\0' ? SC_FAIL : SC_OK;
+}
@@ -0,0 +1,30 @@
+/**
+ * @file consts.h
+ *
+ * @brief Defines for consts.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#ifndef _CONSTS_H
+#define _CONSTS_H
+
+#include <glib.h>
+
+#include "sc2xml.h"
+
+void		consts_begin(const char *);
+const char *consts_use(const char *);
+void		consts_define(const char *);
+void		consts_include(const char *);
+void		consts_checksum(GChecksum *, const char *, const gchar *);
+void		consts_scan(const char *, const gchar *);
+void		consts_enum(GList *);
+SCResult	consts_eval(const char *, gint64 *);
+void		consts_reset(void);
+
+#endif	/* _CONSTS_H */
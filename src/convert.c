@@ -0,0 +1,663 @@
+/**
+ * @file convert.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * @brief Binary record conversion (sc2xml convert). A file that is an array
+ *        of records of a struct is rewritten with the layout and the byte
+ *        order of another ABI:
+ *
+ *        sc2xml convert --struct NAME --abi FROM [--endian big] --to TO
+ *            [--to-endian big] in.bin out.bin <file0>|<dir0> ...
+ *
+ *        The headers are parsed with both layouts (see layout.c) and the
+ *        struct is compiled into a flat list of operations on the bytes of
+ *        a record: copies, byte swaps of runs of integers of the same size,
+ *        integers whose size changes and bit fields. Nested structs, fields
+ *        of struct types and arrays of them are unrolled, and neighbouring
+ *        operations are merged, so a struct of integers is usually a few
+ *        long copies or swaps.
+ *
+ *        The records are converted in blocks that fit in the cache, one
+ *        operation at a time over all the records of the block, by a pool
+ *        of threads that write straight to the mapped output file. The
+ *        padding of the output is zeroed.
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include "config.h"
+#include "sc2xml.h"
+#include "misc.h"
+#include "model.h"
+#include "layout.h"
+#include "gen.h"
+#include "decode.h"
+#include "convert.h"
+
+#define CONVERT_BLOCK	(256 * 1024)	/**< Input bytes converted by a task */
+
+/* The records being converted */
+typedef struct {
+	const guchar *src;		/**< The mapped input */
+	guchar *dst;			/**< The mapped output */
+	SCConvertProgram *program;
+	int src_big;			/**< Byte orders */
+	int dst_big;
+	guint64 block;			/**< Records converted by a task */
+	guint64 records;
+} SCConvertJob;
+
+static GHashTable	*programs = NULL;	/**< Name or C type -> SCConvertProgram */
+static GPtrArray	*compiled = NULL;	/**< The SCConvertProgram */
+static SCAbi		src_abi,
+					dst_abi;
+static int			src_big,
+					dst_big;
+
+static void convert_program_free(gpointer data)
+{
+	SCConvertProgram *program = data;
+
+	g_free(program->name);
+	g_array_free(program->ops, TRUE);
+	g_free(program);
+}
+
+/**
+ * @brief Append an operation, merged with the previous one if it goes on
+ *        where that one ends in both records
+ * @param ops The operations
+ * @param op The operation
+ */
+void convert_emit(GArray *ops, SCConvertOp *op)
+{
+	SCConvertOp *last;
+
+	if (ops->len > 0) {
+		last = &g_array_index(ops, SCConvertOp, ops->len - 1);
+
+		if (op->kind == CONVERT_COPY && last->kind == CONVERT_COPY &&
+				last->src + last->src_size == op->src &&
+				last->dst + last->dst_size == op->dst) {
+			last->src_size += op->src_size;
+			last->dst_size += op->dst_size;
+			return;
+		}
+		if ((op->kind == CONVERT_SWAP || op->kind == CONVERT_INT) &&
+				last->kind == op->kind && last->src_size == op->src_size &&
+				last->dst_size == op->dst_size && last->is_signed == op->is_signed &&
+				last->src + last->count * last->src_size == op->src &&
+				last->dst + last->count * last->dst_size == op->dst) {
+			last->count += op->count;
+			return;
+		}
+	}
+
+	g_array_append_val(ops, *op);
+}
+
+/**
+ * @brief Add the operation of count integers
+ * @param ops The operations
+ * @param src Offset in bytes of the first one in the input record
+ * @param dst Offset in bytes of the first one in the output record
+ * @param src_size Bytes of an integer in the input
+ * @param dst_size Bytes of an integer in the output
+ * @param count Number of integers
+ * @param is_signed Sign extend them if they grow
+ * @param swap The byte orders of the input and the output differ
+ */
+void convert_emit_int(GArray *ops, guint64 src, guint64 dst, guint64 src_size,
+		guint64 dst_size, guint64 count, int is_signed, int swap)
+{
+	SCConvertOp op;
+
+	memset(&op, 0, sizeof(op));
+	op.src = src;
+	op.dst = dst;
+	op.count = count;
+
+	if (src_size == dst_size && (!swap || src_size == 1)) {
+		op.kind = CONVERT_COPY;
+		op.src_size = op.dst_size = src_size * count;
+	}
+	else {
+		op.kind = src_size == dst_size ? CONVERT_SWAP : CONVERT_INT;
+		op.src_size = src_size;
+		op.dst_size = dst_size;
+		op.is_signed = op.kind == CONVERT_INT && is_signed;
+	}
+
+	convert_emit(ops, &op);
+}
+
+static SCResult convert_members(GArray *, SCStruct *, guint64, guint64);
+
+/**
+ * @brief Add the operations of a field
+ * @param ops The operations
+ * @param field The field
+ * @param src Offset in bytes of the enclosing struct in the input record
+ * @param dst Offset in bytes of the enclosing struct in the output record
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+static SCResult convert_field(GArray *ops, SCField *field, guint64 src, guint64 dst)
+{
+	SCLayout			*from = &field->layout[src_abi],
+						*to = &field->layout[dst_abi];
+	SCConvertProgram	*program = NULL;
+	SCConvertOp			op;
+	gchar				*name;
+	gint64				width = 0;
+	guint64				from_size,
+						to_size,
+						i, j;
+	int					pointer,
+						text;
+
+	if (!from->known || !to->known)
+		return SC_FAIL;
+	if (from->count == 0)
+		return SC_OK;
+
+	from_size = from->size / from->count;
+	to_size = to->size / to->count;
+
+	/* Nested structs/unions and arrays of them are unrolled */
+	if (field->nested) {
+		for (i = 0; i < from->count; i++)
+			if (convert_members(ops, field->nested, src + from->offset / 8 + i * from_size,
+					dst + to->offset / 8 + i * to_size) != SC_OK)
+				return SC_FAIL;
+		return SC_OK;
+	}
+
+	if (field->bits) {
+		width = from->bits;
+		if (width == 0)
+			return SC_OK;
+
+		memset(&op, 0, sizeof(op));
+		op.kind = CONVERT_BITS;
+		op.src = src * 8 + from->offset;
+		op.dst = dst * 8 + to->offset;
+		op.src_width = op.dst_width = width;
+		convert_emit(ops, &op);
+		return SC_OK;
+	}
+
+	src += from->offset / 8;
+	dst += to->offset / 8;
+
+	name = model_type_name(field->type, &pointer);
+	if (!pointer && !field->func_ptr && name && programs)
+		program = g_hash_table_lookup(programs, name);
+	g_free(name);
+
+	/* A struct converted before, once per element */
+	if (program) {
+		for (i = 0; i < from->count; i++) {
+			for (j = 0; j < program->ops->len; j++) {
+				op = g_array_index(program->ops, SCConvertOp, j);
+				if (op.kind == CONVERT_BITS) {
+					op.src += (src + i * from_size) * 8;
+					op.dst += (dst + i * to_size) * 8;
+				}
+				else {
+					op.src += src + i * from_size;
+					op.dst += dst + i * to_size;
+				}
+				convert_emit(ops, &op);
+			}
+		}
+		return SC_OK;
+	}
+
+	/* Pointers are unsigned, floats are swapped like integers */
+	if (pointer || field->func_ptr || from_size <= 8) {
+		convert_emit_int(ops, src, dst, from_size, to_size, from->count,
+			!pointer && !field->func_ptr &&
+			decode_scalar(field, src_abi, &text) == DECODE_SIGNED, src_big != dst_big);
+		return SC_OK;
+	}
+
+	/* long double has a format of its own on every ABI, it is copied only
+	 * when it is the same */
+	if (from_size != to_size || src_big != dst_big) {
+		log_error(LOG_WARN, "%s(): '%s' cannot be converted, it is left as zeros",
+			__func__, field->name);
+		return SC_OK;
+	}
+
+	memset(&op, 0, sizeof(op));
+	op.kind = CONVERT_COPY;
+	op.src = src;
+	op.dst = dst;
+	op.src_size = op.dst_size = from->size;
+	convert_emit(ops, &op);
+
+	return SC_OK;
+}
+
+/**
+ * @brief Add the operations of the members of a struct. Only the largest
+ *        member of a union is converted, the other ones share its bytes.
+ * @param ops The operations
+ * @param st The struct
+ * @param src Offset in bytes of st in the input record
+ * @param dst Offset in bytes of st in the output record
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+static SCResult convert_members(GArray *ops, SCStruct *st, guint64 src, guint64 dst)
+{
+	SCField	*largest = NULL;
+	gchar	*name;
+	int		array;
+	guint	i;
+
+	for (i = 0; i < st->fields->len; i++) {
+		SCField *field = g_ptr_array_index(st->fields, i);
+
+		/* Type-only declarations of nested structs take no room */
+		if (field->nested && field->nested->name) {
+			if ((name = gen_nested_name(field->nested, &array)) == NULL)
+				continue;
+			g_free(name);
+		}
+
+		if (!st->is_union) {
+			if (convert_field(ops, field, src, dst) != SC_OK)
+				return SC_FAIL;
+		}
+		else if (largest == NULL ||
+				field->layout[src_abi].size > largest->layout[src_abi].size)
+			largest = field;
+	}
+
+	return largest ? convert_field(ops, largest, src, dst) : SC_OK;
+}
+
+/**
+ * @brief Compile a top-level struct while parsing the headers, so it can
+ *        be converted or used by the structs parsed after it
+ * @param header The header where it is defined
+ * @param st The struct
+ * @return SC_OK
+ */
+SCResult convert_add(const char *header, SCStruct *st)
+{
+	SCConvertProgram	*program;
+	gchar				*type;
+
+	if (!st->layout[src_abi].known || !st->layout[dst_abi].known)
+		return SC_OK;
+
+	program = g_new0(SCConvertProgram, 1);
+	program->src_size = st->layout[src_abi].size;
+	program->dst_size = st->layout[dst_abi].size;
+	program->ops = g_array_new(FALSE, FALSE, sizeof(SCConvertOp));
+	if ((program->name = model_struct_name(st)) == NULL ||
+			convert_members(program->ops, st, 0, 0) != SC_OK) {
+		debug_info("'%s' in '%s' cannot be converted\n", program->name, header);
+		convert_program_free(program);
+		return SC_OK;
+	}
+
+	if (programs == NULL) {
+		programs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+		compiled = g_ptr_array_new_with_free_func(convert_program_free);
+	}
+	g_ptr_array_add(compiled, program);
+
+	/* By name, and by type for the fields of this type */
+	g_hash_table_replace(programs, g_strdup(program->name), program);
+	if ((type = gen_type_name(st)) != NULL)
+		g_hash_table_replace(programs, type, program);
+	if ((type = model_declarator_name(st->typedef_name)) != NULL)
+		g_hash_table_replace(programs, type, program);
+	if ((type = model_declarator_name(st->tail_name)) != NULL)
+		g_hash_table_replace(programs, type, program);
+
+	return SC_OK;
+}
+
+/**
+ * @brief Reverse the bytes of n integers. The loops have a constant size
+ *        so the compiler turns them into vector shuffles.
+ */
+static inline void convert_swap(guchar *dst, const guchar *src, guint64 size, guint64 n)
+{
+	guint64 i;
+
+	switch (size) {
+	case 2:
+		for (i = 0; i < n; i++) {
+			guint16 v;
+
+			memcpy(&v, src + i * 2, 2);
+			v = GUINT16_SWAP_LE_BE(v);
+			memcpy(dst + i * 2, &v, 2);
+		}
+		break;
+
+	case 4:
+		for (i = 0; i < n; i++) {
+			guint32 v;
+
+			memcpy(&v, src + i * 4, 4);
+			v = GUINT32_SWAP_LE_BE(v);
+			memcpy(dst + i * 4, &v, 4);
+		}
+		break;
+
+	case 8:
+		for (i = 0; i < n; i++) {
+			guint64 v;
+
+			memcpy(&v, src + i * 8, 8);
+			v = GUINT64_SWAP_LE_BE(v);
+			memcpy(dst + i * 8, &v, 8);
+		}
+		break;
+
+	default:
+		for (i = 0; i < n * size; i++)
+			dst[i] = src[i / size * size + size - 1 - i % size];
+		break;
+	}
+}
+
+/**
+ * @brief Read an integer of 1 to 8 bytes
+ */
+static inline guint64 convert_get(const guchar *p, guint64 size, int big)
+{
+	guint64	value = 0;
+	guint	i;
+
+	if (big)
+		for (i = 0; i < size; i++)
+			value = value << 8 | p[i];
+	else
+		for (i = size; i > 0; i--)
+			value = value << 8 | p[i - 1];
+
+	return value;
+}
+
+/**
+ * @brief Write an integer of 1 to 8 bytes
+ */
+static inline void convert_put(guchar *p, guint64 size, int big, guint64 value)
+{
+	guint i;
+
+	for (i = 0; i < size; i++, value >>= 8)
+		p[big ? size - 1 - i : i] = value & 0xff;
+}
+
+/**
+ * @brief Read a bit field, a byte at a time. Bits are numbered from the
+ *        least significant bit of a byte in little endian and from the
+ *        most significant one in big endian.
+ */
+static inline guint64 convert_get_bits(const guchar *p, guint64 offset, guint width, int big)
+{
+	guint64	value = 0;
+	guint	i, n, shift;
+
+	for (i = 0; i < width; i += n) {
+		guint64 bit = offset + i;
+
+		n = MIN(8 - bit % 8, width - i);
+		shift = big ? 8 - bit % 8 - n : bit % 8;
+		if (big)
+			value = value << n | ((p[bit / 8] >> shift) & ((1u << n) - 1));
+		else
+			value |= (guint64)((p[bit / 8] >> shift) & ((1u << n) - 1)) << i;
+	}
+
+	return value;
+}
+
+/**
+ * @brief Write a bit field, see convert_get_bits()
+ */
+static inline void convert_put_bits(guchar *p, guint64 offset, guint width, int big,
+		guint64 value)
+{
+	guint i, n, shift, bits;
+
+	for (i = 0; i < width; i += n) {
+		guint64 bit = offset + i;
+
+		n = MIN(8 - bit % 8, width - i);
+		shift = big ? 8 - bit % 8 - n : bit % 8;
+		bits = (big ? value >> (width - i - n) : value >> i) & ((1u << n) - 1);
+		p[bit / 8] = (p[bit / 8] & ~(((1u << n) - 1) << shift)) | bits << shift;
+	}
+}
+
+/**
+ * @brief Convert a block of records, run by the pool
+ * @param data Index of the block, plus 1
+ * @param user_data The SCConvertJob
+ */
+static void convert_block(gpointer data, gpointer user_data)
+{
+	SCConvertJob		*job = user_data;
+	SCConvertProgram	*program = job->program;
+	guint64				first = (GPOINTER_TO_SIZE(data) - 1) * job->block,
+						n = MIN(job->block, job->records - first),
+						ss = program->src_size,
+						ds = program->dst_size,
+						r, i;
+	const guchar		*src = job->src + first * ss;
+	guchar				*dst = job->dst + first * ds;
+	guint				k;
+
+	memset(dst, 0, n * ds);
+
+	/* One operation at a time over all the records, the block is in cache */
+	for (k = 0; k < program->ops->len; k++) {
+		SCConvertOp *op = &g_array_index(program->ops, SCConvertOp, k);
+
+		switch (op->kind) {
+		case CONVERT_COPY:
+			for (r = 0; r < n; r++)
+				memcpy(dst + r * ds + op->dst, src + r * ss + op->src, op->src_size);
+			break;
+
+		case CONVERT_SWAP:
+			for (r = 0; r < n; r++)
+				convert_swap(dst + r * ds + op->dst, src + r * ss + op->src, op->src_size,
+					op->count);
+			break;
+
+		case CONVERT_INT:
+			for (r = 0; r < n; r++) {
+				for (i = 0; i < op->count; i++) {
+					guint64 value = convert_get(src + r * ss + op->src + i * op->src_size,
+										op->src_size, job->src_big);
+
+					if (op->is_signed && op->src_size < 8 &&
+							(value >> (op->src_size * 8 - 1)) & 1)
+						value |= ~(guint64)0 << (op->src_size * 8);
+					convert_put(dst + r * ds + op->dst + i * op->dst_size, op->dst_size,
+						job->dst_big, value);
+				}
+			}
+			break;
+
+		case CONVERT_BITS:
+			for (r = 0; r < n; r++) {
+				guint64 value = convert_get_bits(src + r * ss, op->src, op->src_width,
+									job->src_big);
+
+				if (op->is_signed && op->src_width < 64 && (value >> (op->src_width - 1)) & 1)
+					value |= ~(guint64)0 << op->src_width;
+				convert_put_bits(dst + r * ds, op->dst, op->dst_width, job->dst_big, value);
+			}
+			break;
+		}
+	}
+}
+
+/**
+ * @brief Parse a byte order given to --endian or --to-endian
+ * @param name The byte order, little if NULL
+ * @param big Set to 1 for big endian
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult convert_endian(const char *name, int *big)
+{
+	*big = name && strcmp(name, "big") == 0;
+	if (name && !*big && strcmp(name, "little") != 0) {
+		log_error(LOG_ERR, "The byte order is 'little' or 'big', not '%s'", name);
+		return SC_FAIL;
+	}
+
+	return SC_OK;
+}
+
+/**
+ * @brief Run a program over a file of records, see convert_block()
+ * @param program The program
+ * @param in_name The input file
+ * @param out_name The output file
+ * @param in_big The input records are big endian
+ * @param out_big The output records are big endian
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult convert_run(SCConvertProgram *program, const char *in_name, const char *out_name,
+		int in_big, int out_big)
+{
+	SCConvertJob	job;
+	GThreadPool		*pool;
+	GError			*error = NULL;
+	struct stat		st;
+	void			*in = NULL,
+					*out = NULL;
+	guint64			blocks,
+					i;
+	int				in_fd,
+					out_fd;
+	SCResult		rc = SC_OK;
+
+	memset(&job, 0, sizeof(job));
+	job.program = program;
+	job.src_big = in_big;
+	job.dst_big = out_big;
+
+	if ((in_fd = open(in_name, O_RDONLY)) == -1 || fstat(in_fd, &st) != 0) {
+		log_error(LOG_ERR, "%s(): Could not open '%s'", __func__, in_name);
+		if (in_fd != -1)
+			close(in_fd);
+		return SC_FAIL;
+	}
+	if ((out_fd = open(out_name, O_RDWR | O_CREAT | O_TRUNC, 0644)) == -1) {
+		log_error(LOG_ERR, "%s(): Could not create '%s'", __func__, out_name);
+		close(in_fd);
+		return SC_FAIL;
+	}
+
+	job.records = st.st_size / program->src_size;
+	if (st.st_size % program->src_size)
+		log_error(LOG_WARN, "%s(): '%s' ends with %" G_GUINT64_FORMAT " bytes that are "
+			"not a record of %" G_GUINT64_FORMAT " bytes", __func__, in_name,
+			(guint64)st.st_size % program->src_size, program->src_size);
+
+	if (job.records && program->dst_size) {
+		if (ftruncate(out_fd, job.records * program->dst_size) != 0 ||
+				(in = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, in_fd, 0)) == MAP_FAILED ||
+				(out = mmap(NULL, job.records * program->dst_size, PROT_READ | PROT_WRITE,
+					MAP_SHARED, out_fd, 0)) == MAP_FAILED) {
+			log_error(LOG_ERR, "%s(): Could not map '%s' or '%s'", __func__, in_name, out_name);
+			rc = SC_FAIL;
+			goto out;
+		}
+		madvise(in, st.st_size, MADV_SEQUENTIAL);
+		job.src = in;
+		job.dst = out;
+
+		/* Blocks of whole records that fit in the cache */
+		job.block = MAX(1, CONVERT_BLOCK / MAX(program->src_size, program->dst_size));
+		blocks = (job.records + job.block - 1) / job.block;
+
+		pool = g_thread_pool_new(convert_block, &job,
+			sc_opts.threads > 0 ? sc_opts.threads : (int)g_get_num_processors(), TRUE, &error);
+		if (pool == NULL) {
+			log_error(LOG_ERR, "%s(): Could not start the workers: %s", __func__,
+				error->message);
+			g_error_free(error);
+			rc = SC_FAIL;
+			goto out;
+		}
+		for (i = 0; i < blocks; i++)
+			g_thread_pool_push(pool, GSIZE_TO_POINTER(i + 1), NULL);
+		g_thread_pool_free(pool, FALSE, TRUE);
+	}
+
+out:
+	if (out && out != MAP_FAILED)
+		munmap(out, job.records * program->dst_size);
+	if (in && in != MAP_FAILED)
+		munmap(in, st.st_size);
+	close(in_fd);
+	if (close(out_fd) != 0) {
+		log_error(LOG_ERR, "%s(): Could not write '%s'", __func__, out_name);
+		rc = SC_FAIL;
+	}
+
+	return rc;
+}
+
+/**
+ * @brief Convert a file of records of a struct to another ABI
+ * @param in_name The input file
+ * @param out_name The output file
+ * @param count Number of headers or directories
+ * @param paths The headers or directories where the struct is defined
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult convert_records(const char *in_name, const char *out_name, int count, char **paths)
+{
+	SCConvertProgram	*program;
+	int					abi;
+
+	if ((abi = layout_abi_find(sc_opts.abi)) < 0 ||
+			(src_abi = abi, abi = layout_abi_find(sc_opts.convert_abi)) < 0) {
+		log_error(LOG_ERR, "Unknown ABI, the ABIs are x86_64, i386, aarch64 and arm");
+		return SC_FAIL;
+	}
+	dst_abi = abi;
+	if (convert_endian(sc_opts.endian, &src_big) != SC_OK ||
+			convert_endian(sc_opts.to_endian, &dst_big) != SC_OK)
+		return SC_FAIL;
+
+	sc_opts.abis = 1 << src_abi | 1 << dst_abi;
+	if (decode_parse(count, paths) != SC_OK)
+		return SC_FAIL;
+
+	program = programs ? g_hash_table_lookup(programs, sc_opts.decode_struct) : NULL;
+	if (program == NULL || program->src_size == 0) {
+		log_error(LOG_ERR, "%s(): No struct/union '%s' laid out for %s and %s in the headers",
+			__func__, sc_opts.decode_struct, layout_abi_name(src_abi), layout_abi_name(dst_abi));
+		return SC_FAIL;
+	}
+
+	return convert_run(program, in_name, out_name, src_big, dst_big);
+}
@@ -0,0 +1,55 @@
+/**
+ * @file convert.h
+ *
+ * @brief Defines for convert.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#ifndef _CONVERT_H
+#define _CONVERT_H
+
+#include "sc2xml.h"
+#include "model.h"
+
+/* What an operation does */
+typedef enum {
+	CONVERT_COPY,			/**< Copy size bytes */
+	CONVERT_SWAP,			/**< Reverse the bytes of count integers */
+	CONVERT_INT,			/**< Resize count integers, and swap them if needed */
+	CONVERT_BITS			/**< Move a bit field, or an integer from or to one */
+} SCConvertKind;
+
+/* An operation on a record. Offsets are in bytes, in bits for CONVERT_BITS */
+typedef struct {
+	SCConvertKind kind;
+	guint64 src;			/**< Offset in the input record */
+	guint64 dst;			/**< Offset in the output record */
+	guint64 src_size;		/**< Bytes of an integer, or of the copy */
+	guint64 dst_size;
+	guint64 count;			/**< Integers of CONVERT_SWAP/CONVERT_INT */
+	int is_signed;			/**< CONVERT_INT and CONVERT_BITS sign extend */
+	guint src_width;		/**< Bits of CONVERT_BITS in the input */
+	guint dst_width;		/**< Bits of CONVERT_BITS in the output */
+} SCConvertOp;
+
+/* A struct/union compiled for the two ABIs */
+typedef struct {
+	gchar *name;			/**< See model_struct_name() */
+	guint64 src_size;		/**< Bytes of a record */
+	guint64 dst_size;
+	GArray *ops;			/**< SCConvertOp */
+} SCConvertProgram;
+
+void		convert_emit(GArray *, SCConvertOp *);
+void		convert_emit_int(GArray *, guint64, guint64, guint64, guint64, guint64, int, int);
+SCResult	convert_run(SCConvertProgram *, const char *, const char *, int, int);
+SCResult	convert_endian(const char *, int *);
+SCResult	convert_add(const char *, SCStruct *);
+SCResult	convert_records(const char *, const char *, int, char **);
+
+#endif	/* _CONVERT_H */
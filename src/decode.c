@@ -0,0 +1,1350 @@
+/**
+ * @file decode.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * @brief Binary record decoder (sc2xml decode). A file that is an array of
+ *        records of a struct parsed from the headers is mapped in memory
+ *        and written as XML, with the elements of the serializers (see
+ *        serialize.c), or as JSON:
+ *
+ *        sc2xml decode --struct NAME --abi ABI file.bin <file0>|<dir0> ...
+ *
+ *        The headers are parsed first with the layout of the ABI (see
+ *        layout.c) and the struct is turned into a list of members with
+ *        their offsets, sizes and how to format them. The records are then
+ *        formatted in chunks by a pool of threads and the chunks are written
+ *        in order as they are done, so the output is the same with any
+ *        number of threads and only a few chunks are in memory at a time.
+ *
+ *        The values are read byte by byte in the order given by --endian,
+ *        little by default like all the ABIs, so a file can be decoded on
+ *        any host. Bit fields are numbered from the least significant bit
+ *        of their unit in little endian and from the most significant one
+ *        in big endian, as GCC does.
+ *
+ *        The trace files of the loggers of trace.c are decoded the same way,
+ *        with the byte order they were written with:
+ *
+ *        sc2xml trace --abi ABI file.trc <file0>|<dir0> ...
+ *
+ *        They are indexed first, every record is then formatted with the
+ *        struct of its type id and the chunks are written like above.
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#define _GNU_SOURCE		/* process_vm_readv() */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include <glib.h>
+
+#include "config.h"
+#include "sc2xml.h"
+#include "misc.h"
+#include "xml.h"
+#include "model.h"
+#include "layout.h"
+#include "gen.h"
+#include "trace.h"
+#include "decode.h"
+
+#define DECODE_CHUNK			4096	/**< Records formatted by a task */
+#define DECODE_QUEUE_PER_THREAD	4		/**< Chunks formatted ahead of the output */
+#define DECODE_READ				(4 << 20)	/**< Bytes read from a process at a time */
+
+extern SCResult get_files(int, char **);
+
+typedef struct decode_struct_st SCDecodeStruct;
+
+/* A member of a record, the members of anonymous structs/unions are
+ * members of the enclosing one */
+typedef struct {
+	SCDecodeKind kind;
+	int text;				/**< An array of char, written as text */
+	int array;				/**< 1 if it is an array */
+	guint64 offset;			/**< Bits from the start of the enclosing struct */
+	guint64 size;			/**< Bytes of an element, of the unit of a bit field */
+	guint64 count;			/**< Elements, 1 if it is not an array */
+	guint width;			/**< Width of a bit field, 0 otherwise */
+	gchar *xml_open;		/**< Markup before the value */
+	const char *xml_close;	/**< Markup after the value */
+	gchar *json_key;		/**< "name": */
+	SCDecodeStruct *nested;	/**< The struct/union of DECODE_NESTED */
+	int shared;				/**< The struct is a type of its own, see types */
+	gchar *pointee;			/**< Type pointed to by a pointer, to follow it */
+} SCDecodeMember;
+
+/* A struct/union as it is in memory for the ABI */
+struct decode_struct_st {
+	gchar *name;			/**< See model_struct_name(), NULL if anonymous */
+	int is_union;
+	guint64 size;
+	GPtrArray *members;		/**< SCDecodeMember */
+};
+
+/* A record of a trace file, see trace.h */
+typedef struct {
+	const guchar *record;	/**< Its type id, size and time, then the struct */
+	guint64 thread;
+	SCDecodeStruct *st;		/**< Struct of the type id, NULL if not known */
+} SCDecodeEvent;
+
+/* The records being decoded */
+typedef struct {
+	const guchar *data;		/**< The mapped file, or the records read */
+	guint64 first;			/**< Index of the record at data */
+	SCDecodeStruct *st;		/**< Struct of the records */
+	SCAbi abi;
+	int big;				/**< Big endian values */
+	int json;				/**< JSON instead of XML */
+	pid_t pid;				/**< Process the records are read from, 0 for a file */
+	int mem;				/**< Its /proc/pid/mem, -1 if not needed */
+	int depth;				/**< Levels of pointers followed */
+	SCDecodeEvent *events;	/**< The records of a trace file, NULL otherwise */
+	GMutex lock;			/**< Protects the done flags of the chunks */
+	GCond done;				/**< Signaled every time a chunk is done */
+} SCDecodeJob;
+
+/* Records formatted by a task */
+typedef struct {
+	guint64 first;
+	guint64 count;
+	GString *out;
+	int done;
+} SCDecodeChunk;
+
+static GHashTable	*types = NULL;	/**< Name or C type -> SCDecodeStruct */
+static GPtrArray	*structs = NULL;	/**< The top-level SCDecodeStruct */
+
+static const char digits[] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+static void decode_struct_free(gpointer);
+
+static void decode_member_free(gpointer data)
+{
+	SCDecodeMember *member = data;
+
+	g_free(member->xml_open);
+	g_free(member->json_key);
+	g_free(member->pointee);
+	if (member->nested && !member->shared)
+		decode_struct_free(member->nested);
+	g_free(member);
+}
+
+static void decode_struct_free(gpointer data)
+{
+	SCDecodeStruct *st = data;
+
+	g_free(st->name);
+	g_ptr_array_free(st->members, TRUE);
+	g_free(st);
+}
+
+/**
+ * @brief Find out how the values of a field of a builtin type or a typedef
+ *        of one are stored
+ * @param field The field
+ * @param abi The ABI
+ * @param text Set to 1 for arrays of plain char
+ * @return DECODE_SIGNED, DECODE_UNSIGNED or DECODE_FLOAT
+ */
+SCDecodeKind decode_scalar(SCField *field, SCAbi abi, int *text)
+{
+	SCDecodeKind	kind = DECODE_SIGNED;
+	gchar			**tokens;
+	int				is_char = 0,
+					sign = 0,
+					i;
+
+	*text = 0;
+	tokens = g_strsplit(field->type ? field->type : "", " ", -1);
+	for (i = 0; tokens[i] != NULL; i++) {
+		const char *token = tokens[i];
+
+		if (strcmp(token, "enum") == 0)
+			break;
+		else if (strcmp(token, "float") == 0 || strcmp(token, "double") == 0)
+			kind = DECODE_FLOAT;
+		else if (strcmp(token, "unsigned") == 0 || strcmp(token, "signed") == 0)
+			sign = *token == 'u' ? 2 : 1;
+		else if (strcmp(token, "char") == 0 || strcmp(token, "wchar_t") == 0)
+			is_char = 1;
+		else if (strcmp(token, "_Bool") == 0 || strcmp(token, "bool") == 0 ||
+				strcmp(token, "size_t") == 0 || strcmp(token, "uintptr_t") == 0 ||
+				*token == 'u' || g_str_has_prefix(token, "__u"))
+			kind = DECODE_UNSIGNED;
+	}
+	g_strfreev(tokens);
+
+	if (sign)
+		return sign == 2 ? DECODE_UNSIGNED : DECODE_SIGNED;
+
+	/* Plain char and wchar_t are unsigned on ARM */
+	if (is_char) {
+		*text = field->size != NULL;
+		return abi == ABI_ARM || abi == ABI_AARCH64 ? DECODE_UNSIGNED : DECODE_SIGNED;
+	}
+
+	return kind;
+}
+
+/**
+ * @brief Find out how the values of a field are formatted
+ * @param field The field
+ * @param abi The ABI
+ * @param text Set to 1 for arrays of plain char
+ * @param nested Set to the struct of a field of a struct type
+ * @return The kind of the values
+ */
+static SCDecodeKind decode_classify(SCField *field, SCAbi abi, int *text,
+		SCDecodeStruct **nested)
+{
+	gchar	*name;
+	int		pointer;
+
+	*text = 0;
+	name = model_type_name(field->type, &pointer);
+	if (pointer || field->func_ptr) {
+		g_free(name);
+		return DECODE_POINTER;
+	}
+	if (name && types && (*nested = g_hash_table_lookup(types, name)) != NULL) {
+		g_free(name);
+		return DECODE_NESTED;
+	}
+	g_free(name);
+
+	return decode_scalar(field, abi, text);
+}
+
+static SCDecodeStruct * decode_struct_new(SCStruct *, SCAbi, gchar *);
+
+/**
+ * @brief Add the members of a struct
+ * @param out The struct being built
+ * @param st The parsed struct
+ * @param abi The ABI
+ * @param base Offset in bits of st in out, for anonymous structs/unions
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+static SCResult decode_members(SCDecodeStruct *out, SCStruct *st, SCAbi abi, guint64 base)
+{
+	guint i;
+
+	for (i = 0; i < st->fields->len; i++) {
+		SCField			*field = g_ptr_array_index(st->fields, i);
+		SCLayout		*layout = &field->layout[abi];
+		SCDecodeMember	*member;
+		gchar			*name,
+						*type,
+						*escaped;
+		gint64			width = 0;
+
+		if (!layout->known)
+			return SC_FAIL;
+
+		if (field->nested) {
+			SCStruct	*nested = field->nested;
+			int			array;
+
+			if ((name = gen_nested_name(nested, &array)) == NULL) {
+				if (nested->name == NULL &&
+						decode_members(out, nested, abi, base + layout->offset) != SC_OK)
+					return SC_FAIL;
+				continue;
+			}
+			if (layout->count == 0) {
+				g_free(name);
+				continue;
+			}
+
+			member = g_new0(SCDecodeMember, 1);
+			member->kind = DECODE_NESTED;
+			member->array = array;
+			member->offset = base + layout->offset;
+			member->count = layout->count;
+			member->size = layout->size / layout->count;
+			member->nested = decode_struct_new(nested, abi, model_declarator_name(nested->name));
+			member->xml_open = member->nested && member->nested->name ?
+				g_strdup_printf("<struct_name>%s</struct_name><name>%s</name>",
+					member->nested->name, name) :
+				g_strdup_printf("<name>%s</name>", name);
+			member->json_key = g_strdup_printf("\"%s\": ", name);
+			g_ptr_array_add(out->members, member);
+			g_free(name);
+
+			if (member->nested == NULL)
+				return SC_FAIL;
+			continue;
+		}
+
+		/* Flexible array members and ':0' take no room */
+		if (field->name == NULL || *field->name == '\0' || layout->count == 0)
+			continue;
+		if (field->bits && (width = layout->bits) == 0)
+			continue;
+
+		member = g_new0(SCDecodeMember, 1);
+		member->kind = decode_classify(field, abi, &member->text, &member->nested);
+		member->shared = member->nested != NULL;
+		member->array = field->size != NULL;
+		member->offset = base + layout->offset;
+		member->count = layout->count;
+		member->size = field->bits ? layout->size : layout->size / layout->count;
+		member->width = width;
+		if ((member->kind == DECODE_FLOAT && member->size != 4 && member->size != 8) ||
+				(member->kind != DECODE_NESTED && member->size > 8))
+			member->kind = DECODE_RAW;
+
+		/* Only struct pointers can be followed, see decode_follow() */
+		if (member->kind == DECODE_POINTER && !field->func_ptr && !member->array) {
+			int pointer;
+
+			member->pointee = model_type_name(field->type, &pointer);
+			if (pointer != 1) {
+				g_free(member->pointee);
+				member->pointee = NULL;
+			}
+		}
+
+		type = g_markup_escape_text(field->type ? field->type : "", -1);
+		escaped = g_markup_escape_text(field->size ? field->size : "", -1);
+		member->xml_open = g_strdup_printf("<field type=\"%s\"%s%s%s%s%s%s%s><name>%s</name>%s",
+			type, field->bits ? " bits=\"" : "", field->bits ? field->bits : "",
+			field->bits ? "\"" : "", field->size ? " size=\"" : "", escaped,
+			field->size ? "\"" : "", field->func_ptr ? " function_pointer=\"1\"" : "",
+			field->name, member->kind == DECODE_NESTED ? "" : "<value>");
+		member->xml_close = member->kind == DECODE_NESTED ? "</field>" : "</value></field>";
+		member->json_key = g_strdup_printf("\"%s\": ", field->name);
+		g_ptr_array_add(out->members, member);
+		g_free(type);
+		g_free(escaped);
+	}
+
+	return SC_OK;
+}
+
+/**
+ * @brief Build the members of a struct/union as laid out for an ABI
+ * @param st The parsed struct
+ * @param abi The ABI
+ * @param name The name of the struct, it is taken
+ * @return The struct, NULL if a member could not be laid out
+ */
+static SCDecodeStruct * decode_struct_new(SCStruct *st, SCAbi abi, gchar *name)
+{
+	SCDecodeStruct *out;
+
+	out = g_new0(SCDecodeStruct, 1);
+	out->name = name;
+	out->is_union = st->is_union;
+	out->size = st->layout[abi].size;
+	out->members = g_ptr_array_new_with_free_func(decode_member_free);
+
+	if (!st->layout[abi].known || decode_members(out, st, abi, 0) != SC_OK) {
+		decode_struct_free(out);
+		return NULL;
+	}
+
+	return out;
+}
+
+/**
+ * @brief Keep a top-level struct laid out while parsing the headers, so
+ *        it can be decoded or used by the structs parsed after it
+ * @param header The header where it is defined
+ * @param st The struct
+ * @return SC_OK
+ */
+SCResult decode_add(const char *header, SCStruct *st)
+{
+	SCDecodeStruct	*out;
+	gchar			*name,
+					*type;
+	SCAbi			abi = g_bit_nth_lsf(sc_opts.abis, -1);
+
+	if ((name = model_struct_name(st)) == NULL)
+		return SC_OK;
+	if ((out = decode_struct_new(st, abi, name)) == NULL) {
+		debug_info("Layout of '%s' in '%s' not known, it cannot be decoded", name, header);
+		g_free(name);
+		return SC_OK;
+	}
+
+	if (types == NULL) {
+		types = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+		structs = g_ptr_array_new_with_free_func(decode_struct_free);
+	}
+	g_ptr_array_add(structs, out);
+
+	/* By name, and by type for the fields of this type */
+	g_hash_table_replace(types, g_strdup(out->name), out);
+	if ((type = gen_type_name(st)) != NULL)
+		g_hash_table_replace(types, type, out);
+	if ((type = model_declarator_name(st->typedef_name)) != NULL)
+		g_hash_table_replace(types, type, out);
+	if ((type = model_declarator_name(st->tail_name)) != NULL)
+		g_hash_table_replace(types, type, out);
+
+	return SC_OK;
+}
+
+/**
+ * @brief Read an integer of 1 to 8 bytes
+ */
+static inline guint64 decode_uint(const guchar *p, guint64 size, int big)
+{
+	guint64	value = 0;
+	guint	i;
+
+	if (big)
+		for (i = 0; i < size; i++)
+			value = value << 8 | p[i];
+	else
+		for (i = size; i > 0; i--)
+			value = value << 8 | p[i - 1];
+
+	return value;
+}
+
+/**
+ * @brief Read a bit field
+ * @param p The enclosing struct
+ * @param offset Offset in bits of the bit field
+ * @param width Its width
+ * @param big Big endian
+ */
+static inline guint64 decode_bits(const guchar *p, guint64 offset, guint width, int big)
+{
+	guint64	value = 0,
+			bit;
+	guint	i;
+
+	for (i = 0; i < width; i++) {
+		bit = offset + i;
+		if (big)
+			value = value << 1 | ((p[bit / 8] >> (7 - bit % 8)) & 1);
+		else
+			value |= (guint64)((p[bit / 8] >> (bit % 8)) & 1) << i;
+	}
+
+	return value;
+}
+
+/**
+ * @brief Append an unsigned integer, two digits at a time
+ */
+static void decode_u64(GString *out, guint64 value)
+{
+	char	buf[20],
+			*p = buf + sizeof(buf);
+
+	while (value >= 100) {
+		guint d = (guint)(value % 100) * 2;
+
+		value /= 100;
+		*--p = digits[d + 1];
+		*--p = digits[d];
+	}
+	if (value >= 10) {
+		*--p = digits[value * 2 + 1];
+		*--p = digits[value * 2];
+	}
+	else
+		*--p = (char)('0' + value);
+
+	g_string_append_len(out, p, buf + sizeof(buf) - p);
+}
+
+/**
+ * @brief Append the bytes of a value in hex, in memory order
+ */
+static void decode_hex(GString *out, const guchar *p, guint64 size)
+{
+	guint64 i;
+
+	for (i = 0; i < size; i++) {
+		g_string_append_c(out, "0123456789abcdef"[p[i] >> 4]);
+		g_string_append_c(out, "0123456789abcdef"[p[i] & 15]);
+	}
+}
+
+/**
+ * @brief Append the text of an array of char, up to the first NUL
+ */
+static void decode_text(GString *out, const guchar *p, guint64 size, int json)
+{
+	guint64 i;
+
+	if (json)
+		g_string_append_c(out, '"');
+
+	for (i = 0; i < size && p[i] != '\0'; i++) {
+		guchar c = p[i];
+
+		if (json) {
+			if (c == '"' || c == '\\')
+				g_string_append_c(out, '\\');
+			if (c < 0x20 || c >= 0x7f)
+				g_string_append_printf(out, "\\u%04x", c);
+			else
+				g_string_append_c(out, c);
+			continue;
+		}
+
+		if (c == '&')
+			g_string_append(out, "&amp;");
+		else if (c == '<')
+			g_string_append(out, "&lt;");
+		else if (c == '>')
+			g_string_append(out, "&gt;");
+		else if (c == '"')
+			g_string_append(out, "&quot;");
+		else if (c < 0x20 && c != '\t' && c != '\n' && c != '\r')
+			g_string_append_c(out, '?');
+		else
+			g_string_append_c(out, c);
+	}
+
+	if (json)
+		g_string_append_c(out, '"');
+}
+
+/**
+ * @brief Append a value that is not a struct
+ * @param out Where the value is appended
+ * @param member The member
+ * @param p The value, or the enclosing struct for a bit field
+ * @param job The records being decoded
+ */
+static void decode_value(GString *out, SCDecodeMember *member, const guchar *p, SCDecodeJob *job)
+{
+	guint64	value = 0,
+			bits = 64;
+	char	buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+	if (member->width) {
+		value = decode_bits(p, member->offset, member->width, job->big);
+		bits = member->width;
+	}
+	else if (member->kind != DECODE_RAW) {
+		value = decode_uint(p, member->size, job->big);
+		bits = member->size * 8;
+	}
+
+	switch (member->kind) {
+	case DECODE_SIGNED:
+		if (bits < 64 && (value >> (bits - 1)) & 1)
+			value |= ~(guint64)0 << bits;
+		if ((gint64)value < 0) {
+			g_string_append_c(out, '-');
+			value = 0 - value;
+		}
+		/* Fall through */
+
+	case DECODE_UNSIGNED:
+		decode_u64(out, value);
+		break;
+
+	case DECODE_FLOAT: {
+		double	d;
+		float	f;
+
+		if (member->size == 4) {
+			guint32 u = (guint32)value;
+
+			memcpy(&f, &u, sizeof(f));
+			d = f;
+		}
+		else
+			memcpy(&d, &value, sizeof(d));
+
+		if (job->json && !isfinite(d))
+			g_string_append(out, "null");
+		else
+			g_string_append(out, g_ascii_formatd(buf, sizeof(buf),
+				member->size == 4 ? "%.9g" : "%.17g", d));
+		break;
+	}
+
+	case DECODE_POINTER:
+		g_string_append(out, job->json ? "\"0x" : "0x");
+		g_string_append_printf(out, "%" G_GINT64_MODIFIER "x", value);
+		if (job->json)
+			g_string_append_c(out, '"');
+		break;
+
+	default:
+		if (job->json)
+			g_string_append_c(out, '"');
+		decode_hex(out, p, member->size);
+		if (job->json)
+			g_string_append_c(out, '"');
+		break;
+	}
+}
+
+/**
+ * @brief Read memory of the process being inspected
+ * @param job The records being decoded
+ * @param address Where to read from
+ * @param buf Where to read to
+ * @param size Bytes to read
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+static SCResult decode_read(SCDecodeJob *job, guint64 address, guchar *buf, guint64 size)
+{
+	struct iovec	local,
+					remote;
+	ssize_t			n;
+
+	while (size > 0) {
+		local.iov_base = buf;
+		local.iov_len = size;
+		remote.iov_base = GSIZE_TO_POINTER(address);
+		remote.iov_len = size;
+
+		/* One system call for the whole range, without stopping the process */
+		n = process_vm_readv(job->pid, &local, 1, &remote, 1, 0);
+		if (n == -1 && errno == ENOSYS && job->mem != -1)
+			n = pread(job->mem, buf, size, address);
+		if (n <= 0)
+			return SC_FAIL;
+
+		buf += n;
+		address += n;
+		size -= n;
+	}
+
+	return SC_OK;
+}
+
+/**
+ * @brief Read the struct a pointer points to, with --depth
+ * @param member The pointer
+ * @param value Its value in the record
+ * @param job The records being decoded
+ * @param depth Levels of pointers followed to get to the record
+ * @param target Set to the struct pointed to
+ * @return The struct read, to be freed with g_free(), NULL if it is not
+ *         followed
+ */
+static guchar * decode_follow(SCDecodeMember *member, const guchar *value, SCDecodeJob *job,
+		int depth, SCDecodeStruct **target)
+{
+	guchar	*buf;
+	guint64	address;
+
+	if (job->pid == 0 || depth >= job->depth || member->pointee == NULL)
+		return NULL;
+	if ((*target = g_hash_table_lookup(types, member->pointee)) == NULL)
+		return NULL;
+	if ((address = decode_uint(value, member->size, job->big)) == 0)
+		return NULL;
+
+	buf = g_malloc((*target)->size);
+	if (decode_read(job, address, buf, (*target)->size) != SC_OK) {
+		g_free(buf);
+		return NULL;
+	}
+
+	return buf;
+}
+
+/**
+ * @brief Append the members of a struct as XML
+ * @param out Where the members are appended
+ * @param st The struct
+ * @param p The struct in memory
+ * @param job The records being decoded
+ * @param depth Levels of pointers followed to get to st
+ */
+static void decode_xml(GString *out, SCDecodeStruct *st, const guchar *p, SCDecodeJob *job,
+		int depth)
+{
+	SCDecodeStruct	*target;
+	guchar			*pointee;
+	guint			i;
+	guint64			j;
+
+	for (i = 0; i < st->members->len; i++) {
+		SCDecodeMember	*member = g_ptr_array_index(st->members, i);
+		const guchar	*value = p + member->offset / 8;
+		const char		*element = member->nested && member->nested->is_union ?
+									"union" : "struct";
+
+		/* A nested struct/union, one element per item of an array */
+		if (member->kind == DECODE_NESTED && !member->shared) {
+			for (j = 0; j < member->count; j++, value += member->size) {
+				g_string_append_printf(out, "<%s", element);
+				if (member->array) {
+					g_string_append(out, " index=\"");
+					decode_u64(out, j);
+					g_string_append_c(out, '"');
+				}
+				g_string_append_c(out, '>');
+				g_string_append(out, member->xml_open);
+				decode_xml(out, member->nested, value, job, depth);
+				g_string_append_printf(out, "</%s>", element);
+			}
+			continue;
+		}
+
+		g_string_append(out, member->xml_open);
+
+		if (member->kind == DECODE_NESTED) {
+			for (j = 0; j < member->count; j++, value += member->size) {
+				g_string_append_printf(out, "<%s><struct_name>%s</struct_name>", element,
+					member->nested->name);
+				decode_xml(out, member->nested, value, job, depth);
+				g_string_append_printf(out, "</%s>", element);
+			}
+		}
+		else if (member->width)
+			decode_value(out, member, p, job);
+		else if (member->text)
+			decode_text(out, value, member->count, 0);
+		else if ((pointee = decode_follow(member, value, job, depth, &target)) != NULL) {
+			/* The struct pointed to follows the pointer */
+			decode_value(out, member, value, job);
+			g_string_append_printf(out, "</value><%s><struct_name>%s</struct_name>",
+				target->is_union ? "union" : "struct", target->name);
+			decode_xml(out, target, pointee, job, depth + 1);
+			g_string_append_printf(out, "</%s></field>", target->is_union ? "union" : "struct");
+			g_free(pointee);
+			continue;
+		}
+		else {
+			for (j = 0; j < member->count; j++, value += member->size) {
+				if (j)
+					g_string_append_c(out, ' ');
+				decode_value(out, member, value, job);
+			}
+		}
+
+		g_string_append(out, member->xml_close);
+	}
+}
+
+/**
+ * @brief Append a struct as a JSON object, see decode_xml()
+ */
+static void decode_json(GString *out, SCDecodeStruct *st, const guchar *p, SCDecodeJob *job,
+		int depth)
+{
+	SCDecodeStruct	*target;
+	guchar			*pointee;
+	guint			i;
+	guint64			j;
+
+	g_string_append_c(out, '{');
+	for (i = 0; i < st->members->len; i++) {
+		SCDecodeMember	*member = g_ptr_array_index(st->members, i);
+		const guchar	*value = p + member->offset / 8;
+		int				list = member->array && !member->text;
+
+		if (i)
+			g_string_append(out, ", ");
+		g_string_append(out, member->json_key);
+
+		if (member->width) {
+			decode_value(out, member, p, job);
+			continue;
+		}
+		if (member->text) {
+			decode_text(out, value, member->count, 1);
+			continue;
+		}
+		if ((pointee = decode_follow(member, value, job, depth, &target)) != NULL) {
+			g_string_append(out, "{\"address\": ");
+			decode_value(out, member, value, job);
+			g_string_append(out, ", \"value\": ");
+			decode_json(out, target, pointee, job, depth + 1);
+			g_string_append_c(out, '}');
+			g_free(pointee);
+			continue;
+		}
+
+		if (list)
+			g_string_append_c(out, '[');
+		for (j = 0; j < member->count; j++, value += member->size) {
+			if (j)
+				g_string_append(out, ", ");
+			if (member->kind == DECODE_NESTED)
+				decode_json(out, member->nested, value, job, depth);
+			else
+				decode_value(out, member, value, job);
+		}
+		if (list)
+			g_string_append_c(out, ']');
+	}
+	g_string_append_c(out, '}');
+}
+
+/**
+ * @brief Append a record of a trace file
+ * @param out Where the record is appended
+ * @param event The record
+ * @param index Its index in the trace file
+ * @param job The trace file
+ */
+static void decode_event(GString *out, SCDecodeEvent *event, guint64 index, SCDecodeJob *job)
+{
+	const guchar	*value = event->record + TRACE_RECORD;
+	guint64			type = decode_uint(event->record, 4, job->big),
+					size = decode_uint(event->record + 4, 4, job->big);
+
+	if (job->json) {
+		if (index)
+			g_string_append(out, ",\n");
+		g_string_append(out, "{\"index\": ");
+		decode_u64(out, index);
+		g_string_append(out, ", \"thread\": ");
+		decode_u64(out, event->thread);
+		g_string_append(out, ", \"time\": ");
+		decode_u64(out, decode_uint(event->record + 8, 8, job->big));
+	}
+	else {
+		g_string_append(out, event->st ? "<record" : type ? "<unknown" : "<dropped");
+		g_string_append(out, " index=\"");
+		decode_u64(out, index);
+		g_string_append(out, "\" thread=\"");
+		decode_u64(out, event->thread);
+		g_string_append(out, "\" time=\"");
+		decode_u64(out, decode_uint(event->record + 8, 8, job->big));
+		g_string_append_c(out, '"');
+	}
+
+	/* A control record of the dropped records */
+	if (type == 0) {
+		g_string_append(out, job->json ? ", \"dropped\": " : " count=\"");
+		decode_u64(out, decode_uint(value + 8, 8, job->big));
+		g_string_append(out, job->json ? "}" : "\"/>\n");
+		return;
+	}
+
+	if (event->st == NULL) {
+		g_string_append_printf(out, job->json ? ", \"type_id\": %u, \"size\": " :
+			" type_id=\"0x%08x\" size=\"", (guint32)type);
+		decode_u64(out, size);
+		g_string_append(out, job->json ? "}" : "\"/>\n");
+		return;
+	}
+
+	if (job->json) {
+		g_string_append_printf(out, ", \"struct\": \"%s\", \"value\": ", event->st->name);
+		decode_json(out, event->st, value, job, 0);
+		g_string_append_c(out, '}');
+		return;
+	}
+
+	g_string_append_printf(out, "><%s><struct_name>%s</struct_name>",
+		event->st->is_union ? "union" : "struct", event->st->name);
+	decode_xml(out, event->st, value, job, 0);
+	g_string_append(out, event->st->is_union ? "</union></record>\n" : "</struct></record>\n");
+}
+
+/**
+ * @brief Format a chunk of records, run by the pool
+ * @param data The SCDecodeChunk
+ * @param user_data The SCDecodeJob
+ */
+static void decode_chunk(gpointer data, gpointer user_data)
+{
+	SCDecodeChunk	*chunk = data;
+	SCDecodeJob		*job = user_data;
+	SCDecodeStruct	*st = job->st;
+	guint64			i;
+
+	chunk->out = g_string_sized_new(chunk->count * (st ? st->size : 64) * 4);
+	for (i = chunk->first; i < chunk->first + chunk->count; i++) {
+		const guchar *record = job->data + (i - job->first) * (st ? st->size : 0);
+
+		if (job->events) {
+			decode_event(chunk->out, &job->events[i], i, job);
+			continue;
+		}
+		if (job->json) {
+			if (i)
+				g_string_append(chunk->out, ",\n");
+			decode_json(chunk->out, st, record, job, 0);
+			continue;
+		}
+
+		g_string_append(chunk->out, st->is_union ? "<union index=\"" : "<struct index=\"");
+		decode_u64(chunk->out, i);
+		g_string_append_printf(chunk->out, "\"><struct_name>%s</struct_name>", st->name);
+		decode_xml(chunk->out, st, record, job, 0);
+		g_string_append(chunk->out, st->is_union ? "</union>\n" : "</struct>\n");
+	}
+
+	g_mutex_lock(&job->lock);
+	chunk->done = 1;
+	g_cond_broadcast(&job->done);
+	g_mutex_unlock(&job->lock);
+}
+
+/**
+ * @brief Parse the headers with the layouts of the ABIs in sc_opts.abis.
+ *        They are written to a temporary document and the output of the
+ *        parser is hidden, the records go to stdout.
+ * @param count Number of headers or directories
+ * @param paths The headers or directories
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult decode_parse(int count, char **paths)
+{
+	GError		*error = NULL;
+	gchar		*xml_filename;
+	int			fd,
+				out;
+	SCResult	rc;
+
+	fd = g_file_open_tmp("sc2xml-decode-XXXXXX.xml", &xml_filename, &error);
+	if (fd == -1) {
+		log_error(LOG_ERR, "%s(): %s", __func__, error->message);
+		g_error_free(error);
+		return SC_FAIL;
+	}
+	close(fd);
+
+	fflush(stdout);
+	out = dup(STDOUT_FILENO);
+	if ((fd = open("/dev/null", O_WRONLY)) != -1) {
+		dup2(fd, STDOUT_FILENO);
+		close(fd);
+	}
+
+	sc_opts.aggregate = xml_filename;
+	rc = xml_aggregate_open(xml_filename);
+	if (rc == SC_OK) {
+		get_files(count, paths);
+		rc = xml_aggregate_close();
+	}
+	sc_opts.aggregate = NULL;
+
+	fflush(stdout);
+	if (out != -1) {
+		dup2(out, STDOUT_FILENO);
+		close(out);
+	}
+
+	unlink(xml_filename);
+	g_free(xml_filename);
+
+	return rc;
+}
+
+/**
+ * @brief Format the records with a pool of threads and write them in order
+ * @param job The records, from job->first
+ * @param records Number of records
+ * @param threads Number of threads, 0 for one per processor
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+static SCResult decode_run(SCDecodeJob *job, guint64 records, int threads)
+{
+	SCDecodeChunk	*chunks;
+	GThreadPool		*pool;
+	GError			*error = NULL;
+	guint64			n = (records + DECODE_CHUNK - 1) / DECODE_CHUNK,
+					pushed = 0,
+					i;
+
+	if (threads <= 0)
+		threads = g_get_num_processors();
+
+	g_mutex_init(&job->lock);
+	g_cond_init(&job->done);
+	pool = g_thread_pool_new(decode_chunk, job, threads, TRUE, &error);
+	if (pool == NULL) {
+		log_error(LOG_ERR, "%s(): Could not start the workers: %s", __func__, error->message);
+		g_error_free(error);
+		return SC_FAIL;
+	}
+
+	chunks = g_new0(SCDecodeChunk, n);
+	for (i = 0; i < n; i++) {
+		chunks[i].first = job->first + i * DECODE_CHUNK;
+		chunks[i].count = MIN(DECODE_CHUNK, records - i * DECODE_CHUNK);
+	}
+
+	/* Keep the workers busy a few chunks ahead of the one written */
+	for (i = 0; i < n; i++) {
+		while (pushed < n && pushed < i + (guint64)threads * DECODE_QUEUE_PER_THREAD)
+			g_thread_pool_push(pool, &chunks[pushed++], NULL);
+
+		g_mutex_lock(&job->lock);
+		while (!chunks[i].done)
+			g_cond_wait(&job->done, &job->lock);
+		g_mutex_unlock(&job->lock);
+
+		fwrite(chunks[i].out->str, 1, chunks[i].out->len, stdout);
+		g_string_free(chunks[i].out, TRUE);
+	}
+
+	g_thread_pool_free(pool, FALSE, TRUE);
+	g_free(chunks);
+	g_mutex_clear(&job->lock);
+	g_cond_clear(&job->done);
+
+	return SC_OK;
+}
+
+/**
+ * @brief Check the options, parse the headers and find the struct, if
+ *        not decoding a trace file
+ * @param job Set to the records to decode
+ * @param count Number of headers or directories
+ * @param paths The headers or directories where the struct is defined
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+static SCResult decode_setup(SCDecodeJob *job, int count, char **paths)
+{
+	int abi;
+
+	memset(job, 0, sizeof(*job));
+	job->mem = -1;
+
+	if ((abi = layout_abi_find(sc_opts.abi)) < 0) {
+		log_error(LOG_ERR, "Unknown ABI '%s', the ABIs are x86_64, i386, aarch64 and arm",
+			sc_opts.abi);
+		return SC_FAIL;
+	}
+	if (sc_opts.endian && strcmp(sc_opts.endian, "big") != 0 &&
+			strcmp(sc_opts.endian, "little") != 0) {
+		log_error(LOG_ERR, "--endian is 'little' or 'big'");
+		return SC_FAIL;
+	}
+	job->abi = abi;
+	job->big = sc_opts.endian && strcmp(sc_opts.endian, "big") == 0;
+	job->json = sc_opts.json;
+
+	sc_opts.abis = 1 << abi;
+	if (decode_parse(count, paths) != SC_OK)
+		return SC_FAIL;
+
+	/* Any struct of a trace file */
+	if (sc_opts.decode_all)
+		return SC_OK;
+
+	job->st = types ? g_hash_table_lookup(types, sc_opts.decode_struct) : NULL;
+	if (job->st == NULL || job->st->size == 0) {
+		log_error(LOG_ERR, "%s(): No struct/union '%s' laid out for %s in the headers",
+			__func__, sc_opts.decode_struct, layout_abi_name(abi));
+		return SC_FAIL;
+	}
+
+	return SC_OK;
+}
+
+/**
+ * @brief Write the start of the document
+ * @param job The records, without a struct for a trace file
+ * @param records Number of records
+ * @param source More attributes of <records>, e.g. where they come from
+ */
+static void decode_begin(SCDecodeJob *job, guint64 records, const char *source)
+{
+	if (job->json)
+		printf("[\n");
+	else if (job->st == NULL)
+		printf("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+			   "<trace abi=\"%s\" endian=\"%s\"%s count=\"%" G_GUINT64_FORMAT "\">\n",
+			   layout_abi_name(job->abi), job->big ? "big" : "little", source, records);
+	else
+		printf("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+			   "<records struct=\"%s\" abi=\"%s\" endian=\"%s\"%s size=\"%" G_GUINT64_FORMAT
+			   "\" count=\"%" G_GUINT64_FORMAT "\">\n", job->st->name, layout_abi_name(job->abi),
+			   job->big ? "big" : "little", source, job->st->size, records);
+}
+
+/**
+ * @brief Write the end of the document
+ * @param job The records
+ * @param records Number of records
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+static SCResult decode_end(SCDecodeJob *job, guint64 records)
+{
+	if (job->json)
+		printf("%s]\n", records ? "\n" : "");
+	else
+		printf(job->st ? "</records>\n" : "</trace>\n");
+
+	if (fflush(stdout) != 0 || ferror(stdout)) {
+		log_error(LOG_ERR, "%s(): Could not write the records", __func__);
+		return SC_FAIL;
+	}
+
+	return SC_OK;
+}
+
+/**
+ * @brief Decode a file of records of a struct and write them to stdout
+ * @param filename The file
+ * @param count Number of headers or directories
+ * @param paths The headers or directories where the struct is defined
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult decode_records(const char *filename, int count, char **paths)
+{
+	SCDecodeJob	job;
+	struct stat	st;
+	guint64		records;
+	void		*map = NULL;
+	int			fd;
+	SCResult	rc;
+
+	if (decode_setup(&job, count, paths) != SC_OK)
+		return SC_FAIL;
+
+	if ((fd = open(filename, O_RDONLY)) == -1 || fstat(fd, &st) != 0) {
+		log_error(LOG_ERR, "%s(): Could not open '%s'", __func__, filename);
+		if (fd != -1)
+			close(fd);
+		return SC_FAIL;
+	}
+
+	records = st.st_size / job.st->size;
+	/* Not with log_error(), the records go to stdout */
+	if (st.st_size % job.st->size)
+		fprintf(stderr, "WARNING: %s(): '%s' ends with %" G_GUINT64_FORMAT " bytes that are "
+			"not a record of %" G_GUINT64_FORMAT " bytes\n", __func__, filename,
+			(guint64)st.st_size % job.st->size, job.st->size);
+
+	if (records) {
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED) {
+			log_error(LOG_ERR, "%s(): Could not map '%s'", __func__, filename);
+			close(fd);
+			return SC_FAIL;
+		}
+		madvise(map, st.st_size, MADV_SEQUENTIAL);
+	}
+	close(fd);
+	job.data = map;
+
+	decode_begin(&job, records, "");
+	rc = records ? decode_run(&job, records, sc_opts.threads) : SC_OK;
+	if (decode_end(&job, records) != SC_OK)
+		rc = SC_FAIL;
+
+	if (map)
+		munmap(map, st.st_size);
+
+	return rc;
+}
+
+/**
+ * @brief Decode an array of structs in the memory of a running process and
+ *        write them to stdout. The array is read a few MB at a time, each
+ *        with a single process_vm_readv() that does not stop the process.
+ * @param pid The process
+ * @param address Address of the array
+ * @param records Number of structs
+ * @param count Number of headers or directories
+ * @param paths The headers or directories where the struct is defined
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult decode_process(int pid, guint64 address, guint64 records, int count, char **paths)
+{
+	SCDecodeJob	job;
+	guchar		*buf;
+	gchar		*source,
+				*mem;
+	guint64		window,
+				n;
+	SCResult	rc = SC_OK;
+
+	if (decode_setup(&job, count, paths) != SC_OK)
+		return SC_FAIL;
+	job.pid = pid;
+	job.depth = sc_opts.depth;
+
+	/* Only for the kernels without process_vm_readv() */
+	mem = g_strdup_printf("/proc/%d/mem", pid);
+	job.mem = open(mem, O_RDONLY);
+	g_free(mem);
+
+	window = MAX(1, DECODE_READ / job.st->size);
+	buf = g_malloc(MIN(window, records) * job.st->size);
+	job.data = buf;
+
+	for (job.first = 0; job.first < records && rc == SC_OK; job.first += n) {
+		n = MIN(window, records - job.first);
+		if (decode_read(&job, address + job.first * job.st->size, buf,
+				n * job.st->size) != SC_OK) {
+			log_error(LOG_ERR, "%s(): Could not read %" G_GUINT64_FORMAT " bytes at 0x%"
+				G_GINT64_MODIFIER "x of process %d: %s", __func__, n * job.st->size,
+				address + job.first * job.st->size, pid, g_strerror(errno));
+			rc = SC_FAIL;
+			break;
+		}
+
+		/* Nothing is written if the first read fails, e.g. a wrong address */
+		if (job.first == 0) {
+			source = g_strdup_printf(" pid=\"%d\" address=\"0x%" G_GINT64_MODIFIER "x\"", pid,
+				address);
+			decode_begin(&job, records, source);
+			g_free(source);
+		}
+		rc = decode_run(&job, n, sc_opts.threads);
+	}
+
+	if (job.first > 0 && decode_end(&job, records) != SC_OK)
+		rc = SC_FAIL;
+
+	if (job.mem != -1)
+		close(job.mem);
+	g_free(buf);
+
+	return rc;
+}
+
+/**
+ * @brief Decode a trace file of the loggers of trace.c and write its
+ *        records to stdout, in the order they were drained
+ * @param filename The trace file
+ * @param count Number of headers or directories
+ * @param paths The headers or directories where the structs are defined
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult decode_trace(const char *filename, int count, char **paths)
+{
+	SCDecodeJob		job;
+	SCDecodeEvent	event;
+	GHashTable		*ids;
+	GArray			*events;
+	struct stat		st;
+	const guchar	*map;
+	guint64			pos,
+					size,
+					need,
+					type,
+					thread = 0,
+					unknown = 0,
+					i;
+	int				fd,
+					big;
+	SCResult		rc;
+
+	if ((fd = open(filename, O_RDONLY)) == -1 || fstat(fd, &st) != 0) {
+		log_error(LOG_ERR, "%s(): Could not open '%s'", __func__, filename);
+		if (fd != -1)
+			close(fd);
+		return SC_FAIL;
+	}
+	if (st.st_size < TRACE_HEADER) {
+		log_error(LOG_ERR, "%s(): '%s' is not a trace file", __func__, filename);
+		close(fd);
+		return SC_FAIL;
+	}
+	if ((map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+		log_error(LOG_ERR, "%s(): Could not map '%s'", __func__, filename);
+		close(fd);
+		return SC_FAIL;
+	}
+	close(fd);
+	madvise((void *)map, st.st_size, MADV_SEQUENTIAL);
+
+	/* The byte order of the traced process */
+	big = decode_uint(map + 8, 4, 0) != TRACE_BOM;
+	if (memcmp(map, TRACE_MAGIC, 8) != 0 || decode_uint(map + 8, 4, big) != TRACE_BOM ||
+			decode_uint(map + 12, 4, big) != TRACE_VERSION) {
+		log_error(LOG_ERR, "%s(): '%s' is not a trace file of version %d", __func__, filename,
+			TRACE_VERSION);
+		munmap((void *)map, st.st_size);
+		return SC_FAIL;
+	}
+
+	sc_opts.decode_all = 1;
+	rc = decode_setup(&job, count, paths);
+	sc_opts.decode_all = 0;
+	if (rc != SC_OK) {
+		munmap((void *)map, st.st_size);
+		return SC_FAIL;
+	}
+	job.big = big;
+
+	/* The type ids of the loggers, the first struct of a name like them */
+	ids = g_hash_table_new(g_direct_hash, g_direct_equal);
+	for (i = 0; structs && i < structs->len; i++) {
+		SCDecodeStruct	*s = g_ptr_array_index(structs, i);
+		gpointer		id = GUINT_TO_POINTER(trace_type_id(s->name));
+
+		if (g_hash_table_lookup(ids, id) == NULL)
+			g_hash_table_insert(ids, id, s);
+	}
+
+	/* Index the records, the control records give their threads */
+	events = g_array_new(FALSE, FALSE, sizeof(SCDecodeEvent));
+	size = st.st_size;
+	for (pos = TRACE_HEADER; pos + TRACE_RECORD <= size; pos += need) {
+		event.record = map + pos;
+		event.thread = thread;
+		event.st = NULL;
+		type = decode_uint(event.record, 4, big);
+		need = (TRACE_RECORD + decode_uint(event.record + 4, 4, big) + 7) & ~(guint64)7;
+		if (pos + need > size)
+			break;
+
+		if (type == 0) {
+			if (need < TRACE_RECORD + 16)
+				continue;
+			if (decode_uint(event.record + TRACE_RECORD, 8, big) == TRACE_THREAD) {
+				thread = decode_uint(event.record + TRACE_RECORD + 8, 8, big);
+				continue;
+			}
+			if (decode_uint(event.record + TRACE_RECORD, 8, big) != TRACE_DROPPED)
+				continue;
+		}
+		else {
+			event.st = g_hash_table_lookup(ids, GUINT_TO_POINTER((guint32)type));
+			if (event.st && event.st->size != decode_uint(event.record + 4, 4, big))
+				event.st = NULL;
+			if (event.st == NULL)
+				unknown++;
+		}
+		g_array_append_val(events, event);
+	}
+	g_hash_table_destroy(ids);
+
+	/* Not with log_error(), the records go to stdout */
+	if (pos < size)
+		fprintf(stderr, "WARNING: %s(): '%s' ends with %" G_GUINT64_FORMAT " bytes that are "
+			"not a whole record\n", __func__, filename, size - pos);
+	if (unknown)
+		fprintf(stderr, "WARNING: %s(): %" G_GUINT64_FORMAT " records of '%s' are not of a "
+			"struct laid out for %s in the headers\n", __func__, unknown, filename,
+			layout_abi_name(job.abi));
+
+	job.data = map;
+	job.events = (SCDecodeEvent *)events->data;
+	decode_begin(&job, events->len, "");
+	rc = events->len ? decode_run(&job, events->len, sc_opts.threads) : SC_OK;
+	if (decode_end(&job, events->len) != SC_OK)
+		rc = SC_FAIL;
+
+	g_array_free(events, TRUE);
+	munmap((void *)map, st.st_size);
+
+	return rc;
+}
@@ -0,0 +1,36 @@
+/**
+ * @file decode.h
+ *
+ * @brief Defines for decode.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#ifndef _DECODE_H
+#define _DECODE_H
+
+#include "sc2xml.h"
+#include "model.h"
+
+/* How a value is formatted */
+typedef enum {
+	DECODE_SIGNED,
+	DECODE_UNSIGNED,
+	DECODE_FLOAT,
+	DECODE_POINTER,			/**< In hex, pointers and function pointers */
+	DECODE_RAW,				/**< The bytes in hex, e.g. long double */
+	DECODE_NESTED			/**< A struct/union */
+} SCDecodeKind;
+
+SCDecodeKind decode_scalar(SCField *, SCAbi, int *);
+SCResult	decode_add(const char *, SCStruct *);
+SCResult	decode_parse(int, char **);
+SCResult	decode_records(const char *, int, char **);
+SCResult	decode_process(int, guint64, guint64, int, char **);
+SCResult	decode_trace(const char *, int, char **);
+
+#endif	/* _DECODE_H */
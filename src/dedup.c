@@ -0,0 +1,447 @@
+/**
+ * @file dedup.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * @brief Content-addressed deduplication of identical headers. The driver
+ *        hashes every file it reads; only the first file with a given hash
+ *        is parsed, the outputs of the others are hardlinked (or reflinked
+ *        or copied) from the first one.
+ *
+ *        With a shared cache directory, several sc2xml processes running on
+ *        the same tree cooperate: the outputs are published as
+ *        <dir>/<hash>.xml and the process that parses a hash holds the
+ *        lock <dir>/<hash>.lock, created with O_EXCL. The others wait for
+ *        the outputs instead of parsing the same contents again. The
+ *        holder touches the lock while parsing; a lock that was not
+ *        touched for DEDUP_LOCK_TIMEOUT seconds belongs to a process that
+ *        died and is taken over.
+ *
+ *        The hash covers the contents, the options that change the
+ *        outputs and, with --layout, the constants the header gets from
+ *        the headers it includes, so runs with different options or
+ *        headers seeing different constants do not share them.
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+
+#include <glib.h>
+
+#include "config.h"
+#include "sc2xml.h"
+#include "misc.h"
+#include "index.h"
+#include "archive.h"
+#include "manifest.h"
+#include "consts.h"
+#include "dedup.h"
+
+/** A lock of the cache directory we hold */
+typedef struct {
+	gchar		*lock;		/**< The lock file */
+	struct stat	stats;		/**< The lock file when it was created */
+	GThread		*thread;	/**< Touches the lock */
+	GMutex		mutex;		/**< Protects done */
+	GCond		cond;		/**< Signaled when done is set */
+	int			done;		/**< The lock is being released */
+} SCDedupLock;
+
+static GHashTable *seen = NULL;		/**< hash -> output of its first file */
+static GHashTable *owned = NULL;	/**< hash -> SCDedupLock we hold */
+
+/**
+ * @brief Hash the contents of a file with the options and the included
+ *        constants that change its outputs
+ * @param xml_filename The XML file of the file
+ * @param contents The contents, NUL terminated
+ * @param length The length of the contents
+ * @return The hash, to free with g_free()
+ */
+gchar * dedup_digest(const char *xml_filename, const gchar *contents, gsize length)
+{
+	GChecksum	*checksum = g_checksum_new(G_CHECKSUM_SHA256);
+	gchar		*options,
+				*digest;
+
+	options = g_strdup_printf("%s abis=%d hash=%d index=%d resolve=%d dedup_structs=%d "
+		"padding=%d profile=%d", PACKAGE_STRING, sc_opts.abis, sc_opts.hash, sc_opts.index,
+		sc_opts.resolve, sc_opts.dedup_structs, sc_opts.padding != NULL,
+		sc_opts.profile != NULL);
+
+	g_checksum_update(checksum, (const guchar *)contents, length);
+	g_checksum_update(checksum, (const guchar *)options, -1);
+
+	/* The sizes are evaluated with the constants of the included headers */
+	if (sc_opts.abis) {
+		gchar *header = g_strndup(xml_filename, strlen(xml_filename) - 4);
+
+		consts_checksum(checksum, header, contents);
+		g_free(header);
+	}
+	digest = g_strdup(g_checksum_get_string(checksum));
+
+	g_checksum_free(checksum);
+	g_free(options);
+
+	return digest;
+}
+
+/**
+ * @brief Touch a lock we hold every DEDUP_LOCK_REFRESH seconds, so the
+ *        others know we are still parsing
+ * @param data The SCDedupLock
+ * @return NULL
+ */
+static gpointer dedup_heartbeat(gpointer data)
+{
+	SCDedupLock	*held = (SCDedupLock *)data;
+	gint64		end;
+
+	g_mutex_lock(&held->mutex);
+	while (!held->done) {
+		end = g_get_monotonic_time() + DEDUP_LOCK_REFRESH * G_TIME_SPAN_SECOND;
+		if (!g_cond_wait_until(&held->cond, &held->mutex, end))
+			utime(held->lock, NULL);
+	}
+	g_mutex_unlock(&held->mutex);
+
+	return NULL;
+}
+
+/**
+ * @brief Remove a lock only if it is still the one expected. The lock is
+ *        renamed to a name of ours first, so another process creating a
+ *        new lock in the meantime cannot lose it; it is given back if it
+ *        is not the one expected.
+ * @param lock The lock file
+ * @param expected The lock file, as seen by stat()
+ * @param stale 1 if it is removed because it was not touched for too long
+ * @return 1 if the lock was removed
+ */
+static int dedup_unlock(const char *lock, const struct stat *expected, int stale)
+{
+	struct stat	stats;
+	gchar		*taken;
+	int			rc = 0;
+
+	taken = g_strdup_printf("%s.%d.taken", lock, (int)getpid());
+	if (rename(lock, taken) == 0) {
+		if (stat(taken, &stats) == 0 && stats.st_dev == expected->st_dev &&
+			stats.st_ino == expected->st_ino &&
+			(!stale || stats.st_mtime == expected->st_mtime))
+			rc = 1;
+		else if (link(taken, lock) == -1)
+			log_error(LOG_WARN, "Could not give back '%s'", lock);
+		unlink(taken);
+	}
+	g_free(taken);
+
+	return rc;
+}
+
+/**
+ * @brief Stop touching a lock and release it
+ * @param data The SCDedupLock
+ */
+static void dedup_release(gpointer data)
+{
+	SCDedupLock *held = (SCDedupLock *)data;
+
+	g_mutex_lock(&held->mutex);
+	held->done = 1;
+	g_cond_signal(&held->cond);
+	g_mutex_unlock(&held->mutex);
+	g_thread_join(held->thread);
+
+	dedup_unlock(held->lock, &held->stats, 0);
+
+	g_mutex_clear(&held->mutex);
+	g_cond_clear(&held->cond);
+	g_free(held->lock);
+	g_free(held);
+}
+
+/**
+ * @brief Copy a file. A reflink is tried first so filesystems that support
+ *        it share the blocks.
+ * @param src The file to copy
+ * @param dst The copy, replaced atomically
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+static SCResult copy_file(const char *src, const char *dst)
+{
+	int			in, out;
+	char		buff[CMP_BUFF];
+	ssize_t		len = 0;
+	gchar		*tmp_filename;
+	mode_t		mask;
+
+	if ((in = open(src, O_RDONLY)) == -1)
+		return SC_FAIL;
+
+	tmp_filename = g_strconcat(dst, ".XXXXXX", NULL);
+	if ((out = g_mkstemp(tmp_filename)) == -1) {
+		close(in);
+		g_free(tmp_filename);
+		return SC_FAIL;
+	}
+
+	mask = umask(0);
+	umask(mask);
+	fchmod(out, 0666 & ~mask);
+
+#ifdef FICLONE
+	if (ioctl(out, FICLONE, in) == -1)
+#endif
+	{
+		while ((len = read(in, buff, sizeof(buff))) > 0) {
+			if (write(out, buff, len) != len) {
+				len = -1;
+				break;
+			}
+		}
+	}
+
+	close(in);
+	close(out);
+
+	if (len < 0 || rename(tmp_filename, dst) == -1) {
+		unlink(tmp_filename);
+		g_free(tmp_filename);
+		return SC_FAIL;
+	}
+
+	g_free(tmp_filename);
+
+	return SC_OK;
+}
+
+/**
+ * @brief Make dst a copy of src. A hardlink is used when possible: while
+ *        deduplicating, the outputs are never rewritten in place (see
+ *        xml_file_create()) so the files sharing an inode stay consistent.
+ * @param src The existing output
+ * @param dst The output to create
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+static SCResult materialize(const char *src, const char *dst)
+{
+	struct stat	src_stats,
+				dst_stats;
+	gchar		*tmp_filename,
+				*contents;
+	gsize		length;
+	SCResult	rc;
+
+	if (stat(src, &src_stats) == -1)
+		return SC_FAIL;
+
+	/* Already linked by a previous run */
+	if (stat(dst, &dst_stats) == 0 && src_stats.st_dev == dst_stats.st_dev &&
+		src_stats.st_ino == dst_stats.st_ino)
+		return SC_OK;
+
+	/* Keep the mtime if the contents are the same */
+	if (sc_opts.if_changed) {
+		if (!g_file_get_contents(src, &contents, &length, NULL))
+			return SC_FAIL;
+		rc = write_if_changed(dst, contents, length, NULL);
+		g_free(contents);
+		return rc;
+	}
+
+	tmp_filename = g_strdup_printf("%s.%d.lnk", dst, (int)getpid());
+	unlink(tmp_filename);
+
+	if (link(src, tmp_filename) == 0 && rename(tmp_filename, dst) == 0) {
+		g_free(tmp_filename);
+		return SC_OK;
+	}
+
+	unlink(tmp_filename);
+	g_free(tmp_filename);
+
+	return copy_file(src, dst);
+}
+
+/**
+ * @brief Give xml_filename (and its index) the outputs of an identical file
+ * @param src The XML file of the first occurrence
+ * @param dst The XML file to create
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+static SCResult dedup_copy(const char *src, const char *dst)
+{
+	gchar		*src_idx,
+				*dst_idx;
+	SCResult	rc;
+
+	src_idx = g_strconcat(src, INDEX_SUFFIX, NULL);
+	dst_idx = g_strconcat(dst, INDEX_SUFFIX, NULL);
+
+	if (sc_opts.archive) {
+		rc = archive_add_alias(dst, src);
+		if (rc == SC_OK && sc_opts.index)
+			rc = archive_add_alias(dst_idx, src_idx);
+	}
+	else {
+		rc = SC_OK;
+		if (sc_opts.index)
+			rc = materialize(src_idx, dst_idx);
+		if (rc == SC_OK)
+			rc = materialize(src, dst);
+	}
+
+	g_free(src_idx);
+	g_free(dst_idx);
+
+	return rc;
+}
+
+/**
+ * @brief Decide if a file has to be parsed. If an identical file was
+ *        already parsed, its outputs are copied to xml_filename.
+ *        With a cache directory, wait while another process is parsing
+ *        identical contents.
+ * @param digest The hash of the file contents
+ * @param xml_filename The XML file of the file
+ * @return DEDUP_COPIED if the outputs were copied, DEDUP_PARSE if the caller
+ *         has to parse the file and then call dedup_publish()
+ */
+SCDedup dedup_claim(const char *digest, const char *xml_filename)
+{
+	gchar		*first,
+				*cache_xml,
+				*lock;
+	struct stat	stats;
+	int			fd;
+	SCDedup		rc = DEDUP_PARSE;
+
+	if (seen == NULL) {
+		seen = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+		owned = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, dedup_release);
+	}
+
+	first = g_hash_table_lookup(seen, digest);
+	if (first != NULL) {
+		if (dedup_copy(first, xml_filename) == SC_OK) {
+			if (sc_opts.manifest)
+				manifest_copy(first, xml_filename);
+			return DEDUP_COPIED;
+		}
+		log_error(LOG_WARN, "Could not copy '%s' to '%s'", first, xml_filename);
+		return DEDUP_PARSE;
+	}
+
+	if (sc_opts.dedup_dir == NULL)
+		return DEDUP_PARSE;
+
+	cache_xml = g_strdup_printf("%s/%s.xml", sc_opts.dedup_dir, digest);
+	lock = g_strdup_printf("%s/%s.lock", sc_opts.dedup_dir, digest);
+
+	for (;;) {
+		/* Published by another process */
+		if (stat(cache_xml, &stats) == 0) {
+			if (dedup_copy(cache_xml, xml_filename) == SC_OK) {
+				g_hash_table_replace(seen, g_strdup(digest), g_strdup(xml_filename));
+				rc = DEDUP_COPIED;
+			}
+			break;
+		}
+
+		fd = open(lock, O_WRONLY | O_CREAT | O_EXCL, 0644);
+		if (fd != -1) {
+			SCDedupLock *held = g_new0(SCDedupLock, 1);
+
+			fstat(fd, &held->stats);
+			close(fd);
+			held->lock = g_strdup(lock);
+			g_mutex_init(&held->mutex);
+			g_cond_init(&held->cond);
+			held->thread = g_thread_new("dedup-lock", dedup_heartbeat, held);
+			g_hash_table_replace(owned, g_strdup(digest), held);
+			break;
+		}
+
+		if (errno != EEXIST) {
+			log_error(LOG_WARN, "Could not create '%s', not using the cache", lock);
+			break;
+		}
+
+		/* Another process is parsing identical contents.
+		 * Take the lock over if that process died */
+		if (stat(lock, &stats) == 0 && time(NULL) - stats.st_mtime > DEDUP_LOCK_TIMEOUT) {
+			if (dedup_unlock(lock, &stats, 1))
+				continue;
+		}
+
+		g_usleep(DEDUP_WAIT);
+	}
+
+	g_free(cache_xml);
+	g_free(lock);
+
+	return rc;
+}
+
+/**
+ * @brief A file claimed with dedup_claim() was parsed. Remember its outputs
+ *        and, if we hold the lock, publish them in the cache directory and
+ *        release the lock.
+ * @param digest The hash of the file contents
+ * @param xml_filename The XML file that was written
+ * @param ok 1 if the file was parsed successfully
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult dedup_publish(const char *digest, const char *xml_filename, int ok)
+{
+	gchar		*cache_xml,
+				*cache_idx,
+				*xml_idx;
+	SCResult	rc = SC_OK;
+
+	if (ok)
+		g_hash_table_replace(seen, g_strdup(digest), g_strdup(xml_filename));
+
+	if (!g_hash_table_lookup(owned, digest))
+		return SC_OK;
+
+	cache_xml = g_strdup_printf("%s/%s.xml", sc_opts.dedup_dir, digest);
+	cache_idx = g_strconcat(cache_xml, INDEX_SUFFIX, NULL);
+	xml_idx = g_strconcat(xml_filename, INDEX_SUFFIX, NULL);
+
+	/* The index goes first: the XML file tells the others everything is there */
+	if (ok) {
+		if (sc_opts.index)
+			rc = materialize(xml_idx, cache_idx);
+		if (rc == SC_OK)
+			rc = materialize(xml_filename, cache_xml);
+		if (rc != SC_OK)
+			log_error(LOG_WARN, "Could not publish '%s' in the cache", xml_filename);
+	}
+
+	/* Releases the lock */
+	g_hash_table_remove(owned, digest);
+
+	g_free(cache_xml);
+	g_free(cache_idx);
+	g_free(xml_idx);
+
+	return rc;
+}
@@ -0,0 +1,31 @@
+/**
+ * @file dedup.h
+ *
+ * @brief Defines for dedup.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#ifndef _DEDUP_H
+#define _DEDUP_H
+
+#include "sc2xml.h"
+
+#define DEDUP_WAIT			10000	/**< usecs between checks of a busy hash */
+#define DEDUP_LOCK_TIMEOUT	300		/**< secs after which a lock is stale */
+#define DEDUP_LOCK_REFRESH	60		/**< secs between touches of a lock we hold */
+
+typedef enum {
+	DEDUP_PARSE,	/**< First occurrence: the caller parses the file */
+	DEDUP_COPIED	/**< Duplicate: the output was copied from the first one */
+} SCDedup;
+
+gchar *		dedup_digest(const char *, const gchar *, gsize);
+SCDedup		dedup_claim(const char *, const char *);
+SCResult	dedup_publish(const char *, const char *, int);
+
+#endif	/* _DEDUP_H */
@@ -0,0 +1,863 @@
+/**
+ * @file deserialize.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * @brief XML to struct loaders generator (--loaders), the reverse of the
+ *        serializers of serialize.c. For every struct selected it writes
+ *        NAME_from_xml(), which reads the elements written by NAME_to_xml()
+ *        and stores the values straight into the struct.
+ *
+ *        The XML is read tag by tag, without building a tree. The names of
+ *        the members of every struct, and of every nested struct/union, are
+ *        looked up in a table with a perfect hash whose seed is found here,
+ *        so a name is hashed and compared once. Integers are parsed without
+ *        strtol() and the locale, floating point numbers always have a '.'
+ *        whatever LC_NUMERIC says, and the type of every member selects its
+ *        parser with _Generic. Members not found in the XML, pointers and
+ *        function pointers are left as they were. The generated code needs
+ *        C11.
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "config.h"
+#include "sc2xml.h"
+#include "misc.h"
+#include "model.h"
+#include "gen.h"
+#include "deserialize.h"
+
+#define DESERIALIZE_SEEDS		4096	/**< Seeds tried for every table size */
+#define DESERIALIZE_MAX_TABLE	65536	/**< Largest table of names */
+
+/* Parsing shared by all the generated loaders */
+static const char *deserialize_helpers =
+	"#ifndef SC2XML_LOAD_HELPERS\n"
+	"#define SC2XML_LOAD_HELPERS\n"
+	"#include <limits.h>\n"
+	"#include <locale.h>\n"
+	"#include <stdint.h>\n"
+	"\n"
+	"/* Input being read, and the last tag found */\n"
+	"struct sc2xml_in {\n"
+	"\tconst char *p;\n"
+	"\tconst char *end;\n"
+	"};\n"
+	"\n"
+	"struct sc2xml_tag {\n"
+	"\tconst char *name;\n"
+	"\tsize_t len;\n"
+	"\tsize_t index;\t/* index=\"N\", 0 if missing */\n"
+	"\tint empty;\t\t/* <tag/> */\n"
+	"};\n"
+	"\n"
+	"#define SC2XML_IS(t, s)\t((t)->len == sizeof(s) - 1 && memcmp((t)->name, (s), sizeof(s) - 1) == 0)\n"
+	"\n"
+	"/* Next tag: 1 if it opens an element, 0 if it closes one, -1 at the end or\n"
+	" * on error. Text, comments and processing instructions are skipped */\n"
+	"static inline int sc2xml_next(struct sc2xml_in *in, struct sc2xml_tag *t)\n"
+	"{\n"
+	"\tconst char *p, *q, *a;\n"
+	"\tint closing;\n"
+	"\n"
+	"\tfor (;;) {\n"
+	"\t\tp = memchr(in->p, '<', (size_t)(in->end - in->p));\n"
+	"\t\tif (p == NULL || in->end - p < 3)\n"
+	"\t\t\treturn -1;\n"
+	"\t\tif (p[1] != '?' && p[1] != '!')\n"
+	"\t\t\tbreak;\n"
+	"\t\tq = memchr(p, '>', (size_t)(in->end - p));\n"
+	"\t\tif (q == NULL)\n"
+	"\t\t\treturn -1;\n"
+	"\t\tin->p = q + 1;\n"
+	"\t}\n"
+	"\n"
+	"\tclosing = p[1] == '/';\n"
+	"\tt->name = p += 1 + closing;\n"
+	"\twhile (p < in->end && *p != '>' && *p != '/' && *p != ' ' && *p != '\\t' &&\n"
+	"\t\t\t*p != '\\r' && *p != '\\n')\n"
+	"\t\tp++;\n"
+	"\tt->len = (size_t)(p - t->name);\n"
+	"\tt->index = 0;\n"
+	"\n"
+	"\tq = memchr(p, '>', (size_t)(in->end - p));\n"
+	"\tif (q == NULL || t->len == 0)\n"
+	"\t\treturn -1;\n"
+	"\tt->empty = q[-1] == '/';\n"
+	"\n"
+	"\tfor (a = p; q - a > 7; a++) {\n"
+	"\t\tif (memcmp(a, \" index=\\\"\", 8) != 0)\n"
+	"\t\t\tcontinue;\n"
+	"\t\tfor (a += 8; a < q && *a >= '0' && *a <= '9'; a++)\n"
+	"\t\t\tt->index = t->index * 10 + (size_t)(*a - '0');\n"
+	"\t\tbreak;\n"
+	"\t}\n"
+	"\n"
+	"\tin->p = q + 1;\n"
+	"\n"
+	"\treturn !closing;\n"
+	"}\n"
+	"\n"
+	"/* Skip what is left of the element being read, up to its closing tag */\n"
+	"static inline int sc2xml_end(struct sc2xml_in *in)\n"
+	"{\n"
+	"\tstruct sc2xml_tag t;\n"
+	"\tint rc, depth = 0;\n"
+	"\n"
+	"\twhile ((rc = sc2xml_next(in, &t)) >= 0) {\n"
+	"\t\tif (rc == 1)\n"
+	"\t\t\tdepth += !t.empty;\n"
+	"\t\telse if (depth-- == 0)\n"
+	"\t\t\treturn 0;\n"
+	"\t}\n"
+	"\n"
+	"\treturn -1;\n"
+	"}\n"
+	"\n"
+	"/* Text of a child element like <name>text</name> */\n"
+	"static inline int sc2xml_child(struct sc2xml_in *in, const char *name, size_t len,\n"
+	"\t\tconst char **s, size_t *n)\n"
+	"{\n"
+	"\tstruct sc2xml_tag t;\n"
+	"\tconst char *p;\n"
+	"\n"
+	"\tif (sc2xml_next(in, &t) != 1 || t.len != len || memcmp(t.name, name, len) != 0)\n"
+	"\t\treturn -1;\n"
+	"\t*s = in->p;\n"
+	"\t*n = 0;\n"
+	"\tif (t.empty)\n"
+	"\t\treturn 0;\n"
+	"\tp = memchr(in->p, '<', (size_t)(in->end - in->p));\n"
+	"\tif (p == NULL)\n"
+	"\t\treturn -1;\n"
+	"\t*n = (size_t)(p - in->p);\n"
+	"\tin->p = p;\n"
+	"\n"
+	"\treturn sc2xml_next(in, &t) == 0 ? 0 : -1;\n"
+	"}\n"
+	"\n"
+	"/* Next member of a struct: 1 with the name of the member read and the tag\n"
+	" * of its element in t, 0 at the end of the struct, -1 on error */\n"
+	"static inline int sc2xml_member(struct sc2xml_in *in, struct sc2xml_tag *t,\n"
+	"\t\tconst char **s, size_t *n)\n"
+	"{\n"
+	"\tconst char *p;\n"
+	"\tint rc;\n"
+	"\n"
+	"\twhile ((rc = sc2xml_next(in, t)) == 1) {\n"
+	"\t\tif (t->empty)\n"
+	"\t\t\tcontinue;\n"
+	"\t\tif (SC2XML_IS(t, \"struct_name\")) {\n"
+	"\t\t\tif (sc2xml_end(in) != 0)\n"
+	"\t\t\t\treturn -1;\n"
+	"\t\t\tcontinue;\n"
+	"\t\t}\n"
+	"\n"
+	"\t\t/* Nested structs tell their type before their name */\n"
+	"\t\tp = in->p;\n"
+	"\t\tif (sc2xml_child(in, \"struct_name\", 11, s, n) != 0)\n"
+	"\t\t\tin->p = p;\n"
+	"\n"
+	"\t\treturn sc2xml_child(in, \"name\", 4, s, n) == 0 ? 1 : -1;\n"
+	"\t}\n"
+	"\n"
+	"\treturn rc;\n"
+	"}\n"
+	"\n"
+	"#define sc2xml_value(in, s, n)\tsc2xml_child((in), \"value\", 5, (s), (n))\n"
+	"\n"
+	"/* Perfect hash of the member names, the seed is chosen when generating */\n"
+	"struct sc2xml_key {\n"
+	"\tconst char *name;\n"
+	"\tunsigned short len;\n"
+	"\tunsigned short id;\n"
+	"};\n"
+	"\n"
+	"static inline uint32_t sc2xml_hash(const char *s, size_t n, uint32_t seed)\n"
+	"{\n"
+	"\tuint32_t h = 2166136261u ^ seed;\n"
+	"\n"
+	"\twhile (n--) {\n"
+	"\t\th ^= (unsigned char)*s++;\n"
+	"\t\th *= 16777619u;\n"
+	"\t}\n"
+	"\n"
+	"\treturn h ^ (h >> 16);\n"
+	"}\n"
+	"\n"
+	"static inline unsigned sc2xml_lookup(const struct sc2xml_key *keys, uint32_t mask,\n"
+	"\t\tuint32_t seed, const char *s, size_t n)\n"
+	"{\n"
+	"\tconst struct sc2xml_key *k = &keys[sc2xml_hash(s, n, seed) & mask];\n"
+	"\n"
+	"\treturn k->id && k->len == n && memcmp(k->name, s, n) == 0 ? k->id : 0;\n"
+	"}\n"
+	"\n"
+	"/* Numbers, without the locale */\n"
+	"static inline int sc2xml_get_u64(const char *s, size_t n, unsigned long long *v)\n"
+	"{\n"
+	"\tunsigned long long x = 0;\n"
+	"\tsize_t i = n && *s == '+';\n"
+	"\n"
+	"\tif (i == n)\n"
+	"\t\treturn -1;\n"
+	"\tfor (; i < n; i++) {\n"
+	"\t\tunsigned d = (unsigned)((unsigned char)s[i] - '0');\n"
+	"\n"
+	"\t\tif (d > 9 || x > (ULLONG_MAX - d) / 10)\n"
+	"\t\t\treturn -1;\n"
+	"\t\tx = x * 10 + d;\n"
+	"\t}\n"
+	"\t*v = x;\n"
+	"\n"
+	"\treturn 0;\n"
+	"}\n"
+	"\n"
+	"static inline int sc2xml_get_i64(const char *s, size_t n, long long *v)\n"
+	"{\n"
+	"\tunsigned long long x;\n"
+	"\tint neg = n && *s == '-';\n"
+	"\n"
+	"\tif (sc2xml_get_u64(s + neg, n - (size_t)neg, &x) != 0 ||\n"
+	"\t\t\tx > (unsigned long long)LLONG_MAX + (unsigned long long)neg)\n"
+	"\t\treturn -1;\n"
+	"\t*v = neg ? -(long long)(x - 1) - 1 : (long long)x;\n"
+	"\n"
+	"\treturn 0;\n"
+	"}\n"
+	"\n"
+	"/* Exact when the digits fit in a double and the exponent is small, the\n"
+	" * other values go to strtod(). It follows LC_NUMERIC, so the '.' of the\n"
+	" * XML is replaced by the decimal point of the locale first */\n"
+	"static inline int sc2xml_get_double(const char *s, size_t n, double *v)\n"
+	"{\n"
+	"\tstatic const double pow10[] = {\n"
+	"\t\t1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,\n"
+	"\t\t1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22\n"
+	"\t};\n"
+	"\tconst char *p = s, *end = s + n, *dp;\n"
+	"\tunsigned long long m = 0;\n"
+	"\tsize_t len = n;\n"
+	"\tint neg = 0, digits = 0, any = 0, e = 0, x = 0, xneg = 0;\n"
+	"\tchar tmp[64], *q;\n"
+	"\n"
+	"\tif (p < end && (*p == '-' || *p == '+'))\n"
+	"\t\tneg = *p++ == '-';\n"
+	"\tfor (; p < end && *p >= '0' && *p <= '9'; p++, any = 1) {\n"
+	"\t\tif (digits < 19) {\n"
+	"\t\t\tm = m * 10 + (unsigned)(*p - '0');\n"
+	"\t\t\tdigits += m != 0;\n"
+	"\t\t}\n"
+	"\t\telse\n"
+	"\t\t\te++;\n"
+	"\t}\n"
+	"\tif (p < end && *p == '.') {\n"
+	"\t\tfor (p++; p < end && *p >= '0' && *p <= '9'; p++, any = 1) {\n"
+	"\t\t\tif (digits < 19) {\n"
+	"\t\t\t\tm = m * 10 + (unsigned)(*p - '0');\n"
+	"\t\t\t\tdigits += m != 0;\n"
+	"\t\t\t\te--;\n"
+	"\t\t\t}\n"
+	"\t\t}\n"
+	"\t}\n"
+	"\tif (any && p < end && (*p == 'e' || *p == 'E')) {\n"
+	"\t\tif (++p < end && (*p == '-' || *p == '+'))\n"
+	"\t\t\txneg = *p++ == '-';\n"
+	"\t\tfor (; p < end && *p >= '0' && *p <= '9'; p++)\n"
+	"\t\t\tif (x < 10000)\n"
+	"\t\t\t\tx = x * 10 + (*p - '0');\n"
+	"\t\te += xneg ? -x : x;\n"
+	"\t}\n"
+	"\n"
+	"\tif (any && p == end && m <= (1ULL << 53) && e >= -22 && e <= 22) {\n"
+	"\t\t*v = e < 0 ? (double)m / pow10[-e] : (double)m * pow10[e];\n"
+	"\t\tif (neg)\n"
+	"\t\t\t*v = -*v;\n"
+	"\t\treturn 0;\n"
+	"\t}\n"
+	"\n"
+	"\tif (n == 0 || n >= sizeof(tmp))\n"
+	"\t\treturn -1;\n"
+	"\tmemcpy(tmp, s, n);\n"
+	"\ttmp[n] = '\\0';\n"
+	"\tdp = localeconv()->decimal_point;\n"
+	"\tif (*dp && strcmp(dp, \".\") != 0 && (q = memchr(tmp, '.', n)) != NULL) {\n"
+	"\t\tsize_t dl = strlen(dp);\n"
+	"\n"
+	"\t\tif (n + dl > sizeof(tmp))\n"
+	"\t\t\treturn -1;\n"
+	"\t\tmemmove(q + dl, q + 1, n - (size_t)(q - tmp));\n"
+	"\t\tmemcpy(q, dp, dl);\n"
+	"\t\tlen += dl - 1;\n"
+	"\t}\n"
+	"\t*v = strtod(tmp, &q);\n"
+	"\n"
+	"\treturn q == tmp + len ? 0 : -1;\n"
+	"}\n"
+	"\n"
+	"static inline int sc2xml_get_raw(const char *s, size_t n, void *p, size_t size)\n"
+	"{\n"
+	"\tunsigned char *b = p;\n"
+	"\tsize_t i;\n"
+	"\n"
+	"\tif (n != 2 * size)\n"
+	"\t\treturn -1;\n"
+	"\tfor (i = 0; i < n; i++) {\n"
+	"\t\tunsigned char c = (unsigned char)s[i];\n"
+	"\t\tint d = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 :\n"
+	"\t\t\t\tc >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;\n"
+	"\n"
+	"\t\tif (d < 0)\n"
+	"\t\t\treturn -1;\n"
+	"\t\tb[i / 2] = (unsigned char)(i % 2 ? b[i / 2] | d : d << 4);\n"
+	"\t}\n"
+	"\n"
+	"\treturn 0;\n"
+	"}\n"
+	"\n"
+	"/* Text of a char array, NUL padded when it is shorter */\n"
+	"static inline int sc2xml_get_text(const char *s, size_t n, char *dst, size_t size)\n"
+	"{\n"
+	"\tsize_t i, len = 0;\n"
+	"\n"
+	"\tfor (i = 0; i < n && len < size; i++) {\n"
+	"\t\tchar c = s[i];\n"
+	"\n"
+	"\t\tif (c == '&') {\n"
+	"\t\t\tif (n - i >= 4 && memcmp(s + i, \"&lt;\", 4) == 0)\n"
+	"\t\t\t\tc = '<', i += 3;\n"
+	"\t\t\telse if (n - i >= 4 && memcmp(s + i, \"&gt;\", 4) == 0)\n"
+	"\t\t\t\tc = '>', i += 3;\n"
+	"\t\t\telse if (n - i >= 5 && memcmp(s + i, \"&amp;\", 5) == 0)\n"
+	"\t\t\t\tc = '&', i += 4;\n"
+	"\t\t\telse if (n - i >= 6 && memcmp(s + i, \"&quot;\", 6) == 0)\n"
+	"\t\t\t\tc = '\"', i += 5;\n"
+	"\t\t\telse if (n - i >= 6 && memcmp(s + i, \"&apos;\", 6) == 0)\n"
+	"\t\t\t\tc = '\\'', i += 5;\n"
+	"\t\t\telse\n"
+	"\t\t\t\treturn -1;\n"
+	"\t\t}\n"
+	"\t\tdst[len++] = c;\n"
+	"\t}\n"
+	"\tmemset(dst + len, 0, size - len);\n"
+	"\n"
+	"\treturn 0;\n"
+	"}\n"
+	"\n"
+	"/* Next word of the values of an array */\n"
+	"static inline const char *sc2xml_word(const char **s, size_t *n, size_t *len)\n"
+	"{\n"
+	"\tconst char *w;\n"
+	"\n"
+	"\twhile (*n && (**s == ' ' || **s == '\\t' || **s == '\\r' || **s == '\\n'))\n"
+	"\t\t(*s)++, (*n)--;\n"
+	"\tif (*n == 0)\n"
+	"\t\treturn NULL;\n"
+	"\tfor (w = *s; *n && **s != ' ' && **s != '\\t' && **s != '\\r' && **s != '\\n'; (*s)++, (*n)--)\n"
+	"\t\t;\n"
+	"\t*len = (size_t)(*s - w);\n"
+	"\n"
+	"\treturn w;\n"
+	"}\n"
+	"\n"
+	"/* Parsers selected by SC2XML_PARSE(), size is known at compile time */\n"
+	"static inline int sc2xml_get_signed(const char *s, size_t n, void *p, size_t size)\n"
+	"{\n"
+	"\tlong long x;\n"
+	"\tint8_t v8; int16_t v16; int32_t v32; int64_t v64;\n"
+	"\n"
+	"\tif (size != 1 && size != 2 && size != 4 && size != 8)\n"
+	"\t\treturn sc2xml_get_raw(s, n, p, size);\n"
+	"\tif (sc2xml_get_i64(s, n, &x) != 0)\n"
+	"\t\treturn -1;\n"
+	"\tswitch (size) {\n"
+	"\tcase 1: if (x < INT8_MIN || x > INT8_MAX) return -1; v8 = (int8_t)x; memcpy(p, &v8, 1); break;\n"
+	"\tcase 2: if (x < INT16_MIN || x > INT16_MAX) return -1; v16 = (int16_t)x; memcpy(p, &v16, 2); break;\n"
+	"\tcase 4: if (x < INT32_MIN || x > INT32_MAX) return -1; v32 = (int32_t)x; memcpy(p, &v32, 4); break;\n"
+	"\tdefault: v64 = (int64_t)x; memcpy(p, &v64, 8); break;\n"
+	"\t}\n"
+	"\n"
+	"\treturn 0;\n"
+	"}\n"
+	"\n"
+	"static inline int sc2xml_get_unsigned(const char *s, size_t n, void *p, size_t size)\n"
+	"{\n"
+	"\tunsigned long long x;\n"
+	"\tuint8_t v8; uint16_t v16; uint32_t v32; uint64_t v64;\n"
+	"\n"
+	"\tif (size != 1 && size != 2 && size != 4 && size != 8)\n"
+	"\t\treturn sc2xml_get_raw(s, n, p, size);\n"
+	"\tif (sc2xml_get_u64(s, n, &x) != 0)\n"
+	"\t\treturn -1;\n"
+	"\tswitch (size) {\n"
+	"\tcase 1: if (x > UINT8_MAX) return -1; v8 = (uint8_t)x; memcpy(p, &v8, 1); break;\n"
+	"\tcase 2: if (x > UINT16_MAX) return -1; v16 = (uint16_t)x; memcpy(p, &v16, 2); break;\n"
+	"\tcase 4: if (x > UINT32_MAX) return -1; v32 = (uint32_t)x; memcpy(p, &v32, 4); break;\n"
+	"\tdefault: v64 = (uint64_t)x; memcpy(p, &v64, 8); break;\n"
+	"\t}\n"
+	"\n"
+	"\treturn 0;\n"
+	"}\n"
+	"\n"
+	"static inline int sc2xml_get_char(const char *s, size_t n, void *p, size_t size)\n"
+	"{\n"
+	"\tif ((char)-1 < 0)\n"
+	"\t\treturn sc2xml_get_signed(s, n, p, size);\n"
+	"\n"
+	"\treturn sc2xml_get_unsigned(s, n, p, size);\n"
+	"}\n"
+	"\n"
+	"static inline int sc2xml_get_bool(const char *s, size_t n, void *p, size_t size)\n"
+	"{\n"
+	"\tunsigned long long x;\n"
+	"\t_Bool b;\n"
+	"\n"
+	"\tif (sc2xml_get_u64(s, n, &x) != 0 || x > 1 || size != sizeof(b))\n"
+	"\t\treturn -1;\n"
+	"\tb = x != 0;\n"
+	"\tmemcpy(p, &b, size);\n"
+	"\n"
+	"\treturn 0;\n"
+	"}\n"
+	"\n"
+	"static inline int sc2xml_get_float(const char *s, size_t n, void *p, size_t size)\n"
+	"{\n"
+	"\tfloat f;\n"
+	"\tdouble d;\n"
+	"\tlong double ld;\n"
+	"\n"
+	"\tif (sc2xml_get_double(s, n, &d) != 0)\n"
+	"\t\treturn -1;\n"
+	"\tif (size == sizeof(f)) {\n"
+	"\t\tf = (float)d;\n"
+	"\t\tmemcpy(p, &f, size);\n"
+	"\t}\n"
+	"\telse if (size == sizeof(d))\n"
+	"\t\tmemcpy(p, &d, size);\n"
+	"\telse {\n"
+	"\t\tld = d;\n"
+	"\t\tmemcpy(p, &ld, sizeof(ld));\n"
+	"\t}\n"
+	"\n"
+	"\treturn 0;\n"
+	"}\n"
+	"\n"
+	"#define SC2XML_PARSE(s, n, x) _Generic((x),\t\t\t\t\t\t\t\t\t\\\n"
+	"\tchar: sc2xml_get_char,\t\t\t\t\t\t\t\t\t\t\t\t\t\\\n"
+	"\tsigned char: sc2xml_get_signed, unsigned char: sc2xml_get_unsigned,\t\t\\\n"
+	"\tshort: sc2xml_get_signed, unsigned short: sc2xml_get_unsigned,\t\t\t\\\n"
+	"\tint: sc2xml_get_signed, unsigned int: sc2xml_get_unsigned,\t\t\t\t\\\n"
+	"\tlong: sc2xml_get_signed, unsigned long: sc2xml_get_unsigned,\t\t\t\\\n"
+	"\tlong long: sc2xml_get_signed, unsigned long long: sc2xml_get_unsigned,\t\\\n"
+	"\t_Bool: sc2xml_get_bool,\t\t\t\t\t\t\t\t\t\t\t\t\t\\\n"
+	"\tfloat: sc2xml_get_float, double: sc2xml_get_float,\t\t\t\t\t\t\\\n"
+	"\tlong double: sc2xml_get_float,\t\t\t\t\t\t\t\t\t\t\t\\\n"
+	"\tdefault: sc2xml_get_raw)((s), (n), (void *)&(x), sizeof(x))\n"
+	"#endif\n\n";
+
+/* Code being generated */
+typedef struct {
+	FILE		*fd;
+	GString		*code;		/**< Body of the function being generated */
+	GHashTable	*known;		/**< C type -> name of its loader */
+	const char	*name;		/**< Struct the function is generated for */
+	int			tables;		/**< Tables of names written for it */
+	int			depth;		/**< Nesting of the blocks */
+} SCDeserializer;
+
+/**
+ * @brief Append lines to the function being generated, indented to the
+ *        depth of the block
+ */
+static void deserialize_code(SCDeserializer *des, const char *format, ...)
+{
+	va_list	args;
+	gchar	*text,
+			**lines;
+	int		i,
+			j;
+
+	va_start(args, format);
+	text = g_strdup_vprintf(format, args);
+	va_end(args);
+
+	lines = g_strsplit(text, "\n", -1);
+	for (i = 0; lines[i] != NULL; i++) {
+		if (*lines[i] != '\0')
+			for (j = 0; j <= des->depth; j++)
+				g_string_append_c(des->code, '\t');
+		g_string_append_printf(des->code, "%s\n", lines[i]);
+	}
+	g_strfreev(lines);
+	g_free(text);
+}
+
+/**
+ * @brief Hash of a name, the same as sc2xml_hash() in the generated code
+ */
+static guint32 deserialize_hash(const char *name, guint32 seed)
+{
+	guint32 h = 2166136261u ^ seed;
+
+	for (; *name; name++) {
+		h ^= (guchar)*name;
+		h *= 16777619u;
+	}
+
+	return h ^ (h >> 16);
+}
+
+/**
+ * @brief Find a perfect hash for some names: the smallest table, a power of
+ *        two, and a seed that put every name in its own slot
+ * @param names The names, all different
+ * @param seed Where the seed is returned
+ * @return The size of the table, 0 if none was found
+ */
+static guint deserialize_perfect(GPtrArray *names, guint32 *seed)
+{
+	guchar	*used;
+	guint	size,
+			i;
+
+	for (size = 1; size < names->len; size <<= 1)
+		;
+
+	used = g_malloc(DESERIALIZE_MAX_TABLE);
+	for (; size <= DESERIALIZE_MAX_TABLE; size <<= 1) {
+		for (*seed = 0; *seed < DESERIALIZE_SEEDS; (*seed)++) {
+			memset(used, 0, size);
+			for (i = 0; i < names->len; i++) {
+				guint slot = deserialize_hash(g_ptr_array_index(names, i), *seed) & (size - 1);
+
+				if (used[slot])
+					break;
+				used[slot] = 1;
+			}
+			if (i == names->len) {
+				g_free(used);
+				return size;
+			}
+		}
+	}
+	g_free(used);
+
+	return 0;
+}
+
+/**
+ * @brief Check if a member is loaded: pointers, function pointers and
+ *        flexible array members are not
+ */
+static int deserialize_is_loaded(SCGenMember *member)
+{
+	if (member->kind == GEN_NESTED)
+		return 1;
+	if (member->kind == GEN_FLEXIBLE || member->kind == GEN_FUNC_PTR)
+		return 0;
+
+	return strchr(member->field->type, '*') == NULL;
+}
+
+static SCResult deserialize_members(SCDeserializer *, SCStruct *, const char *);
+
+/**
+ * @brief Write the code that loads a member, after its name was read
+ * @param des The code being generated
+ * @param member The member
+ * @param value The member in the code, e.g. 'v->a'
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+static SCResult deserialize_member(SCDeserializer *des, SCGenMember *member, const char *value)
+{
+	SCField		*field = member->field;
+	const char	*loader = NULL;
+	gchar		*type,
+				*loop = g_strdup_printf("i%d", des->depth);
+	SCResult	rc = SC_OK;
+
+	/* A nested struct/union, or an element of an array of them */
+	if (member->kind == GEN_NESTED) {
+		gchar *base;
+
+		if (member->array) {
+			deserialize_code(des, "{");
+			des->depth++;
+			deserialize_code(des, "size_t %s = t.index;\n", loop);
+			deserialize_code(des, "if (%s >= sizeof(%s) / sizeof(%s[0])) {", loop, value, value);
+			deserialize_code(des, "\tif (sc2xml_end(in) != 0)\n\t\treturn -1;");
+			deserialize_code(des, "\tbreak;");
+			deserialize_code(des, "}");
+			base = g_strdup_printf("%s[%s].", value, loop);
+		}
+		else
+			base = g_strdup_printf("%s.", value);
+
+		rc = deserialize_members(des, member->nested, base);
+
+		if (member->array) {
+			des->depth--;
+			deserialize_code(des, "}");
+		}
+		g_free(base);
+		g_free(loop);
+		return rc;
+	}
+
+	type = gen_value_type(field->type);
+	if (member->kind == GEN_SCALAR)
+		loader = g_hash_table_lookup(des->known, type);
+
+	if (loader) {
+		/* A struct with a loader of its own, one element per <struct> */
+		deserialize_code(des, "for (size_t %s = 0; (rc = sc2xml_next(in, &t)) == 1; %s++) {",
+			loop, loop);
+		if (member->array)
+			deserialize_code(des, "\tif (!t.empty && %s < sizeof(%s) / sizeof(%s[0])) {",
+				loop, value, value);
+		else
+			deserialize_code(des, "\tif (!t.empty && %s == 0) {", loop);
+		deserialize_code(des, "\t\tif (%s_xml_get(in, &%s%s%s%s) != 0)\n\t\t\treturn -1;",
+			loader, value, member->array ? "[" : "", member->array ? loop : "",
+			member->array ? "]" : "");
+		deserialize_code(des, "\t}");
+		deserialize_code(des, "\telse if (!t.empty && sc2xml_end(in) != 0)\n\t\treturn -1;");
+		deserialize_code(des, "}");
+		deserialize_code(des, "if (rc < 0)\n\treturn -1;");
+	}
+	else if (member->kind == GEN_BITS) {
+		/* No address, through a temporary */
+		const char *wide = strstr(type, "unsigned") ? "unsigned long long" : "long long";
+
+		deserialize_code(des, "{");
+		deserialize_code(des, "\t%s x;\n", wide);
+		deserialize_code(des, "\tif (sc2xml_value(in, &s, &n) != 0 || sc2xml_get_%s(s, n, &x) != 0 ||",
+			strstr(type, "unsigned") ? "u64" : "i64");
+		deserialize_code(des, "\t\t\tsc2xml_end(in) != 0)\n\t\treturn -1;");
+		deserialize_code(des, "\t%s = (%s)x;", value, type);
+		deserialize_code(des, "}");
+	}
+	else if (member->array && strcmp(type, "char") == 0) {
+		deserialize_code(des, "if (sc2xml_value(in, &s, &n) != 0 ||");
+		deserialize_code(des, "\t\tsc2xml_get_text(s, n, (char *)%s, sizeof(%s)) != 0 ||",
+			value, value);
+		deserialize_code(des, "\t\tsc2xml_end(in) != 0)\n\treturn -1;");
+	}
+	else if (member->array) {
+		/* Arrays of arrays are read as one array of scalars */
+		deserialize_code(des, "if (sc2xml_value(in, &s, &n) != 0)\n\treturn -1;");
+		deserialize_code(des, "for (size_t %s = 0; %s < sizeof(%s) / sizeof(%s); %s++) {",
+			loop, loop, value, type, loop);
+		deserialize_code(des, "\tsize_t wn;");
+		deserialize_code(des, "\tconst char *w = sc2xml_word(&s, &n, &wn);\n");
+		deserialize_code(des, "\tif (w == NULL)\n\t\tbreak;");
+		deserialize_code(des, "\tif (SC2XML_PARSE(w, wn, ((%s *)&%s)[%s]) != 0)\n\t\treturn -1;",
+			type, value, loop);
+		deserialize_code(des, "}");
+		deserialize_code(des, "if (sc2xml_end(in) != 0)\n\treturn -1;");
+	}
+	else {
+		deserialize_code(des, "if (sc2xml_value(in, &s, &n) != 0 || SC2XML_PARSE(s, n, %s) != 0 ||",
+			value);
+		deserialize_code(des, "\t\tsc2xml_end(in) != 0)\n\treturn -1;");
+	}
+
+	g_free(type);
+	g_free(loop);
+
+	return rc;
+}
+
+/**
+ * @brief Write the code that loads the members of a struct: the table of
+ *        their names and a loop over the elements up to the end of the struct
+ * @param des The code being generated
+ * @param st The struct
+ * @param base What the path of the members is appended to, e.g. 'v->'
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+static SCResult deserialize_members(SCDeserializer *des, SCStruct *st, const char *base)
+{
+	GPtrArray	*members = gen_members(st),
+				*loaded = g_ptr_array_new(),
+				*names = g_ptr_array_new();
+	GHashTable	*seen = g_hash_table_new(g_str_hash, g_str_equal);
+	guint		*slots;
+	guint32		seed = 0;
+	guint		size,
+				i;
+	int			table = des->tables++;
+	SCResult	rc = SC_OK;
+
+	for (i = 0; i < members->len; i++) {
+		SCGenMember *member = g_ptr_array_index(members, i);
+
+		if (!deserialize_is_loaded(member) || g_hash_table_lookup(seen, member->path))
+			continue;
+		g_hash_table_insert(seen, member->path, member);
+		g_ptr_array_add(loaded, member);
+		g_ptr_array_add(names, member->path);
+	}
+
+	size = deserialize_perfect(names, &seed);
+	if (size == 0) {
+		log_error(LOG_ERR, "%s(): No perfect hash for the members of '%s'",
+			__func__, des->name);
+		rc = SC_FAIL;
+		goto out;
+	}
+
+	/* The table goes before the function, the id of a member is its case */
+	slots = g_new0(guint, size);
+	for (i = 0; i < names->len; i++)
+		slots[deserialize_hash(g_ptr_array_index(names, i), seed) & (size - 1)] = i + 1;
+
+	fprintf(des->fd, "static const struct sc2xml_key %s_keys%d[%u] = {\n", des->name, table, size);
+	for (i = 0; i < size; i++) {
+		const char *name = slots[i] ? g_ptr_array_index(names, slots[i] - 1) : NULL;
+
+		if (name)
+			fprintf(des->fd, "\t{ \"%s\", %u, %u },\n", name, (guint)strlen(name), slots[i]);
+		else
+			fprintf(des->fd, "\t{ NULL, 0, 0 },\n");
+	}
+	fprintf(des->fd, "};\n\n");
+	g_free(slots);
+
+	deserialize_code(des, "while ((rc = sc2xml_member(in, &t, &s, &n)) == 1) {");
+	deserialize_code(des, "\tswitch (sc2xml_lookup(%s_keys%d, %uu, %uu, s, n)) {",
+		des->name, table, size - 1, seed);
+	for (i = 0; i < loaded->len && rc == SC_OK; i++) {
+		SCGenMember	*member = g_ptr_array_index(loaded, i);
+		gchar		*value = g_strdup_printf("%s%s", base, member->path);
+
+		deserialize_code(des, "\tcase %u:\t/* %s */", i + 1, member->path);
+		des->depth += 2;
+		rc = deserialize_member(des, member, value);
+		deserialize_code(des, "break;");
+		des->depth -= 2;
+		g_free(value);
+	}
+	deserialize_code(des, "\tdefault:");
+	deserialize_code(des, "\t\tif (sc2xml_end(in) != 0)\n\t\t\treturn -1;");
+	deserialize_code(des, "\t}");
+	deserialize_code(des, "}");
+	deserialize_code(des, "if (rc < 0)\n\treturn -1;");
+
+out:
+	g_hash_table_destroy(seen);
+	g_ptr_array_free(names, TRUE);
+	g_ptr_array_free(loaded, TRUE);
+	g_ptr_array_free(members, TRUE);
+
+	return rc;
+}
+
+/**
+ * @brief Write the loader of a struct
+ * @param des The code being generated
+ * @param gen The struct
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+static SCResult deserialize_struct(SCDeserializer *des, SCGenStruct *gen)
+{
+	des->name = gen->name;
+	des->tables = 0;
+	des->depth = 0;
+	g_string_truncate(des->code, 0);
+
+	fprintf(des->fd, "/* %s (%s) */\n", gen->type, gen->header);
+	if (deserialize_members(des, gen->st, "v->") != SC_OK)
+		return SC_FAIL;
+
+	/* Called after the opening tag, reads up to the closing one */
+	fprintf(des->fd, "static inline int %s_xml_get(struct sc2xml_in *in, %s *v)\n{\n",
+		gen->name, gen->type);
+	fprintf(des->fd, "\tstruct sc2xml_tag t;\n\tconst char *s;\n\tsize_t n;\n\tint rc;\n\n");
+	fputs(des->code->str, des->fd);
+	fprintf(des->fd, "\n\treturn 0;\n}\n\n");
+
+	/* The entry point */
+	fprintf(des->fd, "/* Load v from the XML written by %s_to_xml(), return 0 if it is\n"
+					 " * ok and -1 otherwise */\n", gen->name);
+	fprintf(des->fd, "static inline int %s_from_xml(const char *xml, size_t len, %s *v)\n{\n",
+		gen->name, gen->type);
+	fprintf(des->fd, "\tstruct sc2xml_in in = { xml, xml + len };\n"
+					 "\tstruct sc2xml_tag t;\n\n"
+					 "\tif (sc2xml_next(&in, &t) != 1 || t.empty ||\n"
+					 "\t\t\t!(SC2XML_IS(&t, \"struct\") || SC2XML_IS(&t, \"union\")))\n"
+					 "\t\treturn -1;\n\n"
+					 "\treturn %s_xml_get(&in, v);\n}\n\n", gen->name);
+
+	return SC_OK;
+}
+
+/**
+ * @brief Write the loaders of the structs selected
+ * @param filename The header to generate
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult deserialize_write(const char *filename)
+{
+	GPtrArray		*gens = gen_structs(),
+					*written = g_ptr_array_new();
+	GHashTable		*names;
+	SCDeserializer	des;
+	SCResult		rc = SC_OK;
+	guint			i;
+
+	des.fd = gen_open(filename, "Loaders of the parsed structs from XML", gens, 0);
+	if (des.fd == NULL) {
+		g_ptr_array_free(written, TRUE);
+		return SC_FAIL;
+	}
+	des.code = g_string_new(NULL);
+	des.known = g_hash_table_new(g_str_hash, g_str_equal);
+
+	fputs(deserialize_helpers, des.fd);
+
+	names = g_hash_table_new(g_str_hash, g_str_equal);
+	for (i = 0; i < gens->len; i++) {
+		SCGenStruct *gen = g_ptr_array_index(gens, i);
+
+		if (g_hash_table_lookup(names, gen->name)) {
+			log_error(LOG_WARN, "%s(): '%s' is defined again in '%s', skipping it",
+				__func__, gen->name, gen->header);
+			continue;
+		}
+		g_hash_table_insert(names, gen->name, gen);
+		g_hash_table_insert(des.known, gen->type, gen->name);
+		g_ptr_array_add(written, gen);
+	}
+	g_hash_table_destroy(names);
+
+	/* The loaders call each other for the members of struct types */
+	for (i = 0; i < written->len; i++) {
+		SCGenStruct *gen = g_ptr_array_index(written, i);
+
+		fprintf(des.fd, "static inline int %s_xml_get(struct sc2xml_in *, %s *);\n",
+			gen->name, gen->type);
+	}
+	fputc('\n', des.fd);
+
+	for (i = 0; i < written->len && rc == SC_OK; i++)
+		rc = deserialize_struct(&des, g_ptr_array_index(written, i));
+
+	g_hash_table_destroy(des.known);
+	g_string_free(des.code, TRUE);
+	g_ptr_array_free(written, TRUE);
+
+	if (gen_close(des.fd, filename) != SC_OK)
+		return SC_FAIL;
+
+	return rc;
+}
@@ -0,0 +1,20 @@
+/**
+ * @file deserialize.h
+ *
+ * @brief Defines for deserialize.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#ifndef _DESERIALIZE_H
+#define _DESERIALIZE_H
+
+#include "sc2xml.h"
+
+SCResult	deserialize_write(const char *);
+
+#endif	/* _DESERIALIZE_H */
@@ -0,0 +1,713 @@
+/**
+ * @file diff.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * @brief Compare the structs/unions of two header trees:
+ *
+ *        sc2xml diff <old-tree> <new-tree>
+ *
+ *        Each tree is split in shards that are parsed in parallel by child
+ *        processes (the parser is not reentrant), every child writes its
+ *        shard to a single XML document with the structural fingerprints.
+ *        The documents are then loaded back and the structs are matched by
+ *        header and name, or only by name if they moved to another header.
+ *        Structs with the same fingerprint and the same layouts are 
+ *        skipped, the others are compared member by member. The layouts
+ *        are computed for the ABIs given to --layout, or the one sc2xml
+ *        runs on, so a constant that changes the size of an array is a
+ *        change too.
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <glib.h>
+
+#include "config.h"
+#include "sc2xml.h"
+#include "misc.h"
+#include "xml.h"
+#include "model.h"
+#include "layout.h"
+#include "loader.h"
+#include "diff.h"
+
+extern SCResult get_files(int, char **);
+
+/* A named top-level struct of one of the trees */
+typedef struct diff_entry_st {
+	SCStruct *st;			/**< The struct */
+	gchar *name;			/**< Tag or typedef name */
+	const char *header;		/**< The header, relative to the tree */
+	guint seq;				/**< Position in the tree */
+	struct diff_entry_st *match;	/**< The same struct in the other tree */
+} SCDiffEntry;
+
+/* A member of a struct, nested members are flattened as 'outer.member' */
+typedef struct diff_member_st {
+	gchar *path;			/**< Name of the member */
+	SCField *field;			/**< The field, NULL for a nested struct */
+	SCStruct *nested;		/**< The nested struct, NULL for a field */
+	SCLayout *layout;		/**< Where the member is, for all the ABIs */
+} SCDiffMember;
+
+/* The parsed trees */
+typedef struct diff_tree_st {
+	const char *root;		/**< The tree as given in the command line */
+	GPtrArray *headers;		/**< SCHeader of all the shards */
+	GPtrArray *entries;		/**< SCDiffEntry, sorted by header */
+} SCDiffTree;
+
+/**
+ * @brief Parse a shard of a tree in a child process
+ * @param root The tree
+ * @param xml_filename The document where the child writes the structs
+ * @param shard The shard parsed by the child
+ * @param shards Number of shards of the tree
+ * @return The pid of the child, -1 on error
+ */
+static pid_t diff_parse(const char *root, char *xml_filename, guint shard, guint shards)
+{
+	pid_t	pid;
+	gchar	*tree;
+	int		fd,
+			abis = sc_opts.abis;
+
+	pid = fork();
+	if (pid != 0)
+		return pid;
+
+	/* The child: only the report of the parent goes to stdout */
+	if ((fd = open("/dev/null", O_WRONLY)) != -1) {
+		dup2(fd, STDOUT_FILENO);
+		close(fd);
+	}
+
+	memset(&sc_opts, 0, sizeof(sc_opts));
+	sc_opts.aggregate = xml_filename;
+	sc_opts.hash = 1;
+	sc_opts.abis = abis;
+	sc_opts.shard = shard;
+	sc_opts.shards = shards;
+
+	if (xml_aggregate_open(xml_filename) != SC_OK)
+		_exit(1);
+
+	tree = g_strdup(root);
+	get_files(1, &tree);
+	g_free(tree);
+
+	_exit(xml_aggregate_close() == SC_OK ? 0 : 1);
+}
+
+static void diff_entry_free(gpointer data)
+{
+	SCDiffEntry *entry = (SCDiffEntry *)data;
+
+	g_free(entry->name);
+	g_free(entry);
+}
+
+static gint diff_entry_cmp(gconstpointer a, gconstpointer b)
+{
+	const SCDiffEntry	*ea = *(SCDiffEntry **)a,
+						*eb = *(SCDiffEntry **)b;
+	gint				rc;
+
+	if ((rc = strcmp(ea->header, eb->header)) != 0)
+		return rc;
+
+	return ea->seq < eb->seq ? -1 : ea->seq > eb->seq;
+}
+
+/**
+ * @brief Load the documents of the shards of a tree and collect its
+ *        named structs. Anonymous structs cannot be matched and are skipped.
+ * @param tree The tree
+ * @param xml_filenames The documents of the shards
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+static SCResult diff_load(SCDiffTree *tree, GPtrArray *xml_filenames)
+{
+	GPtrArray	*headers;
+	guint		i, j, k,
+				seq = 0;
+
+	tree->headers = g_ptr_array_new_with_free_func((GDestroyNotify)g_ptr_array_unref);
+	tree->entries = g_ptr_array_new_with_free_func(diff_entry_free);
+
+	for (i = 0; i < xml_filenames->len; i++) {
+		if ((headers = loader_read(g_ptr_array_index(xml_filenames, i))) == NULL)
+			return SC_FAIL;
+		g_ptr_array_add(tree->headers, headers);
+
+		for (j = 0; j < headers->len; j++) {
+			SCHeader	*header = g_ptr_array_index(headers, j);
+			const char	*rel = header->name;
+
+			/* The header relative to the tree */
+			if (g_str_has_prefix(rel, tree->root))
+				rel += strlen(tree->root);
+			while (*rel == '/')
+				rel++;
+			if (*rel == '\0')
+				rel = header->name;
+
+			for (k = 0; k < header->structs->len; k++) {
+				SCStruct	*st = g_ptr_array_index(header->structs, k);
+				SCDiffEntry	*entry;
+				gchar		*name;
+
+				if ((name = model_struct_name(st)) == NULL)
+					continue;
+
+				entry = g_new0(SCDiffEntry, 1);
+				entry->st = st;
+				entry->name = name;
+				entry->header = rel;
+				entry->seq = seq++;
+				g_ptr_array_add(tree->entries, entry);
+			}
+		}
+	}
+
+	g_ptr_array_sort(tree->entries, diff_entry_cmp);
+
+	return SC_OK;
+}
+
+/**
+ * @brief Match the structs of both trees: first by header and name, then
+ *        by name alone if it is unique among the structs left in both trees
+ */
+static void diff_match(SCDiffTree *old_tree, SCDiffTree *new_tree)
+{
+	GHashTable	*by_key,
+				*by_name;
+	gchar		*key;
+	guint		i;
+
+	by_key = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	for (i = 0; i < new_tree->entries->len; i++) {
+		SCDiffEntry *entry = g_ptr_array_index(new_tree->entries, i);
+
+		key = g_strconcat(entry->header, "\t", entry->name, NULL);
+		if (g_hash_table_lookup(by_key, key))
+			g_free(key);
+		else
+			g_hash_table_insert(by_key, key, entry);
+	}
+
+	for (i = 0; i < old_tree->entries->len; i++) {
+		SCDiffEntry *entry = g_ptr_array_index(old_tree->entries, i),
+					*other;
+
+		key = g_strconcat(entry->header, "\t", entry->name, NULL);
+		other = g_hash_table_lookup(by_key, key);
+		if (other && other->match == NULL) {
+			entry->match = other;
+			other->match = entry;
+		}
+		g_free(key);
+	}
+	g_hash_table_destroy(by_key);
+
+	/* Moved to another header. A name seen more than once on a side
+	 * is ambiguous and maps to the table itself */
+	by_name = g_hash_table_new(g_str_hash, g_str_equal);
+	for (i = 0; i < new_tree->entries->len; i++) {
+		SCDiffEntry *entry = g_ptr_array_index(new_tree->entries, i);
+
+		if (entry->match)
+			continue;
+		if (g_hash_table_lookup(by_name, entry->name))
+			g_hash_table_insert(by_name, entry->name, by_name);
+		else
+			g_hash_table_insert(by_name, entry->name, entry);
+	}
+
+	for (i = 0; i < old_tree->entries->len; i++) {
+		SCDiffEntry *entry = g_ptr_array_index(old_tree->entries, i),
+					*other;
+
+		if (entry->match)
+			continue;
+
+		other = g_hash_table_lookup(by_name, entry->name);
+		if (other == NULL)
+			continue;
+
+		/* Ambiguous in the new tree or already taken by the same name */
+		if ((gpointer)other == (gpointer)by_name || other->match) {
+			if (other->match) {
+				other->match->match = NULL;
+				other->match = NULL;
+			}
+			g_hash_table_insert(by_name, entry->name, by_name);
+			continue;
+		}
+		entry->match = other;
+		other->match = entry;
+	}
+	g_hash_table_destroy(by_name);
+}
+
+static void diff_member_free(gpointer data)
+{
+	SCDiffMember *member = (SCDiffMember *)data;
+
+	if (member == NULL)
+		return;
+
+	g_free(member->path);
+	g_free(member);
+}
+
+/**
+ * @brief Flatten the members of a struct. A nested struct is a member
+ *        and its own members are named after it, unless it is anonymous.
+ */
+static void diff_flatten(SCStruct *st, const char *prefix, GPtrArray *members)
+{
+	SCDiffMember	*member;
+	gchar			*name,
+					*path;
+	guint			i;
+
+	for (i = 0; i < st->fields->len; i++) {
+		SCField *field = g_ptr_array_index(st->fields, i);
+
+		if (field->nested) {
+			SCStruct *nested = field->nested;
+
+			name = model_declarator_name(nested->nested_name);
+			if (name == NULL)
+				name = model_declarator_name(nested->typedef_name);
+			if (name == NULL)
+				name = model_declarator_name(nested->tail_name);
+			if (name == NULL) {
+				diff_flatten(nested, prefix, members);
+				continue;
+			}
+
+			path = g_strconcat(prefix, name, NULL);
+			member = g_new0(SCDiffMember, 1);
+			member->path = path;
+			member->nested = nested;
+			member->layout = field->layout;
+			g_ptr_array_add(members, member);
+
+			path = g_strconcat(path, ".", NULL);
+			diff_flatten(nested, path, members);
+			g_free(path);
+			g_free(name);
+			continue;
+		}
+
+		member = g_new0(SCDiffMember, 1);
+		member->path = g_strconcat(prefix, field->name ? field->name : "?", NULL);
+		member->field = field;
+		member->layout = field->layout;
+		g_ptr_array_add(members, member);
+	}
+}
+
+/**
+ * @brief Describe a member for the added/removed lines
+ */
+static gchar * diff_member_describe(SCDiffMember *member)
+{
+	SCField *field = member->field;
+
+	if (member->nested)
+		return g_strdup_printf("%s (%s)", member->path,
+				member->nested->is_union ? "union" : "struct");
+
+	return g_strdup_printf("%s (%s%s%s%s%s)", member->path,
+			field->type ? field->type : "?",
+			field->bits ? " : " : "", field->bits ? field->bits : "",
+			field->size ? " array " : "",
+			field->size ? (*field->size ? field->size : "[]") : "");
+}
+
+#define STR(s) ((s) ? (s) : "none")
+
+/**
+ * @brief Append a '~' line if a property changed
+ */
+static void diff_value(GString *out, const char *path, const char *what,
+		const char *old_value, const char *new_value)
+{
+	if (g_strcmp0(old_value, new_value) == 0)
+		return;
+
+	g_string_append_printf(out, "  ~ %s: %s '%s' -> '%s'\n", path, what,
+		STR(old_value), STR(new_value));
+}
+
+/**
+ * @brief Format an offset in bits as bytes, with the bit within the byte
+ *        for bit fields
+ */
+static gchar * diff_offset(guint64 offset)
+{
+	if (offset % 8)
+		return g_strdup_printf("%" G_GUINT64_FORMAT " bit %" G_GUINT64_FORMAT,
+			offset / 8, offset % 8);
+
+	return g_strdup_printf("%" G_GUINT64_FORMAT, offset / 8);
+}
+
+/**
+ * @brief Append a '~' line for every ABI where the offset, the size or
+ *        the alignment changed. Layouts not known on both sides are not
+ *        compared.
+ * @param path The member, "" for the struct itself
+ * @param member 1 to compare the offsets
+ */
+static void diff_layout(GString *out, const char *path, const SCLayout *old_layout,
+		const SCLayout *new_layout, int member)
+{
+	gchar	*old_offset,
+			*new_offset;
+	int		abi;
+
+	for (abi = 0; abi < ABI_COUNT; abi++) {
+		const SCLayout	*o = &old_layout[abi],
+						*n = &new_layout[abi];
+		const char		*name = layout_abi_name(abi);
+
+		if (!(sc_opts.abis & (1 << abi)) || !o->known || !n->known)
+			continue;
+
+		if (member && o->offset != n->offset) {
+			old_offset = diff_offset(o->offset);
+			new_offset = diff_offset(n->offset);
+			g_string_append_printf(out, "  ~ %s%soffset (%s) %s -> %s\n", path,
+				*path ? ": " : "", name, old_offset, new_offset);
+			g_free(old_offset);
+			g_free(new_offset);
+		}
+		if (o->size != n->size)
+			g_string_append_printf(out, "  ~ %s%ssize (%s) %" G_GUINT64_FORMAT 
+				" -> %" G_GUINT64_FORMAT "\n", path, *path ? ": " : "", name,
+				o->size, n->size);
+		if (o->align != n->align)
+			g_string_append_printf(out, "  ~ %s%salignment (%s) %" G_GUINT64_FORMAT 
+				" -> %" G_GUINT64_FORMAT "\n", path, *path ? ": " : "", name,
+				o->align, n->align);
+	}
+}
+
+/**
+ * @brief Check whether two structs with the same fingerprint have the same
+ *        layouts: a type defined in another header may have changed
+ */
+static gboolean diff_same_layout(SCStruct *old_st, SCStruct *new_st)
+{
+	guint i;
+
+	if (memcmp(old_st->layout, new_st->layout, sizeof(old_st->layout)) != 0 ||
+			old_st->fields->len != new_st->fields->len)
+		return FALSE;
+
+	for (i = 0; i < old_st->fields->len; i++) {
+		SCField *o = g_ptr_array_index(old_st->fields, i),
+				*n = g_ptr_array_index(new_st->fields, i);
+
+		if (memcmp(o->layout, n->layout, sizeof(o->layout)) != 0)
+			return FALSE;
+		if (o->nested && n->nested && !diff_same_layout(o->nested, n->nested))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * @brief Compare two versions of a struct member by member
+ * @param old_st The struct in the old tree
+ * @param new_st The struct in the new tree
+ * @param out The lines describing the changes are appended here
+ */
+static void diff_struct(SCStruct *old_st, SCStruct *new_st, GString *out)
+{
+	GPtrArray	*old_members,
+				*new_members;
+	GHashTable	*by_path;
+	gchar		*text;
+	guint		i,
+				common = 0,
+				last = 0;
+	gboolean	reordered = FALSE;
+
+	if (old_st->is_union != new_st->is_union)
+		g_string_append_printf(out, "  ~ kind '%s' -> '%s'\n",
+			old_st->is_union ? "union" : "struct",
+			new_st->is_union ? "union" : "struct");
+	diff_value(out, "", "attributes", old_st->attributes, new_st->attributes);
+	diff_layout(out, "", old_st->layout, new_st->layout, 0);
+
+	old_members = g_ptr_array_new_with_free_func(diff_member_free);
+	new_members = g_ptr_array_new_with_free_func(diff_member_free);
+	diff_flatten(old_st, "", old_members);
+	diff_flatten(new_st, "", new_members);
+
+	/* Path -> position + 1 in the new struct */
+	by_path = g_hash_table_new(g_str_hash, g_str_equal);
+	for (i = 0; i < new_members->len; i++) {
+		SCDiffMember *member = g_ptr_array_index(new_members, i);
+
+		if (!g_hash_table_lookup(by_path, member->path))
+			g_hash_table_insert(by_path, member->path, GUINT_TO_POINTER(i + 1));
+	}
+
+	for (i = 0; i < old_members->len; i++) {
+		SCDiffMember	*old_m = g_ptr_array_index(old_members, i),
+						*new_m;
+		guint			pos;
+
+		pos = GPOINTER_TO_UINT(g_hash_table_lookup(by_path, old_m->path));
+		if (pos == 0) {
+			text = diff_member_describe(old_m);
+			g_string_append_printf(out, "  - %s\n", text);
+			g_free(text);
+			continue;
+		}
+		g_hash_table_remove(by_path, old_m->path);
+		new_m = g_ptr_array_index(new_members, pos - 1);
+		g_ptr_array_index(new_members, pos - 1) = NULL;
+
+		if (pos < last)
+			reordered = TRUE;
+		last = pos;
+		common++;
+
+		if (old_m->nested && new_m->nested) {
+			SCStruct *o = old_m->nested,
+					 *n = new_m->nested;
+
+			if (o->is_union != n->is_union)
+				g_string_append_printf(out, "  ~ %s: kind '%s' -> '%s'\n",
+					old_m->path, o->is_union ? "union" : "struct",
+					n->is_union ? "union" : "struct");
+			diff_value(out, old_m->path, "declarator",
+				o->typedef_name ? o->typedef_name : o->nested_name,
+				n->typedef_name ? n->typedef_name : n->nested_name);
+			diff_value(out, old_m->path, "attributes", o->attributes, n->attributes);
+		}
+		else if (old_m->field && new_m->field) {
+			SCField *o = old_m->field,
+					*n = new_m->field;
+
+			diff_value(out, old_m->path, "type", o->type, n->type);
+			diff_value(out, old_m->path, "bits", o->bits, n->bits);
+			diff_value(out, old_m->path, "array size",
+				o->size && !*o->size ? "[]" : o->size,
+				n->size && !*n->size ? "[]" : n->size);
+			if (o->func_ptr != n->func_ptr)
+				g_string_append_printf(out, "  ~ %s: %s\n", old_m->path,
+					o->func_ptr ? "no longer a function pointer" :
+					"now a function pointer");
+			else
+				diff_value(out, old_m->path, "args", o->input_args, n->input_args);
+		}
+		else {
+			g_string_append_printf(out, "  ~ %s: now a %s\n", old_m->path,
+				new_m->nested ? "nested struct" : "field");
+		}
+
+		diff_layout(out, old_m->path, old_m->layout, new_m->layout, 1);
+
+		/* The members of the new one are the ones that remain */
+		diff_member_free(new_m);
+	}
+
+	for (i = 0; i < new_members->len; i++) {
+		SCDiffMember *member = g_ptr_array_index(new_members, i);
+
+		if (member == NULL)
+			continue;
+		text = diff_member_describe(member);
+		g_string_append_printf(out, "  + %s\n", text);
+		g_free(text);
+	}
+
+	if (reordered)
+		g_string_append_printf(out, "  ~ the order of the members changed\n");
+
+	g_hash_table_destroy(by_path);
+	g_ptr_array_free(old_members, TRUE);
+	g_ptr_array_free(new_members, TRUE);
+}
+
+/**
+ * @brief Write the report of the matched trees to stdout
+ * @return The number of structs that were added, removed or changed
+ */
+static guint diff_report(SCDiffTree *old_tree, SCDiffTree *new_tree)
+{
+	GString		*out;
+	gboolean	same;
+	guint		i,
+				unchanged = 0,
+				changed = 0,
+				added = 0,
+				removed = 0;
+
+	out = g_string_new(NULL);
+
+	for (i = 0; i < old_tree->entries->len; i++) {
+		SCDiffEntry *entry = g_ptr_array_index(old_tree->entries, i),
+					*other = entry->match;
+
+		if (other == NULL) {
+			printf("removed %s %s (%s)\n", entry->st->is_union ? "union" : "struct",
+				entry->name, entry->header);
+			removed++;
+			continue;
+		}
+
+		same = g_strcmp0(model_struct_hash(entry->st), model_struct_hash(other->st)) == 0 &&
+				diff_same_layout(entry->st, other->st);
+
+		/* Same tokens and layouts: nothing to compare */
+		if (same && strcmp(entry->header, other->header) == 0) {
+			unchanged++;
+			continue;
+		}
+
+		g_string_truncate(out, 0);
+		if (strcmp(entry->header, other->header) != 0)
+			g_string_append_printf(out, "  ~ moved from %s to %s\n",
+				entry->header, other->header);
+		if (!same)
+			diff_struct(entry->st, other->st, out);
+
+		if (out->len == 0) {
+			unchanged++;
+			continue;
+		}
+
+		printf("changed %s %s (%s)\n%s", other->st->is_union ? "union" : "struct",
+			other->name, other->header, out->str);
+		changed++;
+	}
+
+	for (i = 0; i < new_tree->entries->len; i++) {
+		SCDiffEntry *entry = g_ptr_array_index(new_tree->entries, i);
+
+		if (entry->match)
+			continue;
+		printf("added %s %s (%s)\n", entry->st->is_union ? "union" : "struct",
+			entry->name, entry->header);
+		added++;
+	}
+
+	printf("\n%u unchanged, %u changed, %u added, %u removed\n",
+		unchanged, changed, added, removed);
+
+	g_string_free(out, TRUE);
+
+	return changed + added + removed;
+}
+
+/**
+ * @brief Compare the structs/unions of two header trees and write the
+ *        differences to stdout
+ * @param old_root The old tree (a directory or a header)
+ * @param new_root The new tree
+ * @param differences Set to the number of structs that changed
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult diff_trees(const char *old_root, const char *new_root, guint *differences)
+{
+	SCDiffTree	trees[2];
+	GPtrArray	*xml_filenames[2];
+	GError		*error = NULL;
+	gchar		*tmp_dir;
+	pid_t		*pids;
+	SCResult	rc = SC_OK;
+	int			jobs,
+				shards,
+				status,
+				t, i;
+
+	tmp_dir = g_dir_make_tmp("sc2xml-diff-XXXXXX", &error);
+	if (tmp_dir == NULL) {
+		log_error(LOG_ERR, "%s(): %s", __func__, error->message);
+		g_error_free(error);
+		return SC_FAIL;
+	}
+
+	/* Both trees are parsed at the same time, each one split in shards */
+	jobs = sc_opts.threads > 0 ? sc_opts.threads : (int)g_get_num_processors();
+	shards = MAX(1, jobs / 2);
+
+	memset(trees, 0, sizeof(trees));
+	trees[0].root = old_root;
+	trees[1].root = new_root;
+	pids = g_new0(pid_t, 2 * shards);
+
+	for (t = 0; t < 2; t++) {
+		xml_filenames[t] = g_ptr_array_new_with_free_func(g_free);
+		for (i = 0; i < shards; i++) {
+			gchar *xml_filename = g_strdup_printf("%s/%s-%d.xml", tmp_dir,
+									t ? "new" : "old", i);
+
+			g_ptr_array_add(xml_filenames[t], xml_filename);
+			pids[t * shards + i] = diff_parse(trees[t].root, xml_filename, i, shards);
+			if (pids[t * shards + i] == -1) {
+				log_error(LOG_ERR, "%s(): Could not fork for parsing '%s'",
+					__func__, trees[t].root);
+				rc = SC_FAIL;
+			}
+		}
+	}
+
+	for (i = 0; i < 2 * shards; i++) {
+		if (pids[i] <= 0)
+			continue;
+		if (waitpid(pids[i], &status, 0) == -1 || !WIFEXITED(status) ||
+				WEXITSTATUS(status) != 0) {
+			log_error(LOG_ERR, "%s(): Could not parse '%s'", __func__,
+				trees[i / shards].root);
+			rc = SC_FAIL;
+		}
+	}
+
+	if (rc == SC_OK)
+		rc = diff_load(&trees[0], xml_filenames[0]);
+	if (rc == SC_OK)
+		rc = diff_load(&trees[1], xml_filenames[1]);
+
+	if (rc == SC_OK) {
+		diff_match(&trees[0], &trees[1]);
+		*differences = diff_report(&trees[0], &trees[1]);
+	}
+
+	for (t = 0; t < 2; t++) {
+		for (i = 0; i < (int)xml_filenames[t]->len; i++)
+			unlink(g_ptr_array_index(xml_filenames[t], i));
+		g_ptr_array_free(xml_filenames[t], TRUE);
+		if (trees[t].entries)
+			g_ptr_array_free(trees[t].entries, TRUE);
+		if (trees[t].headers)
+			g_ptr_array_free(trees[t].headers, TRUE);
+	}
+	rmdir(tmp_dir);
+	g_free(tmp_dir);
+	g_free(pids);
+
+	return rc;
+}
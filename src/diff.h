@@ -0,0 +1,22 @@
+/**
+ * @file diff.h
+ *
+ * @brief Defines for diff.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#ifndef _DIFF_H
+#define _DIFF_H
+
+#include <glib.h>
+
+#include "sc2xml.h"
+
+SCResult	diff_trees(const char *, const char *, guint *);
+
+#endif	/* _DIFF_H */
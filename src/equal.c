@@ -0,0 +1,465 @@
+/**
+ * @file equal.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * @brief Equality and hash functions generator (--equality). memcmp() on a
+ *        struct also compares its padding, which holds anything. With the
+ *        layout computed by layout.c, for the first ABI given to --layout or
+ *        the one sc2xml runs on, every struct gets a mask of the bits that
+ *        hold its members and the generated functions only look at them:
+ *
+ *        NAME_equal(a, b), 1 if a and b hold the same values
+ *        NAME_hash(v, seed), the same for two structs NAME_equal() says equal
+ *
+ *        The bytes with no padding bit are compared with memcmp() and hashed
+ *        8 at a time. The runs of such bytes separated by less than 8 bytes
+ *        of padding, and the units of the bit fields, are compared and
+ *        hashed through the mask, still 8 bytes at a time. Fields of other
+ *        struct types use the mask of their type, the bytes of long double
+ *        after the 80 bits of x87 are skipped and unions are compared with
+ *        the bytes of all their members. The values are compared by their
+ *        bytes, so 0.0 and -0.0 differ and a NaN equals itself.
+ *
+ *        The generated code checks that sizeof() is the size it was
+ *        generated for, and needs C11.
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "config.h"
+#include "sc2xml.h"
+#include "misc.h"
+#include "model.h"
+#include "layout.h"
+#include "gen.h"
+#include "equal.h"
+
+#define EQUAL_GAP	8	/**< Padding bytes under which two runs are merged */
+#define X87_BYTES	10	/**< Bytes of a long double holding its value */
+
+/* The bits of a struct that hold its members */
+typedef struct {
+	guint64 size;
+	guchar *mask;			/**< One byte per byte of the struct */
+} SCEqualMask;
+
+/* Bytes compared with a single call */
+typedef struct {
+	guint64 offset;
+	guint64 size;
+	int masked;				/**< Some bits are not compared */
+} SCEqualRun;
+
+static GHashTable	*masks = NULL;	/**< Name or C type -> SCEqualMask */
+static GPtrArray	*owned = NULL;	/**< The SCEqualMask */
+static int			equal_abi = -1;	/**< ABI of the layouts */
+
+/* Compared and hashed by all the generated functions */
+static const char *equal_helpers =
+	"#ifndef SC2XML_EQ_HELPERS\n"
+	"#define SC2XML_EQ_HELPERS\n"
+	"#include <stdint.h>\n"
+	"\n"
+	"/* Compare n bytes of p and q, only the bits set in m */\n"
+	"static inline int sc2xml_eq_masked(const unsigned char *p, const unsigned char *q,\n"
+	"\t\tconst unsigned char *m, size_t n)\n"
+	"{\n"
+	"\tuint64_t x, y, k;\n"
+	"\tsize_t i;\n"
+	"\n"
+	"\tfor (i = 0; i + 8 <= n; i += 8) {\n"
+	"\t\tmemcpy(&x, p + i, 8);\n"
+	"\t\tmemcpy(&y, q + i, 8);\n"
+	"\t\tmemcpy(&k, m + i, 8);\n"
+	"\t\tif ((x ^ y) & k)\n"
+	"\t\t\treturn 0;\n"
+	"\t}\n"
+	"\tfor (; i < n; i++)\n"
+	"\t\tif ((p[i] ^ q[i]) & m[i])\n"
+	"\t\t\treturn 0;\n"
+	"\n"
+	"\treturn 1;\n"
+	"}\n"
+	"\n"
+	"/* Hashing 8 bytes at a time, the hashes depend on the byte order */\n"
+	"static inline uint64_t sc2xml_hash_word(uint64_t h, uint64_t w)\n"
+	"{\n"
+	"\th = (h ^ w) * 0x9e3779b97f4a7c15ULL;\n"
+	"\n"
+	"\treturn h ^ (h >> 29);\n"
+	"}\n"
+	"\n"
+	"static inline uint64_t sc2xml_hash_block(uint64_t h, const unsigned char *p, size_t n)\n"
+	"{\n"
+	"\tuint64_t w;\n"
+	"\tsize_t i;\n"
+	"\n"
+	"\tfor (i = 0; i + 8 <= n; i += 8) {\n"
+	"\t\tmemcpy(&w, p + i, 8);\n"
+	"\t\th = sc2xml_hash_word(h, w);\n"
+	"\t}\n"
+	"\tif (i < n) {\n"
+	"\t\tw = 0;\n"
+	"\t\tmemcpy(&w, p + i, n - i);\n"
+	"\t\th = sc2xml_hash_word(h, w);\n"
+	"\t}\n"
+	"\n"
+	"\treturn h;\n"
+	"}\n"
+	"\n"
+	"static inline uint64_t sc2xml_hash_masked(uint64_t h, const unsigned char *p,\n"
+	"\t\tconst unsigned char *m, size_t n)\n"
+	"{\n"
+	"\tuint64_t w, k;\n"
+	"\tsize_t i;\n"
+	"\n"
+	"\tfor (i = 0; i + 8 <= n; i += 8) {\n"
+	"\t\tmemcpy(&w, p + i, 8);\n"
+	"\t\tmemcpy(&k, m + i, 8);\n"
+	"\t\th = sc2xml_hash_word(h, w & k);\n"
+	"\t}\n"
+	"\tif (i < n) {\n"
+	"\t\tw = k = 0;\n"
+	"\t\tmemcpy(&w, p + i, n - i);\n"
+	"\t\tmemcpy(&k, m + i, n - i);\n"
+	"\t\th = sc2xml_hash_word(h, w & k);\n"
+	"\t}\n"
+	"\n"
+	"\treturn h;\n"
+	"}\n"
+	"\n"
+	"static inline uint64_t sc2xml_hash_final(uint64_t h)\n"
+	"{\n"
+	"\th ^= h >> 33;\n"
+	"\th *= 0xff51afd7ed558ccdULL;\n"
+	"\th ^= h >> 33;\n"
+	"\th *= 0xc4ceb9fe1a85ec53ULL;\n"
+	"\n"
+	"\treturn h ^ (h >> 33);\n"
+	"}\n"
+	"#endif\n"
+	"\n";
+
+static void equal_mask_free(gpointer data)
+{
+	SCEqualMask *mask = data;
+
+	g_free(mask->mask);
+	g_free(mask);
+}
+
+/**
+ * @brief Get the ABI the functions are generated for
+ * @return The ABI, -1 if there is none
+ */
+int equal_abi_get(void)
+{
+	if (equal_abi < 0)
+		equal_abi = sc_opts.abis ? g_bit_nth_lsf(sc_opts.abis, -1) : layout_abi_host();
+
+	return equal_abi;
+}
+
+/**
+ * @brief Mark the bits of the members of a struct
+ * @param st The struct
+ * @param abi The ABI
+ * @param base Offset of st in bits
+ * @param out The mask being built
+ * @return SC_OK if everything is ok, SC_FAIL if a layout is not known
+ */
+static SCResult equal_members(SCStruct *st, SCAbi abi, guint64 base, SCEqualMask *out)
+{
+	guint i;
+
+	for (i = 0; i < st->fields->len; i++) {
+		SCField			*field = g_ptr_array_index(st->fields, i);
+		SCLayout		*layout = &field->layout[abi];
+		SCEqualMask		*other = NULL;
+		guint64			offset = base + layout->offset,
+						element,
+						used,
+						j;
+		gint64			width = 0;
+		gchar			*name,
+						*value;
+		int				pointer;
+
+		if (!layout->known)
+			return SC_FAIL;
+
+		/* Flexible array members and ':0' take no room */
+		if (layout->count == 0)
+			continue;
+		element = layout->size / layout->count;
+
+		if (field->nested) {
+			for (j = 0; j < layout->count; j++)
+				if (equal_members(field->nested, abi, offset + j * element * 8, out) != SC_OK)
+					return SC_FAIL;
+			continue;
+		}
+
+		if (field->name == NULL || *field->name == '\0')
+			continue;
+
+		/* The bits of a bit field, numbered from the least significant one */
+		if (field->bits) {
+			width = layout->bits;
+			if (offset + (guint64)width > out->size * 8)
+				return SC_FAIL;
+			for (j = offset; j < offset + (guint64)width; j++)
+				out->mask[j / 8] |= 1 << (j % 8);
+			continue;
+		}
+
+		if (offset % 8 || offset / 8 + layout->size > out->size)
+			return SC_FAIL;
+
+		name = model_type_name(field->type, &pointer);
+		if (name && !pointer && !field->func_ptr && masks)
+			other = g_hash_table_lookup(masks, name);
+		g_free(name);
+
+		value = gen_value_type(field->type);
+		used = element;
+		if (strcmp(value, "long double") == 0 && element > X87_BYTES &&
+				(abi == ABI_X86_64 || abi == ABI_I386))
+			used = X87_BYTES;
+		g_free(value);
+
+		for (j = 0; j < layout->count; j++) {
+			guchar	*dst = out->mask + offset / 8 + j * element;
+			guint64	k;
+
+			if (other && other->size == element)
+				for (k = 0; k < element; k++)
+					dst[k] |= other->mask[k];
+			else
+				memset(dst, 0xff, used);
+		}
+	}
+
+	return SC_OK;
+}
+
+/**
+ * @brief Build the mask of a top-level struct while parsing the headers,
+ *        for the structs that have fields of its type
+ * @param header The header where it is defined
+ * @param st The struct
+ * @return SC_OK
+ */
+SCResult equal_add(const char *header, SCStruct *st)
+{
+	SCEqualMask	*out;
+	gchar		*name,
+				*tag,
+				*type;
+	int			abi = equal_abi_get();
+
+	if (abi < 0 || (name = model_struct_name(st)) == NULL)
+		return SC_OK;
+
+	/* The XML has no layouts without --layout */
+	if (!sc_opts.abis)
+		layout_struct(st, header);
+
+	out = g_new0(SCEqualMask, 1);
+	out->size = st->layout[abi].size;
+	out->mask = g_malloc0(out->size ? out->size : 1);
+	if (!st->layout[abi].known || equal_members(st, abi, 0, out) != SC_OK) {
+		debug_info("Layout of '%s' in '%s' not known, it cannot be compared\n", name, header);
+		equal_mask_free(out);
+		g_free(name);
+		return SC_OK;
+	}
+	g_free(name);
+
+	if (masks == NULL) {
+		masks = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+		owned = g_ptr_array_new_with_free_func(equal_mask_free);
+	}
+	g_ptr_array_add(owned, out);
+
+	/* By the names of the fields of this type, and by the C type */
+	if ((tag = model_declarator_name(st->name)) != NULL) {
+		g_hash_table_replace(masks, g_strconcat(st->is_union ? "union " : "struct ", tag,
+			NULL), out);
+		g_free(tag);
+	}
+	if ((type = model_declarator_name(st->typedef_name)) != NULL)
+		g_hash_table_replace(masks, type, out);
+	if ((type = gen_type_name(st)) != NULL)
+		g_hash_table_replace(masks, type, out);
+
+	return SC_OK;
+}
+
+/**
+ * @brief Split a mask into the runs of bytes compared with a single call
+ * @param mask The mask
+ * @return The SCEqualRun, in order
+ */
+static GArray * equal_runs(SCEqualMask *mask)
+{
+	GArray		*runs = g_array_new(FALSE, FALSE, sizeof(SCEqualRun));
+	SCEqualRun	*last = NULL;
+	guint64		i,
+				end;
+
+	for (i = 0; i < mask->size; i = end) {
+		SCEqualRun run;
+
+		if (mask->mask[i] == 0) {
+			end = i + 1;
+			continue;
+		}
+		run.offset = i;
+		run.masked = 0;
+		for (end = i; end < mask->size && mask->mask[end]; end++)
+			run.masked |= mask->mask[end] != 0xff;
+		run.size = end - i;
+
+		/* Through the mask, rather than one more call */
+		if (last && run.offset - (last->offset + last->size) < EQUAL_GAP) {
+			last->size = run.offset + run.size - last->offset;
+			last->masked = 1;
+			continue;
+		}
+		g_array_append_val(runs, run);
+		last = &g_array_index(runs, SCEqualRun, runs->len - 1);
+	}
+
+	return runs;
+}
+
+/**
+ * @brief Write the functions of a struct
+ * @param fd The header being generated
+ * @param gen The struct
+ * @param mask Its mask
+ */
+static void equal_struct(FILE *fd, SCGenStruct *gen, SCEqualMask *mask)
+{
+	GArray	*runs = equal_runs(mask);
+	guint64	compared = 0,
+			i;
+	int		masked = 0;
+
+	for (i = 0; i < runs->len; i++)
+		masked |= g_array_index(runs, SCEqualRun, i).masked;
+	for (i = 0; i < mask->size; i++)
+		compared += mask->mask[i] != 0;
+
+	fprintf(fd, "/* %s (%s): %" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT " bytes compared "
+		"for %s */\n", gen->type, gen->header, compared, mask->size,
+		layout_abi_name(equal_abi));
+	fprintf(fd, "_Static_assert(sizeof(%s) == %" G_GUINT64_FORMAT ", \"%s is not laid out "
+		"like for %s\");\n\n", gen->type, mask->size, gen->type, layout_abi_name(equal_abi));
+
+	if (masked) {
+		fprintf(fd, "static const unsigned char %s_mask[%" G_GUINT64_FORMAT "] = {", gen->name,
+			mask->size);
+		for (i = 0; i < mask->size; i++)
+			fprintf(fd, "%s0x%02x,", i % 12 ? " " : "\n\t", mask->mask[i]);
+		fprintf(fd, "\n};\n\n");
+	}
+
+	/* Equality, the runs from the first to the last */
+	fprintf(fd, "static inline int %s_equal(const %s *a, const %s *b)\n{\n", gen->name,
+		gen->type, gen->type);
+	if (runs->len == 0)
+		fprintf(fd, "\t(void)a;\n\t(void)b;\n\n\treturn 1;\n}\n\n");
+	else {
+		fprintf(fd, "\tconst unsigned char *p = (const unsigned char *)a, "
+			"*q = (const unsigned char *)b;\n\n\treturn ");
+		for (i = 0; i < runs->len; i++) {
+			SCEqualRun *run = &g_array_index(runs, SCEqualRun, i);
+
+			if (i)
+				fprintf(fd, " &&\n\t\t");
+			if (run->masked)
+				fprintf(fd, "sc2xml_eq_masked(p + %" G_GUINT64_FORMAT ", q + %" G_GUINT64_FORMAT
+					", %s_mask + %" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ")", run->offset,
+					run->offset, gen->name, run->offset, run->size);
+			else
+				fprintf(fd, "memcmp(p + %" G_GUINT64_FORMAT ", q + %" G_GUINT64_FORMAT ", %"
+					G_GUINT64_FORMAT ") == 0", run->offset, run->offset, run->size);
+		}
+		fprintf(fd, ";\n}\n\n");
+	}
+
+	/* Hash, of the same bits */
+	fprintf(fd, "static inline uint64_t %s_hash(const %s *v, uint64_t seed)\n{\n", gen->name,
+		gen->type);
+	if (runs->len == 0)
+		fprintf(fd, "\t(void)v;\n\n\treturn sc2xml_hash_final(seed);\n}\n\n");
+	else {
+		fprintf(fd, "\tconst unsigned char *p = (const unsigned char *)v;\n"
+			"\tuint64_t h = seed;\n\n");
+		for (i = 0; i < runs->len; i++) {
+			SCEqualRun *run = &g_array_index(runs, SCEqualRun, i);
+
+			if (run->masked)
+				fprintf(fd, "\th = sc2xml_hash_masked(h, p + %" G_GUINT64_FORMAT ", %s_mask + %"
+					G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ");\n", run->offset, gen->name,
+					run->offset, run->size);
+			else
+				fprintf(fd, "\th = sc2xml_hash_block(h, p + %" G_GUINT64_FORMAT ", %"
+					G_GUINT64_FORMAT ");\n", run->offset, run->size);
+		}
+		fprintf(fd, "\n\treturn sc2xml_hash_final(h);\n}\n\n");
+	}
+
+	g_array_free(runs, TRUE);
+}
+
+/**
+ * @brief Write the equality and hash functions of the structs selected
+ * @param filename The header to generate
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult equal_write(const char *filename)
+{
+	GPtrArray	*gens = gen_structs();
+	GHashTable	*names;
+	FILE		*fd;
+	guint		i;
+
+	fd = gen_open(filename, "Equality and hash functions of the parsed structs", gens, 0);
+	if (fd == NULL)
+		return SC_FAIL;
+
+	fputs(equal_helpers, fd);
+
+	names = g_hash_table_new(g_str_hash, g_str_equal);
+	for (i = 0; i < gens->len; i++) {
+		SCGenStruct	*gen = g_ptr_array_index(gens, i);
+		SCEqualMask	*mask = masks ? g_hash_table_lookup(masks, gen->type) : NULL;
+
+		if (g_hash_table_lookup(names, gen->name)) {
+			log_error(LOG_WARN, "%s(): '%s' is defined again in '%s', skipping it",
+				__func__, gen->name, gen->header);
+			continue;
+		}
+		if (mask == NULL) {
+			log_error(LOG_WARN, "%s(): The layout of '%s' in '%s' is not known, skipping it",
+				__func__, gen->name, gen->header);
+			continue;
+		}
+		g_hash_table_insert(names, gen->name, gen);
+		equal_struct(fd, gen, mask);
+	}
+	g_hash_table_destroy(names);
+
+	return gen_close(fd, filename);
+}
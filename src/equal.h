@@ -0,0 +1,23 @@
+/**
+ * @file equal.h
+ *
+ * @brief Defines for equal.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#ifndef _EQUAL_H
+#define _EQUAL_H
+
+#include "sc2xml.h"
+#include "model.h"
+
+int			equal_abi_get(void);
+SCResult	equal_add(const char *, SCStruct *);
+SCResult	equal_write(const char *);
+
+#endif	/* _EQUAL_H */
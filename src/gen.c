@@ -0,0 +1,389 @@
+/**
+ * @file gen.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * @brief Common part of the code generators (--soa, --reflect, ...). The
+ *        structs selected with --select, or all the named ones, are copied
+ *        while parsing and the generators write their headers at the end.
+ *        The generated headers include the parsed ones, so the sizes of the
+ *        arrays are left to the compiler (sizeof) instead of being taken
+ *        from the expressions found in the headers.
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "config.h"
+#include "sc2xml.h"
+#include "misc.h"
+#include "model.h"
+#include "gen.h"
+
+static GHashTable	*selected = NULL;	/**< Names given to --select, NULL for all */
+static GPtrArray	*structs = NULL;	/**< SCGenStruct, in the order they were parsed */
+
+/**
+ * @brief Free a copied struct
+ */
+static void gen_struct_free(gpointer data)
+{
+	SCGenStruct *gen = data;
+
+	g_free(gen->header);
+	g_free(gen->name);
+	g_free(gen->type);
+	model_struct_free(gen->st);
+	g_free(gen);
+}
+
+/**
+ * @brief Set the structs to generate code for
+ * @param list Comma separated names, as in model_struct_name()
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult gen_select(const char *list)
+{
+	gchar	**names;
+	int		i;
+
+	if (selected == NULL)
+		selected = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+	names = g_strsplit(list, ",", -1);
+	for (i = 0; names[i] != NULL; i++) {
+		g_strstrip(names[i]);
+		if (*names[i] != '\0')
+			g_hash_table_insert(selected, g_strdup(names[i]), GINT_TO_POINTER(1));
+	}
+	g_strfreev(names);
+
+	if (g_hash_table_size(selected) == 0) {
+		log_error(LOG_ERR, "%s(): No struct given to --select", __func__);
+		return SC_FAIL;
+	}
+
+	return SC_OK;
+}
+
+/**
+ * @brief Get the C type of a top-level struct/union
+ * @param st The struct
+ * @return 'struct tag' or the typedef name, NULL for an anonymous struct.
+ *         Free it with g_free()
+ */
+gchar * gen_type_name(SCStruct *st)
+{
+	gchar *name;
+
+	if ((name = model_declarator_name(st->name)) != NULL) {
+		gchar *type = g_strdup_printf("%s %s", st->is_union ? "union" : "struct", name);
+
+		g_free(name);
+		return type;
+	}
+
+	/* 'typedef struct { ... } name;' */
+	if ((name = model_declarator_name(st->typedef_name)) != NULL)
+		return name;
+
+	return model_declarator_name(st->tail_name);
+}
+
+/**
+ * @brief Copy a top-level struct for the generators if it was selected
+ * @param header The header where it is defined
+ * @param st The struct
+ */
+void gen_add(const char *header, SCStruct *st)
+{
+	SCGenStruct	*gen;
+	gchar		*name = model_struct_name(st);
+
+	if (name == NULL || (selected && !g_hash_table_lookup(selected, name))) {
+		g_free(name);
+		return;
+	}
+
+	if (structs == NULL)
+		structs = g_ptr_array_new_with_free_func(gen_struct_free);
+
+	gen = g_new0(SCGenStruct, 1);
+	gen->header = g_strdup(header);
+	gen->name = name;
+	gen->type = gen_type_name(st);
+	gen->st = model_struct_copy(st, NULL);
+	g_ptr_array_add(structs, gen);
+}
+
+/**
+ * @brief Get the structs copied by gen_add()
+ * @return The SCGenStruct, never NULL
+ */
+GPtrArray * gen_structs(void)
+{
+	if (structs == NULL)
+		structs = g_ptr_array_new_with_free_func(gen_struct_free);
+
+	if (selected) {
+		GHashTableIter	iter;
+		gpointer		name;
+		guint			i;
+
+		/* Tell about the names that were not found */
+		g_hash_table_iter_init(&iter, selected);
+		while (g_hash_table_iter_next(&iter, &name, NULL)) {
+			for (i = 0; i < structs->len; i++)
+				if (strcmp(((SCGenStruct *)g_ptr_array_index(structs, i))->name, name) == 0)
+					break;
+			if (i == structs->len)
+				log_error(LOG_WARN, "%s(): No struct/union '%s' to generate code for",
+					__func__, (char *)name);
+		}
+	}
+
+	return structs;
+}
+
+/**
+ * @brief Free a member
+ */
+static void gen_member_free(gpointer data)
+{
+	SCGenMember *member = data;
+
+	g_free(member->path);
+	g_free(member->id);
+	g_free(member->type);
+	g_free(member);
+}
+
+/**
+ * @brief Get the name a nested struct/union is declared with
+ * @param nested The nested struct/union
+ * @param array Set to 1 if it is an array, 0 otherwise
+ * @return The name, NULL if it has no declarator. Free it with g_free()
+ */
+gchar * gen_nested_name(SCStruct *nested, int *array)
+{
+	const char	*texts[4];
+	gchar		*name;
+	int			i;
+
+	/* Where the parser left the declarator, e.g. 'hola [ 10 ]' */
+	texts[0] = nested->nested_name;
+	texts[1] = nested->typedef_name;
+	texts[2] = nested->tail_name;
+	texts[3] = nested->attributes && !strstr(nested->attributes, "__attribute__") ?
+				nested->attributes : NULL;
+
+	*array = 0;
+	for (i = 0; i < 4; i++) {
+		if ((name = model_declarator_name(texts[i])) != NULL) {
+			*array = strchr(texts[i], '[') != NULL;
+			return name;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Flatten the members of a struct, see gen_members()
+ */
+static void gen_flatten(SCStruct *st, const char *prefix, GPtrArray *members)
+{
+	guint i;
+
+	for (i = 0; i < st->fields->len; i++) {
+		SCField		*field = g_ptr_array_index(st->fields, i);
+		SCGenMember	*member;
+		gchar		*name;
+
+		if (field->nested) {
+			SCStruct	*nested = field->nested;
+			int			array;
+
+			/* 'struct tag { ... };' only declares the type, while the members
+			 * of an anonymous struct/union are members of the enclosing one */
+			if ((name = gen_nested_name(nested, &array)) == NULL) {
+				if (nested->name == NULL)
+					gen_flatten(nested, prefix, members);
+				continue;
+			}
+
+			member = g_new0(SCGenMember, 1);
+			member->kind = GEN_NESTED;
+			member->nested = nested;
+			member->array = array;
+			if (nested->name)
+				member->type = g_strdup_printf("%s %s",
+					nested->is_union ? "union" : "struct", nested->name);
+		}
+		else {
+			name = g_strdup(field->name ? field->name : "");
+			if (*name == '\0') {
+				g_free(name);
+				continue;
+			}
+
+			member = g_new0(SCGenMember, 1);
+			member->field = field;
+			member->type = g_strdup(field->type);
+			member->array = field->size != NULL;
+
+			if (field->func_ptr)
+				member->kind = GEN_FUNC_PTR;
+			else if (field->bits)
+				member->kind = GEN_BITS;
+			else if (field->size && *field->size == '\0')
+				member->kind = GEN_FLEXIBLE;
+			else
+				member->kind = GEN_SCALAR;
+		}
+
+		member->path = g_strconcat(prefix, name, NULL);
+		member->id = g_strdelimit(g_strdup(member->path), ".", '_');
+		g_ptr_array_add(members, member);
+		g_free(name);
+	}
+}
+
+/**
+ * @brief Get the members of a struct to generate code for. The members of
+ *        anonymous nested structs/unions are taken as members of the struct,
+ *        named nested ones are a single member.
+ * @param st The struct
+ * @return The SCGenMember, to be freed with g_ptr_array_free()
+ */
+GPtrArray * gen_members(SCStruct *st)
+{
+	GPtrArray *members = g_ptr_array_new_with_free_func(gen_member_free);
+
+	gen_flatten(st, "", members);
+
+	return members;
+}
+
+/**
+ * @brief Get a type without its top-level qualifiers, so values of the
+ *        type can be stored: 'const int' is 'int', 'const char *' is kept
+ * @param type The type
+ * @return The type, to be freed with g_free()
+ */
+gchar * gen_value_type(const char *type)
+{
+	gchar	**tokens;
+	GString	*value;
+	int		i;
+
+	if (strchr(type, '*'))
+		return g_strdup(type);
+
+	tokens = g_strsplit(type, " ", -1);
+	value = g_string_new(NULL);
+	for (i = 0; tokens[i] != NULL; i++) {
+		if (*tokens[i] == '\0' || strcmp(tokens[i], "const") == 0 ||
+				strcmp(tokens[i], "volatile") == 0)
+			continue;
+		g_string_append_printf(value, "%s%s", value->len ? " " : "", tokens[i]);
+	}
+	g_strfreev(tokens);
+
+	return g_string_free(value, FALSE);
+}
+
+/**
+ * @brief Create a generated header: a banner, the include guard and the
+ *        parsed headers with the structs
+ * @param filename The header to create
+ * @param what What the header contains, for the banner
+ * @param gens The SCGenStruct the code is generated for
+ * @param flags GEN_CPLUSPLUS for C++ code, GEN_NEXT_TO if the header is
+ *        written next to the parsed ones
+ * @return The stream, NULL on error
+ */
+FILE * gen_open(const char *filename, const char *what, GPtrArray *gens, int flags)
+{
+	FILE		*fd;
+	GHashTable	*included;
+	gchar		*base,
+				*guard;
+	guint		i;
+
+	fd = fopen(filename, "w");
+	if (fd == NULL) {
+		log_error(LOG_ERR, "%s(): Could not create '%s'", __func__, filename);
+		return NULL;
+	}
+
+	base = g_path_get_basename(filename);
+	guard = g_ascii_strup(base, -1);
+	g_strcanon(guard, "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789", '_');
+
+	fprintf(fd, "/**\n * @file %s\n *\n * @brief %s\n *\n", base, what);
+	fprintf(fd, " * Generated by %s, do not edit.\n */\n\n", PACKAGE_STRING);
+	fprintf(fd, "#ifndef _%s\n#define _%s\n\n", guard, guard);
+	if (flags & GEN_CPLUSPLUS)
+		fprintf(fd, "#include <cstddef>\n#include <tuple>\n#include <type_traits>\n"
+					"#include <utility>\n\nextern \"C\" {\n");
+	else
+		fprintf(fd, "#include <stddef.h>\n#include <stdlib.h>\n#include <string.h>\n\n");
+
+	included = g_hash_table_new(g_str_hash, g_str_equal);
+	for (i = 0; i < gens->len; i++) {
+		SCGenStruct *gen = g_ptr_array_index(gens, i);
+
+		if (g_hash_table_lookup(included, gen->header))
+			continue;
+		g_hash_table_insert(included, gen->header, gen->header);
+
+		if (flags & GEN_NEXT_TO) {
+			gchar *header = g_path_get_basename(gen->header);
+
+			fprintf(fd, "#include \"%s\"\n", header);
+			g_free(header);
+		}
+		else
+			fprintf(fd, "#include \"%s\"\n", gen->header);
+	}
+	g_hash_table_destroy(included);
+	fputs(flags & GEN_CPLUSPLUS ? "}\n\n" : "\n", fd);
+
+	g_free(base);
+	g_free(guard);
+
+	return fd;
+}
+
+/**
+ * @brief Close a generated header
+ * @param fd The stream returned by gen_open()
+ * @param filename The header
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult gen_close(FILE *fd, const char *filename)
+{
+	gchar	*base = g_path_get_basename(filename),
+			*guard = g_ascii_strup(base, -1);
+	int		rc;
+
+	g_strcanon(guard, "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789", '_');
+	fprintf(fd, "#endif\t/* _%s */\n", guard);
+	g_free(base);
+	g_free(guard);
+
+	rc = ferror(fd);
+	if (fclose(fd) != 0 || rc) {
+		log_error(LOG_ERR, "%s(): Could not write '%s'", __func__, filename);
+		return SC_FAIL;
+	}
+
+	return SC_OK;
+}
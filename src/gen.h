@@ -0,0 +1,63 @@
+/**
+ * @file gen.h
+ *
+ * @brief Defines for gen.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#ifndef _GEN_H
+#define _GEN_H
+
+#include <stdio.h>
+#include <glib.h>
+
+#include "sc2xml.h"
+#include "model.h"
+
+#define GEN_CPLUSPLUS	0x01	/**< gen_open(): C++ code */
+#define GEN_NEXT_TO		0x02	/**< gen_open(): next to the parsed headers */
+
+/* A struct/union to generate code for */
+typedef struct {
+	gchar *header;			/**< Parsed header that defines it */
+	gchar *name;			/**< See model_struct_name(), used to name the code */
+	gchar *type;			/**< C type, see gen_type_name() */
+	SCStruct *st;			/**< Copy of the struct */
+} SCGenStruct;
+
+/* How a member is accessed */
+typedef enum {
+	GEN_SCALAR,				/**< A value or an array of values */
+	GEN_BITS,				/**< A bit field, it has no address */
+	GEN_FUNC_PTR,			/**< A function pointer or an array of them */
+	GEN_NESTED,				/**< A named nested struct/union */
+	GEN_FLEXIBLE			/**< A flexible array member, it has no size */
+} SCGenKind;
+
+/* A member of a struct to generate code for */
+typedef struct {
+	SCGenKind kind;
+	gchar *path;			/**< Expression to access it, e.g. 'a.b' */
+	gchar *id;				/**< Identifier made of the path, e.g. 'a_b' */
+	gchar *type;			/**< Its type, NULL for an anonymous struct/union */
+	int array;				/**< 1 if it is an array */
+	SCField *field;			/**< The field, NULL for GEN_NESTED */
+	SCStruct *nested;		/**< The struct/union of GEN_NESTED */
+} SCGenMember;
+
+SCResult	gen_select(const char *);
+void		gen_add(const char *, SCStruct *);
+GPtrArray *	gen_structs(void);
+gchar *		gen_type_name(SCStruct *);
+gchar *		gen_nested_name(SCStruct *, int *);
+GPtrArray *	gen_members(SCStruct *);
+gchar *		gen_value_type(const char *);
+FILE *		gen_open(const char *, const char *, GPtrArray *, int);
+SCResult	gen_close(FILE *, const char *);
+
+#endif	/* _GEN_H */
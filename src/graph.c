@@ -0,0 +1,594 @@
+/**
+ * @file graph.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * @brief Type dependency graph. While parsing, every top-level struct/union
+ *        adds an edge to each type used by its fields, including the fields
+ *        of its nested structs. The nodes are named like in C: 'struct tag',
+ *        'union tag', 'enum tag' or the typedef name. A typedef'ed struct
+ *        is a node for the typedef that depends on the node of the tag.
+ *        Builtin types are not nodes.
+ *
+ *        The graph is written with both its forward (dependencies) and
+ *        reverse (dependents) adjacency arrays, so the queries just walk
+ *        the arrays. The layout of the file is:
+ *
+ *        header:   "SC2XMLGR", u32 version, u32 nodes, u32 edges,
+ *                  u32 size of the strings
+ *        nodes:    per node: u32 name, u32 header (offsets in the strings,
+ *                  the header is "" if the type is not defined in the tree)
+ *        forward:  u32 offsets[nodes + 1], u32 targets[edges]
+ *        reverse:  u32 offsets[nodes + 1], u32 targets[edges]
+ *        strings:  NUL terminated
+ *
+ *        The edges of node n are targets[offsets[n]] to
+ *        targets[offsets[n + 1] - 1]. A target with GRAPH_POINTER set is
+ *        only used through a pointer. All the integers are little endian.
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "config.h"
+#include "sc2xml.h"
+#include "misc.h"
+#include "model.h"
+#include "graph.h"
+
+#define GRAPH_HEADER_SIZE	24	/**< Magic, version, nodes, edges, strings */
+
+/* An edge while parsing */
+typedef struct graph_edge_st {
+	guint32 from;			/**< The node that uses the type */
+	guint32 to;				/**< The type, with GRAPH_POINTER if only pointed to */
+} SCGraphEdge;
+
+/* A graph file loaded for a query */
+typedef struct graph_st {
+	gchar *data;			/**< The whole file */
+	guint32 nodes;			/**< Number of nodes */
+	guint32 edges;			/**< Number of edges */
+	const guchar *table;	/**< Name and header of every node */
+	const guchar *fwd_offsets;
+	const guchar *fwd_targets;
+	const guchar *rev_offsets;
+	const guchar *rev_targets;
+	const char *strings;
+	guint32 strings_size;
+} SCGraph;
+
+static GHashTable	*node_ids = NULL;	/**< name -> node + 1 */
+static GPtrArray	*node_names = NULL;	/**< Name of every node */
+static GPtrArray	*node_headers = NULL;	/**< Defining header or NULL */
+static GArray		*edges = NULL;		/**< SCGraphEdge */
+
+/**
+ * @brief Get the node of a type, adding it if needed
+ * @param name The type
+ * @param header The header where the type is defined or NULL if it is
+ *        only used
+ * @return The node
+ */
+static guint32 graph_node(const char *name, const char *header)
+{
+	guint32 node;
+
+	if (node_ids == NULL) {
+		node_ids = g_hash_table_new(g_str_hash, g_str_equal);
+		node_names = g_ptr_array_new();
+		node_headers = g_ptr_array_new();
+		edges = g_array_new(FALSE, FALSE, sizeof(SCGraphEdge));
+	}
+
+	node = GPOINTER_TO_UINT(g_hash_table_lookup(node_ids, name));
+	if (node == 0) {
+		g_ptr_array_add(node_names, g_strdup(name));
+		g_ptr_array_add(node_headers, NULL);
+		node = node_names->len;
+		g_hash_table_insert(node_ids, g_ptr_array_index(node_names, node - 1),
+			GUINT_TO_POINTER(node));
+	}
+	node--;
+
+	/* The first definition wins */
+	if (header && g_ptr_array_index(node_headers, node) == NULL)
+		g_ptr_array_index(node_headers, node) = g_strdup(header);
+
+	return node;
+}
+
+static void graph_edge(guint32 from, guint32 to, int pointer)
+{
+	SCGraphEdge edge;
+
+	edge.from = from;
+	edge.to = to | (pointer ? GRAPH_POINTER : 0);
+	g_array_append_val(edges, edge);
+}
+
+/**
+ * @brief Add an edge from a node to the type of every field of a struct
+ *        and of its nested structs
+ */
+static void graph_add_fields(guint32 from, SCStruct *st)
+{
+	gchar	*name;
+	int		pointer;
+	guint	i;
+
+	for (i = 0; i < st->fields->len; i++) {
+		SCField *field = g_ptr_array_index(st->fields, i);
+
+		if (field->nested) {
+			graph_add_fields(from, field->nested);
+			continue;
+		}
+
+		/* The return type of a function ptr is not part of the struct */
+		if (field->func_ptr)
+			continue;
+
+		if ((name = model_type_name(field->type, &pointer)) == NULL)
+			continue;
+		graph_edge(from, graph_node(name, NULL), pointer);
+		g_free(name);
+	}
+}
+
+/**
+ * @brief Add a top-level struct/union to the graph
+ * @param xml_filename The XML file being written, the header is the XML
+ *        filename without '.xml'
+ * @param st The struct
+ * @return SC_OK
+ */
+SCResult graph_add_struct(const char *xml_filename, SCStruct *st)
+{
+	gchar		*header,
+				*tag,
+				*type_name,
+				*name;
+	guint32		node = 0;
+	gboolean	has_node = FALSE;
+
+	header = g_strndup(xml_filename, strlen(xml_filename) - 4);
+	tag = model_declarator_name(st->name);
+
+	/* 'typedef struct {...} my_type;' gives the name after the members */
+	if ((type_name = model_declarator_name(st->typedef_name)) == NULL)
+		type_name = model_declarator_name(st->tail_name);
+
+	if (tag) {
+		name = g_strconcat(st->is_union ? "union " : "struct ", tag, NULL);
+		node = graph_node(name, header);
+		has_node = TRUE;
+		g_free(name);
+	}
+
+	if (type_name) {
+		guint32 def = graph_node(type_name, header);
+
+		if (has_node)
+			graph_edge(def, node, 0);
+		else
+			node = def;
+		has_node = TRUE;
+	}
+
+	/* Anonymous structs cannot be used by other types */
+	if (has_node)
+		graph_add_fields(node, st);
+
+	g_free(header);
+	g_free(tag);
+	g_free(type_name);
+
+	return SC_OK;
+}
+
+static gint graph_edge_cmp(gconstpointer a, gconstpointer b)
+{
+	const SCGraphEdge	*ea = (const SCGraphEdge *)a,
+						*eb = (const SCGraphEdge *)b;
+	guint32				ta = ea->to & ~GRAPH_POINTER,
+						tb = eb->to & ~GRAPH_POINTER;
+
+	if (ea->from != eb->from)
+		return ea->from < eb->from ? -1 : 1;
+	if (ta != tb)
+		return ta < tb ? -1 : 1;
+
+	/* Embedding first, so it is the edge kept */
+	return (ea->to & GRAPH_POINTER) ? ((eb->to & GRAPH_POINTER) ? 0 : 1) :
+		((eb->to & GRAPH_POINTER) ? -1 : 0);
+}
+
+static void append_u32(GByteArray *buff, guint32 val)
+{
+	guchar bytes[4];
+
+	put_u32(bytes, val);
+	g_byte_array_append(buff, bytes, 4);
+}
+
+/**
+ * @brief Write the graph of all the parsed headers
+ * @param filename The graph file
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult graph_write(const char *filename)
+{
+	GByteArray	*buff;
+	GString		*strings;
+	guint32		nodes = node_names ? node_names->len : 0,
+				count = 0,
+				*offsets,
+				*fill,
+				*reverse;
+	SCGraphEdge	*edge;
+	guint		i;
+	SCResult	rc = SC_OK;
+
+	/* One edge per pair of types, embedding wins over pointer */
+	if (edges) {
+		g_array_sort(edges, graph_edge_cmp);
+		for (i = 0; i < edges->len; i++) {
+			edge = &g_array_index(edges, SCGraphEdge, i);
+			if (count > 0) {
+				SCGraphEdge *prev = &g_array_index(edges, SCGraphEdge, count - 1);
+
+				if (prev->from == edge->from &&
+						(prev->to & ~GRAPH_POINTER) == (edge->to & ~GRAPH_POINTER))
+					continue;
+			}
+			g_array_index(edges, SCGraphEdge, count++) = *edge;
+		}
+		g_array_set_size(edges, count);
+	}
+
+	buff = g_byte_array_new();
+	strings = g_string_new(NULL);
+
+	g_byte_array_append(buff, (guchar *)GRAPH_MAGIC, 8);
+	append_u32(buff, GRAPH_VERSION);
+	append_u32(buff, nodes);
+	append_u32(buff, count);
+	append_u32(buff, 0);			/* Size of the strings, set below */
+
+	for (i = 0; i < nodes; i++) {
+		const char *header = g_ptr_array_index(node_headers, i);
+
+		append_u32(buff, strings->len);
+		g_string_append_len(strings, g_ptr_array_index(node_names, i),
+			strlen(g_ptr_array_index(node_names, i)) + 1);
+		append_u32(buff, strings->len);
+		g_string_append_len(strings, header ? header : "",
+			(header ? strlen(header) : 0) + 1);
+	}
+
+	/* Forward: the edges are already sorted by their source */
+	offsets = g_new0(guint32, nodes + 1);
+	for (i = 0; i < count; i++)
+		offsets[g_array_index(edges, SCGraphEdge, i).from + 1]++;
+	for (i = 0; i < nodes; i++)
+		offsets[i + 1] += offsets[i];
+	for (i = 0; i <= nodes; i++)
+		append_u32(buff, offsets[i]);
+	for (i = 0; i < count; i++)
+		append_u32(buff, g_array_index(edges, SCGraphEdge, i).to);
+
+	/* Reverse: counting sort by target */
+	memset(offsets, 0, (nodes + 1) * sizeof(guint32));
+	for (i = 0; i < count; i++)
+		offsets[(g_array_index(edges, SCGraphEdge, i).to & ~GRAPH_POINTER) + 1]++;
+	for (i = 0; i < nodes; i++)
+		offsets[i + 1] += offsets[i];
+
+	fill = g_new(guint32, nodes + 1);
+	memcpy(fill, offsets, (nodes + 1) * sizeof(guint32));
+	reverse = g_new0(guint32, count + 1);
+	for (i = 0; i < count; i++) {
+		edge = &g_array_index(edges, SCGraphEdge, i);
+		reverse[fill[edge->to & ~GRAPH_POINTER]++] = edge->from |
+			(edge->to & GRAPH_POINTER);
+	}
+
+	for (i = 0; i <= nodes; i++)
+		append_u32(buff, offsets[i]);
+	for (i = 0; i < count; i++)
+		append_u32(buff, reverse[i]);
+
+	g_byte_array_append(buff, (guchar *)strings->str, strings->len);
+	put_u32(buff->data + 20, strings->len);
+
+	if (sc_opts.if_changed)
+		rc = write_if_changed(filename, (const char *)buff->data, buff->len, NULL);
+	else if (!g_file_set_contents(filename, (const char *)buff->data, buff->len, NULL))
+		rc = SC_FAIL;
+
+	if (rc != SC_OK)
+		log_error(LOG_ERR, "%s(): Could not write the graph '%s'", __func__, filename);
+
+	g_free(offsets);
+	g_free(fill);
+	g_free(reverse);
+	g_string_free(strings, TRUE);
+	g_byte_array_free(buff, TRUE);
+
+	return rc;
+}
+
+/**
+ * @brief Load a graph file
+ * @param filename The graph file
+ * @param graph Filled with the arrays of the file
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+static SCResult graph_load(const char *filename, SCGraph *graph)
+{
+	gsize			length;
+	const guchar	*ptr;
+	guint64			expected;
+
+	memset(graph, 0, sizeof(SCGraph));
+
+	if (!g_file_get_contents(filename, &graph->data, &length, NULL)) {
+		log_error(LOG_ERR, "%s(): Could not read '%s'", __func__, filename);
+		return SC_FAIL;
+	}
+
+	ptr = (const guchar *)graph->data;
+	if (length < GRAPH_HEADER_SIZE || memcmp(ptr, GRAPH_MAGIC, 8) != 0 ||
+			get_u32(ptr + 8) != GRAPH_VERSION)
+		goto error;
+
+	graph->nodes = get_u32(ptr + 12);
+	graph->edges = get_u32(ptr + 16);
+	graph->strings_size = get_u32(ptr + 20);
+
+	expected = GRAPH_HEADER_SIZE + 8 * (guint64)graph->nodes +
+		2 * 4 * ((guint64)graph->nodes + 1 + graph->edges) + graph->strings_size;
+	if (expected != length)
+		goto error;
+
+	ptr += GRAPH_HEADER_SIZE;
+	graph->table = ptr;
+	ptr += 8 * graph->nodes;
+	graph->fwd_offsets = ptr;
+	ptr += 4 * (graph->nodes + 1);
+	graph->fwd_targets = ptr;
+	ptr += 4 * graph->edges;
+	graph->rev_offsets = ptr;
+	ptr += 4 * (graph->nodes + 1);
+	graph->rev_targets = ptr;
+	ptr += 4 * graph->edges;
+	graph->strings = (const char *)ptr;
+
+	if (graph->strings_size == 0 || graph->strings[graph->strings_size - 1] != '\0')
+		goto error;
+
+	return SC_OK;
+
+error:
+	log_error(LOG_ERR, "%s(): '%s' is not a valid graph", __func__, filename);
+	g_free(graph->data);
+	graph->data = NULL;
+	return SC_FAIL;
+}
+
+static const char * graph_string(SCGraph *graph, guint32 offset)
+{
+	return offset < graph->strings_size ? graph->strings + offset : "";
+}
+
+static const char * graph_name(SCGraph *graph, guint32 node)
+{
+	return graph_string(graph, get_u32(graph->table + 8 * node));
+}
+
+static const char * graph_header(SCGraph *graph, guint32 node)
+{
+	return graph_string(graph, get_u32(graph->table + 8 * node + 4));
+}
+
+/**
+ * @brief Find the node of a type. A plain tag also finds its struct or union.
+ * @return The node or -1 if there is no such type
+ */
+static gint64 graph_find(SCGraph *graph, const char *name)
+{
+	gchar	*as_struct,
+			*as_union;
+	gint64	found = -1;
+	guint32	i;
+
+	as_struct = g_strconcat("struct ", name, NULL);
+	as_union = g_strconcat("union ", name, NULL);
+
+	for (i = 0; i < graph->nodes && found < 0; i++)
+		if (strcmp(graph_name(graph, i), name) == 0)
+			found = i;
+	for (i = 0; i < graph->nodes && found < 0; i++)
+		if (strcmp(graph_name(graph, i), as_struct) == 0 ||
+				strcmp(graph_name(graph, i), as_union) == 0)
+			found = i;
+
+	g_free(as_struct);
+	g_free(as_union);
+
+	return found;
+}
+
+static void graph_print(SCGraph *graph, guint32 node, guint depth)
+{
+	const char *header = graph_header(graph, node);
+
+	if (*header)
+		printf("%u\t%s\t%s\n", depth, graph_name(graph, node), header);
+	else
+		printf("%u\t%s\n", depth, graph_name(graph, node));
+}
+
+/**
+ * @brief Breadth-first walk from a type, printing every type reached with
+ *        its distance
+ * @param filename The graph file
+ * @param name The type
+ * @param reverse Follow the reverse edges
+ * @param embedded Do not follow the edges of types only pointed to
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+static SCResult graph_walk(const char *filename, const char *name, int reverse,
+		int embedded)
+{
+	SCGraph			graph;
+	const guchar	*offsets,
+					*targets;
+	guint32			*queue,
+					*depth,
+					head = 0,
+					tail = 0,
+					i;
+	guint8			*seen;
+	gint64			start;
+
+	if (graph_load(filename, &graph) != SC_OK)
+		return SC_FAIL;
+
+	if ((start = graph_find(&graph, name)) < 0) {
+		log_error(LOG_ERR, "%s(): Unknown type '%s'", __func__, name);
+		g_free(graph.data);
+		return SC_FAIL;
+	}
+
+	offsets = reverse ? graph.rev_offsets : graph.fwd_offsets;
+	targets = reverse ? graph.rev_targets : graph.fwd_targets;
+
+	queue = g_new(guint32, graph.nodes);
+	depth = g_new(guint32, graph.nodes);
+	seen = g_new0(guint8, graph.nodes);
+
+	queue[tail++] = start;
+	depth[start] = 0;
+	seen[start] = 1;
+
+	while (head < tail) {
+		guint32 node = queue[head++];
+
+		for (i = get_u32(offsets + 4 * node); i < get_u32(offsets + 4 * (node + 1)); i++) {
+			guint32 target = get_u32(targets + 4 * i);
+
+			if (embedded && (target & GRAPH_POINTER))
+				continue;
+			target &= ~GRAPH_POINTER;
+			if (target >= graph.nodes || seen[target])
+				continue;
+
+			seen[target] = 1;
+			depth[target] = depth[node] + 1;
+			queue[tail++] = target;
+			graph_print(&graph, target, depth[target]);
+		}
+	}
+
+	g_free(queue);
+	g_free(depth);
+	g_free(seen);
+	g_free(graph.data);
+
+	return SC_OK;
+}
+
+/**
+ * @brief Print every type that uses a type, directly or not
+ * @param filename The graph file
+ * @param name The type
+ * @param embedded Only the types that contain it, not through pointers
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult graph_dependents(const char *filename, const char *name, int embedded)
+{
+	return graph_walk(filename, name, 1, embedded);
+}
+
+/**
+ * @brief Print every type used by a type, directly or not
+ * @param filename The graph file
+ * @param name The type
+ * @param embedded Only the types it contains, not through pointers
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult graph_dependencies(const char *filename, const char *name, int embedded)
+{
+	return graph_walk(filename, name, 0, embedded);
+}
+
+/**
+ * @brief Print the types in an order where every type comes after the
+ *        types it contains. Types only pointed to do not need to come first,
+ *        so the pointer edges are not followed. The types left in a cycle
+ *        are printed at the end.
+ * @param filename The graph file
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult graph_topo(const char *filename)
+{
+	SCGraph		graph;
+	guint32		*pending,
+				*queue,
+				head = 0,
+				tail = 0,
+				node,
+				i;
+
+	if (graph_load(filename, &graph) != SC_OK)
+		return SC_FAIL;
+
+	/* Number of contained types not printed yet */
+	pending = g_new0(guint32, graph.nodes);
+	queue = g_new(guint32, graph.nodes);
+
+	for (node = 0; node < graph.nodes; node++) {
+		for (i = get_u32(graph.fwd_offsets + 4 * node);
+				i < get_u32(graph.fwd_offsets + 4 * (node + 1)); i++)
+			if (!(get_u32(graph.fwd_targets + 4 * i) & GRAPH_POINTER))
+				pending[node]++;
+		if (pending[node] == 0)
+			queue[tail++] = node;
+	}
+
+	while (head < tail) {
+		node = queue[head++];
+		printf("%s\n", graph_name(&graph, node));
+
+		for (i = get_u32(graph.rev_offsets + 4 * node);
+				i < get_u32(graph.rev_offsets + 4 * (node + 1)); i++) {
+			guint32 source = get_u32(graph.rev_targets + 4 * i);
+
+			if (source & GRAPH_POINTER)
+				continue;
+			if (source < graph.nodes && --pending[source] == 0)
+				queue[tail++] = source;
+		}
+	}
+
+	if (tail < graph.nodes) {
+		log_error(LOG_WARN, "%u types contain each other", graph.nodes - tail);
+		for (node = 0; node < graph.nodes; node++)
+			if (pending[node])
+				printf("%s\n", graph_name(&graph, node));
+	}
+
+	g_free(pending);
+	g_free(queue);
+	g_free(graph.data);
+
+	return SC_OK;
+}
@@ -0,0 +1,29 @@
+/**
+ * @file graph.h
+ *
+ * @brief Defines for graph.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#ifndef _GRAPH_H
+#define _GRAPH_H
+
+#include "sc2xml.h"
+#include "model.h"
+
+#define GRAPH_MAGIC		"SC2XMLGR"	/**< First bytes of a graph file */
+#define GRAPH_VERSION	1			/**< Version of the format */
+#define GRAPH_POINTER	0x80000000	/**< Edge flag: the type is only pointed to */
+
+SCResult	graph_add_struct(const char *, SCStruct *);
+SCResult	graph_write(const char *);
+SCResult	graph_dependents(const char *, const char *, int);
+SCResult	graph_dependencies(const char *, const char *, int);
+SCResult	graph_topo(const char *);
+
+#endif	/* _GRAPH_H */
@@ -0,0 +1,202 @@
+/**
+ * @file index.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * @brief Sidecar offset index. While the XML file is written, the byte
+ *        offset and length of every top-level <struct>/<union> element is
+ *        recorded together with the names it can be looked up by. When the
+ *        document is closed the entries are written to <file>.xml.idx, one
+ *        per line:
+ *
+ *        name kind offset length
+ *
+ *        where kind is 'struct', 'union' or 'typedef'. A consumer can then
+ *        seek to the offset and parse only the element it needs.
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "config.h"
+#include "sc2xml.h"
+#include "misc.h"
+#include "index.h"
+#include "archive.h"
+
+typedef struct index_entry_st {
+	char *name;			/**< struct/union tag or typedef name */
+	const char *kind;	/**< 'struct', 'union' or 'typedef' */
+	long offset;		/**< Byte offset of the element in the XML file */
+	long length;		/**< Length of the element in bytes */
+} SCIndexEntry;
+
+static GList		*entries = NULL;	/**< Finished entries of the document */
+static GList		*pending = NULL;	/**< Entries of the element being written */
+static const char	*element_kind;		/**< Kind of the element being written */
+static long			element_start = -1;	/**< Offset of the element being written */
+
+/**
+ * @brief Free an entry of the index
+ * @param data The SCIndexEntry to free
+ * @param user_data NULL
+ */
+static void free_entry(gpointer data, gpointer user_data)
+{
+	SCIndexEntry *entry = (SCIndexEntry *)data;
+
+	g_free(entry->name);
+	g_free(entry);
+}
+
+/**
+ * @brief Discard all the entries. Called when a new XML file is created.
+ */
+void index_reset(void)
+{
+	g_list_foreach(entries, free_entry, NULL);
+	g_list_free(entries);
+	entries = NULL;
+
+	g_list_foreach(pending, free_entry, NULL);
+	g_list_free(pending);
+	pending = NULL;
+
+	element_kind = NULL;
+	element_start = -1;
+}
+
+/**
+ * @brief A top-level element starts
+ * @param kind 'struct' or 'union'
+ * @param offset Byte offset of the '<' that opens the element
+ * @return SC_OK
+ */
+SCResult index_element_start(const char *kind, long offset)
+{
+	element_kind = kind;
+	element_start = offset;
+
+	return SC_OK;
+}
+
+/**
+ * @brief Add a name to the element being written. Typedef names may come
+ *        with attributes like '__attribute__ ( ( packed ) ) name', so
+ *        only the last token is used.
+ * @param kind 'typedef' or NULL to use the kind of the element
+ * @param text The name as written in the XML file
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult index_element_name(const char *kind, const char *text)
+{
+	SCIndexEntry	*entry;
+	gchar			**tokens;
+	gint			n;
+
+	if (element_start < 0 || text == NULL)
+		return SC_FAIL;
+
+	tokens = g_strsplit(text, " ", -1);
+	for (n = 0; tokens[n] != NULL; n++);
+	while (n > 0 && *tokens[n - 1] == '\0')
+		n--;
+
+	if (n == 0) {
+		g_strfreev(tokens);
+		return SC_OK;
+	}
+
+	entry = g_new0(SCIndexEntry, 1);
+	entry->name = g_strdup(tokens[n - 1]);
+	entry->kind = kind ? kind : element_kind;
+	pending = g_list_append(pending, entry);
+
+	g_strfreev(tokens);
+
+	return SC_OK;
+}
+
+/**
+ * @brief The element written since index_element_start() is complete.
+ *        All its names become entries of the index.
+ * @param offset Byte offset right after the closing tag
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult index_element_end(long offset)
+{
+	GList *ptr;
+
+	if (element_start < 0)
+		return SC_FAIL;
+
+	for (ptr = pending; ptr; ptr = ptr->next) {
+		SCIndexEntry *entry = (SCIndexEntry *)ptr->data;
+
+		entry->offset = element_start;
+		entry->length = offset - element_start;
+	}
+
+	entries = g_list_concat(entries, pending);
+	pending = NULL;
+	element_start = -1;
+
+	return SC_OK;
+}
+
+/**
+ * @brief Write the index of a finished XML file. When writing an archive,
+ *        the index is added as another entry.
+ * @param xml_filename The XML file. The index is <xml_filename>.idx
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult index_write(const char *xml_filename)
+{
+	FILE		*fd;
+	GList		*ptr;
+	GString		*str;
+	gchar		*idx_filename;
+	SCResult	rc = SC_OK;
+
+	str = g_string_new(NULL);
+	for (ptr = entries; ptr; ptr = ptr->next) {
+		SCIndexEntry *entry = (SCIndexEntry *)ptr->data;
+
+		g_string_append_printf(str, "%s %s %ld %ld\n", entry->name, entry->kind,
+			entry->offset, entry->length);
+	}
+
+	idx_filename = g_strconcat(xml_filename, INDEX_SUFFIX, NULL);
+
+	/* Like the XML file, it may be a hardlink shared with identical headers */
+	if (sc_opts.dedup && !sc_opts.archive && !sc_opts.if_changed)
+		unlink(idx_filename);
+
+	if (sc_opts.archive) {
+		rc = archive_add(idx_filename, str->str, str->len);
+	}
+	else if (sc_opts.if_changed) {
+		rc = write_if_changed(idx_filename, str->str, str->len, NULL);
+	}
+	else if ((fd = fopen(idx_filename, "w")) != NULL) {
+		fwrite(str->str, 1, str->len, fd);
+		fclose(fd);
+	}
+	else {
+		log_error(LOG_ERR, "%s(): Could not create the index '%s'",
+			__func__, idx_filename);
+		rc = SC_FAIL;
+	}
+
+	g_string_free(str, TRUE);
+	g_free(idx_filename);
+
+	return rc;
+}
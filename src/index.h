@@ -0,0 +1,26 @@
+/**
+ * @file index.h
+ *
+ * @brief Defines for index.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#ifndef _INDEX_H
+#define _INDEX_H
+
+#include "sc2xml.h"
+
+#define INDEX_SUFFIX	".idx"		/**< Appended to the XML filename */
+
+void		index_reset(void);
+SCResult	index_element_start(const char *, long);
+SCResult	index_element_name(const char *, const char *);
+SCResult	index_element_end(long);
+SCResult	index_write(const char *);
+
+#endif	/* _INDEX_H */
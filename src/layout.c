@@ -0,0 +1,680 @@
+/**
+ * @file layout.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * @brief Layout engine. Computes the size and alignment of the structs/unions
+ *        and the offset of their members for several ABIs at once, following
+ *        the rules of GCC:
+ *
+ *        - A member is placed at the next multiple of its alignment, the
+ *          struct is aligned to its most aligned member and its size is
+ *          rounded up to that alignment. A union places all its members at 0.
+ *        - A bit field that would cross a unit of its declared type aligned
+ *          to the alignment of that type starts at the next such unit.
+ *          Its type aligns the struct. A zero width bit field only moves
+ *          to the next unit.
+ *        - __attribute__((packed)) aligns every member to 1 byte and packs
+ *          the bit fields, __attribute__((aligned(N))) raises the alignment
+ *          of the struct.
+ *
+ *        The offsets are kept in bits so bit fields are handled like the
+ *        other members. All the ABIs are little endian.
+ *
+ *        Types are sized from the builtin types, the common fixed size
+ *        typedefs and the structs laid out before (or, with --resolve, any
+ *        struct of the tree). A member of any other type, or an array whose
+ *        size is not a number, makes the layout unknown from that member on.
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "config.h"
+#include "sc2xml.h"
+#include "misc.h"
+#include "consts.h"
+#include "model.h"
+#include "resolve.h"
+#include "layout.h"
+
+#define ALIGN_UP(x, a)	(((x) + (a) - 1) / (a) * (a))
+
+/* The sizes and alignments that differ between the ABIs */
+typedef struct abi_info_st {
+	const char *name;			/**< Name given to --layout */
+	guint8 pointer;				/**< Pointers, long, size_t */
+	guint8 llong_align;			/**< long long and 64-bit integers */
+	guint8 double_align;		/**< double */
+	guint8 ldouble_size;		/**< long double */
+	guint8 ldouble_align;
+	guint8 max_align;			/**< __attribute__((aligned)) without N */
+} SCAbiInfo;
+
+static const SCAbiInfo abis[ABI_COUNT] = {
+	{ "x86_64",		8, 8, 8, 16, 16, 16 },
+	{ "i386",		4, 4, 4, 12, 4, 16 },
+	{ "aarch64",	8, 8, 8, 16, 16, 16 },
+	{ "arm",		4, 8, 8, 8, 8, 8 },
+};
+
+/* Typedefs whose size does not depend on the headers.
+ * A size of 0 is the size of a pointer */
+static const struct {
+	const char *name;
+	guint8 size;
+} fixed_types[] = {
+	{ "int8_t", 1 }, { "uint8_t", 1 }, { "int16_t", 2 }, { "uint16_t", 2 },
+	{ "int32_t", 4 }, { "uint32_t", 4 }, { "int64_t", 8 }, { "uint64_t", 8 },
+	{ "__s8", 1 }, { "__u8", 1 }, { "__s16", 2 }, { "__u16", 2 },
+	{ "__s32", 4 }, { "__u32", 4 }, { "__s64", 8 }, { "__u64", 8 },
+	{ "s8", 1 }, { "u8", 1 }, { "s16", 2 }, { "u16", 2 },
+	{ "s32", 4 }, { "u32", 4 }, { "s64", 8 }, { "u64", 8 },
+	{ "bool", 1 }, { "wchar_t", 4 },
+	{ "intptr_t", 0 }, { "uintptr_t", 0 }, { "size_t", 0 }, { "ssize_t", 0 },
+	{ "ptrdiff_t", 0 },
+	{ NULL, 0 }
+};
+
+/* Layouts of the structs laid out so far: name -> SCLayout[ABI_COUNT] */
+static GHashTable *registry = NULL;
+
+/**
+ * @brief Copy the layouts of a struct for the registry
+ */
+static SCLayout * layout_copy(SCStruct *st)
+{
+	SCLayout *copy;
+
+	copy = g_new(SCLayout, ABI_COUNT);
+	memcpy(copy, st->layout, sizeof(st->layout));
+
+	return copy;
+}
+
+/**
+ * @brief Get the name of an ABI
+ */
+const char * layout_abi_name(SCAbi abi)
+{
+	return abi < ABI_COUNT ? abis[abi].name : "";
+}
+
+/**
+ * @brief Get the size of a pointer in an ABI
+ */
+guint64 layout_pointer_size(SCAbi abi)
+{
+	return abi < ABI_COUNT ? abis[abi].pointer : 0;
+}
+
+/**
+ * @brief Find an ABI by name
+ * @return The ABI or -1 if there is no such ABI
+ */
+int layout_abi_find(const char *name)
+{
+	int abi;
+
+	for (abi = 0; abi < ABI_COUNT; abi++)
+		if (strcmp(name, abis[abi].name) == 0)
+			return abi;
+
+	return -1;
+}
+
+/**
+ * @brief Get the ABI sc2xml runs on
+ * @return The ABI or -1 if it is not one of the ABIs
+ */
+int layout_abi_host(void)
+{
+#if defined(__x86_64__)
+	return ABI_X86_64;
+#elif defined(__i386__)
+	return ABI_I386;
+#elif defined(__aarch64__)
+	return ABI_AARCH64;
+#elif defined(__arm__)
+	return ABI_ARM;
+#else
+	return -1;
+#endif
+}
+
+/**
+ * @brief Parse a list of ABIs like 'x86_64,arm' or 'all'
+ * @param spec The list
+ * @param mask Set to the mask of the ABIs, bit n is SCAbi n
+ * @return SC_OK if everything is ok, SC_FAIL if an ABI is unknown
+ */
+SCResult layout_parse_abis(const char *spec, int *mask)
+{
+	gchar	**names;
+	int		i, abi;
+
+	*mask = 0;
+	names = g_strsplit(spec, ",", -1);
+	for (i = 0; names[i] != NULL; i++) {
+		g_strstrip(names[i]);
+		if (strcmp(names[i], "all") == 0) {
+			*mask = LAYOUT_ALL_ABIS;
+			continue;
+		}
+		if ((abi = layout_abi_find(names[i])) < 0) {
+			log_error(LOG_ERR, "Unknown ABI '%s', the ABIs are x86_64, i386, "
+				"aarch64, arm and all", names[i]);
+			g_strfreev(names);
+			return SC_FAIL;
+		}
+		*mask |= 1 << abi;
+	}
+	g_strfreev(names);
+
+	return *mask ? SC_OK : SC_FAIL;
+}
+
+/**
+ * @brief Forget the structs laid out so far
+ */
+void layout_reset(void)
+{
+	if (registry)
+		g_hash_table_destroy(registry);
+	registry = NULL;
+}
+
+/**
+ * @brief Evaluate an array size or a bit width with the constants known
+ * @param expr The expression as written in the XML file
+ * @param value Set to the value
+ * @return SC_OK if the value is known, SC_FAIL otherwise
+ */
+SCResult layout_eval(const char *expr, gint64 *value)
+{
+	if (consts_eval(expr, value) != SC_OK)
+		return SC_FAIL;
+
+	return *value >= 0 ? SC_OK : SC_FAIL;
+}
+
+/**
+ * @brief Evaluate the number of elements of an array, all its dimensions
+ * @param size The dimensions after the first '[', e.g. "K][DIM" or
+ *        "2 ] [ 3 ]"
+ * @param count Set to the number of elements, 0 for a flexible array
+ * @return SC_OK if the number is known, SC_FAIL otherwise
+ */
+SCResult layout_count(const char *size, gint64 *count)
+{
+	SCResult	rc = SC_OK;
+	gchar		*text = g_strstrip(g_strdup(size)),
+				**dims;
+	gint64		value;
+	guint		i;
+
+	if (*text && text[strlen(text) - 1] == ']')
+		text[strlen(text) - 1] = '\0';
+
+	*count = 1;
+	dims = g_strsplit(text, "]", -1);
+	for (i = 0; dims[i] != NULL && rc == SC_OK; i++) {
+		gchar *dim = g_strstrip(dims[i]);
+
+		if (i > 0 && *dim == '[')
+			dim = g_strchug(dim + 1);
+
+		/* Only the first dimension of a flexible array member is empty */
+		if (*dim == '\0' && i == 0)
+			value = 0;
+		else if (layout_eval(dim, &value) != SC_OK)
+			rc = SC_FAIL;
+		*count *= value;
+	}
+
+	g_strfreev(dims);
+	g_free(text);
+
+	return rc;
+}
+
+/**
+ * @brief Find an attribute of a struct, like 'packed' or '__aligned__ ( 8 )'.
+ *        Only the tokens within '__attribute__ ( ( ... ) )' are attributes,
+ *        the names of the struct are not.
+ * @param st The struct
+ * @param name The attribute, without underscores
+ * @param arg If not NULL, set to the tokens between the parentheses after
+ *        the attribute, "" if there are none, to be freed with g_free()
+ * @return 1 if the struct has the attribute, 0 otherwise
+ */
+static int layout_attribute(SCStruct *st, const char *name, gchar **arg)
+{
+	const char	*texts[4];
+	gchar		**tokens,
+				*underscored;
+	int			i, n,
+				depth,
+				attr_depth,
+				found = 0;
+
+	texts[0] = st->attributes;
+	texts[1] = st->typedef_name;
+	texts[2] = st->tail_name;
+	texts[3] = st->nested_name;
+
+	underscored = g_strconcat("__", name, "__", NULL);
+	for (i = 0; i < 4 && !found; i++) {
+		if (texts[i] == NULL)
+			continue;
+
+		tokens = g_strsplit(texts[i], " ", -1);
+		depth = 0;
+		attr_depth = -1;
+		for (n = 0; tokens[n] != NULL && !found; n++) {
+			const char *token = tokens[n];
+
+			if (strcmp(token, "__attribute__") == 0 || strcmp(token, "__attribute") == 0)
+				attr_depth = depth;
+			else if (*token == '(')
+				depth++;
+			else if (*token == ')') {
+				if (--depth == attr_depth)
+					attr_depth = -1;
+			}
+			/* The attributes are within the double parentheses */
+			else if (attr_depth >= 0 && depth == attr_depth + 2 &&
+					(strcmp(token, name) == 0 || strcmp(token, underscored) == 0))
+				found = n + 1;
+		}
+
+		if (found && arg) {
+			GString	*str = g_string_new(NULL);
+
+			/* The argument goes until the closing parenthesis */
+			if (tokens[found] && *tokens[found] == '(') {
+				for (n = found + 1, depth = 1; tokens[n] != NULL; n++) {
+					if (*tokens[n] == '(')
+						depth++;
+					else if (*tokens[n] == ')' && --depth == 0)
+						break;
+					if (str->len)
+						g_string_append_c(str, ' ');
+					g_string_append(str, tokens[n]);
+				}
+			}
+			*arg = g_string_free(str, FALSE);
+		}
+		g_strfreev(tokens);
+	}
+	g_free(underscored);
+
+	return found != 0;
+}
+
+/**
+ * @brief Check if a struct is declared with __attribute__((packed))
+ * @param st The struct
+ * @return 1 if it is packed
+ */
+int layout_is_packed(SCStruct *st)
+{
+	return layout_attribute(st, "packed", NULL);
+}
+
+/**
+ * @brief Get N of __attribute__((aligned(N))) if the struct has it. A bare
+ *        'aligned' is the largest alignment of the ABI.
+ * @return N or 0
+ */
+static guint64 layout_aligned(SCStruct *st, SCAbi abi)
+{
+	gchar	*arg;
+	gint64	value = 0;
+
+	if (!layout_attribute(st, "aligned", &arg))
+		return 0;
+
+	if (*arg == '\0')
+		value = abis[abi].max_align;
+	else if (layout_eval(arg, &value) != SC_OK)
+		value = 0;
+	g_free(arg);
+
+	return value;
+}
+
+/**
+ * @brief Size and alignment of a builtin type or a fixed size typedef
+ * @param tokens The tokens of the type, without qualifiers
+ * @param abi The ABI
+ * @param out Set to the size and alignment
+ * @return SC_OK if the type is known, SC_FAIL otherwise
+ */
+static SCResult layout_scalar(gchar **tokens, SCAbi abi, SCLayout *out)
+{
+	const SCAbiInfo	*info = &abis[abi];
+	int				longs = 0,
+					is_double = 0,
+					i, j;
+	guint64			size = 0,
+					align = 0;
+
+	for (i = 0; tokens[i] != NULL; i++) {
+		const char *token = tokens[i];
+
+		if (strcmp(token, "long") == 0)
+			longs++;
+		else if (strcmp(token, "char") == 0 || strcmp(token, "_Bool") == 0)
+			size = 1;
+		else if (strcmp(token, "short") == 0)
+			size = 2;
+		else if (strcmp(token, "float") == 0)
+			size = 4;
+		else if (strcmp(token, "double") == 0) {
+			size = 8;
+			is_double = 1;
+		}
+		else if (strcmp(token, "int") == 0 || strcmp(token, "signed") == 0 ||
+				strcmp(token, "unsigned") == 0) {
+			if (size == 0)
+				size = 4;
+		}
+		else {
+			for (j = 0; fixed_types[j].name != NULL; j++)
+				if (strcmp(token, fixed_types[j].name) == 0)
+					break;
+			if (fixed_types[j].name == NULL)
+				return SC_FAIL;
+			size = fixed_types[j].size ? fixed_types[j].size : info->pointer;
+		}
+	}
+
+	if (is_double && longs > 0) {
+		size = info->ldouble_size;
+		align = info->ldouble_align;
+	}
+	else if (is_double) {
+		align = info->double_align;
+	}
+	else if (longs >= 2) {
+		size = 8;
+		align = info->llong_align;
+	}
+	else if (longs == 1 && size != 2 && size != 1) {
+		size = info->pointer;
+		align = size;
+	}
+	else if (size == 8) {
+		align = info->llong_align;
+	}
+	else {
+		align = size;
+	}
+
+	if (size == 0)
+		return SC_FAIL;
+
+	out->size = size;
+	out->align = align;
+
+	return SC_OK;
+}
+
+/**
+ * @brief Size and alignment of the type of a field for all the ABIs
+ * @param field The field
+ * @param header The header of the struct
+ * @param out Set to the size of one element and its alignment
+ */
+static void layout_type(SCField *field, const char *header, SCLayout *out)
+{
+	SCLayout	*known;
+	gchar		**tokens,
+				**words,
+				*name;
+	int			pointer,
+				abi, i, n;
+
+	memset(out, 0, sizeof(SCLayout) * ABI_COUNT);
+
+	/* Pointers, including function pointers */
+	name = model_type_name(field->type, &pointer);
+	if (pointer || field->func_ptr) {
+		for (abi = 0; abi < ABI_COUNT; abi++) {
+			out[abi].known = 1;
+			out[abi].size = out[abi].align = abis[abi].pointer;
+		}
+		g_free(name);
+		return;
+	}
+
+	/* A struct/union laid out before */
+	if (name && (known = g_hash_table_lookup(registry, name)) != NULL) {
+		memcpy(out, known, sizeof(SCLayout) * ABI_COUNT);
+		g_free(name);
+		return;
+	}
+
+	/* Builtin types, fixed size typedefs and enums */
+	tokens = g_strsplit(field->type ? field->type : "", " ", -1);
+	words = g_new0(gchar *, g_strv_length(tokens) + 1);
+	for (i = 0, n = 0; tokens[i] != NULL; i++) {
+		if (*tokens[i] == '\0' || strcmp(tokens[i], "const") == 0 ||
+				strcmp(tokens[i], "volatile") == 0 ||
+				strcmp(tokens[i], "register") == 0 ||
+				strcmp(tokens[i], "static") == 0)
+			continue;
+		words[n++] = tokens[i];
+	}
+
+	for (abi = 0; abi < ABI_COUNT && n > 0; abi++) {
+		if (strcmp(words[0], "enum") == 0) {
+			out[abi].known = 1;
+			out[abi].size = out[abi].align = 4;
+		}
+		else {
+			out[abi].known = layout_scalar(words, abi, &out[abi]) == SC_OK;
+		}
+	}
+
+	g_free(words);
+	g_strfreev(tokens);
+
+	/* With --resolve every struct of the tree is known */
+	if (!out[0].known && name && sc_opts.resolve) {
+		SCDefinition *def = resolve_type(header, field->type);
+
+		if (def && def->st->laid_out == 0)
+			layout_struct(def->st, def->header);
+		if (def && def->st->laid_out == 2)
+			memcpy(out, def->st->layout, sizeof(SCLayout) * ABI_COUNT);
+	}
+
+	g_free(name);
+}
+
+/**
+ * @brief Lay out the members of a struct, nested structs first
+ * @param st The struct
+ * @param header The header of the struct
+ */
+static void layout_members(SCStruct *st, const char *header)
+{
+	SCLayout	member[ABI_COUNT];
+	guint64		bitpos[ABI_COUNT],
+				end[ABI_COUNT],
+				align[ABI_COUNT],
+				aligned;
+	int			known[ABI_COUNT],
+				packed,
+				abi;
+	guint		i;
+
+	packed = layout_is_packed(st);
+	for (abi = 0; abi < ABI_COUNT; abi++) {
+		bitpos[abi] = end[abi] = 0;
+		align[abi] = 1;
+		known[abi] = 1;
+	}
+
+	for (i = 0; i < st->fields->len; i++) {
+		SCField		*field = g_ptr_array_index(st->fields, i);
+		gint64		count = 1,
+					width = -1;
+		const char	*size = field->size;
+
+		if (field->nested) {
+			SCStruct *nested = field->nested;
+
+			layout_members(nested, header);
+			memcpy(member, nested->layout, sizeof(member));
+
+			/* The declarator of a nested struct carries its array size */
+			size = NULL;
+			if (nested->typedef_name && strchr(nested->typedef_name, '['))
+				size = strchr(nested->typedef_name, '[') + 1;
+			else if (nested->attributes && strchr(nested->attributes, '['))
+				size = strchr(nested->attributes, '[') + 1;
+			else if (nested->tail_name && strchr(nested->tail_name, '['))
+				size = strchr(nested->tail_name, '[') + 1;
+		}
+		else {
+			layout_type(field, header, member);
+		}
+
+		/* Array elements, of all the dimensions */
+		if (size != NULL && layout_count(size, &count) != SC_OK)
+			count = -1;
+
+		if (!field->nested && field->bits && layout_eval(field->bits, &width) != SC_OK)
+			count = -1;
+
+		for (abi = 0; abi < ABI_COUNT; abi++) {
+			SCLayout	*out = &field->layout[abi];
+			guint64		a = member[abi].align,
+						unit,
+						start;
+
+			memset(out, 0, sizeof(SCLayout));
+			if (!known[abi] || !member[abi].known || count < 0) {
+				known[abi] = 0;
+				continue;
+			}
+
+			if (st->is_union)
+				bitpos[abi] = 0;
+
+			out->known = 1;
+			out->align = packed ? 1 : a;
+			out->count = count;
+
+			if (width >= 0) {
+				/* Bit field */
+				unit = member[abi].size * 8;
+				out->size = member[abi].size;
+				if (width == 0) {
+					if (!packed)
+						bitpos[abi] = ALIGN_UP(bitpos[abi], a * 8);
+					out->offset = bitpos[abi];
+					continue;
+				}
+				start = bitpos[abi] / (a * 8) * (a * 8);
+				if (!packed && bitpos[abi] + width > start + unit)
+					bitpos[abi] = ALIGN_UP(bitpos[abi], a * 8);
+				out->offset = bitpos[abi];
+				out->bits = width;
+				bitpos[abi] += width;
+			}
+			else {
+				bitpos[abi] = ALIGN_UP(bitpos[abi], 8);
+				bitpos[abi] = ALIGN_UP(bitpos[abi], out->align * 8);
+				out->offset = bitpos[abi];
+				out->size = member[abi].size * count;
+				bitpos[abi] += out->size * 8;
+			}
+
+			if (out->align > align[abi])
+				align[abi] = out->align;
+			if (bitpos[abi] > end[abi])
+				end[abi] = bitpos[abi];
+		}
+	}
+
+	for (abi = 0; abi < ABI_COUNT; abi++) {
+		SCLayout *out = &st->layout[abi];
+
+		memset(out, 0, sizeof(SCLayout));
+		if (!known[abi])
+			continue;
+
+		aligned = layout_aligned(st, abi);
+		if (aligned > align[abi])
+			align[abi] = aligned;
+		out->known = 1;
+		out->align = align[abi];
+		out->count = 1;
+		out->size = ALIGN_UP((end[abi] + 7) / 8, align[abi]);
+	}
+}
+
+/**
+ * @brief Compute the layout of a top-level struct for all the ABIs. The
+ *        results are in the layout of the struct and of its members. The
+ *        struct can then be used by the structs laid out after it.
+ * @param st The struct
+ * @param header The header of the struct
+ * @return SC_OK if the layout is known for all the ABIs, SC_FAIL otherwise
+ */
+SCResult layout_struct(SCStruct *st, const char *header)
+{
+	const char	*previous;
+	gchar		*tag,
+				*type_name,
+				*name;
+	int			abi;
+
+	if (registry == NULL)
+		registry = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+	/* Already done, or a struct that contains itself */
+	if (st->laid_out == 1) {
+		memset(st->layout, 0, sizeof(st->layout));
+		return SC_FAIL;
+	}
+
+	if (st->laid_out == 0) {
+		/* With --resolve, a struct of another header with its constants */
+		previous = consts_use(header);
+		st->laid_out = 1;
+		layout_members(st, header);
+		st->laid_out = 2;
+		consts_use(previous);
+
+		tag = model_declarator_name(st->name);
+		type_name = model_declarator_name(st->typedef_name);
+
+		if (tag) {
+			name = g_strconcat(st->is_union ? "union " : "struct ", tag, NULL);
+			g_hash_table_replace(registry, name, layout_copy(st));
+		}
+		if (type_name)
+			g_hash_table_replace(registry, g_strdup(type_name), layout_copy(st));
+
+		g_free(tag);
+		g_free(type_name);
+	}
+
+	for (abi = 0; abi < ABI_COUNT; abi++)
+		if (!st->layout[abi].known)
+			return SC_FAIL;
+
+	return SC_OK;
+}
@@ -0,0 +1,34 @@
+/**
+ * @file layout.h
+ *
+ * @brief Defines for layout.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#ifndef _LAYOUT_H
+#define _LAYOUT_H
+
+#include <glib.h>
+
+#include "sc2xml.h"
+#include "model.h"
+
+#define LAYOUT_ALL_ABIS		((1 << ABI_COUNT) - 1)	/**< Mask of every ABI */
+
+SCResult	layout_parse_abis(const char *, int *);
+const char *layout_abi_name(SCAbi);
+int			layout_abi_find(const char *);
+int			layout_abi_host(void);
+guint64		layout_pointer_size(SCAbi);
+SCResult	layout_struct(SCStruct *, const char *);
+int			layout_is_packed(SCStruct *);
+SCResult	layout_eval(const char *, gint64 *);
+SCResult	layout_count(const char *, gint64 *);
+void		layout_reset(void);
+
+#endif	/* _LAYOUT_H */
@@ -0,0 +1,301 @@
+/**
+ * @file loader.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * @brief Load an XML file written by sc2xml back into the in-memory model
+ *        (see model.h), so the structs can be compared or used without 
+ *        parsing the headers again. Both a file per header and a document
+ *        written with --aggregate are understood, and the references 
+ *        written with --dedup-structs are resolved. The <layout> elements
+ *        written with --layout are loaded too.
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+
+#include "config.h"
+#include "sc2xml.h"
+#include "misc.h"
+#include "model.h"
+#include "layout.h"
+#include "loader.h"
+
+/**
+ * @brief Get an attribute of an element
+ * @return A copy of the value to be freed with g_free(), or NULL
+ */
+static gchar * loader_attr(xmlNodePtr node, const char *name)
+{
+	xmlChar	*value;
+	gchar	*copy;
+
+	if ((value = xmlGetProp(node, (xmlChar *)name)) == NULL)
+		return NULL;
+
+	copy = g_strdup((char *)value);
+	xmlFree(value);
+
+	return copy;
+}
+
+/**
+ * @brief Get the text of an element
+ * @return A copy of the text to be freed with g_free()
+ */
+static gchar * loader_text(xmlNodePtr node)
+{
+	xmlChar	*value;
+	gchar	*copy;
+
+	value = xmlNodeGetContent(node);
+	copy = g_strdup(value ? (char *)value : "");
+	xmlFree(value);
+
+	return copy;
+}
+
+#define IS(node, str) (xmlStrcmp((node)->name, (xmlChar *)(str)) == 0)
+
+/**
+ * @brief Get an attribute of an element as a number
+ * @return The value, 0 if there is no such attribute
+ */
+static guint64 loader_number(xmlNodePtr node, const char *name)
+{
+	gchar	*value;
+	guint64	number;
+
+	if ((value = loader_attr(node, name)) == NULL)
+		return 0;
+
+	number = g_ascii_strtoull(value, NULL, 10);
+	g_free(value);
+
+	return number;
+}
+
+/**
+ * @brief Load a <layout> element, the offset is kept in bits
+ * @param node The element
+ * @param layout The layouts of the struct or the member, for all the ABIs
+ */
+static void loader_layout(xmlNodePtr node, SCLayout *layout)
+{
+	gchar	*name;
+	int		abi;
+
+	if ((name = loader_attr(node, "abi")) == NULL)
+		return;
+	abi = layout_abi_find(name);
+	g_free(name);
+	if (abi < 0)
+		return;
+
+	layout[abi].known = 1;
+	layout[abi].offset = loader_number(node, "offset") * 8 + loader_number(node, "bit_offset");
+	layout[abi].size = loader_number(node, "size");
+	layout[abi].align = loader_number(node, "align");
+}
+
+/**
+ * @brief Load a <field> element
+ */
+static void loader_field(xmlNodePtr node, SCStruct *st)
+{
+	SCField		*field;
+	xmlNodePtr	child;
+	gchar		*func_ptr;
+
+	field = model_field_new(st);
+	field->type = loader_attr(node, "type");
+	field->bits = loader_attr(node, "bits");
+	field->size = loader_attr(node, "size");
+
+	/* An array whose size was not specified */
+	if (field->size && strcmp(field->size, "N/A") == 0)
+		*field->size = '\0';
+
+	if ((func_ptr = loader_attr(node, "function_pointer")) != NULL) {
+		field->func_ptr = atoi(func_ptr);
+		g_free(func_ptr);
+	}
+
+	for (child = node->children; child; child = child->next) {
+		if (child->type != XML_ELEMENT_NODE)
+			continue;
+		if (IS(child, "input_args"))
+			field->input_args = loader_text(child);
+		else if (IS(child, "name"))
+			field->name = loader_text(child);
+		else if (IS(child, "layout"))
+			loader_layout(child, field->layout);
+	}
+}
+
+/**
+ * @brief Load a <struct>/<union> element and all its members
+ * @param node The element
+ * @param parent The enclosing struct or NULL
+ * @param ids The top-level structs by id, for resolving references
+ * @return The struct
+ */
+static SCStruct * loader_struct(xmlNodePtr node, SCStruct *parent, GHashTable *ids)
+{
+	SCStruct	*st;
+	xmlNodePtr	child;
+	gchar		*id;
+	int			members = 0;
+
+	st = model_struct_new(IS(node, "union"), parent);
+	st->hash = loader_attr(node, "hash");
+
+	for (child = node->children; child; child = child->next) {
+		if (child->type != XML_ELEMENT_NODE)
+			continue;
+
+		if (IS(child, "field")) {
+			loader_field(child, st);
+			members++;
+		}
+		else if (IS(child, "struct") || IS(child, "union")) {
+			loader_struct(child, st, NULL);
+			members++;
+		}
+		/* The name is written before the members if it was found when
+		 * the struct opened, otherwise after them */
+		else if (IS(child, "struct_name")) {
+			if (members == 0 && st->name == NULL)
+				st->name = loader_text(child);
+			else
+				st->tail_name = loader_text(child);
+		}
+		else if (IS(child, "typedef_name"))
+			st->typedef_name = loader_text(child);
+		else if (IS(child, "struct_attributes"))
+			st->attributes = loader_text(child);
+		else if (IS(child, "struct_nested_name"))
+			st->nested_name = loader_text(child);
+		/* Where a nested struct is in its parent, its member is the last 
+		 * one of the parent so far */
+		else if (IS(child, "layout"))
+			loader_layout(child, parent ? ((SCField *)g_ptr_array_index(parent->fields,
+				parent->fields->len - 1))->layout : st->layout);
+	}
+
+	if (ids && (id = loader_attr(node, "id")) != NULL)
+		g_hash_table_insert(ids, id, st);
+
+	return st;
+}
+
+/**
+ * @brief Load the top-level elements of a header
+ */
+static SCResult loader_header(xmlNodePtr node, SCHeader *header, GHashTable *ids)
+{
+	xmlNodePtr	child;
+	SCStruct	*st;
+	gchar		*ref;
+
+	for (child = node->children; child; child = child->next) {
+		if (child->type != XML_ELEMENT_NODE)
+			continue;
+
+		if (IS(child, "struct") || IS(child, "union")) {
+			g_ptr_array_add(header->structs, loader_struct(child, NULL, ids));
+		}
+		else if (IS(child, "struct_ref") || IS(child, "union_ref")) {
+			ref = loader_attr(child, "ref");
+			st = ref ? g_hash_table_lookup(ids, ref) : NULL;
+			if (st == NULL) {
+				log_error(LOG_ERR, "%s(): Unknown reference '%s' in '%s'", 
+					__func__, ref ? ref : "", header->name);
+				g_free(ref);
+				return SC_FAIL;
+			}
+			g_ptr_array_add(header->structs, model_struct_copy(st, NULL));
+			g_free(ref);
+		}
+	}
+
+	return SC_OK;
+}
+
+/**
+ * @brief Load an XML file written by sc2xml
+ * @param xml_filename The XML file
+ * @return The headers found in the file (SCHeader), to be freed with
+ *         g_ptr_array_free(), or NULL on error
+ */
+GPtrArray * loader_read(const char *xml_filename)
+{
+	xmlDocPtr	doc;
+	xmlNodePtr	root,
+				child;
+	GPtrArray	*headers;
+	GHashTable	*ids;
+	SCHeader	*header;
+	SCResult	rc = SC_OK;
+	gchar		*name;
+
+	doc = xmlReadFile(xml_filename, NULL, XML_PARSE_NOBLANKS | XML_PARSE_HUGE);
+	if (doc == NULL) {
+		log_error(LOG_ERR, "%s(): Could not read '%s'", __func__, xml_filename);
+		return NULL;
+	}
+
+	root = xmlDocGetRootElement(doc);
+	if (root == NULL || !IS(root, "sc2xml")) {
+		log_error(LOG_ERR, "%s(): '%s' was not written by sc2xml", 
+			__func__, xml_filename);
+		xmlFreeDoc(doc);
+		return NULL;
+	}
+
+	headers = g_ptr_array_new_with_free_func((GDestroyNotify)model_header_free);
+	ids = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+	/* Written with --aggregate */
+	for (child = root->children; child && rc == SC_OK; child = child->next) {
+		if (child->type != XML_ELEMENT_NODE || !IS(child, "header"))
+			continue;
+
+		name = loader_attr(child, "name");
+		header = model_header_new(name ? name : "");
+		g_ptr_array_add(headers, header);
+		rc = loader_header(child, header, ids);
+		g_free(name);
+	}
+
+	/* A file per header */
+	if (headers->len == 0 && rc == SC_OK) {
+		name = g_strdup(xml_filename);
+		if (g_str_has_suffix(name, ".xml"))
+			name[strlen(name) - 4] = '\0';
+		header = model_header_new(name);
+		g_ptr_array_add(headers, header);
+		rc = loader_header(root, header, ids);
+		g_free(name);
+	}
+
+	g_hash_table_destroy(ids);
+	xmlFreeDoc(doc);
+
+	if (rc != SC_OK) {
+		g_ptr_array_free(headers, TRUE);
+		return NULL;
+	}
+
+	return headers;
+}
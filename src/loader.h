@@ -0,0 +1,23 @@
+/**
+ * @file loader.h
+ *
+ * @brief Defines for loader.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#ifndef _LOADER_H
+#define _LOADER_H
+
+#include <glib.h>
+
+#include "sc2xml.h"
+#include "model.h"
+
+GPtrArray *	loader_read(const char *);
+
+#endif	/* _LOADER_H */
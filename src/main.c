@@ -23,6 +23,27 @@
 
 #include "parser.tab.h"
 #include "xml.h"
+#include "index.h"
+#include "archive.h"
+#include "dedup.h"
+#include "manifest.h"
+#include "diff.h"
+#include "graph.h"
+#include "layout.h"
+#include "consts.h"
+#include "padding.h"
+#include "profile.h"
+#include "gen.h"
+#include "soa.h"
+#include "reflect.h"
+#include "serialize.h"
+#include "deserialize.h"
+#include "trace.h"
+#include "equal.h"
+#include "slab.h"
+#include "decode.h"
+#include "convert.h"
+#include "migrate.h"
 #include "misc.h"
 #include "config.h"
 
@@ -40,6 +61,91 @@ extern SC2XMLPtr xml_ptr;
 
 GList  *my_list = NULL;
 
+SCOpts sc_opts;
+
+static GOptionEntry option_entries[] = {
+	{ "index", 'i', 0, G_OPTION_ARG_NONE, &sc_opts.index,
+		"Write an offset index <file>.xml.idx next to each XML file", NULL },
+	{ "if-changed", 'u', 0, G_OPTION_ARG_NONE, &sc_opts.if_changed,
+		"Replace the XML files only if their contents changed", NULL },
+	{ "dedup", 'd', 0, G_OPTION_ARG_NONE, &sc_opts.dedup,
+		"Parse identical headers only once and link their XML files", NULL },
+	{ "dedup-dir", 'D', 0, G_OPTION_ARG_FILENAME, &sc_opts.dedup_dir,
+		"Share the deduplicated XML files with other sc2xml processes through DIR", "DIR" },
+	{ "aggregate", 'A', 0, G_OPTION_ARG_FILENAME, &sc_opts.aggregate,
+		"Write all the headers to a single XML file", "FILE" },
+	{ "dedup-structs", 's', 0, G_OPTION_ARG_NONE, &sc_opts.dedup_structs,
+		"Write identical structs once and refer to them by id afterwards", NULL },
+	{ "hash", 'H', 0, G_OPTION_ARG_NONE, &sc_opts.hash,
+		"Add the 128-bit structural fingerprint to every struct/union", NULL },
+	{ "manifest", 'm', 0, G_OPTION_ARG_FILENAME, &sc_opts.manifest,
+		"Write the fingerprints of all the structs/unions to FILE", "FILE" },
+	{ "resolve", 'r', 0, G_OPTION_ARG_NONE, &sc_opts.resolve,
+		"Refer every field to the header and struct where its type is defined", NULL },
+	{ "layout", 'L', 0, G_OPTION_ARG_STRING, &sc_opts.layout,
+		"Add the size, alignment and offsets for the ABIs: x86_64, i386, aarch64, arm or all",
+		"ABI[,ABI...]" },
+	{ "padding", 'P', 0, G_OPTION_ARG_FILENAME, &sc_opts.padding,
+		"Write the padding and cache-line report of the laid out structs to FILE", "FILE" },
+	{ "profile", 0, 0, G_OPTION_ARG_FILENAME, &sc_opts.profile,
+		"Recommend hot/cold splits in the report from the CSV of accesses (struct,offset,count)", "FILE" },
+	{ "select", 0, 0, G_OPTION_ARG_STRING, &sc_opts.select,
+		"Structs/unions to generate code for (default: all the named ones)", "NAME[,NAME...]" },
+	{ "soa", 0, 0, G_OPTION_ARG_FILENAME, &sc_opts.soa,
+		"Generate the structure of arrays of the structs in the header FILE", "FILE" },
+	{ "reflect", 0, 0, G_OPTION_ARG_NONE, &sc_opts.reflect,
+		"Generate a C++17 reflection header next to every parsed header", NULL },
+	{ "serializers", 0, 0, G_OPTION_ARG_FILENAME, &sc_opts.serializers,
+		"Generate the struct to XML serializers in the header FILE", "FILE" },
+	{ "loaders", 0, 0, G_OPTION_ARG_FILENAME, &sc_opts.loaders,
+		"Generate the XML to struct loaders in the header FILE", "FILE" },
+	{ "tracers", 0, 0, G_OPTION_ARG_FILENAME, &sc_opts.tracers,
+		"Generate the binary trace loggers of the structs in the header FILE", "FILE" },
+	{ "equality", 0, 0, G_OPTION_ARG_FILENAME, &sc_opts.equality,
+		"Generate the padding-aware equality and hash functions of the structs in the header FILE", "FILE" },
+	{ "slabs", 0, 0, G_OPTION_ARG_FILENAME, &sc_opts.slabs,
+		"Generate the slab allocators of the structs in the header FILE", "FILE" },
+	{ "struct", 0, 0, G_OPTION_ARG_STRING, &sc_opts.decode_struct,
+		"Struct/union of the records to decode", "NAME" },
+	{ "abi", 0, 0, G_OPTION_ARG_STRING, &sc_opts.abi,
+		"ABI of the records to decode: x86_64, i386, aarch64 or arm", "ABI" },
+	{ "endian", 0, 0, G_OPTION_ARG_STRING, &sc_opts.endian,
+		"Byte order of the records to decode: little (default) or big", "ORDER" },
+	{ "json", 0, 0, G_OPTION_ARG_NONE, &sc_opts.json,
+		"Decode the records to JSON instead of XML", NULL },
+	{ "pid", 0, 0, G_OPTION_ARG_INT, &sc_opts.pid,
+		"Process to inspect", "PID" },
+	{ "addr", 0, 0, G_OPTION_ARG_STRING, &sc_opts.address,
+		"Address of the structs to inspect", "ADDRESS" },
+	{ "count", 0, 0, G_OPTION_ARG_INT, &sc_opts.count,
+		"Number of structs to inspect (default: 1)", "N" },
+	{ "depth", 0, 0, G_OPTION_ARG_INT, &sc_opts.depth,
+		"Levels of struct pointers to follow when inspecting (default: 0)", "N" },
+	{ "to", 0, 0, G_OPTION_ARG_STRING, &sc_opts.convert_abi,
+		"ABI to convert the records to", "ABI" },
+	{ "to-endian", 0, 0, G_OPTION_ARG_STRING, &sc_opts.to_endian,
+		"Byte order to convert the records to: little (default) or big", "ORDER" },
+	{ "graph", 'g', 0, G_OPTION_ARG_FILENAME, &sc_opts.graph,
+		"Write the type dependency graph to FILE, or query it", "FILE" },
+	{ "dependents", 0, 0, G_OPTION_ARG_STRING, &sc_opts.dependents,
+		"List the types that use TYPE, directly or not", "TYPE" },
+	{ "dependencies", 0, 0, G_OPTION_ARG_STRING, &sc_opts.dependencies,
+		"List the types used by TYPE, directly or not", "TYPE" },
+	{ "topo", 0, 0, G_OPTION_ARG_NONE, &sc_opts.topo,
+		"List the types, each one after the types it contains", NULL },
+	{ "embedded", 0, 0, G_OPTION_ARG_NONE, &sc_opts.embedded,
+		"Do not follow the types used only through pointers", NULL },
+	{ "archive", 'a', 0, G_OPTION_ARG_FILENAME, &sc_opts.archive,
+		"Write all the XML files compressed into a single archive", "FILE" },
+	{ "threads", 'j', 0, G_OPTION_ARG_INT, &sc_opts.threads,
+		"Number of compression/padding/decode/convert threads or diff processes (default: one per processor)", "N" },
+	{ "list", 'l', 0, G_OPTION_ARG_NONE, &sc_opts.list,
+		"List the entries of the archive", NULL },
+	{ "extract", 'e', 0, G_OPTION_ARG_STRING, &sc_opts.extract,
+		"Extract an entry of the archive to stdout", "NAME" },
+	{ NULL }
+};
+
 static gboolean stub_exists(gchar *filename)
 {
 	gchar 		*stubfile;
@@ -64,64 +170,25 @@ static gboolean stub_exists(gchar *filename)
 }
 
 /**
- * @brief Renames a file with a name  *.gen.h.xml  to  *.h.xml
- * The former file was the output of parse_file() that received as input
- * a file *.gen.h
- * @param gen_name The file example.gen.h.xml
- */
-static void rename_files(gchar *gen_name)
-{
-	gint	offset;
-	gchar	*gen_xml_name,
-			*xml_name;
-	struct stat stats;
-
-	/* Rename the file example.gen.h.xml to example.h.xml */
-	gen_xml_name = g_new0(gchar, strlen(gen_name) + 10);
-	sprintf(gen_xml_name, "%s.xml", gen_name);
-
-	xml_name = g_new0(gchar, strlen(gen_name) + 10);
-	sprintf(xml_name, "%s", gen_name);
-	offset = strlen(gen_name) - 6;
-	sprintf(xml_name + offset, ".h.xml");
-	/*printf("%s(): final filename: '%s'\n", __func__, xml_name);*/
-	rename(gen_xml_name, xml_name);
-
-	/* Remove file *.gen.h.xml */
-	if (stat(gen_xml_name, &stats) != -1) {
-	unlink(gen_xml_name);
-	g_free(gen_xml_name);
-	}
-}
-
-/**
- * @brief Parse a file by calling yyparse()
- * @param filename File to parse
+ * @brief Parse a stream by calling yyparse()
+ * @param fd The stream to parse
+ * @param filename File being parsed
+ * @param xml_filename The XML file to create
  * @return SC_OK if everything is ok, SC_FAIL otherwise
  */
-SCResult parse_file(char *filename)
+static SCResult parse_stream(FILE *fd, char *filename, char *xml_filename)
 {
 	SCResult rc;
-	FILE *fd;
 
-	rc = xml_file_create(filename);
+	rc = xml_file_create(xml_filename);
 	if (rc != SC_OK)
 		return SC_FAIL; 
 
-	fd = fopen(filename, "r");
-	if (fd == NULL) {
-		perror("fopen()");
-		xml_file_close();
-		return SC_FAIL;
-	}
-
 	log_error(LOG_INFO, "*** Parsing file %s ***\n", filename);
 
 	yyin = fd;
 	yyparse();
 
-	fclose(fd);
-
 	if (xml_ptr->struct_cnt) {
 		log_error(LOG_ERR, "%s(): The parser could not recognize the token!",
 			__func__);
@@ -138,6 +205,67 @@ SCResult parse_file(char *filename)
 	return SC_OK;
 }
 
+/**
+ * @brief Parse a file by calling yyparse(). 
+ *        With --dedup the file is read in memory and hashed, then parsed
+ *        from memory only if no identical file was parsed before.
+ * @param filename File to parse
+ * @param xml_filename The XML file to create
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult parse_file(char *filename, char *xml_filename)
+{
+	SCResult rc;
+	FILE *fd;
+	gchar *contents = NULL,
+		  *digest = NULL;
+	gsize length = 0;
+
+	if (sc_opts.dedup) {
+		if (!g_file_get_contents(filename, &contents, &length, NULL)) {
+			log_error(LOG_ERR, "%s(): Could not read file '%s'", __func__, filename);
+			return SC_FAIL;
+		}
+
+		digest = dedup_digest(xml_filename, contents, length);
+		if (dedup_claim(digest, xml_filename) == DEDUP_COPIED) {
+			log_error(LOG_INFO, "*** File %s is a duplicate ***\n", filename);
+
+			/* Its constants are still seen by the headers including it */
+			if (sc_opts.abis) {
+				gchar *header = g_strndup(xml_filename, strlen(xml_filename) - 4);
+
+				consts_scan(header, contents);
+				g_free(header);
+			}
+			g_free(contents);
+			g_free(digest);
+			return SC_OK;
+		}
+	}
+
+	if (contents != NULL && length > 0)
+		fd = fmemopen(contents, length, "r");
+	else
+		fd = fopen(filename, "r");
+	if (fd == NULL) {
+		perror("fopen()");
+		rc = SC_FAIL;
+	}
+	else {
+		rc = parse_stream(fd, filename, xml_filename);
+		fclose(fd);
+	}
+
+	if (digest != NULL)
+		dedup_publish(digest, xml_filename, rc == SC_OK);
+
+	g_free(contents);
+	g_free(digest);
+
+	return rc;
+}
+
 /**
  * @brief Call the C pre-processor for exanding the macros. The resulting file
  * with the expanded macro can then be parsed with the C grammar
@@ -157,10 +285,22 @@ gchar * preprocess_stub(gchar *stub_file, gchar *needle)
 	if (stub_file == NULL)
 		return NULL;
 
-	gen_name = g_new0(gchar, strlen(stub_file) + 1);
-	sprintf(gen_name, "%s", stub_file);
-	offset = strlen(stub_file) - 7;
-	sprintf(gen_name + offset, ".gen.h");
+	/* The shards of sc2xml diff run at the same time, possibly on the same
+	 * tree, so they keep the pre-processed file out of it */
+	if (sc_opts.shards) {
+		rc = g_file_open_tmp("sc2xml-XXXXXX.gen.h", &gen_name, NULL);
+		if (rc == -1) {
+			log_error(LOG_ERR, "Could not create a temporary file for pre-processing");
+			return NULL;
+		}
+		close(rc);
+	}
+	else {
+		gen_name = g_new0(gchar, strlen(stub_file) + 1);
+		sprintf(gen_name, "%s", stub_file);
+		offset = strlen(stub_file) - 7;
+		sprintf(gen_name + offset, ".gen.h");
+	}
 	/*printf("%s(): gen filename: '%s'\n", __func__, gen_name);*/
 
 	pid = vfork();
@@ -204,8 +344,10 @@ gchar * preprocess_stub(gchar *stub_file, gchar *needle)
  */
 SCResult get_files(int file_count, char **files)
 {
+	static guint file_seq = 0;
 	int 		i;
 	gchar		*gen_name = NULL,
+				*xml_name,
 				*needle;
 	SCResult 	rc;
 	struct stat stats;
@@ -227,6 +369,10 @@ SCResult get_files(int file_count, char **files)
 				continue;
 			}
 
+			/* Each shard parses every n-th file */
+			if (sc_opts.shards > 1 && file_seq++ % sc_opts.shards != sc_opts.shard)
+				continue;
+
 			if ((needle = strstr(files[i], ".stub.h")) != NULL) {
 				/* Pre-process file example.stub.h */
 				if ((gen_name = preprocess_stub(files[i], needle)) == NULL) {
@@ -235,31 +381,34 @@ SCResult get_files(int file_count, char **files)
 					continue;
 				}
 
-				/* Parse the pre-processed file example.gen.h */
-				rc = parse_file(gen_name);
+				/* Parse the pre-processed file example.gen.h. 
+				 * The resulting XML file is example.h.xml */
+				xml_name = g_strdup(files[i]);
+				sprintf(xml_name + (needle - files[i]), ".h.xml");
+
+				rc = parse_file(gen_name, xml_name);
 				if (rc != SC_OK) {
 					log_error(LOG_ERR, "%s(): Could not parse file '%s'. Skipping...", 
 						__func__, files[i]);
-					g_free(gen_name);
-					continue;
 				}
 
-				rename_files(gen_name);
-
 				/* Remove file *.gen.h */
 				unlink(gen_name);
 				g_free(gen_name);
+				g_free(xml_name);
 			}
 			else {
 				if (stub_exists(files[i]) == TRUE)
 					continue;
 
 				/* Process normal files '.h' */
-				rc = parse_file(files[i]);
+				xml_name = g_strconcat(files[i], ".xml", NULL);
+				rc = parse_file(files[i], xml_name);
 				if (rc != SC_OK) {
 					log_error(LOG_ERR, "%s(): Could not parse file '%s'. Skipping...", 
 						__func__, files[i]);
 				}
+				g_free(xml_name);
 			}
 		}
 		else if (S_ISDIR(stats.st_mode)) {
@@ -286,11 +435,202 @@ SCResult get_files(int file_count, char **files)
 
 void usage(char *prog_name)
 {
-	printf("Usage: %s <file0>|<dir0> [file1] ...\n", prog_name);
+	printf("Usage: %s [OPTION...] <file0>|<dir0> [file1] ...\n", prog_name);
+	printf("   or: %s diff <old-tree> <new-tree>\n", prog_name);
+	printf("   or: %s decode --struct NAME --abi ABI [--json] <file.bin> <file0>|<dir0> ...\n",
+		prog_name);
+	printf("   or: %s convert --struct NAME --abi ABI --to ABI <in.bin> <out.bin> <file0>|<dir0> ...\n",
+		prog_name);
+	printf("   or: %s migrate --struct NAME --abi ABI <old-tree> <new-tree> [<in.bin> <out.bin>]\n",
+		prog_name);
+	printf("   or: %s inspect --pid PID --addr ADDRESS --struct NAME [--count N] [--depth N] "
+		"<file0>|<dir0> ...\n", prog_name);
+	printf("   or: %s trace [--abi ABI] [--json] <file.trc> <file0>|<dir0> ...\n", prog_name);
+	printf("Try '%s --help' for the list of options\n", prog_name);
 }
 
 int main(int argc, char **argv) 
 {
+	GOptionContext	*context;
+	GError			*error = NULL;
+	SCResult		rc;
+
+	context = g_option_context_new("<file0>|<dir0> [file1] ...");
+	g_option_context_add_main_entries(context, option_entries, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &error)) {
+		log_error(LOG_ERR, "%s", error->message);
+		g_error_free(error);
+		g_option_context_free(context);
+		usage(argv[0]);
+		return -1;
+	}
+	g_option_context_free(context);
+
+	/* Compare two trees */
+	if (argc > 1 && strcmp(argv[1], "diff") == 0) {
+		guint differences = 0;
+
+		if (argc != 4) {
+			usage(argv[0]);
+			return -1;
+		}
+		/* The layouts are compared for the ABIs given to --layout, or for
+		 * the one sc2xml runs on */
+		if (sc_opts.layout && layout_parse_abis(sc_opts.layout, &sc_opts.abis) != SC_OK)
+			return -1;
+		if (!sc_opts.layout && layout_abi_host() >= 0)
+			sc_opts.abis = 1 << layout_abi_host();
+		if (diff_trees(argv[2], argv[3], &differences) != SC_OK)
+			return -1;
+		return differences ? 1 : 0;
+	}
+
+	/* Decode a file of records */
+	if (argc > 1 && strcmp(argv[1], "decode") == 0) {
+		if (argc < 4 || sc_opts.decode_struct == NULL || sc_opts.abi == NULL) {
+			usage(argv[0]);
+			return -1;
+		}
+		return decode_records(argv[2], argc - 3, &argv[3]) == SC_OK ? 0 : -1;
+	}
+
+	/* Decode structs in the memory of a running process */
+	if (argc > 1 && strcmp(argv[1], "inspect") == 0) {
+		guint64	address;
+		gchar	*end = NULL;
+		int		abi = layout_abi_host();
+
+		if (argc < 3 || sc_opts.pid <= 0 || sc_opts.address == NULL || sc_opts.decode_struct == NULL) {
+			usage(argv[0]);
+			return -1;
+		}
+		address = g_ascii_strtoull(sc_opts.address, &end, 0);
+		if (end == sc_opts.address || *end != '\0') {
+			log_error(LOG_ERR, "Bad address '%s'", sc_opts.address);
+			return -1;
+		}
+		if (sc_opts.abi == NULL && abi >= 0)
+			sc_opts.abi = (char *)layout_abi_name(abi);
+		if (sc_opts.abi == NULL) {
+			log_error(LOG_ERR, "--abi is needed on this machine");
+			return -1;
+		}
+		return decode_process(sc_opts.pid, address, sc_opts.count > 0 ? sc_opts.count : 1,
+			argc - 2, &argv[2]) == SC_OK ? 0 : -1;
+	}
+
+	/* Decode a trace file of the generated loggers, see --tracers */
+	if (argc > 1 && strcmp(argv[1], "trace") == 0) {
+		int abi = layout_abi_host();
+
+		if (argc < 4) {
+			usage(argv[0]);
+			return -1;
+		}
+		if (sc_opts.abi == NULL && abi >= 0)
+			sc_opts.abi = (char *)layout_abi_name(abi);
+		if (sc_opts.abi == NULL) {
+			log_error(LOG_ERR, "--abi is needed on this machine");
+			return -1;
+		}
+		return decode_trace(argv[2], argc - 3, &argv[3]) == SC_OK ? 0 : -1;
+	}
+
+	/* Convert a file of records to another ABI */
+	if (argc > 1 && strcmp(argv[1], "convert") == 0) {
+		if (argc < 5 || sc_opts.decode_struct == NULL || sc_opts.abi == NULL || sc_opts.convert_abi == NULL) {
+			usage(argv[0]);
+			return -1;
+		}
+		return convert_records(argv[2], argv[3], argc - 4, &argv[4]) == SC_OK ? 0 : -1;
+	}
+
+	/* Migrate a file of records to a new revision of the headers */
+	if (argc > 1 && strcmp(argv[1], "migrate") == 0) {
+		if ((argc != 4 && argc != 6) || sc_opts.decode_struct == NULL || sc_opts.abi == NULL) {
+			usage(argv[0]);
+			return -1;
+		}
+		return migrate_records(argv[2], argv[3], argc == 6 ? argv[4] : NULL,
+			argc == 6 ? argv[5] : NULL) == SC_OK ? 0 : -1;
+	}
+
+	/* Query an existing graph */
+	if (sc_opts.graph && (sc_opts.dependents || sc_opts.dependencies || sc_opts.topo)) {
+		if (sc_opts.dependents)
+			rc = graph_dependents(sc_opts.graph, sc_opts.dependents, sc_opts.embedded);
+		else if (sc_opts.dependencies)
+			rc = graph_dependencies(sc_opts.graph, sc_opts.dependencies, sc_opts.embedded);
+		else
+			rc = graph_topo(sc_opts.graph);
+		return rc == SC_OK ? 0 : -1;
+	}
+
+	/* Read an existing archive */
+	if (sc_opts.archive && (sc_opts.list || sc_opts.extract)) {
+		if (sc_opts.list)
+			return archive_list(sc_opts.archive) == SC_OK ? 0 : -1;
+		return archive_extract(sc_opts.archive, sc_opts.extract, stdout) == SC_OK ? 0 : -1;
+	}
+
+	if (sc_opts.dedup_dir) {
+		if (sc_opts.archive) {
+			log_error(LOG_ERR, "--dedup-dir cannot be used with --archive");
+			return -1;
+		}
+		sc_opts.dedup = 1;
+	}
+
+	if ((sc_opts.manifest || sc_opts.graph || sc_opts.padding) && sc_opts.dedup_dir) {
+		log_error(LOG_ERR, "--manifest, --graph and --padding cannot be used with --dedup-dir");
+		return -1;
+	}
+
+	if (sc_opts.layout && layout_parse_abis(sc_opts.layout, &sc_opts.abis) != SC_OK)
+		return -1;
+
+	if (sc_opts.padding && !sc_opts.abis) {
+		log_error(LOG_ERR, "--padding needs the ABIs given to --layout");
+		return -1;
+	}
+
+	if (sc_opts.equality && equal_abi_get() < 0) {
+		log_error(LOG_ERR, "--equality needs an ABI given to --layout on this machine");
+		return -1;
+	}
+
+	if (sc_opts.profile && !sc_opts.padding) {
+		log_error(LOG_ERR, "--profile needs --padding");
+		return -1;
+	}
+
+	if (sc_opts.profile && profile_read(sc_opts.profile) != SC_OK)
+		return -1;
+
+	sc_opts.generate = sc_opts.soa || sc_opts.reflect || sc_opts.serializers ||
+					   sc_opts.loaders || sc_opts.tracers || sc_opts.equality ||
+					   sc_opts.slabs;
+
+	if (sc_opts.generate && sc_opts.dedup_dir) {
+		log_error(LOG_ERR, "Code cannot be generated with --dedup-dir");
+		return -1;
+	}
+
+	if (sc_opts.select && (!sc_opts.generate || gen_select(sc_opts.select) != SC_OK)) {
+		log_error(LOG_ERR, "--select needs a code generator like --soa");
+		return -1;
+	}
+
+	if (sc_opts.resolve && (sc_opts.dedup || sc_opts.dedup_structs)) {
+		log_error(LOG_ERR, "--resolve cannot be used with --dedup or --dedup-structs");
+		return -1;
+	}
+
+	if (sc_opts.aggregate && (sc_opts.archive || sc_opts.dedup)) {
+		log_error(LOG_ERR, "--aggregate cannot be used with --archive or --dedup");
+		return -1;
+	}
+
 	if (argc < 2) {
 		usage(argv[0]);
 		return -1;
@@ -298,7 +638,54 @@ int main(int argc, char **argv)
 
 	g_printf("\n%s\n\n", PACKAGE_STRING);
 
-	if (get_files(argc - 1, &argv[1]) != SC_FAIL)
+	if (sc_opts.archive && archive_open(sc_opts.archive, sc_opts.threads) != SC_OK)
+		return -1;
+
+	if (sc_opts.aggregate && xml_aggregate_open(sc_opts.aggregate) != SC_OK)
+		return -1;
+
+	rc = get_files(argc - 1, &argv[1]);
+
+	if (sc_opts.resolve && xml_resolve_flush() != SC_OK)
+		return -1;
+
+	if (sc_opts.aggregate && xml_aggregate_close() != SC_OK)
+		return -1;
+
+	if (sc_opts.archive && archive_close() != SC_OK)
+		return -1;
+
+	if (sc_opts.manifest && manifest_write(sc_opts.manifest) != SC_OK)
+		return -1;
+
+	if (sc_opts.graph && graph_write(sc_opts.graph) != SC_OK)
+		return -1;
+
+	if (sc_opts.padding && padding_write(sc_opts.padding, sc_opts.threads) != SC_OK)
+		return -1;
+
+	if (sc_opts.soa && soa_write(sc_opts.soa) != SC_OK)
+		return -1;
+
+	if (sc_opts.reflect && reflect_write() != SC_OK)
+		return -1;
+
+	if (sc_opts.serializers && serialize_write(sc_opts.serializers) != SC_OK)
+		return -1;
+
+	if (sc_opts.loaders && deserialize_write(sc_opts.loaders) != SC_OK)
+		return -1;
+
+	if (sc_opts.tracers && trace_write(sc_opts.tracers) != SC_OK)
+		return -1;
+
+	if (sc_opts.equality && equal_write(sc_opts.equality) != SC_OK)
+		return -1;
+
+	if (sc_opts.slabs && slab_write(sc_opts.slabs) != SC_OK)
+		return -1;
+
+	if (rc != SC_FAIL)
 		return -1;
 
 	return SC_OK;
@@ -0,0 +1,146 @@
+/**
+ * @file manifest.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * @brief Manifest of the structural fingerprints of all the top-level 
+ *        structs/unions of a run. It is written at the end, one line per
+ *        struct, the fields separated by tabs:
+ *
+ *        hash kind name header
+ *
+ *        where kind is 'struct' or 'union' and name is '-' for anonymous
+ *        structs. Comparing the manifests of two releases tells which 
+ *        layouts changed without comparing the XML files.
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "config.h"
+#include "sc2xml.h"
+#include "misc.h"
+#include "model.h"
+#include "manifest.h"
+
+static GPtrArray	*files = NULL;		/**< XML files, in the order they were written */
+static GHashTable	*entries = NULL;	/**< XML file -> GString with its lines */
+
+/**
+ * @brief Get the lines of an XML file, creating them if needed
+ * @param xml_filename The XML file
+ * @return The lines without the header column
+ */
+static GString * manifest_lines(const char *xml_filename)
+{
+	GString *lines;
+
+	if (entries == NULL) {
+		files = g_ptr_array_new();
+		entries = g_hash_table_new(g_str_hash, g_str_equal);
+	}
+
+	lines = g_hash_table_lookup(entries, xml_filename);
+	if (lines == NULL) {
+		gchar *key = g_strdup(xml_filename);
+
+		lines = g_string_new(NULL);
+		g_ptr_array_add(files, key);
+		g_hash_table_insert(entries, key, lines);
+	}
+
+	return lines;
+}
+
+/**
+ * @brief Add a top-level struct of an XML file
+ * @param xml_filename The XML file being written
+ * @param st The struct
+ * @return SC_OK
+ */
+SCResult manifest_add(const char *xml_filename, SCStruct *st)
+{
+	gchar *name;
+
+	name = model_struct_name(st);
+	g_string_append_printf(manifest_lines(xml_filename), "%s\t%s\t%s\n", 
+		model_struct_hash(st), st->is_union ? "union" : "struct", 
+		name ? name : "-");
+	g_free(name);
+
+	return SC_OK;
+}
+
+/**
+ * @brief An XML file is a copy of another one (see dedup_claim()), 
+ *        so it has the same structs
+ * @param src The XML file that was parsed
+ * @param dst Its copy
+ * @return SC_OK if everything is ok, SC_FAIL if src is unknown
+ */
+SCResult manifest_copy(const char *src, const char *dst)
+{
+	GString *lines;
+
+	if (entries == NULL || (lines = g_hash_table_lookup(entries, src)) == NULL)
+		return SC_FAIL;
+
+	g_string_append_len(manifest_lines(dst), lines->str, lines->len);
+
+	return SC_OK;
+}
+
+/**
+ * @brief Write the manifest
+ * @param filename The manifest file
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult manifest_write(const char *filename)
+{
+	GString		*str;
+	SCResult	rc = SC_OK;
+	guint		i;
+
+	str = g_string_new(NULL);
+
+	for (i = 0; files && i < files->len; i++) {
+		const char	*xml_filename = g_ptr_array_index(files, i);
+		GString		*lines = g_hash_table_lookup(entries, xml_filename);
+		gchar		**line;
+		gint		n, 
+					header_len;
+
+		/* The header is the XML filename without '.xml' */
+		header_len = strlen(xml_filename) - 4;
+
+		line = g_strsplit(lines->str, "\n", -1);
+		for (n = 0; line[n] != NULL; n++) {
+			if (*line[n] == '\0')
+				continue;
+			g_string_append_printf(str, "%s\t%.*s\n", line[n], header_len, 
+				xml_filename);
+		}
+		g_strfreev(line);
+	}
+
+	if (sc_opts.if_changed) {
+		rc = write_if_changed(filename, str->str, str->len, NULL);
+	}
+	else if (!g_file_set_contents(filename, str->str, str->len, NULL)) {
+		rc = SC_FAIL;
+	}
+
+	if (rc != SC_OK)
+		log_error(LOG_ERR, "%s(): Could not write the manifest '%s'", 
+			__func__, filename);
+
+	g_string_free(str, TRUE);
+
+	return rc;
+}
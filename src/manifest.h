@@ -0,0 +1,23 @@
+/**
+ * @file manifest.h
+ *
+ * @brief Defines for manifest.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#ifndef _MANIFEST_H
+#define _MANIFEST_H
+
+#include "sc2xml.h"
+#include "model.h"
+
+SCResult	manifest_add(const char *, SCStruct *);
+SCResult	manifest_copy(const char *, const char *);
+SCResult	manifest_write(const char *);
+
+#endif	/* _MANIFEST_H */
@@ -0,0 +1,424 @@
+/**
+ * @file migrate.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * @brief Binary record migration (sc2xml migrate). When a struct changes
+ *        between two revisions of the headers, a file of records written
+ *        with the old one is rewritten with the new one:
+ *
+ *        sc2xml migrate --struct NAME --abi ABI <old-tree> <new-tree>
+ *            [in.bin out.bin]
+ *
+ *        Both revisions are parsed and the struct is flattened into its
+ *        scalar members, named by their path (e.g. 'hdr.flags' or
+ *        'ports[2].speed'). The members of the new struct are matched by
+ *        name with the old ones and the plan is a program of convert.c:
+ *        members that did not move are copied, and neighbours that did not
+ *        move either are one copy, integers that grew or shrank are resized,
+ *        arrays are truncated or extended and new members are left zeroed.
+ *        The plan is written to stdout and, given the files, run over them
+ *        by the threads of convert_run().
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "config.h"
+#include "sc2xml.h"
+#include "misc.h"
+#include "model.h"
+#include "consts.h"
+#include "layout.h"
+#include "gen.h"
+#include "decode.h"
+#include "convert.h"
+#include "migrate.h"
+
+/* A scalar member, or a whole union */
+typedef struct {
+	gchar *path;			/**< e.g. 'ports[2].speed' */
+	SCDecodeKind kind;		/**< DECODE_RAW for unions and long double */
+	guint64 offset;			/**< Bits from the start of the record */
+	guint64 size;			/**< Bytes of an element, of the unit of a bit field */
+	guint64 count;			/**< Elements, 1 if it is not an array */
+	guint width;			/**< Width of a bit field, 0 otherwise */
+} SCMigrateLeaf;
+
+/* A struct flattened for one revision */
+typedef struct {
+	guint64 size;
+	GPtrArray *leaves;		/**< SCMigrateLeaf */
+} SCMigrateStruct;
+
+static GHashTable	*types[2] = { NULL, NULL };	/**< Name or C type -> SCMigrateStruct */
+static GPtrArray	*flattened = NULL;			/**< The SCMigrateStruct */
+static int			revision = 0;				/**< 0 while parsing the old tree */
+static SCAbi		abi;
+
+static void migrate_leaf_free(gpointer data)
+{
+	SCMigrateLeaf *leaf = data;
+
+	g_free(leaf->path);
+	g_free(leaf);
+}
+
+static void migrate_struct_free(gpointer data)
+{
+	SCMigrateStruct *st = data;
+
+	g_ptr_array_free(st->leaves, TRUE);
+	g_free(st);
+}
+
+/**
+ * @brief Add a leaf
+ */
+static void migrate_leaf(GPtrArray *leaves, gchar *path, SCDecodeKind kind, guint64 offset,
+		guint64 size, guint64 count, guint width)
+{
+	SCMigrateLeaf *leaf = g_new0(SCMigrateLeaf, 1);
+
+	leaf->path = path;
+	leaf->kind = kind;
+	leaf->offset = offset;
+	leaf->size = size;
+	leaf->count = count;
+	leaf->width = width;
+	g_ptr_array_add(leaves, leaf);
+}
+
+/**
+ * @brief Prefix of the members of an element of a struct member
+ */
+static gchar * migrate_prefix(const char *prefix, const char *name, int array, guint64 i)
+{
+	if (array)
+		return g_strdup_printf("%s%s[%" G_GUINT64_FORMAT "].", prefix, name, i);
+
+	return g_strdup_printf("%s%s.", prefix, name);
+}
+
+/**
+ * @brief Flatten the members of a struct
+ * @param leaves Where the leaves are added
+ * @param st The struct
+ * @param prefix Path of st, e.g. 'hdr.'
+ * @param base Offset in bits of st in the record
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+static SCResult migrate_flatten(GPtrArray *leaves, SCStruct *st, const char *prefix,
+		guint64 base)
+{
+	guint	i;
+	guint64	j;
+
+	for (i = 0; i < st->fields->len; i++) {
+		SCField			*field = g_ptr_array_index(st->fields, i);
+		SCLayout		*layout = &field->layout[abi];
+		SCMigrateStruct	*known = NULL;
+		SCDecodeKind	kind;
+		gchar			*name,
+						*path;
+		gint64			width = 0;
+		guint64			size;
+		int				array,
+						pointer,
+						text;
+
+		if (!layout->known)
+			return SC_FAIL;
+		size = layout->count ? layout->size / layout->count : 0;
+
+		if (field->nested) {
+			if ((name = gen_nested_name(field->nested, &array)) == NULL) {
+				if (field->nested->name == NULL && migrate_flatten(leaves, field->nested,
+						prefix, base + layout->offset) != SC_OK)
+					return SC_FAIL;
+				continue;
+			}
+
+			for (j = 0; j < layout->count; j++) {
+				path = migrate_prefix(prefix, name, array, j);
+				if (field->nested->is_union) {
+					path[strlen(path) - 1] = '\0';
+					migrate_leaf(leaves, path, DECODE_RAW, base + layout->offset + j * size * 8,
+						size, 1, 0);
+					continue;
+				}
+				if (migrate_flatten(leaves, field->nested, path,
+						base + layout->offset + j * size * 8) != SC_OK) {
+					g_free(path);
+					g_free(name);
+					return SC_FAIL;
+				}
+				g_free(path);
+			}
+			g_free(name);
+			continue;
+		}
+
+		if (field->name == NULL || *field->name == '\0' || layout->count == 0)
+			continue;
+		if (field->bits && (width = layout->bits) == 0)
+			continue;
+
+		name = model_type_name(field->type, &pointer);
+		if (!pointer && !field->func_ptr && name && types[revision])
+			known = g_hash_table_lookup(types[revision], name);
+		g_free(name);
+
+		/* A struct flattened before, once per element */
+		if (known) {
+			for (j = 0; j < layout->count; j++) {
+				gchar	*element = migrate_prefix(prefix, field->name, field->size != NULL, j);
+				guint	k;
+
+				for (k = 0; k < known->leaves->len; k++) {
+					SCMigrateLeaf *leaf = g_ptr_array_index(known->leaves, k);
+
+					/* A union is a leaf of its own, named like the field */
+					path = *leaf->path ? g_strconcat(element, leaf->path, NULL) :
+						g_strndup(element, strlen(element) - 1);
+					migrate_leaf(leaves, path, leaf->kind,
+						base + layout->offset + j * size * 8 + leaf->offset, leaf->size,
+						leaf->count, leaf->width);
+				}
+				g_free(element);
+			}
+			continue;
+		}
+
+		if (pointer || field->func_ptr)
+			kind = DECODE_POINTER;
+		else if ((kind = decode_scalar(field, abi, &text)) != DECODE_FLOAT && size > 8)
+			kind = DECODE_RAW;
+
+		migrate_leaf(leaves, g_strconcat(prefix, field->name, NULL), kind,
+			base + layout->offset, field->bits ? layout->size : size, layout->count, width);
+	}
+
+	return SC_OK;
+}
+
+/**
+ * @brief Flatten a top-level struct of the revision being parsed
+ * @param header The header where it is defined
+ * @param st The struct
+ * @return SC_OK
+ */
+SCResult migrate_add(const char *header, SCStruct *st)
+{
+	SCMigrateStruct	*out;
+	gchar			*names[4];
+	int				i;
+
+	if (!st->layout[abi].known)
+		return SC_OK;
+
+	out = g_new0(SCMigrateStruct, 1);
+	out->size = st->layout[abi].size;
+	out->leaves = g_ptr_array_new_with_free_func(migrate_leaf_free);
+	if (st->is_union)
+		migrate_leaf(out->leaves, g_strdup(""), DECODE_RAW, 0, out->size, 1, 0);
+	else if (migrate_flatten(out->leaves, st, "", 0) != SC_OK) {
+		debug_info("Layout of a struct in '%s' not known, it cannot be migrated\n", header);
+		migrate_struct_free(out);
+		return SC_OK;
+	}
+
+	if (flattened == NULL)
+		flattened = g_ptr_array_new_with_free_func(migrate_struct_free);
+	if (types[revision] == NULL)
+		types[revision] = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	g_ptr_array_add(flattened, out);
+
+	/* By name, and by type for the fields of this type */
+	names[0] = model_struct_name(st);
+	names[1] = gen_type_name(st);
+	names[2] = model_declarator_name(st->typedef_name);
+	names[3] = model_declarator_name(st->tail_name);
+	for (i = 0; i < 4; i++)
+		if (names[i])
+			g_hash_table_replace(types[revision], names[i], out);
+
+	return SC_OK;
+}
+
+/**
+ * @brief Write an operation of the plan
+ */
+static void migrate_print_op(SCConvertOp *op)
+{
+	switch (op->kind) {
+	case CONVERT_COPY:
+		printf("copy   %6" G_GUINT64_FORMAT " -> %6" G_GUINT64_FORMAT "  %" G_GUINT64_FORMAT
+			" bytes\n", op->src, op->dst, op->src_size);
+		break;
+
+	case CONVERT_INT:
+		printf("resize %6" G_GUINT64_FORMAT " -> %6" G_GUINT64_FORMAT "  %" G_GUINT64_FORMAT
+			" x %" G_GUINT64_FORMAT " -> %" G_GUINT64_FORMAT " bytes%s\n", op->src, op->dst,
+			op->count, op->src_size, op->dst_size, op->is_signed ? ", signed" : "");
+		break;
+
+	case CONVERT_BITS:
+		printf("bits   %4" G_GUINT64_FORMAT ":%" G_GUINT64_FORMAT " -> %4" G_GUINT64_FORMAT
+			":%" G_GUINT64_FORMAT "  %u -> %u bits%s\n", op->src / 8, op->src % 8,
+			op->dst / 8, op->dst % 8, op->src_width, op->dst_width,
+			op->is_signed ? ", signed" : "");
+		break;
+
+	default:
+		break;
+	}
+}
+
+/**
+ * @brief Compile the migration of the members of the new struct
+ * @param program Where the operations are added
+ * @param from The old struct
+ * @param to The new struct
+ */
+static void migrate_plan(SCConvertProgram *program, SCMigrateStruct *from, SCMigrateStruct *to)
+{
+	GHashTable	*old;
+	guint		i;
+
+	old = g_hash_table_new(g_str_hash, g_str_equal);
+	for (i = 0; i < from->leaves->len; i++) {
+		SCMigrateLeaf *leaf = g_ptr_array_index(from->leaves, i);
+
+		g_hash_table_insert(old, leaf->path, leaf);
+	}
+
+	for (i = 0; i < to->leaves->len; i++) {
+		SCMigrateLeaf	*leaf = g_ptr_array_index(to->leaves, i),
+						*was = g_hash_table_lookup(old, leaf->path);
+		SCConvertOp		op;
+		guint64			count;
+
+		if (was == NULL) {
+			printf("new    %s, zeroed\n", leaf->path);
+			continue;
+		}
+		g_hash_table_remove(old, leaf->path);
+
+		/* Integers of another type keep their value, other types are lost */
+		if ((was->kind == DECODE_FLOAT || leaf->kind == DECODE_FLOAT ||
+				was->kind == DECODE_RAW || leaf->kind == DECODE_RAW) &&
+				(was->kind != leaf->kind || was->size != leaf->size || was->width ||
+				 leaf->width)) {
+			printf("type   %s changed, zeroed\n", leaf->path);
+			continue;
+		}
+
+		count = MIN(was->count, leaf->count);
+		if (was->count != leaf->count)
+			printf("%s %s, %" G_GUINT64_FORMAT " -> %" G_GUINT64_FORMAT " elements\n",
+				was->count > leaf->count ? "trunc " : "extend", leaf->path, was->count,
+				leaf->count);
+
+		if (was->kind == DECODE_RAW) {
+			memset(&op, 0, sizeof(op));
+			op.kind = CONVERT_COPY;
+			op.src = was->offset / 8;
+			op.dst = leaf->offset / 8;
+			op.src_size = op.dst_size = MIN(was->size * was->count, leaf->size * leaf->count);
+			convert_emit(program->ops, &op);
+		}
+		else if (was->width || leaf->width) {
+			memset(&op, 0, sizeof(op));
+			op.kind = CONVERT_BITS;
+			op.src = was->offset;
+			op.dst = leaf->offset;
+			op.src_width = was->width ? was->width : was->size * 8;
+			op.dst_width = leaf->width ? leaf->width : leaf->size * 8;
+			op.is_signed = was->kind == DECODE_SIGNED && op.dst_width > op.src_width;
+			convert_emit(program->ops, &op);
+		}
+		else
+			convert_emit_int(program->ops, was->offset / 8, leaf->offset / 8, was->size,
+				leaf->size, count, was->kind == DECODE_SIGNED, 0);
+	}
+
+	for (i = 0; i < from->leaves->len; i++) {
+		SCMigrateLeaf *leaf = g_ptr_array_index(from->leaves, i);
+
+		if (g_hash_table_lookup(old, leaf->path))
+			printf("drop   %s\n", leaf->path);
+	}
+	g_hash_table_destroy(old);
+
+	for (i = 0; i < program->ops->len; i++)
+		migrate_print_op(&g_array_index(program->ops, SCConvertOp, i));
+}
+
+/**
+ * @brief Migrate a file of records of a struct to a new revision of it
+ * @param old_tree The old headers, a file or a directory
+ * @param new_tree The new headers
+ * @param in_name The records, NULL to write only the plan
+ * @param out_name The migrated records
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult migrate_records(char *old_tree, char *new_tree, const char *in_name,
+		const char *out_name)
+{
+	SCMigrateStruct		*st[2];
+	SCConvertProgram	program;
+	char				*trees[2] = { old_tree, new_tree };
+	int					big;
+	SCResult			rc = SC_OK;
+
+	if ((abi = layout_abi_find(sc_opts.abi)) < 0) {
+		log_error(LOG_ERR, "Unknown ABI '%s', the ABIs are x86_64, i386, aarch64 and arm",
+			sc_opts.abi);
+		return SC_FAIL;
+	}
+	if (convert_endian(sc_opts.endian, &big) != SC_OK)
+		return SC_FAIL;
+
+	/* Each revision with its own constants and layouts */
+	sc_opts.abis = 1 << abi;
+	sc_opts.migrate = 1;
+	for (revision = 0; revision < 2; revision++) {
+		layout_reset();
+		consts_reset();
+		if (decode_parse(1, &trees[revision]) != SC_OK)
+			return SC_FAIL;
+
+		st[revision] = types[revision] ?
+			g_hash_table_lookup(types[revision], sc_opts.decode_struct) : NULL;
+		if (st[revision] == NULL || st[revision]->size == 0) {
+			log_error(LOG_ERR, "%s(): No struct/union '%s' laid out for %s in '%s'",
+				__func__, sc_opts.decode_struct, layout_abi_name(abi), trees[revision]);
+			return SC_FAIL;
+		}
+	}
+
+	printf("%s: %" G_GUINT64_FORMAT " -> %" G_GUINT64_FORMAT " bytes\n", sc_opts.decode_struct,
+		st[0]->size, st[1]->size);
+
+	memset(&program, 0, sizeof(program));
+	program.name = sc_opts.decode_struct;
+	program.src_size = st[0]->size;
+	program.dst_size = st[1]->size;
+	program.ops = g_array_new(FALSE, FALSE, sizeof(SCConvertOp));
+	migrate_plan(&program, st[0], st[1]);
+
+	if (in_name)
+		rc = convert_run(&program, in_name, out_name, big, big);
+
+	g_array_free(program.ops, TRUE);
+
+	return rc;
+}
@@ -0,0 +1,22 @@
+/**
+ * @file migrate.h
+ *
+ * @brief Defines for migrate.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#ifndef _MIGRATE_H
+#define _MIGRATE_H
+
+#include "sc2xml.h"
+#include "model.h"
+
+SCResult	migrate_add(const char *, SCStruct *);
+SCResult	migrate_records(char *, char *, const char *, const char *);
+
+#endif	/* _MIGRATE_H */
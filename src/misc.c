@@ -13,6 +13,10 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #include <glib.h>
 
@@ -38,6 +42,146 @@ void reset_buff(char *buff, int size)
         buff[i] = '\0';
 }
 
+/**
+ * @brief Compare a file against a buffer without loading the whole file
+ * @param filename The file
+ * @param data The buffer
+ * @param size Size of the buffer
+ * @return TRUE if the file exists and has the same contents
+ */
+static gboolean file_equals(const char *filename, const char *data, unsigned long size)
+{
+	FILE		*fd;
+	char		buff[CMP_BUFF];
+	size_t		len;
+	struct stat	stats;
+	gboolean	equal = TRUE;
+
+	if (stat(filename, &stats) == -1 || !S_ISREG(stats.st_mode) ||
+		(unsigned long)stats.st_size != size)
+		return FALSE;
+
+	if ((fd = fopen(filename, "rb")) == NULL)
+		return FALSE;
+
+	while (equal && (len = fread(buff, 1, sizeof(buff), fd)) > 0) {
+		if (len > size || memcmp(buff, data, len))
+			equal = FALSE;
+		data += len;
+		size -= len;
+	}
+
+	fclose(fd);
+
+	return equal && size == 0;
+}
+
+/**
+ * @brief Write a buffer to a file only if the file contents differ, so its
+ *        mtime is kept otherwise. The new contents are written to a
+ *        temporary file that replaces the old one with rename(), readers
+ *        never see a partially written file.
+ * @param filename The file
+ * @param data The new contents
+ * @param size Size of the new contents
+ * @param changed If not NULL, set to 1 if the file was replaced, 0 otherwise
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult write_if_changed(const char *filename, const char *data, 
+	unsigned long size, int *changed)
+{
+	gchar	*tmp_filename;
+	int		fd;
+	mode_t	mask;
+
+	if (changed)
+		*changed = 0;
+
+	if (file_equals(filename, data, size) == TRUE)
+		return SC_OK;
+
+	tmp_filename = g_strconcat(filename, ".XXXXXX", NULL);
+	fd = g_mkstemp(tmp_filename);
+	if (fd == -1) {
+		log_error(LOG_ERR, "%s(): Could not create '%s'", __func__, tmp_filename);
+		g_free(tmp_filename);
+		return SC_FAIL;
+	}
+
+	/* mkstemp() creates the file 0600, use the same mode as fopen() */
+	mask = umask(0);
+	umask(mask);
+	fchmod(fd, 0666 & ~mask);
+
+	while (size > 0) {
+		ssize_t len = write(fd, data, size);
+
+		if (len <= 0) {
+			log_error(LOG_ERR, "%s(): Could not write '%s'", __func__, tmp_filename);
+			close(fd);
+			unlink(tmp_filename);
+			g_free(tmp_filename);
+			return SC_FAIL;
+		}
+		data += len;
+		size -= len;
+	}
+	close(fd);
+
+	if (rename(tmp_filename, filename) == -1) {
+		log_error(LOG_ERR, "%s(): Could not replace '%s'", __func__, filename);
+		unlink(tmp_filename);
+		g_free(tmp_filename);
+		return SC_FAIL;
+	}
+
+	if (changed)
+		*changed = 1;
+
+	g_free(tmp_filename);
+
+	return SC_OK;
+}
+
+/**
+ * @brief Store a little endian u32
+ */
+void put_u32(guchar *buff, guint32 val)
+{
+	int i;
+
+	for (i = 0; i < 4; i++)
+		buff[i] = (val >> (8 * i)) & 0xff;
+}
+
+/**
+ * @brief Store a little endian u64
+ */
+void put_u64(guchar *buff, guint64 val)
+{
+	int i;
+
+	for (i = 0; i < 8; i++)
+		buff[i] = (val >> (8 * i)) & 0xff;
+}
+
+/**
+ * @brief Read a little endian u32
+ */
+guint32 get_u32(const guchar *buff)
+{
+	return (guint32)buff[0] | ((guint32)buff[1] << 8) |
+		((guint32)buff[2] << 16) | ((guint32)buff[3] << 24);
+}
+
+/**
+ * @brief Read a little endian u64
+ */
+guint64 get_u64(const guchar *buff)
+{
+	return (guint64)get_u32(buff) | ((guint64)get_u32(buff + 4) << 32);
+}
+
 /**
  * @brief Prints the log msgs to a log file and stdout using a specific format.
  */
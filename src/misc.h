@@ -13,6 +13,10 @@
 #ifndef _MISC_H
 #define _MISC_H
 
+#include <glib.h>
+
+#include "sc2xml.h"
+
 typedef enum {
     LOG_FATAL,
     LOG_ERR,
@@ -23,5 +27,10 @@ typedef enum {
 void	log_error(SCLogs, char *, ...);
 void	reset_buff(char *, int);
 void	debug_info(const char *, ...);
+SCResult	write_if_changed(const char *, const char *, unsigned long, int *);
+void	put_u32(guchar *, guint32);
+void	put_u64(guchar *, guint64);
+guint32	get_u32(const guchar *);
+guint64	get_u64(const guchar *);
 
 #endif	/* _MISC_H */
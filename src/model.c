@@ -0,0 +1,452 @@
+/**
+ * @file model.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * @brief Build, free and compare the in-memory description of the
+ *        parsed structs/unions.
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "config.h"
+#include "sc2xml.h"
+#include "model.h"
+#include "layout.h"
+
+/**
+ * @brief Append a tagged value, prefixed by its length so values cannot 
+ *        run together. NULL and "" are different values.
+ */
+static void put_value(GString *str, char tag, const char *val)
+{
+	g_string_append_printf(str, "%c%d:%s", tag, val ? (int)strlen(val) : -1, 
+		val ? val : "");
+}
+
+/**
+ * @brief Serialize the layouts of a struct or a field, all zero if they
+ *        were not computed
+ */
+static void put_layout(GString *str, const SCLayout *layout)
+{
+	int abi;
+
+	for (abi = 0; abi < ABI_COUNT; abi++)
+		if (layout[abi].known)
+			g_string_append_printf(str, "L%d:%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT
+				",%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT, abi,
+				layout[abi].offset, layout[abi].size, layout[abi].align,
+				layout[abi].count, layout[abi].bits);
+}
+
+/**
+ * @brief Append the value of a size or a width when it is not written as
+ *        that number, e.g. 'N' or '2 ] [ 3'
+ */
+static void put_number(GString *str, char tag, const char *text, gint64 value)
+{
+	gchar *number = g_strdup_printf("%" G_GINT64_FORMAT, value);
+
+	if (strcmp(number, text) != 0)
+		g_string_append_printf(str, "%c%s", tag, number);
+	g_free(number);
+}
+
+/**
+ * @brief Append the number of elements of the declarator of a nested
+ *        struct, e.g. 'name [ N ]'
+ */
+static void put_count(GString *str, const char *declarator)
+{
+	gint64 value;
+
+	if (declarator && strchr(declarator, '[') &&
+			layout_count(strchr(declarator, '[') + 1, &value) == SC_OK)
+		put_number(str, 'c', "", value);
+}
+
+static void model_field_free(gpointer data)
+{
+	SCField *field = (SCField *)data;
+
+	g_free(field->type);
+	g_free(field->bits);
+	g_free(field->size);
+	g_free(field->input_args);
+	g_free(field->name);
+	model_struct_free(field->nested);
+	g_free(field);
+}
+
+/**
+ * @brief Create a struct/union. If it is nested, it is added as a member
+ *        of its parent.
+ * @param is_union 0 for a struct, 1 for a union
+ * @param parent The enclosing struct or NULL
+ * @return The new struct
+ */
+SCStruct * model_struct_new(int is_union, SCStruct *parent)
+{
+	SCStruct *st;
+
+	st = g_new0(SCStruct, 1);
+	st->is_union = is_union;
+	st->fields = g_ptr_array_new_with_free_func(model_field_free);
+	st->parent = parent;
+
+	if (parent)
+		model_field_new(parent)->nested = st;
+
+	return st;
+}
+
+/**
+ * @brief Free a struct and all its members
+ * @param st The struct, may be NULL
+ */
+void model_struct_free(SCStruct *st)
+{
+	if (st == NULL)
+		return;
+
+	g_free(st->name);
+	g_free(st->typedef_name);
+	g_free(st->tail_name);
+	g_free(st->attributes);
+	g_free(st->nested_name);
+	g_free(st->hash);
+	g_ptr_array_free(st->fields, TRUE);
+	g_free(st);
+}
+
+/**
+ * @brief Copy a struct and all its members
+ * @param st The struct
+ * @param parent The enclosing struct of the copy or NULL
+ * @return The copy
+ */
+SCStruct * model_struct_copy(SCStruct *st, SCStruct *parent)
+{
+	SCStruct	*copy;
+	guint		i;
+
+	copy = model_struct_new(st->is_union, parent);
+	copy->name = g_strdup(st->name);
+	copy->typedef_name = g_strdup(st->typedef_name);
+	copy->tail_name = g_strdup(st->tail_name);
+	copy->attributes = g_strdup(st->attributes);
+	copy->nested_name = g_strdup(st->nested_name);
+	copy->hash = g_strdup(st->hash);
+	memcpy(copy->layout, st->layout, sizeof(copy->layout));
+
+	for (i = 0; i < st->fields->len; i++) {
+		SCField *field = g_ptr_array_index(st->fields, i),
+				*dst;
+
+		if (field->nested) {
+			model_struct_copy(field->nested, copy);
+			dst = g_ptr_array_index(copy->fields, copy->fields->len - 1);
+			memcpy(dst->layout, field->layout, sizeof(dst->layout));
+			continue;
+		}
+		dst = model_field_new(copy);
+		memcpy(dst->layout, field->layout, sizeof(dst->layout));
+		dst->type = g_strdup(field->type);
+		dst->bits = g_strdup(field->bits);
+		dst->size = g_strdup(field->size);
+		dst->func_ptr = field->func_ptr;
+		dst->input_args = g_strdup(field->input_args);
+		dst->name = g_strdup(field->name);
+	}
+
+	return copy;
+}
+
+/**
+ * @brief Append an empty member to a struct
+ * @param st The struct
+ * @return The new member
+ */
+SCField * model_field_new(SCStruct *st)
+{
+	SCField *field;
+
+	field = g_new0(SCField, 1);
+	g_ptr_array_add(st->fields, field);
+
+	return field;
+}
+
+/**
+ * @brief Serialize everything that is written to the XML file for a struct,
+ *        the layouts included: headers with different constants give the
+ *        same tokens different layouts
+ */
+static void model_struct_serialize(SCStruct *st, GString *str)
+{
+	guint i;
+
+	g_string_append_c(str, st->is_union ? 'U' : 'S');
+	put_value(str, 'n', st->name);
+
+	for (i = 0; i < st->fields->len; i++) {
+		SCField *field = g_ptr_array_index(st->fields, i);
+
+		if (field->nested) {
+			model_struct_serialize(field->nested, str);
+			put_layout(str, field->layout);
+			continue;
+		}
+		g_string_append_c(str, 'F');
+		put_value(str, 't', field->type);
+		put_value(str, 'b', field->bits);
+		put_value(str, 's', field->size);
+		g_string_append_printf(str, "p%d", field->func_ptr);
+		put_value(str, 'a', field->input_args);
+		put_value(str, 'n', field->name);
+		put_layout(str, field->layout);
+	}
+	put_layout(str, st->layout);
+
+	put_value(str, 'T', st->typedef_name);
+	put_value(str, 'N', st->tail_name);
+	put_value(str, 'A', st->attributes);
+	put_value(str, 'M', st->nested_name);
+	g_string_append_c(str, 'E');
+}
+
+/**
+ * @brief Canonical structural key of a struct. Two structs have the same
+ *        key if and only if they produce the same XML.
+ * @param st The struct
+ * @return The key, to be freed with g_free()
+ */
+gchar * model_struct_key(SCStruct *st)
+{
+	GString	*str;
+	gchar	*key;
+
+	str = g_string_new(NULL);
+	model_struct_serialize(st, str);
+
+	key = g_compute_checksum_for_string(G_CHECKSUM_SHA256, str->str, str->len);
+	g_string_free(str, TRUE);
+
+	return key;
+}
+
+/**
+ * @brief 128-bit structural fingerprint of a struct: kind, attributes and,
+ *        in order, the type, bit width, array size and function ptr args of
+ *        every field, with nested structs included through their own 
+ *        fingerprint. The tokens were already separated by single spaces, 
+ *        so whitespace and comments do not change it. The names of the
+ *        struct and of its fields are not part of it, except the 
+ *        declarators of nested structs, which carry their array sizes.
+ *        Sizes and widths written with constants add their values, so the
+ *        fingerprint changes with the #define they use.
+ *        The fingerprints of the nested structs are computed too.
+ * @param st The struct
+ * @return The fingerprint as 32 hex digits, owned by the struct
+ */
+const char * model_struct_hash(SCStruct *st)
+{
+	GString	*str;
+	gint64	value;
+	guint	i;
+
+	if (st->hash)
+		return st->hash;
+
+	str = g_string_new(NULL);
+	g_string_append_c(str, st->is_union ? 'U' : 'S');
+	put_value(str, 'A', st->attributes);
+
+	for (i = 0; i < st->fields->len; i++) {
+		SCField *field = g_ptr_array_index(st->fields, i);
+
+		if (field->nested) {
+			g_string_append_c(str, 'N');
+			g_string_append(str, model_struct_hash(field->nested));
+			put_value(str, 'T', field->nested->typedef_name);
+			put_value(str, 'N', field->nested->tail_name);
+			put_value(str, 'M', field->nested->nested_name);
+			put_count(str, field->nested->typedef_name);
+			put_count(str, field->nested->tail_name);
+			continue;
+		}
+		g_string_append_c(str, 'F');
+		put_value(str, 't', field->type);
+		put_value(str, 'b', field->bits);
+		put_value(str, 's', field->size);
+		if (field->bits && layout_eval(field->bits, &value) == SC_OK)
+			put_number(str, 'w', field->bits, value);
+		if (field->size && layout_count(field->size, &value) == SC_OK)
+			put_number(str, 'c', field->size, value);
+		g_string_append_printf(str, "p%d", field->func_ptr);
+		put_value(str, 'a', field->input_args);
+	}
+	g_string_append_c(str, 'E');
+
+	st->hash = g_compute_checksum_for_string(G_CHECKSUM_MD5, str->str, str->len);
+	g_string_free(str, TRUE);
+
+	return st->hash;
+}
+
+/**
+ * @brief Get the identifier declared by a name as written in the XML file.
+ *        Names may come with attributes or array sizes, like
+ *        '__attribute__ ( ( packed ) ) name' or 'name [ 10 ]', so the last
+ *        identifier outside parentheses and brackets is used.
+ * @param text The name
+ * @return The identifier, to be freed with g_free(), or NULL if there is none
+ */
+gchar * model_declarator_name(const char *text)
+{
+	gchar	**tokens,
+			*name = NULL;
+	gint	n,
+			depth = 0;
+
+	if (text == NULL)
+		return NULL;
+
+	tokens = g_strsplit(text, " ", -1);
+	for (n = 0; tokens[n] != NULL; n++) {
+		char *token = tokens[n];
+
+		if (*token == '(' || *token == '[')
+			depth++;
+		else if (*token == ')' || *token == ']')
+			depth--;
+		else if (depth == 0 && (g_ascii_isalpha(*token) || *token == '_') &&
+				strncmp(token, "__attribute__", 13) != 0) {
+			g_free(name);
+			name = g_strdup(token);
+		}
+	}
+	g_strfreev(tokens);
+
+	return name;
+}
+
+/**
+ * @brief Get the name of the type of a field like it is declared in C:
+ *        'struct tag', 'union tag', 'enum tag' or a typedef name. 
+ *        Qualifiers and pointers are dropped.
+ * @param type The type as written in the XML file
+ * @param pointer Set to 1 if the type is only pointed to
+ * @return The name to be freed with g_free(), NULL for builtin types
+ */
+gchar * model_type_name(const char *type, int *pointer)
+{
+	static const char *builtin[] = {
+		"void", "char", "short", "int", "long", "float", "double", "signed",
+		"unsigned", "_Bool", "const", "volatile", "register", "static",
+		"extern", "inline", NULL
+	};
+	gchar	**tokens,
+			*name = NULL;
+	gint	n, i,
+			depth = 0;
+
+	*pointer = 0;
+	if (type == NULL)
+		return NULL;
+
+	tokens = g_strsplit(type, " ", -1);
+	for (n = 0; tokens[n] != NULL; n++) {
+		char *token = tokens[n];
+
+		if (*token == '*') {
+			*pointer = 1;
+			continue;
+		}
+		if (*token == '(' || *token == '[') {
+			depth++;
+			continue;
+		}
+		if (*token == ')' || *token == ']') {
+			depth--;
+			continue;
+		}
+		if (depth > 0 || !(g_ascii_isalpha(*token) || *token == '_') ||
+				strncmp(token, "__attribute__", 13) == 0)
+			continue;
+
+		if ((strcmp(token, "struct") == 0 || strcmp(token, "union") == 0 ||
+				strcmp(token, "enum") == 0) && tokens[n + 1] != NULL) {
+			g_free(name);
+			name = g_strconcat(token, " ", tokens[n + 1], NULL);
+			n++;
+			continue;
+		}
+
+		for (i = 0; builtin[i] != NULL; i++)
+			if (strcmp(token, builtin[i]) == 0)
+				break;
+		if (builtin[i] == NULL && name == NULL)
+			name = g_strdup(token);
+	}
+	g_strfreev(tokens);
+
+	return name;
+}
+
+/**
+ * @brief The name a top-level struct is known by: its tag, otherwise its
+ *        typedef name
+ * @param st The struct
+ * @return The name, to be freed with g_free(), or NULL if it is anonymous
+ */
+gchar * model_struct_name(SCStruct *st)
+{
+	gchar *name;
+
+	if ((name = model_declarator_name(st->name)) != NULL)
+		return name;
+	if ((name = model_declarator_name(st->typedef_name)) != NULL)
+		return name;
+
+	return model_declarator_name(st->tail_name);
+}
+
+/**
+ * @brief Create an empty header
+ * @param name The header
+ * @return The new header
+ */
+SCHeader * model_header_new(const char *name)
+{
+	SCHeader *header;
+
+	header = g_new0(SCHeader, 1);
+	header->name = g_strdup(name);
+	header->structs = g_ptr_array_new_with_free_func(
+						(GDestroyNotify)model_struct_free);
+
+	return header;
+}
+
+/**
+ * @brief Free a header and all its structs
+ * @param header The header, may be NULL
+ */
+void model_header_free(SCHeader *header)
+{
+	if (header == NULL)
+		return;
+
+	g_free(header->name);
+	g_ptr_array_free(header->structs, TRUE);
+	g_free(header);
+}
@@ -0,0 +1,90 @@
+/**
+ * @file model.h
+ *
+ * @brief In-memory description of the parsed structs/unions. The parser
+ *        actions in xml.c build it and the XML document is written from it
+ *        once a top-level struct is complete.
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#ifndef _MODEL_H
+#define _MODEL_H
+
+#include <glib.h>
+
+#include "sc2xml.h"
+
+typedef struct sc_struct_st SCStruct;
+typedef struct sc_field_st SCField;
+typedef struct sc_header_st SCHeader;
+
+/* Target ABIs of the layout engine (see layout.c) */
+typedef enum {
+	ABI_X86_64,				/**< x86_64 System V */
+	ABI_I386,				/**< i386 System V */
+	ABI_AARCH64,			/**< AArch64 AAPCS64 */
+	ABI_ARM,				/**< 32-bit ARM EABI */
+	ABI_COUNT
+} SCAbi;
+
+/* Where a struct or a member lives in memory for one ABI */
+typedef struct sc_layout_st {
+	int known;				/**< 0 if it could not be computed */
+	guint64 offset;			/**< Members: bits from the start of the struct */
+	guint64 size;			/**< Bytes, all the elements of an array */
+	guint64 align;			/**< Bytes */
+	guint64 count;			/**< Elements of an array, 1 otherwise */
+	guint64 bits;			/**< Width of a bit field */
+} SCLayout;
+
+/* A member of a struct: a field or a nested struct/union */
+struct sc_field_st {
+	char *type;				/**< Data type, including the '*' of ptrs */
+	char *bits;				/**< Bit size, NULL if not a bit field */
+	char *size;				/**< Array size, "" if unspecified, NULL if not an array */
+	int func_ptr;			/**< Function ptr */
+	char *input_args;		/**< Args of the function ptr */
+	char *name;				/**< Field name */
+	SCStruct *nested;		/**< Nested struct/union, the members above are unused */
+	SCLayout layout[ABI_COUNT];	/**< See layout_struct() */
+};
+
+/* A struct or union */
+struct sc_struct_st {
+	int is_union;			/**< 0 for a struct, 1 for a union */
+	char *name;				/**< <struct_name> found when the struct opens */
+	char *typedef_name;		/**< <typedef_name> found when the struct closes */
+	char *tail_name;		/**< <struct_name> found when the struct closes */
+	char *attributes;		/**< <struct_attributes> */
+	char *nested_name;		/**< <struct_nested_name> */
+	char *hash;				/**< Structural fingerprint, see model_struct_hash() */
+	GPtrArray *fields;		/**< SCField, in declaration order */
+	SCStruct *parent;		/**< The enclosing struct, NULL if top-level */
+	SCLayout layout[ABI_COUNT];	/**< Size and alignment, see layout_struct() */
+	int laid_out;			/**< 1 while the layout is computed, 2 when done */
+};
+
+/* The top-level structs/unions of a header, as loaded from an XML file */
+struct sc_header_st {
+	char *name;				/**< The header, the XML filename without '.xml' */
+	GPtrArray *structs;		/**< SCStruct, in the order they were written */
+};
+
+SCStruct *	model_struct_new(int, SCStruct *);
+void		model_struct_free(SCStruct *);
+SCField *	model_field_new(SCStruct *);
+gchar *		model_struct_key(SCStruct *);
+const char *model_struct_hash(SCStruct *);
+gchar *		model_declarator_name(const char *);
+gchar *		model_struct_name(SCStruct *);
+gchar *		model_type_name(const char *, int *);
+SCStruct *	model_struct_copy(SCStruct *, SCStruct *);
+SCHeader *	model_header_new(const char *);
+void		model_header_free(SCHeader *);
+
+#endif	/* _MODEL_H */
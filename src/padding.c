@@ -0,0 +1,620 @@
+/**
+ * @file padding.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * @brief Padding and cache-line report. Using the layouts computed by
+ *        layout.c, the top-level structs/unions are analyzed by a pool of
+ *        threads once the headers are parsed:
+ *
+ *        - the internal padding, between members, and the tail padding
+ *        - the 64-byte cache lines spanned by the struct and the members
+ *          that straddle a line boundary
+ *        - an order of the members with less padding, if there is one
+ *
+ *        The members are reordered by decreasing alignment, which leaves
+ *        no holes as long as their sizes are multiples of their alignment.
+ *        Consecutive bit fields are moved together as a single member.
+ *        The report ranks the structs by the bytes they waste, for each
+ *        ABI selected with --layout.
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "config.h"
+#include "sc2xml.h"
+#include "misc.h"
+#include "model.h"
+#include "layout.h"
+#include "profile.h"
+#include "padding.h"
+
+#define ALIGN_UP(x, a)	((a) ? ((x) + (a) - 1) / (a) * (a) : (x))
+#define LINES(size)		(((size) + PADDING_LINE - 1) / PADDING_LINE)
+
+/* A member as it is moved around: a field, a nested struct/union or a
+ * group of consecutive bit fields */
+typedef struct {
+	gchar	*name;
+	guint64	offset;			/**< Bytes */
+	guint64	size;			/**< Bytes */
+	guint64	align;			/**< Bytes */
+	guint	index;			/**< Position in the struct */
+	guint64	count;			/**< Accesses given by the profile */
+	int		hot;			/**< Kept in the hot struct */
+} SCPadMember;
+
+/* A struct/union analyzed for an ABI */
+typedef struct {
+	gchar		*name;
+	gchar		*header;
+	SCAbi		abi;
+	int			is_union;
+	int			packed;
+	int			profiled;	/**< The ABI of the --profile offsets */
+	guint64		size;
+	guint64		align;
+	GPtrArray	*members;	/**< SCPadMember, by offset */
+	guint64		internal;	/**< Bytes between members */
+	guint64		tail;		/**< Bytes after the last member */
+	GString		*details;	/**< Straddling members and suggestion */
+} SCPadStruct;
+
+static GPtrArray *entries = NULL;	/**< SCPadStruct of every struct and ABI */
+
+static void padding_reorder(SCPadStruct *);
+static void padding_split(SCPadStruct *, GArray *);
+
+/**
+ * @brief Free a member
+ */
+static void padding_member_free(gpointer data)
+{
+	SCPadMember *member = data;
+
+	g_free(member->name);
+	g_free(member);
+}
+
+/**
+ * @brief Free an analyzed struct
+ */
+static void padding_entry_free(gpointer data)
+{
+	SCPadStruct *entry = data;
+
+	g_free(entry->name);
+	g_free(entry->header);
+	g_ptr_array_free(entry->members, TRUE);
+	if (entry->details)
+		g_string_free(entry->details, TRUE);
+	g_free(entry);
+}
+
+/**
+ * @brief Name of a member
+ * @param field The field
+ * @return The field name, the declarator of a nested struct/union or a
+ *         description of an anonymous one
+ */
+static gchar * padding_member_name(SCField *field)
+{
+	SCStruct	*nested = field->nested;
+	gchar		*name;
+
+	if (nested == NULL)
+		return g_strdup(field->name ? field->name : "?");
+
+	name = model_declarator_name(nested->nested_name);
+	if (name == NULL)
+		name = model_declarator_name(nested->typedef_name);
+	if (name == NULL)
+		name = model_declarator_name(nested->tail_name);
+	if (name == NULL && nested->attributes && !strstr(nested->attributes, "__attribute__"))
+		name = model_declarator_name(nested->attributes);
+	if (name == NULL)
+		name = g_strdup(nested->is_union ? "(anonymous union)" : "(anonymous struct)");
+
+	return name;
+}
+
+/**
+ * @brief Collect the members of a struct for an ABI
+ * @param st The struct, already laid out
+ * @param abi The ABI
+ * @param members The SCPadMember are added here
+ * @return SC_OK if the layout of every member is known
+ */
+static SCResult padding_members(SCStruct *st, SCAbi abi, GPtrArray *members)
+{
+	SCPadMember	*group = NULL;
+	guint64		group_end = 0;
+	guint		i;
+
+	for (i = 0; i < st->fields->len; i++) {
+		SCField		*field = g_ptr_array_index(st->fields, i);
+		SCLayout	*layout = &field->layout[abi];
+		SCPadMember	*member;
+		gint64		width;
+
+		if (!layout->known)
+			return SC_FAIL;
+
+		/* Bit fields sharing storage are kept together */
+		if (field->bits && !field->nested) {
+			width = layout->bits;
+
+			/* ':0' closes the group */
+			if (width == 0) {
+				group = NULL;
+				continue;
+			}
+
+			if (group != NULL && !st->is_union) {
+				gchar *name = g_strdup_printf("%s, %s", group->name,
+									field->name ? field->name : "?");
+
+				g_free(group->name);
+				group->name = name;
+				group_end = MAX(group_end, layout->offset + width);
+				group->size = (group_end + 7) / 8 - group->offset;
+				group->align = MAX(group->align, layout->align);
+				continue;
+			}
+
+			group = g_new0(SCPadMember, 1);
+			group->name = g_strdup(field->name ? field->name : "?");
+			group->offset = layout->offset / 8;
+			group->align = layout->align;
+			group_end = layout->offset + width;
+			group->size = (group_end + 7) / 8 - group->offset;
+			group->index = members->len;
+			g_ptr_array_add(members, group);
+			continue;
+		}
+
+		group = NULL;
+		member = g_new0(SCPadMember, 1);
+		member->name = padding_member_name(field);
+		member->offset = layout->offset / 8;
+		member->size = layout->size;
+		member->align = layout->align;
+		member->index = members->len;
+		g_ptr_array_add(members, member);
+	}
+
+	/* Braces around the groups of several bit fields */
+	for (i = 0; i < members->len; i++) {
+		SCPadMember *member = g_ptr_array_index(members, i);
+
+		if (strchr(member->name, ',')) {
+			gchar *name = g_strdup_printf("{%s}", member->name);
+
+			g_free(member->name);
+			member->name = name;
+		}
+	}
+
+	return SC_OK;
+}
+
+/**
+ * @brief Record a top-level struct/union for the report
+ * @param header The header where it is defined
+ * @param st The struct, already laid out
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult padding_add(const char *header, SCStruct *st)
+{
+	SCPadStruct	*entry;
+	int			abi;
+
+	if (entries == NULL)
+		entries = g_ptr_array_new_with_free_func(padding_entry_free);
+
+	for (abi = 0; abi < ABI_COUNT; abi++) {
+		if (!(sc_opts.abis & (1 << abi)) || !st->layout[abi].known)
+			continue;
+
+		entry = g_new0(SCPadStruct, 1);
+		entry->members = g_ptr_array_new_with_free_func(padding_member_free);
+
+		if (padding_members(st, abi, entry->members) != SC_OK) {
+			padding_entry_free(entry);
+			continue;
+		}
+
+		entry->name = model_struct_name(st);
+		if (entry->name == NULL)
+			entry->name = g_strdup("(anonymous)");
+		entry->header = g_strdup(header);
+		entry->abi = abi;
+		entry->is_union = st->is_union;
+		entry->packed = layout_is_packed(st);
+		entry->profiled = sc_opts.profile && abi == g_bit_nth_lsf(sc_opts.abis, -1);
+		entry->size = st->layout[abi].size;
+		entry->align = st->layout[abi].align;
+		g_ptr_array_add(entries, entry);
+	}
+
+	return SC_OK;
+}
+
+/**
+ * @brief Order for the suggested layout: decreasing alignment, then the
+ *        original order
+ */
+static gint padding_member_cmp(gconstpointer a, gconstpointer b)
+{
+	const SCPadMember	*ma = *(SCPadMember **)a,
+						*mb = *(SCPadMember **)b;
+
+	if (ma->align != mb->align)
+		return ma->align > mb->align ? -1 : 1;
+
+	return ma->index < mb->index ? -1 : (ma->index > mb->index);
+}
+
+/**
+ * @brief Analyze a struct, run by the workers
+ * @param data The SCPadStruct
+ * @param user_data Unused
+ */
+static void padding_analyze(gpointer data, gpointer user_data)
+{
+	SCPadStruct	*entry = data;
+	GArray		*samples;
+	guint64		end = 0;
+	guint		i;
+
+	entry->details = g_string_new(NULL);
+
+	for (i = 0; i < entry->members->len; i++) {
+		SCPadMember *member = g_ptr_array_index(entry->members, i);
+
+		if (entry->is_union) {
+			end = MAX(end, member->size);
+			continue;
+		}
+
+		if (member->offset > end)
+			entry->internal += member->offset - end;
+		end = MAX(end, member->offset + member->size);
+
+		if (member->size > 0 && member->offset / PADDING_LINE !=
+				(member->offset + member->size - 1) / PADDING_LINE)
+			g_string_append_printf(entry->details,
+				"  straddles a cache line: %s (%" G_GUINT64_FORMAT "..%"
+				G_GUINT64_FORMAT ")\n", member->name, member->offset,
+				member->offset + member->size - 1);
+	}
+	entry->tail = entry->size > end ? entry->size - end : 0;
+
+	padding_reorder(entry);
+
+	if (entry->profiled && (samples = profile_lookup(entry->name)) != NULL)
+		padding_split(entry, samples);
+}
+
+/**
+ * @brief Suggest an order of the members with less padding
+ * @param entry The struct
+ */
+static void padding_reorder(SCPadStruct *entry)
+{
+	GPtrArray	*order;
+	GString		*names;
+	guint64		end = 0,
+				size;
+	guint		i;
+
+	/* Unions and packed structs cannot be improved by reordering */
+	if (entry->is_union || entry->packed || entry->internal + entry->tail == 0)
+		return;
+
+	order = g_ptr_array_new();
+	for (i = 0; i < entry->members->len; i++)
+		g_ptr_array_add(order, g_ptr_array_index(entry->members, i));
+	g_ptr_array_sort(order, padding_member_cmp);
+
+	names = g_string_new(NULL);
+	end = 0;
+	for (i = 0; i < order->len; i++) {
+		SCPadMember *member = g_ptr_array_index(order, i);
+
+		end = ALIGN_UP(end, member->align) + member->size;
+		g_string_append_printf(names, "%s%s", i ? ", " : "", member->name);
+	}
+	size = ALIGN_UP(end, entry->align);
+
+	if (size < entry->size)
+		g_string_append_printf(entry->details,
+			"  suggested order: %s (size %" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT
+			" cache line%s, %" G_GUINT64_FORMAT " bytes less)\n", names->str,
+			size, LINES(size), LINES(size) == 1 ? "" : "s", entry->size - size);
+
+	g_string_free(names, TRUE);
+	g_ptr_array_free(order, TRUE);
+}
+
+/**
+ * @brief Order of the members by accesses per byte, see padding_split()
+ */
+static gint padding_density_cmp(gconstpointer a, gconstpointer b, gpointer data)
+{
+	SCPadStruct	*entry = data;
+	guint		ia = *(guint *)a,
+				ib = *(guint *)b;
+	SCPadMember	*ma = g_ptr_array_index(entry->members, ia),
+				*mb = g_ptr_array_index(entry->members, ib);
+	guint64		da = ma->count * MAX(mb->size, 1),
+				db = mb->count * MAX(ma->size, 1);
+
+	if (da != db)
+		return da > db ? -1 : 1;
+
+	return ia < ib ? -1 : (ia > ib);
+}
+
+/**
+ * @brief Size of a struct made of some of the members, in the order of
+ *        padding_reorder()
+ * @param entry The struct
+ * @param hot Members to take: 1 for the hot ones, 0 for the cold ones
+ * @param pointer Size of an extra pointer member, 0 for none
+ * @return The size in bytes
+ */
+static guint64 padding_split_size(SCPadStruct *entry, int hot, guint64 pointer)
+{
+	GPtrArray	*order = g_ptr_array_new();
+	guint64		end = 0,
+				align = MAX(pointer, 1);
+	guint		i;
+
+	for (i = 0; i < entry->members->len; i++) {
+		SCPadMember *member = g_ptr_array_index(entry->members, i);
+
+		if (member->hot == hot)
+			g_ptr_array_add(order, member);
+	}
+	g_ptr_array_sort(order, padding_member_cmp);
+
+	/* The pointer to the cold struct goes with the most aligned members */
+	end = pointer;
+	for (i = 0; i < order->len; i++) {
+		SCPadMember *member = g_ptr_array_index(order, i);
+
+		end = ALIGN_UP(end, member->align) + member->size;
+		align = MAX(align, member->align);
+	}
+	g_ptr_array_free(order, TRUE);
+
+	return ALIGN_UP(end, align);
+}
+
+/**
+ * @brief Map the profile onto the members and recommend moving the cold 
+ *        ones to a struct of their own, pointed to by the hot one. The hot
+ *        members are the most accessed per byte that make PADDING_HOT % of
+ *        the accesses.
+ * @param entry The struct
+ * @param samples The SCSample of the struct
+ */
+static void padding_split(SCPadStruct *entry, GArray *samples)
+{
+	GArray		*order;
+	GString		*hot,
+				*cold;
+	gboolean	*touched;
+	guint64		total = 0,
+				unmapped = 0,
+				taken = 0,
+				before = 0,
+				hot_size,
+				cold_size;
+	guint		i,
+				j;
+
+	for (i = 0; i < samples->len; i++) {
+		SCSample *sample = &g_array_index(samples, SCSample, i);
+
+		for (j = 0; j < entry->members->len; j++) {
+			SCPadMember *member = g_ptr_array_index(entry->members, j);
+
+			if (sample->offset >= member->offset && 
+					sample->offset < member->offset + MAX(member->size, 1)) {
+				member->count += sample->count;
+				break;
+			}
+		}
+
+		if (j == entry->members->len)
+			unmapped += sample->count;
+		else
+			total += sample->count;
+	}
+
+	g_string_append_printf(entry->details, "  profile: %" G_GUINT64_FORMAT 
+		" accesses", total);
+	if (unmapped)
+		g_string_append_printf(entry->details, ", %" G_GUINT64_FORMAT 
+			" outside the members", unmapped);
+	g_string_append_c(entry->details, '\n');
+
+	if (total == 0 || entry->is_union)
+		return;
+
+	/* The hottest members first */
+	order = g_array_new(FALSE, FALSE, sizeof(guint));
+	for (i = 0; i < entry->members->len; i++)
+		g_array_append_val(order, i);
+	g_array_sort_with_data(order, padding_density_cmp, entry);
+
+	for (i = 0; i < order->len; i++) {
+		SCPadMember *member = g_ptr_array_index(entry->members, 
+								g_array_index(order, guint, i));
+
+		if (member->count == 0 || taken * 100 >= total * PADDING_HOT)
+			break;
+		member->hot = 1;
+		taken += member->count;
+	}
+	g_array_free(order, TRUE);
+
+	/* Cache lines touched by the hot members as they are now */
+	touched = g_new0(gboolean, LINES(entry->size) + 1);
+	hot = g_string_new(NULL);
+	cold = g_string_new(NULL);
+	for (i = 0; i < entry->members->len; i++) {
+		SCPadMember *member = g_ptr_array_index(entry->members, i);
+		GString		*names = member->hot ? hot : cold;
+		guint64		line;
+
+		g_string_append_printf(names, "%s%s", names->len ? ", " : "", member->name);
+		if (!member->hot || member->size == 0)
+			continue;
+
+		for (line = member->offset / PADDING_LINE; 
+				line <= (member->offset + member->size - 1) / PADDING_LINE &&
+				line <= LINES(entry->size); line++) {
+			before += !touched[line];
+			touched[line] = TRUE;
+		}
+	}
+	g_free(touched);
+
+	g_string_append_printf(entry->details, "  hot: %s (%" G_GUINT64_FORMAT 
+		"%% of the accesses)\n", hot->str, taken * 100 / total);
+
+	if (cold->len == 0) {
+		g_string_append_printf(entry->details, "  no cold members, %" 
+			G_GUINT64_FORMAT " cache line%s touched\n", before, before == 1 ? "" : "s");
+	}
+	else {
+		hot_size = padding_split_size(entry, 1, layout_pointer_size(entry->abi));
+		cold_size = padding_split_size(entry, 0, 0);
+
+		g_string_append_printf(entry->details, "  cold: %s\n", cold->str);
+		g_string_append_printf(entry->details, "  hot/cold split: %" G_GUINT64_FORMAT
+			" cache line%s touched -> %" G_GUINT64_FORMAT " (hot struct %" 
+			G_GUINT64_FORMAT " bytes with the pointer to the cold one, cold struct %" 
+			G_GUINT64_FORMAT " bytes)\n", before, before == 1 ? "" : "s",
+			LINES(hot_size), hot_size, cold_size);
+	}
+
+	g_string_free(hot, TRUE);
+	g_string_free(cold, TRUE);
+}
+
+/**
+ * @brief Ranking of the report: ABI, most bytes wasted, name
+ */
+static gint padding_entry_cmp(gconstpointer a, gconstpointer b)
+{
+	const SCPadStruct	*ea = *(SCPadStruct **)a,
+						*eb = *(SCPadStruct **)b;
+	guint64				wa = ea->internal + ea->tail,
+						wb = eb->internal + eb->tail;
+	gint				rc;
+
+	if (ea->abi != eb->abi)
+		return ea->abi < eb->abi ? -1 : 1;
+	if (wa != wb)
+		return wa > wb ? -1 : 1;
+	if ((rc = strcmp(ea->name, eb->name)) != 0)
+		return rc;
+
+	return strcmp(ea->header, eb->header);
+}
+
+/**
+ * @brief Analyze all the structs recorded and write the report
+ * @param filename The report
+ * @param threads Number of workers, 0 for one per processor
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult padding_write(const char *filename, int threads)
+{
+	GThreadPool	*pool;
+	GError		*error = NULL;
+	FILE		*fd;
+	guint64		wasted = 0;
+	guint		i,
+				count = 0;
+	int			abi = -1;
+
+	if (entries == NULL)
+		entries = g_ptr_array_new_with_free_func(padding_entry_free);
+
+	if (threads <= 0)
+		threads = g_get_num_processors();
+
+	pool = g_thread_pool_new(padding_analyze, NULL, threads, TRUE, &error);
+	if (pool == NULL) {
+		log_error(LOG_ERR, "%s(): Could not start the workers: %s",
+			__func__, error->message);
+		g_error_free(error);
+		return SC_FAIL;
+	}
+
+	for (i = 0; i < entries->len; i++)
+		g_thread_pool_push(pool, g_ptr_array_index(entries, i), NULL);
+
+	/* Wait for every struct */
+	g_thread_pool_free(pool, FALSE, TRUE);
+
+	g_ptr_array_sort(entries, padding_entry_cmp);
+
+	fd = fopen(filename, "w");
+	if (fd == NULL) {
+		log_error(LOG_ERR, "%s(): Could not create the report '%s'",
+			__func__, filename);
+		return SC_FAIL;
+	}
+
+	for (i = 0; i <= entries->len; i++) {
+		SCPadStruct *entry = i < entries->len ? g_ptr_array_index(entries, i) : NULL;
+
+		/* Totals at the end of each ABI */
+		if (abi != -1 && (entry == NULL || (int)entry->abi != abi))
+			fprintf(fd, "# %s: %u structs/unions waste %" G_GUINT64_FORMAT " bytes\n\n",
+				layout_abi_name(abi), count, wasted);
+		if (entry == NULL)
+			break;
+
+		if ((int)entry->abi != abi) {
+			abi = entry->abi;
+			count = 0;
+			wasted = 0;
+			fprintf(fd, "# %s\n", layout_abi_name(abi));
+		}
+
+		/* Only the structs with something to report */
+		if (entry->internal + entry->tail == 0 && entry->details->len == 0)
+			continue;
+
+		count++;
+		wasted += entry->internal + entry->tail;
+		fprintf(fd, "%s %s (%s): %" G_GUINT64_FORMAT " bytes wasted, %"
+			G_GUINT64_FORMAT " internal, %" G_GUINT64_FORMAT " tail; size %"
+			G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT " cache line%s\n%s",
+			entry->is_union ? "union" : "struct", entry->name, entry->header,
+			entry->internal + entry->tail, entry->internal, entry->tail,
+			entry->size, LINES(entry->size), LINES(entry->size) == 1 ? "" : "s",
+			entry->details->str);
+	}
+
+	fclose(fd);
+
+	g_ptr_array_free(entries, TRUE);
+	entries = NULL;
+
+	return SC_OK;
+}
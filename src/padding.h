@@ -0,0 +1,25 @@
+/**
+ * @file padding.h
+ *
+ * @brief Defines for padding.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#ifndef _PADDING_H
+#define _PADDING_H
+
+#include "sc2xml.h"
+#include "model.h"
+
+#define PADDING_LINE	64	/**< Bytes of a cache line */
+#define PADDING_HOT		90	/**< Percentage of the accesses to the hot members */
+
+SCResult	padding_add(const char *, SCStruct *);
+SCResult	padding_write(const char *, int);
+
+#endif	/* _PADDING_H */
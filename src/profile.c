@@ -0,0 +1,139 @@
+/**
+ * @file profile.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * @brief Access profile of the structs given to --profile. It is a CSV
+ *        file, one line per sampled offset, as exported from perf mem or 
+ *        any other sampler:
+ *
+ *        struct,offset,count
+ *        my_st,0,1200
+ *        struct my_st,16,35
+ *
+ *        The struct is named like in the padding report, with or without
+ *        'struct'/'union'. The offset is in bytes, decimal or hex. Lines
+ *        that do not start with a struct and a number, like a title line,
+ *        are skipped. The same offset can be given several times.
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "config.h"
+#include "sc2xml.h"
+#include "misc.h"
+#include "profile.h"
+
+#define PROFILE_LINE	1024	/**< Longest line */
+
+static GHashTable *samples = NULL;	/**< Struct name -> GArray of SCSample */
+
+/**
+ * @brief Free the samples of a struct
+ */
+static void profile_samples_free(gpointer data)
+{
+	g_array_free(data, TRUE);
+}
+
+/**
+ * @brief Read an access profile
+ * @param filename The CSV file
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult profile_read(const char *filename)
+{
+	FILE	*fd;
+	char	line[PROFILE_LINE];
+	guint	lineno = 0,
+			skipped = 0;
+
+	fd = fopen(filename, "r");
+	if (fd == NULL) {
+		log_error(LOG_ERR, "%s(): Could not open the profile '%s'",
+			__func__, filename);
+		return SC_FAIL;
+	}
+
+	if (samples == NULL)
+		samples = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, 
+						profile_samples_free);
+
+	while (fgets(line, sizeof(line), fd) != NULL) {
+		gchar		**columns,
+					*name,
+					*end;
+		SCSample	sample;
+		GArray		*array;
+
+		lineno++;
+		g_strstrip(line);
+		if (*line == '\0' || *line == '#')
+			continue;
+
+		columns = g_strsplit(line, ",", 3);
+		if (g_strv_length(columns) != 3) {
+			g_strfreev(columns);
+			skipped++;
+			continue;
+		}
+
+		name = g_strstrip(columns[0]);
+		if (g_str_has_prefix(name, "struct "))
+			name += strlen("struct ");
+		else if (g_str_has_prefix(name, "union "))
+			name += strlen("union ");
+		name = g_strstrip(name);
+
+		sample.offset = g_ascii_strtoull(g_strstrip(columns[1]), &end, 0);
+		if (end == columns[1] || *end != '\0') {
+			g_strfreev(columns);
+			skipped++;
+			continue;
+		}
+		sample.count = g_ascii_strtoull(g_strstrip(columns[2]), &end, 10);
+		if (end == columns[2] || *end != '\0') {
+			g_strfreev(columns);
+			skipped++;
+			continue;
+		}
+
+		array = g_hash_table_lookup(samples, name);
+		if (array == NULL) {
+			array = g_array_new(FALSE, FALSE, sizeof(SCSample));
+			g_hash_table_insert(samples, g_strdup(name), array);
+		}
+		g_array_append_val(array, sample);
+
+		g_strfreev(columns);
+	}
+
+	fclose(fd);
+
+	/* Only the title is expected to be skipped */
+	if (skipped > 1)
+		log_error(LOG_WARN, "%s(): Skipped %u lines of '%s' out of %u",
+			__func__, skipped, filename, lineno);
+
+	return SC_OK;
+}
+
+/**
+ * @brief Get the samples of a struct
+ * @param name The name of the struct, see model_struct_name()
+ * @return The SCSample of the struct, NULL if it was not profiled
+ */
+GArray * profile_lookup(const char *name)
+{
+	if (samples == NULL || name == NULL)
+		return NULL;
+
+	return g_hash_table_lookup(samples, name);
+}
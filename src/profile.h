@@ -0,0 +1,29 @@
+/**
+ * @file profile.h
+ *
+ * @brief Defines for profile.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+#include <glib.h>
+
+#include "sc2xml.h"
+
+/* The accesses sampled at an offset of a struct */
+typedef struct {
+	guint64 offset;			/**< Bytes from the start of the struct */
+	guint64 count;			/**< Accesses */
+} SCSample;
+
+SCResult	profile_read(const char *);
+GArray *	profile_lookup(const char *);
+
+#endif	/* _PROFILE_H */
@@ -0,0 +1,244 @@
+/**
+ * @file reflect.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * @brief C++17 reflection generator (--reflect). Next to every parsed
+ *        header, e.g. test1.h, it writes test1.reflect.hpp with a
+ *        specialization of sc2xml::reflect<T> for each struct/union:
+ *
+ *        reflect<T>::fields		std::tuple of one type per field
+ *        field::type			the type of the field, as decltype()
+ *        field::name			its name
+ *        field::c_type			its type as written in the header
+ *        field::offset			offsetof(), 0 for bit fields
+ *        field::extent			std::extent_v<type>, 0 if not an array
+ *        field::bits			width of a bit field, 0 otherwise
+ *        field::get(s)			the field of s, field::set(s, v) for bit fields
+ *
+ *        sc2xml::for_each_field<T>(f) calls f with every field with a fold
+ *        expression, so templates over the fields are instantiated at
+ *        compile time and nothing is looked up at run time.
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "config.h"
+#include "sc2xml.h"
+#include "misc.h"
+#include "model.h"
+#include "gen.h"
+#include "reflect.h"
+
+/* Declarations shared by all the generated headers */
+static const char *reflect_base =
+	"#ifndef SC2XML_REFLECT_BASE\n"
+	"#define SC2XML_REFLECT_BASE\n"
+	"namespace sc2xml {\n"
+	"\n"
+	"/* Specialized for every reflected struct/union */\n"
+	"template <typename T> struct reflect;\n"
+	"\n"
+	"/* Call f with the descriptor of every field of T, in declaration order */\n"
+	"template <typename T, typename F>\n"
+	"constexpr void for_each_field(F &&f)\n"
+	"{\n"
+	"\tstd::apply([&](auto... fields) { (f(fields), ...); },\n"
+	"\t\ttypename reflect<T>::fields{});\n"
+	"}\n"
+	"\n"
+	"}\n"
+	"#endif\n\n";
+
+/**
+ * @brief Get the type of a member as written in the header
+ * @param member The member
+ * @return The type, to be freed with g_free()
+ */
+static gchar * reflect_c_type(SCGenMember *member)
+{
+	SCField *field = member->field;
+
+	if (member->kind == GEN_NESTED)
+		return g_strdup_printf("%s%s", member->type ? member->type :
+					(member->nested->is_union ? "union" : "struct"),
+					member->array ? " []" : "");
+
+	if (field->func_ptr)
+		return g_strdup_printf("%s (*%s)(%s)", field->type, member->array ? "[]" : "",
+					field->input_args ? field->input_args : "");
+
+	if (field->size)
+		return g_strdup_printf("%s [%s]", field->type, field->size);
+
+	return g_strdup(field->type);
+}
+
+/**
+ * @brief Write the descriptor of a field
+ * @param fd The generated header
+ * @param gen The struct
+ * @param member The field
+ */
+static void reflect_field(FILE *fd, SCGenStruct *gen, SCGenMember *member)
+{
+	gchar		*c_type = reflect_c_type(member),
+				*escaped = g_strescape(c_type, NULL);
+	const char	*type = gen->type;
+
+	fprintf(fd, "\tstruct field_%s {\n", member->id);
+	fprintf(fd, "\t\tusing type = decltype(std::declval<%s &>().%s);\n", type, member->path);
+	fprintf(fd, "\t\tstatic constexpr const char *name = \"%s\";\n", member->path);
+	fprintf(fd, "\t\tstatic constexpr const char *c_type = \"%s\";\n", escaped);
+
+	if (member->kind == GEN_BITS) {
+		fprintf(fd, "\t\tstatic constexpr std::size_t offset = 0;\n");
+		fprintf(fd, "\t\tstatic constexpr std::size_t extent = 0;\n");
+		fprintf(fd, "\t\tstatic constexpr unsigned bits = (%s);\n", member->field->bits);
+		fprintf(fd, "\t\tstatic constexpr type get(const %s &s) { return s.%s; }\n",
+			type, member->path);
+		fprintf(fd, "\t\tstatic constexpr void set(%s &s, type v) { s.%s = v; }\n",
+			type, member->path);
+	}
+	else {
+		fprintf(fd, "\t\tstatic constexpr std::size_t offset = offsetof(%s, %s);\n",
+			type, member->path);
+		fprintf(fd, "\t\tstatic constexpr std::size_t extent = std::extent_v<type>;\n");
+		fprintf(fd, "\t\tstatic constexpr unsigned bits = 0;\n");
+		fprintf(fd, "\t\tstatic constexpr type &get(%s &s) { return s.%s; }\n",
+			type, member->path);
+		fprintf(fd, "\t\tstatic constexpr const type &get(const %s &s) { return s.%s; }\n",
+			type, member->path);
+	}
+	fprintf(fd, "\t};\n");
+
+	g_free(c_type);
+	g_free(escaped);
+}
+
+/**
+ * @brief Write the specialization of sc2xml::reflect for a struct
+ * @param fd The generated header
+ * @param gen The struct
+ */
+static void reflect_struct(FILE *fd, SCGenStruct *gen)
+{
+	GPtrArray	*members = gen_members(gen->st);
+	gchar		*header = g_path_get_basename(gen->header);
+	guint		i;
+
+	fprintf(fd, "namespace sc2xml {\n\n");
+	fprintf(fd, "template <>\nstruct reflect<%s> {\n", gen->type);
+	fprintf(fd, "\tusing type = %s;\n", gen->type);
+	fprintf(fd, "\tstatic constexpr const char *name = \"%s\";\n", gen->name);
+	fprintf(fd, "\tstatic constexpr const char *header = \"%s\";\n", header);
+	fprintf(fd, "\tstatic constexpr bool is_union = %s;\n\n",
+		gen->st->is_union ? "true" : "false");
+
+	for (i = 0; i < members->len; i++)
+		reflect_field(fd, gen, g_ptr_array_index(members, i));
+
+	fprintf(fd, "\n\tusing fields = std::tuple<");
+	for (i = 0; i < members->len; i++)
+		fprintf(fd, "%sfield_%s", i ? ", " : "",
+			((SCGenMember *)g_ptr_array_index(members, i))->id);
+	fprintf(fd, ">;\n");
+	fprintf(fd, "\tstatic constexpr std::size_t field_count = std::tuple_size_v<fields>;\n");
+	fprintf(fd, "};\n\n}\n\n");
+
+	g_free(header);
+	g_ptr_array_free(members, TRUE);
+}
+
+/**
+ * @brief Write the reflection header of the structs of a parsed header
+ * @param header The parsed header
+ * @param gens The SCGenStruct defined in it
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+static SCResult reflect_header(const char *header, GPtrArray *gens)
+{
+	GHashTable	*names;
+	FILE		*fd;
+	gchar		*filename;
+	guint		i;
+	SCResult	rc;
+
+	/* test1.h -> test1.reflect.hpp */
+	if (g_str_has_suffix(header, ".h"))
+		filename = g_strdup_printf("%.*s.reflect.hpp", (int)strlen(header) - 2, header);
+	else
+		filename = g_strdup_printf("%s.reflect.hpp", header);
+
+	fd = gen_open(filename, "C++17 reflection of the structs/unions of the header",
+			gens, GEN_CPLUSPLUS | GEN_NEXT_TO);
+	if (fd == NULL) {
+		g_free(filename);
+		return SC_FAIL;
+	}
+
+	fputs(reflect_base, fd);
+
+	names = g_hash_table_new(g_str_hash, g_str_equal);
+	for (i = 0; i < gens->len; i++) {
+		SCGenStruct *gen = g_ptr_array_index(gens, i);
+
+		if (g_hash_table_lookup(names, gen->type)) {
+			log_error(LOG_WARN, "%s(): '%s' is defined again in '%s', skipping it",
+				__func__, gen->type, header);
+			continue;
+		}
+		g_hash_table_insert(names, gen->type, gen);
+
+		reflect_struct(fd, gen);
+	}
+	g_hash_table_destroy(names);
+
+	rc = gen_close(fd, filename);
+	g_free(filename);
+
+	return rc;
+}
+
+/**
+ * @brief Write a reflection header next to every parsed header with
+ *        structs selected
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult reflect_write(void)
+{
+	GPtrArray	*gens = gen_structs(),
+				*header_gens = NULL;
+	const char	*header = NULL;
+	guint		i;
+	SCResult	rc = SC_OK;
+
+	/* The structs of a header were copied one after the other */
+	for (i = 0; i <= gens->len; i++) {
+		SCGenStruct *gen = i < gens->len ? g_ptr_array_index(gens, i) : NULL;
+
+		if (header_gens && (gen == NULL || strcmp(gen->header, header) != 0)) {
+			if (reflect_header(header, header_gens) != SC_OK)
+				rc = SC_FAIL;
+			g_ptr_array_free(header_gens, TRUE);
+			header_gens = NULL;
+		}
+		if (gen == NULL)
+			break;
+
+		if (header_gens == NULL) {
+			header_gens = g_ptr_array_new();
+			header = gen->header;
+		}
+		g_ptr_array_add(header_gens, gen);
+	}
+
+	return rc;
+}
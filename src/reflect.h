@@ -0,0 +1,20 @@
+/**
+ * @file reflect.h
+ *
+ * @brief Defines for reflect.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#ifndef _REFLECT_H
+#define _REFLECT_H
+
+#include "sc2xml.h"
+
+SCResult	reflect_write(void);
+
+#endif	/* _REFLECT_H */
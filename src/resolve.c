@@ -0,0 +1,179 @@
+/**
+ * @file resolve.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * @brief Cross-file type resolution. Once all the headers are parsed, every
+ *        named top-level struct/union gets a definition id and the index
+ *        maps its names ('struct tag', 'union tag' and its typedef name) to
+ *        it. The type of a field then resolves to the definition in the same
+ *        header if there is one, otherwise to the first definition in the
+ *        tree. The answers are memoized, so every type string of a header
+ *        is resolved only once.
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "config.h"
+#include "sc2xml.h"
+#include "misc.h"
+#include "model.h"
+#include "resolve.h"
+
+static GHashTable	*by_struct = NULL;	/**< SCStruct -> SCDefinition */
+static GHashTable	*global = NULL;		/**< name -> first SCDefinition */
+static GHashTable	*local = NULL;		/**< header\tname -> SCDefinition */
+static GHashTable	*memo = NULL;		/**< header\ttype -> SCDefinition or NULL */
+
+static void free_definition(gpointer data)
+{
+	SCDefinition *def = (SCDefinition *)data;
+
+	g_free(def->id);
+	g_free(def);
+}
+
+/**
+ * @brief Forget the index
+ */
+void resolve_reset(void)
+{
+	if (by_struct == NULL)
+		return;
+
+	g_hash_table_destroy(memo);
+	g_hash_table_destroy(local);
+	g_hash_table_destroy(global);
+	g_hash_table_destroy(by_struct);
+	by_struct = global = local = memo = NULL;
+}
+
+/**
+ * @brief Add a name of a definition
+ */
+static void resolve_name(SCDefinition *def, gchar *name)
+{
+	if (!g_hash_table_lookup(global, name))
+		g_hash_table_insert(global, g_strdup(name), def);
+
+	g_hash_table_insert(local, g_strconcat(def->header, "\t", name, NULL), def);
+}
+
+/**
+ * @brief Build the index of the definitions of all the headers
+ * @param headers SCHeader, in the order they were parsed
+ */
+void resolve_index(GPtrArray *headers)
+{
+	guint	i, j,
+			count = 0;
+
+	resolve_reset();
+
+	by_struct = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, 
+					free_definition);
+	global = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	local = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	memo = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+	for (i = 0; i < headers->len; i++) {
+		SCHeader *header = g_ptr_array_index(headers, i);
+
+		for (j = 0; j < header->structs->len; j++) {
+			SCStruct		*st = g_ptr_array_index(header->structs, j);
+			SCDefinition	*def;
+			gchar			*tag,
+							*type_name,
+							*name;
+
+			tag = model_declarator_name(st->name);
+
+			/* 'typedef struct {...} my_type;' gives the name after the members */
+			if ((type_name = model_declarator_name(st->typedef_name)) == NULL)
+				type_name = model_declarator_name(st->tail_name);
+
+			/* Nothing can refer to an anonymous struct */
+			if (tag == NULL && type_name == NULL)
+				continue;
+
+			def = g_new0(SCDefinition, 1);
+			def->id = g_strdup_printf("d%u", ++count);
+			def->header = header->name;
+			def->st = st;
+			g_hash_table_insert(by_struct, st, def);
+
+			if (tag) {
+				name = g_strconcat(st->is_union ? "union " : "struct ", tag, NULL);
+				resolve_name(def, name);
+				g_free(name);
+			}
+			if (type_name)
+				resolve_name(def, type_name);
+
+			g_free(tag);
+			g_free(type_name);
+		}
+	}
+}
+
+/**
+ * @brief Get the definition id of a top-level struct
+ * @param st The struct
+ * @return The id or NULL if the struct is anonymous
+ */
+const char * resolve_struct_id(SCStruct *st)
+{
+	SCDefinition *def;
+
+	if (by_struct == NULL || (def = g_hash_table_lookup(by_struct, st)) == NULL)
+		return NULL;
+
+	return def->id;
+}
+
+/**
+ * @brief Find the definition of the type of a field
+ * @param header The header of the field
+ * @param type The type as written in the XML file
+ * @return The definition or NULL if the type is not a struct/union defined
+ *         in the tree
+ */
+SCDefinition * resolve_type(const char *header, const char *type)
+{
+	SCDefinition	*def;
+	gchar			*key,
+					*name;
+	int				pointer;
+
+	if (memo == NULL || type == NULL)
+		return NULL;
+
+	key = g_strconcat(header, "\t", type, NULL);
+	if (g_hash_table_lookup_extended(memo, key, NULL, (gpointer *)&def)) {
+		g_free(key);
+		return def;
+	}
+
+	def = NULL;
+	if ((name = model_type_name(type, &pointer)) != NULL) {
+		gchar *local_key = g_strconcat(header, "\t", name, NULL);
+
+		def = g_hash_table_lookup(local, local_key);
+		if (def == NULL)
+			def = g_hash_table_lookup(global, name);
+
+		g_free(local_key);
+		g_free(name);
+	}
+
+	g_hash_table_insert(memo, key, def);
+
+	return def;
+}
@@ -0,0 +1,33 @@
+/**
+ * @file resolve.h
+ *
+ * @brief Defines for resolve.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#ifndef _RESOLVE_H
+#define _RESOLVE_H
+
+#include <glib.h>
+
+#include "sc2xml.h"
+#include "model.h"
+
+/* Where a struct/union is defined */
+typedef struct sc_definition_st {
+	char *id;				/**< Definition id, unique in the run */
+	const char *header;		/**< The defining header */
+	SCStruct *st;			/**< The definition */
+} SCDefinition;
+
+void			resolve_index(GPtrArray *);
+const char *	resolve_struct_id(SCStruct *);
+SCDefinition *	resolve_type(const char *, const char *);
+void			resolve_reset(void);
+
+#endif	/* _RESOLVE_H */
@@ -23,6 +23,7 @@
 #endif
 
 #define NAME_SIZE		256					/**< Default buffer size */
+#define CMP_BUFF		65536				/**< Buffer size for comparing files */
 
 /* Operations result status */
 typedef enum {
@@ -30,4 +31,55 @@ typedef enum {
 	SC_FAIL = 1		/**< Operation failed */
 } SCResult;
 
+/* Command line options */
+typedef struct sc_opts_st {
+	int index;		/**< Write a sidecar offset index next to each XML file */
+	char *archive;	/**< Write all the XML documents to this archive */
+	int threads;	/**< Compression workers, 0 for one per processor */
+	int list;		/**< List the entries of the archive */
+	char *extract;	/**< Extract this entry of the archive */
+	int if_changed;	/**< Replace the XML files only if their contents changed */
+	int dedup;		/**< Parse identical headers only once */
+	char *dedup_dir;	/**< Cache shared by several sc2xml processes */
+	char *aggregate;	/**< Write all the headers to this XML file */
+	int dedup_structs;	/**< Write identical structs once, then refer to them */
+	int hash;			/**< Add the structural fingerprint to every struct */
+	char *manifest;		/**< Write the fingerprints of all the structs here */
+	int resolve;		/**< Add where the type of every field is defined */
+	char *layout;		/**< ABIs given to --layout */
+	int abis;			/**< Mask of the ABIs to lay out the structs for */
+	char *padding;		/**< Padding and cache-line report */
+	char *profile;		/**< Accesses per struct and offset, for the report */
+	char *select;		/**< Structs to generate code for, all if NULL */
+	char *soa;			/**< Structure of arrays header to generate */
+	int reflect;		/**< Generate the C++ reflection headers */
+	char *serializers;	/**< Struct to XML serializers header to generate */
+	char *loaders;		/**< XML to struct loaders header to generate */
+	char *tracers;		/**< Binary trace loggers header to generate */
+	char *equality;		/**< Equality and hash functions header to generate */
+	char *slabs;		/**< Slab allocators header to generate */
+	char *decode_struct;	/**< Struct of the records to decode, see decode.c */
+	char *abi;			/**< ABI of the records to decode */
+	char *endian;		/**< Byte order of the records, little if NULL */
+	int json;			/**< Decode the records to JSON */
+	int pid;			/**< Process to inspect */
+	char *address;		/**< Address of the structs to inspect */
+	int count;			/**< Number of structs to inspect */
+	int depth;			/**< Levels of pointers to follow when inspecting */
+	char *convert_abi;	/**< ABI to convert the records to, see convert.c */
+	char *to_endian;	/**< Byte order of the converted records */
+	int migrate;		/**< Migrating records, see migrate.c */
+	int decode_all;		/**< Decoding a trace file, of any struct */
+	int generate;		/**< Some code is generated, see gen.c */
+	char *graph;		/**< Type dependency graph */
+	char *dependents;	/**< Query: types that use this type */
+	char *dependencies;	/**< Query: types used by this type */
+	int topo;			/**< Query: types in dependency order */
+	int embedded;		/**< Queries do not follow pointers */
+	unsigned int shard;		/**< Parse only the files of this shard... */
+	unsigned int shards;	/**< ...out of this many (see diff.c) */
+} SCOpts;
+
+extern SCOpts sc_opts;
+
 #endif /* _SC2XML_H */
@@ -0,0 +1,678 @@
+/**
+ * @file serialize.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * @brief Struct to XML serializers generator (--serializers). For every
+ *        struct selected it writes a function that writes an instance
+ *        with the elements used by sc2xml:
+ *
+ *        <struct><struct_name>my_st</struct_name>
+ *        <field type="int"><name>a</name><value>5</value></field>
+ *        ...</struct>
+ *
+ *        The markup between two values is a single string literal copied
+ *        with its length known at compile time, the integers are formatted
+ *        two digits at a time and the type of every value selects its
+ *        formatter with _Generic, so nothing is looked up per field at run
+ *        time. The output goes to a bounded buffer and, like snprintf(),
+ *        the functions return the length the whole document needs.
+ *
+ *        Arrays of char are written as text, other arrays as their values
+ *        separated by spaces, pointers in hex and values of unknown types
+ *        as their bytes in hex. Floating point numbers always use '.',
+ *        whatever the locale. Nested structs/unions, and the fields whose
+ *        type is another selected struct, are written as <struct> elements
+ *        inside the field. The generated code needs C11.
+ *
+ *        NAME_to_xml_delta() writes only the members of an instance that
+ *        changed since a previous one: bit fields compared by value, other
+ *        members by their bytes, nested structs member by member and arrays
+ *        of numbers up to their last changed element. Loading it with the
+ *        loaders of deserialize.c into a copy of the previous instance,
+ *        which keeps the members not in the XML, gives the new one back.
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "config.h"
+#include "sc2xml.h"
+#include "misc.h"
+#include "model.h"
+#include "gen.h"
+#include "serialize.h"
+
+/* Formatting shared by all the generated serializers */
+static const char *serialize_helpers =
+	"#ifndef SC2XML_XML_HELPERS\n"
+	"#define SC2XML_XML_HELPERS\n"
+	"#include <locale.h>\n"
+	"#include <stdint.h>\n"
+	"#include <stdio.h>\n"
+	"\n"
+	"/* Output buffer, len keeps counting when the buffer is full */\n"
+	"struct sc2xml_out {\n"
+	"\tchar *buf;\n"
+	"\tsize_t size;\n"
+	"\tsize_t len;\n"
+	"};\n"
+	"\n"
+	"static inline void sc2xml_put(struct sc2xml_out *o, const char *s, size_t n)\n"
+	"{\n"
+	"\tif (o->len + n <= o->size)\n"
+	"\t\tmemcpy(o->buf + o->len, s, n);\n"
+	"\to->len += n;\n"
+	"}\n"
+	"\n"
+	"#define SC2XML_LIT(o, s)\tsc2xml_put((o), (s), sizeof(s) - 1)\n"
+	"\n"
+	"static const char sc2xml_digits[] =\n"
+	"\t\"00010203040506070809101112131415161718192021222324252627282930313233343536373839\"\n"
+	"\t\"40414243444546474849505152535455565758596061626364656667686970717273747576777879\"\n"
+	"\t\"8081828384858687888990919293949596979899\";\n"
+	"\n"
+	"static inline void sc2xml_put_u64(struct sc2xml_out *o, unsigned long long v)\n"
+	"{\n"
+	"\tchar tmp[20], *p = tmp + sizeof(tmp);\n"
+	"\n"
+	"\twhile (v >= 100) {\n"
+	"\t\tunsigned d = (unsigned)(v % 100) * 2;\n"
+	"\n"
+	"\t\tv /= 100;\n"
+	"\t\t*--p = sc2xml_digits[d + 1];\n"
+	"\t\t*--p = sc2xml_digits[d];\n"
+	"\t}\n"
+	"\tif (v >= 10) {\n"
+	"\t\t*--p = sc2xml_digits[v * 2 + 1];\n"
+	"\t\t*--p = sc2xml_digits[v * 2];\n"
+	"\t}\n"
+	"\telse\n"
+	"\t\t*--p = (char)('0' + v);\n"
+	"\tsc2xml_put(o, p, (size_t)(tmp + sizeof(tmp) - p));\n"
+	"}\n"
+	"\n"
+	"static inline void sc2xml_put_i64(struct sc2xml_out *o, long long v)\n"
+	"{\n"
+	"\tif (v < 0) {\n"
+	"\t\tSC2XML_LIT(o, \"-\");\n"
+	"\t\tsc2xml_put_u64(o, 0ULL - (unsigned long long)v);\n"
+	"\t}\n"
+	"\telse\n"
+	"\t\tsc2xml_put_u64(o, (unsigned long long)v);\n"
+	"}\n"
+	"\n"
+	"static inline void sc2xml_put_hex(struct sc2xml_out *o, const void *p, size_t n)\n"
+	"{\n"
+	"\tconst unsigned char *b = p;\n"
+	"\tchar tmp[2];\n"
+	"\tsize_t i;\n"
+	"\n"
+	"\tfor (i = 0; i < n; i++) {\n"
+	"\t\ttmp[0] = \"0123456789abcdef\"[b[i] >> 4];\n"
+	"\t\ttmp[1] = \"0123456789abcdef\"[b[i] & 15];\n"
+	"\t\tsc2xml_put(o, tmp, 2);\n"
+	"\t}\n"
+	"}\n"
+	"\n"
+	"static inline void sc2xml_put_ptr(struct sc2xml_out *o, const void *p, size_t n)\n"
+	"{\n"
+	"\tchar tmp[2 * sizeof(uintptr_t)], *q = tmp + sizeof(tmp);\n"
+	"\tuintptr_t u;\n"
+	"\n"
+	"\tif (n != sizeof(u)) {\n"
+	"\t\tsc2xml_put_hex(o, p, n);\n"
+	"\t\treturn;\n"
+	"\t}\n"
+	"\tmemcpy(&u, p, n);\n"
+	"\tdo {\n"
+	"\t\t*--q = \"0123456789abcdef\"[u & 15];\n"
+	"\t\tu >>= 4;\n"
+	"\t} while (u);\n"
+	"\tSC2XML_LIT(o, \"0x\");\n"
+	"\tsc2xml_put(o, q, (size_t)(tmp + sizeof(tmp) - q));\n"
+	"}\n"
+	"\n"
+	"/* Text up to the first NUL or max bytes, escaped */\n"
+	"static inline void sc2xml_put_text(struct sc2xml_out *o, const char *s, size_t max)\n"
+	"{\n"
+	"\tsize_t i, run = 0;\n"
+	"\n"
+	"\tfor (i = 0; i < max && s[i] != '\\0'; i++) {\n"
+	"\t\tunsigned char c = (unsigned char)s[i];\n"
+	"\n"
+	"\t\tif (c != '&' && c != '<' && c != '>' && c != '\"' &&\n"
+	"\t\t\t\t(c >= 0x20 || c == '\\t' || c == '\\n' || c == '\\r'))\n"
+	"\t\t\tcontinue;\n"
+	"\t\tsc2xml_put(o, s + run, i - run);\n"
+	"\t\trun = i + 1;\n"
+	"\t\tif (c == '&')\n"
+	"\t\t\tSC2XML_LIT(o, \"&amp;\");\n"
+	"\t\telse if (c == '<')\n"
+	"\t\t\tSC2XML_LIT(o, \"&lt;\");\n"
+	"\t\telse if (c == '>')\n"
+	"\t\t\tSC2XML_LIT(o, \"&gt;\");\n"
+	"\t\telse if (c == '\"')\n"
+	"\t\t\tSC2XML_LIT(o, \"&quot;\");\n"
+	"\t\telse\n"
+	"\t\t\tSC2XML_LIT(o, \"?\");\n"
+	"\t}\n"
+	"\tsc2xml_put(o, s + run, i - run);\n"
+	"}\n"
+	"\n"
+	"/* Formatters selected by SC2XML_VALUE(), n is known at compile time */\n"
+	"static inline void sc2xml_val_signed(struct sc2xml_out *o, const void *p, size_t n)\n"
+	"{\n"
+	"\tint8_t v8; int16_t v16; int32_t v32; int64_t v64;\n"
+	"\n"
+	"\tswitch (n) {\n"
+	"\tcase 1: memcpy(&v8, p, 1); sc2xml_put_i64(o, v8); break;\n"
+	"\tcase 2: memcpy(&v16, p, 2); sc2xml_put_i64(o, v16); break;\n"
+	"\tcase 4: memcpy(&v32, p, 4); sc2xml_put_i64(o, v32); break;\n"
+	"\tcase 8: memcpy(&v64, p, 8); sc2xml_put_i64(o, v64); break;\n"
+	"\tdefault: sc2xml_put_hex(o, p, n); break;\n"
+	"\t}\n"
+	"}\n"
+	"\n"
+	"static inline void sc2xml_val_unsigned(struct sc2xml_out *o, const void *p, size_t n)\n"
+	"{\n"
+	"\tuint8_t v8; uint16_t v16; uint32_t v32; uint64_t v64;\n"
+	"\n"
+	"\tswitch (n) {\n"
+	"\tcase 1: memcpy(&v8, p, 1); sc2xml_put_u64(o, v8); break;\n"
+	"\tcase 2: memcpy(&v16, p, 2); sc2xml_put_u64(o, v16); break;\n"
+	"\tcase 4: memcpy(&v32, p, 4); sc2xml_put_u64(o, v32); break;\n"
+	"\tcase 8: memcpy(&v64, p, 8); sc2xml_put_u64(o, v64); break;\n"
+	"\tdefault: sc2xml_put_hex(o, p, n); break;\n"
+	"\t}\n"
+	"}\n"
+	"\n"
+	"static inline void sc2xml_val_char(struct sc2xml_out *o, const void *p, size_t n)\n"
+	"{\n"
+	"\tif ((char)-1 < 0)\n"
+	"\t\tsc2xml_val_signed(o, p, n);\n"
+	"\telse\n"
+	"\t\tsc2xml_val_unsigned(o, p, n);\n"
+	"}\n"
+	"\n"
+	"static inline void sc2xml_val_float(struct sc2xml_out *o, const void *p, size_t n)\n"
+	"{\n"
+	"\tconst char *dp = localeconv()->decimal_point;\n"
+	"\tchar tmp[48], *q;\n"
+	"\tfloat f;\n"
+	"\tdouble d;\n"
+	"\tlong double ld;\n"
+	"\tint len;\n"
+	"\n"
+	"\tif (n == sizeof(f)) {\n"
+	"\t\tmemcpy(&f, p, n);\n"
+	"\t\tlen = snprintf(tmp, sizeof(tmp), \"%.9g\", f);\n"
+	"\t}\n"
+	"\telse if (n == sizeof(d)) {\n"
+	"\t\tmemcpy(&d, p, n);\n"
+	"\t\tlen = snprintf(tmp, sizeof(tmp), \"%.17g\", d);\n"
+	"\t}\n"
+	"\telse {\n"
+	"\t\tmemcpy(&ld, p, sizeof(ld));\n"
+	"\t\tlen = snprintf(tmp, sizeof(tmp), \"%.21Lg\", ld);\n"
+	"\t}\n"
+	"\t/* snprintf() follows LC_NUMERIC, the XML always has a '.' */\n"
+	"\tif (*dp && strcmp(dp, \".\") != 0 && (q = strstr(tmp, dp)) != NULL) {\n"
+	"\t\tsize_t dl = strlen(dp);\n"
+	"\n"
+	"\t\t*q = '.';\n"
+	"\t\tmemmove(q + 1, q + dl, (size_t)len - (size_t)(q - tmp) - dl + 1);\n"
+	"\t\tlen -= (int)dl - 1;\n"
+	"\t}\n"
+	"\tsc2xml_put(o, tmp, (size_t)len);\n"
+	"}\n"
+	"\n"
+	"static inline void sc2xml_val_raw(struct sc2xml_out *o, const void *p, size_t n)\n"
+	"{\n"
+	"\tsc2xml_put_hex(o, p, n);\n"
+	"}\n"
+	"\n"
+	"#define SC2XML_VALUE(o, x) _Generic((x),\t\t\t\t\t\t\t\t\\\n"
+	"\tchar: sc2xml_val_char,\t\t\t\t\t\t\t\t\t\t\\\n"
+	"\tsigned char: sc2xml_val_signed, unsigned char: sc2xml_val_unsigned,\t\\\n"
+	"\tshort: sc2xml_val_signed, unsigned short: sc2xml_val_unsigned,\t\t\\\n"
+	"\tint: sc2xml_val_signed, unsigned int: sc2xml_val_unsigned,\t\t\t\\\n"
+	"\tlong: sc2xml_val_signed, unsigned long: sc2xml_val_unsigned,\t\t\\\n"
+	"\tlong long: sc2xml_val_signed, unsigned long long: sc2xml_val_unsigned,\t\\\n"
+	"\t_Bool: sc2xml_val_unsigned,\t\t\t\t\t\t\t\t\t\\\n"
+	"\tfloat: sc2xml_val_float, double: sc2xml_val_float,\t\t\t\t\\\n"
+	"\tlong double: sc2xml_val_float,\t\t\t\t\t\t\t\t\\\n"
+	"\tdefault: sc2xml_val_raw)((o), &(x), sizeof(x))\n"
+	"#endif\n\n";
+
+/* Code being generated */
+typedef struct {
+	FILE		*fd;
+	GString		*markup;	/**< Markup not written yet */
+	GHashTable	*known;		/**< C type -> name of its serializer */
+	int			depth;		/**< Nesting of the loops */
+	int			delta;		/**< Only the members that differ from prev */
+} SCSerializer;
+
+/**
+ * @brief Append markup, written as one literal with the next markup
+ */
+static void serialize_markup(SCSerializer *ser, const char *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	g_string_append_vprintf(ser->markup, format, args);
+	va_end(args);
+}
+
+/**
+ * @brief Write a line of code, after the markup pending
+ */
+static void serialize_code(SCSerializer *ser, const char *format, ...)
+{
+	va_list	args;
+	int		i;
+
+	if (ser->markup->len) {
+		gchar *literal = g_strescape(ser->markup->str, NULL);
+
+		for (i = 0; i <= ser->depth; i++)
+			fputc('\t', ser->fd);
+		fprintf(ser->fd, "SC2XML_LIT(o, \"%s\");\n", literal);
+		g_string_truncate(ser->markup, 0);
+		g_free(literal);
+	}
+
+	if (format == NULL)
+		return;
+
+	for (i = 0; i <= ser->depth; i++)
+		fputc('\t', ser->fd);
+	va_start(args, format);
+	vfprintf(ser->fd, format, args);
+	va_end(args);
+	fputc('\n', ser->fd);
+}
+
+/**
+ * @brief Open the block written only if a member changed, when writing a
+ *        delta serializer
+ * @param ser The code being generated
+ * @param value The member, e.g. 'v->a'
+ * @param bits 1 for a bit field, compared by value
+ * @return The same member of the previous instance, to be freed
+ */
+static gchar * serialize_delta_open(SCSerializer *ser, const char *value, int bits)
+{
+	/* Every member is accessed through v */
+	gchar *prev = g_strdup_printf("prev%s", value + 1);
+
+	if (!ser->delta)
+		return prev;
+
+	if (bits)
+		serialize_code(ser, "if (%s != %s) {", value, prev);
+	else
+		serialize_code(ser, "if (memcmp(&%s, &%s, sizeof(%s)) != 0) {", value, prev, value);
+	ser->depth++;
+
+	return prev;
+}
+
+/**
+ * @brief Close the block of serialize_delta_open()
+ */
+static void serialize_delta_close(SCSerializer *ser, gchar *prev)
+{
+	if (ser->delta) {
+		serialize_code(ser, NULL);
+		ser->depth--;
+		serialize_code(ser, "}");
+	}
+	g_free(prev);
+}
+
+/**
+ * @brief Write the opening tag of a field
+ */
+static void serialize_field_open(SCSerializer *ser, SCGenMember *member)
+{
+	SCField	*field = member->field;
+	gchar	*type = g_markup_escape_text(field->type ? field->type : "", -1);
+
+	serialize_markup(ser, "<field type=\"%s\"", type);
+	g_free(type);
+
+	if (field->bits) {
+		gchar *bits = g_markup_escape_text(field->bits, -1);
+
+		serialize_markup(ser, " bits=\"%s\"", bits);
+		g_free(bits);
+	}
+
+	if (field->size) {
+		gchar *size = g_markup_escape_text(field->size, -1);
+
+		serialize_markup(ser, " size=\"%s\"", size);
+		g_free(size);
+	}
+
+	if (field->func_ptr)
+		serialize_markup(ser, " function_pointer=\"1\"");
+
+	serialize_markup(ser, "><name>%s</name>", member->path);
+}
+
+/**
+ * @brief Check if the arrays of a type are written as text, signed and
+ *        unsigned char are taken as numbers
+ */
+static int serialize_is_text(const char *type)
+{
+	gchar	*value = gen_value_type(type);
+	int		rc;
+
+	rc = strcmp(value, "char") == 0;
+	g_free(value);
+
+	return rc;
+}
+
+static void serialize_members(SCSerializer *, SCStruct *, const char *);
+
+/**
+ * @brief Write the code of a member
+ * @param ser The code being generated
+ * @param member The member
+ * @param base What the path of the member is appended to, e.g. 'v->'
+ */
+static void serialize_member(SCSerializer *ser, SCGenMember *member, const char *base)
+{
+	SCField		*field = member->field;
+	const char	*writer = NULL;
+	gchar		*value,
+				*prev,
+				*loop;
+	int			depth = ser->depth;
+
+	if (member->kind == GEN_FLEXIBLE)
+		return;
+
+	value = g_strdup_printf("%s%s", base, member->path);
+	loop = g_strdup_printf("i%d", depth);
+
+	/* A nested struct/union, or an array of them */
+	if (member->kind == GEN_NESTED) {
+		const char	*element = member->nested->is_union ? "union" : "struct";
+		gchar		*nested_base;
+
+		if (member->array) {
+			gchar *item = g_strdup_printf("%s[%s]", value, loop);
+
+			serialize_code(ser, "for (size_t %s = 0; %s < sizeof(%s) / sizeof(%s[0]); %s++) {",
+				loop, loop, value, value, loop);
+			ser->depth++;
+			prev = serialize_delta_open(ser, item, 0);
+			serialize_markup(ser, "<%s index=\"", element);
+			serialize_code(ser, "sc2xml_put_u64(o, %s);", loop);
+			serialize_markup(ser, "\">");
+			nested_base = g_strdup_printf("%s.", item);
+			g_free(item);
+		}
+		else {
+			prev = serialize_delta_open(ser, value, 0);
+			serialize_markup(ser, "<%s>", element);
+			nested_base = g_strdup_printf("%s.", value);
+		}
+
+		if (member->nested->name)
+			serialize_markup(ser, "<struct_name>%s</struct_name>", member->nested->name);
+		serialize_markup(ser, "<name>%s</name>", member->path);
+		serialize_members(ser, member->nested, nested_base);
+		serialize_markup(ser, "</%s>", element);
+		serialize_delta_close(ser, prev);
+
+		if (member->array) {
+			serialize_code(ser, NULL);
+			ser->depth--;
+			serialize_code(ser, "}");
+		}
+		g_free(nested_base);
+		goto out;
+	}
+
+	prev = serialize_delta_open(ser, value, member->kind == GEN_BITS);
+	serialize_field_open(ser, member);
+
+	if (member->kind == GEN_SCALAR && !strchr(field->type, '*')) {
+		gchar *type = gen_value_type(field->type);
+
+		writer = g_hash_table_lookup(ser->known, type);
+		g_free(type);
+	}
+
+	/* A struct with a serializer of its own */
+	if (writer) {
+		if (member->array) {
+			serialize_code(ser, "for (size_t %s = 0; %s < sizeof(%s) / sizeof(%s[0]); %s++)",
+				loop, loop, value, value, loop);
+			if (ser->delta)
+				serialize_code(ser, "\t%s_xml_put_delta(o, &%s[%s], &%s[%s]);", writer, value,
+					loop, prev, loop);
+			else
+				serialize_code(ser, "\t%s_xml_put(o, &%s[%s]);", writer, value, loop);
+		}
+		else if (ser->delta)
+			serialize_code(ser, "%s_xml_put_delta(o, &%s, &%s);", writer, value, prev);
+		else
+			serialize_code(ser, "%s_xml_put(o, &%s);", writer, value);
+		serialize_markup(ser, "</field>");
+		serialize_delta_close(ser, prev);
+		goto out;
+	}
+
+	serialize_markup(ser, "<value>");
+
+	if (member->kind == GEN_BITS) {
+		if (strstr(field->type, "unsigned"))
+			serialize_code(ser, "sc2xml_put_u64(o, (unsigned long long)%s);", value);
+		else
+			serialize_code(ser, "sc2xml_put_i64(o, (long long)%s);", value);
+	}
+	else if (member->array && member->kind == GEN_SCALAR && serialize_is_text(field->type)) {
+		serialize_code(ser, "sc2xml_put_text(o, (const char *)%s, sizeof(%s));", value, value);
+	}
+	else {
+		const char	*put = member->kind == GEN_FUNC_PTR || strchr(field->type, '*') ?
+							"sc2xml_put_ptr" : NULL;
+		gchar		*type = gen_value_type(field->type),
+					*element,
+					*count;
+
+		/* Arrays of arrays are written as one array of scalars */
+		if (member->kind == GEN_FUNC_PTR)
+			element = member->array ? g_strdup_printf("%s[%s]", value, loop) : g_strdup(value);
+		else if (member->array)
+			element = g_strdup_printf("((%s const *)&%s)[%s]", type, value, loop);
+		else
+			element = g_strdup(value);
+
+		count = g_strdup_printf("sizeof(%s) / sizeof(%s)", value,
+			member->kind == GEN_FUNC_PTR ? element : type);
+
+		/* Delta: up to the last element that changed, the loaders keep the rest */
+		if (member->array && ser->delta && member->kind == GEN_SCALAR) {
+			g_free(count);
+			count = g_strdup_printf("n%d", depth);
+			serialize_code(ser, "size_t %s = sizeof(%s) / sizeof(%s);\n", count, value, type);
+			serialize_code(ser, "while (memcmp(&((%s const *)&%s)[%s - 1], "
+				"&((%s const *)&%s)[%s - 1], sizeof(%s)) == 0)", type, value, count, type,
+				prev, count, type);
+			serialize_code(ser, "\t%s--;", count);
+		}
+
+		if (member->array) {
+			serialize_code(ser, "for (size_t %s = 0; %s < %s; %s++) {", loop, loop, count, loop);
+			ser->depth++;
+			serialize_code(ser, "if (%s)", loop);
+			serialize_code(ser, "\tSC2XML_LIT(o, \" \");");
+		}
+
+		if (put)
+			serialize_code(ser, "%s(o, &%s, sizeof(%s));", put, element, element);
+		else
+			serialize_code(ser, "SC2XML_VALUE(o, %s);", element);
+
+		if (member->array) {
+			ser->depth--;
+			serialize_code(ser, "}");
+		}
+		g_free(element);
+		g_free(count);
+		g_free(type);
+	}
+
+	serialize_markup(ser, "</value></field>");
+	serialize_delta_close(ser, prev);
+
+out:
+	g_free(value);
+	g_free(loop);
+}
+
+/**
+ * @brief Write the code of the members of a struct
+ * @param ser The code being generated
+ * @param st The struct
+ * @param base What the path of the members is appended to
+ */
+static void serialize_members(SCSerializer *ser, SCStruct *st, const char *base)
+{
+	GPtrArray	*members = gen_members(st);
+	guint		i;
+
+	for (i = 0; i < members->len; i++)
+		serialize_member(ser, g_ptr_array_index(members, i), base);
+
+	g_ptr_array_free(members, TRUE);
+}
+
+/**
+ * @brief Write the serializer of a struct
+ * @param ser The code being generated
+ * @param gen The struct
+ */
+static void serialize_struct(SCSerializer *ser, SCGenStruct *gen)
+{
+	const char *element = gen->st->is_union ? "union" : "struct";
+
+	fprintf(ser->fd, "/* %s (%s) */\n", gen->type, gen->header);
+	fprintf(ser->fd, "static inline void %s_xml_put(struct sc2xml_out *o, const %s *v)\n{\n",
+		gen->name, gen->type);
+
+	serialize_markup(ser, "<%s><struct_name>%s</struct_name>", element, gen->name);
+	serialize_members(ser, gen->st, "v->");
+	serialize_markup(ser, "</%s>", element);
+	serialize_code(ser, NULL);
+	fprintf(ser->fd, "}\n\n");
+
+	/* The entry point */
+	fprintf(ser->fd, "/* Write v to buf, return the length of the XML, which does not fit\n"
+					 " * if it is size or more */\n");
+	fprintf(ser->fd, "static inline size_t %s_to_xml(const %s *v, char *buf, size_t size)\n{\n",
+		gen->name, gen->type);
+	fprintf(ser->fd, "\tstruct sc2xml_out o = { buf, size, 0 };\n\n"
+					 "\t%s_xml_put(&o, v);\n"
+					 "\tif (o.len < size)\n\t\tbuf[o.len] = '\\0';\n\n"
+					 "\treturn o.len;\n}\n\n", gen->name);
+
+	/* The same with only the members that changed */
+	fprintf(ser->fd, "static inline void %s_xml_put_delta(struct sc2xml_out *o, const %s *v,\n"
+					 "\t\tconst %s *prev)\n{\n", gen->name, gen->type, gen->type);
+	ser->delta = 1;
+	serialize_markup(ser, "<%s><struct_name>%s</struct_name>", element, gen->name);
+	serialize_members(ser, gen->st, "v->");
+	serialize_markup(ser, "</%s>", element);
+	serialize_code(ser, NULL);
+	ser->delta = 0;
+	fprintf(ser->fd, "}\n\n");
+
+	fprintf(ser->fd, "/* Write the members of v that differ from prev, like %s_to_xml().\n"
+					 " * %s_from_xml() into a copy of prev gives v back */\n",
+		gen->name, gen->name);
+	fprintf(ser->fd, "static inline size_t %s_to_xml_delta(const %s *v, const %s *prev, "
+					 "char *buf,\n\t\tsize_t size)\n{\n", gen->name, gen->type, gen->type);
+	fprintf(ser->fd, "\tstruct sc2xml_out o = { buf, size, 0 };\n\n"
+					 "\t%s_xml_put_delta(&o, v, prev);\n"
+					 "\tif (o.len < size)\n\t\tbuf[o.len] = '\\0';\n\n"
+					 "\treturn o.len;\n}\n\n", gen->name);
+}
+
+/**
+ * @brief Write the serializers of the structs selected
+ * @param filename The header to generate
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult serialize_write(const char *filename)
+{
+	GPtrArray		*gens = gen_structs(),
+					*written = g_ptr_array_new();
+	GHashTable		*names;
+	SCSerializer	ser;
+	guint			i;
+
+	ser.fd = gen_open(filename, "Serializers of the parsed structs to XML", gens, 0);
+	if (ser.fd == NULL) {
+		g_ptr_array_free(written, TRUE);
+		return SC_FAIL;
+	}
+	ser.markup = g_string_new(NULL);
+	ser.known = g_hash_table_new(g_str_hash, g_str_equal);
+	ser.depth = 0;
+	ser.delta = 0;
+
+	fputs(serialize_helpers, ser.fd);
+
+	names = g_hash_table_new(g_str_hash, g_str_equal);
+	for (i = 0; i < gens->len; i++) {
+		SCGenStruct *gen = g_ptr_array_index(gens, i);
+
+		if (g_hash_table_lookup(names, gen->name)) {
+			log_error(LOG_WARN, "%s(): '%s' is defined again in '%s', skipping it",
+				__func__, gen->name, gen->header);
+			continue;
+		}
+		g_hash_table_insert(names, gen->name, gen);
+		g_hash_table_insert(ser.known, gen->type, gen->name);
+		g_ptr_array_add(written, gen);
+	}
+	g_hash_table_destroy(names);
+
+	/* The serializers call each other for the fields of struct types */
+	for (i = 0; i < written->len; i++) {
+		SCGenStruct *gen = g_ptr_array_index(written, i);
+
+		fprintf(ser.fd, "static inline void %s_xml_put(struct sc2xml_out *, const %s *);\n",
+			gen->name, gen->type);
+		fprintf(ser.fd, "static inline void %s_xml_put_delta(struct sc2xml_out *, const %s *,\n"
+						"\t\tconst %s *);\n", gen->name, gen->type, gen->type);
+	}
+	fputc('\n', ser.fd);
+
+	for (i = 0; i < written->len; i++)
+		serialize_struct(&ser, g_ptr_array_index(written, i));
+
+	g_hash_table_destroy(ser.known);
+	g_string_free(ser.markup, TRUE);
+	g_ptr_array_free(written, TRUE);
+
+	return gen_close(ser.fd, filename);
+}
@@ -0,0 +1,20 @@
+/**
+ * @file serialize.h
+ *
+ * @brief Defines for serialize.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#ifndef _SERIALIZE_H
+#define _SERIALIZE_H
+
+#include "sc2xml.h"
+
+SCResult	serialize_write(const char *);
+
+#endif	/* _SERIALIZE_H */
@@ -0,0 +1,281 @@
+/**
+ * @file slab.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * @brief Typed slab allocators generator (--slabs). For every struct
+ *        selected it writes an allocator of its instances:
+ *
+ *        struct my_st *v = my_st_slab_alloc();
+ *        my_st_slab_free(v);
+ *
+ *        The instances are carved from slabs of SC2XML_SLAB_BYTES aligned to
+ *        a cache line. Every thread keeps a free list per type, so allocating
+ *        and freeing is popping and pushing a list without atomics. The
+ *        lists are refilled from, and trimmed to, a pool per type a batch at
+ *        a time, under a spinlock held only to splice the lists. The
+ *        sizes and alignments are taken with sizeof() and _Alignof() when
+ *        the generated code is compiled, so they always follow the parsed
+ *        headers.
+ *
+ *        The slabs are never given back to the system. The generated code
+ *        needs C11 and exactly one source file that defines
+ *        SC2XML_SLAB_IMPLEMENTATION before including it.
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "config.h"
+#include "sc2xml.h"
+#include "misc.h"
+#include "model.h"
+#include "gen.h"
+#include "slab.h"
+
+/* Slabs, free lists and pools shared by all the generated allocators */
+static const char *slab_helpers =
+	"#ifndef SC2XML_SLAB_HELPERS\n"
+	"#define SC2XML_SLAB_HELPERS\n"
+	"#include <stdatomic.h>\n"
+	"\n"
+	"/* Bytes of a slab and of a cache line, powers of 2 */\n"
+	"#ifndef SC2XML_SLAB_BYTES\n"
+	"#define SC2XML_SLAB_BYTES (64u << 10)\n"
+	"#endif\n"
+	"#ifndef SC2XML_SLAB_LINE\n"
+	"#define SC2XML_SLAB_LINE 64u\n"
+	"#endif\n"
+	"\n"
+	"/* Objects moved at a time between a thread and the pool of their type */\n"
+	"#ifndef SC2XML_SLAB_BATCH\n"
+	"#define SC2XML_SLAB_BATCH 64u\n"
+	"#endif\n"
+	"\n"
+	"/* A free object, linked through its first bytes */\n"
+	"struct sc2xml_slab_free {\n"
+	"\tstruct sc2xml_slab_free *next;\n"
+	"};\n"
+	"\n"
+	"/* The free objects of a type kept by a thread */\n"
+	"struct sc2xml_slab_cache {\n"
+	"\tstruct sc2xml_slab_free *head;\n"
+	"\tsize_t count;\n"
+	"};\n"
+	"\n"
+	"/* The free objects of a type given back by the threads */\n"
+	"struct sc2xml_slab_pool {\n"
+	"\tatomic_flag lock;\n"
+	"\tstruct sc2xml_slab_free *depot;\n"
+	"\tsize_t size;\t/* Bytes from an object to the next one */\n"
+	"\tsize_t align;\n"
+	"};\n"
+	"\n"
+	"#define SC2XML_SLAB_MAX(a, b) ((a) > (b) ? (a) : (b))\n"
+	"#define SC2XML_SLAB_ALIGN(type) SC2XML_SLAB_MAX(_Alignof(type), _Alignof(void *))\n"
+	"#define SC2XML_SLAB_POOL(type) { ATOMIC_FLAG_INIT, NULL,\t\t\t\t\t\t\t\\\n"
+	"\t(SC2XML_SLAB_MAX(sizeof(type), sizeof(void *)) + SC2XML_SLAB_ALIGN(type) - 1) /\t\\\n"
+	"\t\tSC2XML_SLAB_ALIGN(type) * SC2XML_SLAB_ALIGN(type),\t\t\t\t\t\t\t\\\n"
+	"\tSC2XML_SLAB_ALIGN(type) }\n"
+	"\n"
+	"int sc2xml_slab_refill(struct sc2xml_slab_pool *pool, struct sc2xml_slab_cache *cache,\n"
+	"\t\tsize_t want);\n"
+	"void sc2xml_slab_flush(struct sc2xml_slab_pool *pool, struct sc2xml_slab_cache *cache,\n"
+	"\t\tsize_t keep);\n"
+	"\n"
+	"static inline void *sc2xml_slab_get(struct sc2xml_slab_pool *pool,\n"
+	"\t\tstruct sc2xml_slab_cache *cache)\n"
+	"{\n"
+	"\tstruct sc2xml_slab_free *f = cache->head;\n"
+	"\n"
+	"\tif (f == NULL) {\n"
+	"\t\tif (sc2xml_slab_refill(pool, cache, SC2XML_SLAB_BATCH) != 0)\n"
+	"\t\t\treturn NULL;\n"
+	"\t\tf = cache->head;\n"
+	"\t}\n"
+	"\tcache->head = f->next;\n"
+	"\tcache->count--;\n"
+	"\n"
+	"\treturn f;\n"
+	"}\n"
+	"\n"
+	"static inline void sc2xml_slab_push(struct sc2xml_slab_cache *cache, void *p)\n"
+	"{\n"
+	"\tstruct sc2xml_slab_free *f = p;\n"
+	"\n"
+	"\tf->next = cache->head;\n"
+	"\tcache->head = f;\n"
+	"\tcache->count++;\n"
+	"}\n"
+	"\n"
+	"/* Give an object back, to the pool when the thread keeps too many */\n"
+	"static inline void sc2xml_slab_put(struct sc2xml_slab_pool *pool,\n"
+	"\t\tstruct sc2xml_slab_cache *cache, void *p)\n"
+	"{\n"
+	"\tif (p == NULL)\n"
+	"\t\treturn;\n"
+	"\tsc2xml_slab_push(cache, p);\n"
+	"\tif (cache->count > 2 * SC2XML_SLAB_BATCH)\n"
+	"\t\tsc2xml_slab_flush(pool, cache, SC2XML_SLAB_BATCH);\n"
+	"}\n"
+	"\n"
+	"#ifdef SC2XML_SLAB_IMPLEMENTATION\n"
+	"static void sc2xml_slab_lock(struct sc2xml_slab_pool *pool)\n"
+	"{\n"
+	"\twhile (atomic_flag_test_and_set_explicit(&pool->lock, memory_order_acquire))\n"
+	"\t\t;\n"
+	"}\n"
+	"\n"
+	"static void sc2xml_slab_unlock(struct sc2xml_slab_pool *pool)\n"
+	"{\n"
+	"\tatomic_flag_clear_explicit(&pool->lock, memory_order_release);\n"
+	"}\n"
+	"\n"
+	"/* Give the thread at least want free objects, from the pool or from new\n"
+	" * slabs aligned to a cache line. Returns -1 if there is no memory left */\n"
+	"int sc2xml_slab_refill(struct sc2xml_slab_pool *pool, struct sc2xml_slab_cache *cache,\n"
+	"\t\tsize_t want)\n"
+	"{\n"
+	"\tstruct sc2xml_slab_free *f;\n"
+	"\tsize_t line = SC2XML_SLAB_MAX(SC2XML_SLAB_LINE, pool->align), bytes, n;\n"
+	"\tunsigned char *slab;\n"
+	"\n"
+	"\tsc2xml_slab_lock(pool);\n"
+	"\twhile (cache->count < want && (f = pool->depot) != NULL) {\n"
+	"\t\tpool->depot = f->next;\n"
+	"\t\tsc2xml_slab_push(cache, f);\n"
+	"\t}\n"
+	"\tsc2xml_slab_unlock(pool);\n"
+	"\n"
+	"\twhile (cache->count < want) {\n"
+	"\t\t/* At least 8 objects, pushed backwards to pop them in address order */\n"
+	"\t\tbytes = SC2XML_SLAB_MAX(SC2XML_SLAB_BYTES, 8 * pool->size);\n"
+	"\t\tbytes = (bytes + line - 1) / line * line;\n"
+	"\t\tif ((slab = aligned_alloc(line, bytes)) == NULL)\n"
+	"\t\t\treturn cache->count ? 0 : -1;\n"
+	"\t\tfor (n = bytes / pool->size; n > 0; n--)\n"
+	"\t\t\tsc2xml_slab_push(cache, slab + (n - 1) * pool->size);\n"
+	"\t}\n"
+	"\n"
+	"\treturn 0;\n"
+	"}\n"
+	"\n"
+	"/* Give the free objects of the thread but keep to the pool */\n"
+	"void sc2xml_slab_flush(struct sc2xml_slab_pool *pool, struct sc2xml_slab_cache *cache,\n"
+	"\t\tsize_t keep)\n"
+	"{\n"
+	"\tstruct sc2xml_slab_free *first = cache->head, *last = NULL;\n"
+	"\tsize_t n;\n"
+	"\n"
+	"\tif (cache->count <= keep)\n"
+	"\t\treturn;\n"
+	"\tfor (n = cache->count - keep; n > 0; n--) {\n"
+	"\t\tlast = cache->head;\n"
+	"\t\tcache->head = last->next;\n"
+	"\t}\n"
+	"\tcache->count = keep;\n"
+	"\n"
+	"\tsc2xml_slab_lock(pool);\n"
+	"\tlast->next = pool->depot;\n"
+	"\tpool->depot = first;\n"
+	"\tsc2xml_slab_unlock(pool);\n"
+	"}\n"
+	"#endif\t/* SC2XML_SLAB_IMPLEMENTATION */\n"
+	"#endif\t/* SC2XML_SLAB_HELPERS */\n"
+	"\n";
+
+/**
+ * @brief Write the allocator of a struct
+ * @param fd The header being generated
+ * @param gen The struct
+ */
+static void slab_struct(FILE *fd, SCGenStruct *gen)
+{
+	const char	*name = gen->name,
+				*type = gen->type;
+
+	fprintf(fd, "/* %s (%s) */\n", type, gen->header);
+	fprintf(fd, "extern struct sc2xml_slab_pool %s_slab_pool;\n", name);
+	fprintf(fd, "extern _Thread_local struct sc2xml_slab_cache %s_slab_cache;\n\n", name);
+
+	fprintf(fd, "/* An uninitialized instance, NULL if there is no memory left */\n");
+	fprintf(fd, "static inline %s *%s_slab_alloc(void)\n{\n"
+				"\treturn (%s *)sc2xml_slab_get(&%s_slab_pool, &%s_slab_cache);\n}\n\n",
+		type, name, type, name, name);
+
+	fprintf(fd, "static inline void %s_slab_free(%s *v)\n{\n"
+				"\tsc2xml_slab_put(&%s_slab_pool, &%s_slab_cache, v);\n}\n\n",
+		name, type, name, name);
+
+	fprintf(fd, "/* Fill v with up to n instances, return how many */\n");
+	fprintf(fd, "static inline size_t %s_slab_alloc_bulk(%s **v, size_t n)\n{\n"
+				"\tsize_t i;\n\n"
+				"\tif (%s_slab_cache.count < n)\n"
+				"\t\tsc2xml_slab_refill(&%s_slab_pool, &%s_slab_cache, n);\n"
+				"\tfor (i = 0; i < n; i++)\n"
+				"\t\tif ((v[i] = %s_slab_alloc()) == NULL)\n"
+				"\t\t\tbreak;\n\n"
+				"\treturn i;\n}\n\n",
+		name, type, name, name, name, name);
+
+	fprintf(fd, "static inline void %s_slab_free_bulk(%s **v, size_t n)\n{\n"
+				"\tsize_t i;\n\n"
+				"\tfor (i = 0; i < n; i++)\n"
+				"\t\tif (v[i] != NULL)\n"
+				"\t\t\tsc2xml_slab_push(&%s_slab_cache, v[i]);\n"
+				"\tif (%s_slab_cache.count > 2 * SC2XML_SLAB_BATCH)\n"
+				"\t\tsc2xml_slab_flush(&%s_slab_pool, &%s_slab_cache, SC2XML_SLAB_BATCH);\n}\n\n",
+		name, type, name, name, name, name);
+
+	fprintf(fd, "/* Give the free instances of the thread to the other ones, before it\n"
+				" * exits */\n");
+	fprintf(fd, "static inline void %s_slab_flush(void)\n{\n"
+				"\tsc2xml_slab_flush(&%s_slab_pool, &%s_slab_cache, 0);\n}\n\n",
+		name, name, name);
+
+	fprintf(fd, "#ifdef SC2XML_SLAB_IMPLEMENTATION\n"
+				"struct sc2xml_slab_pool %s_slab_pool = SC2XML_SLAB_POOL(%s);\n"
+				"_Thread_local struct sc2xml_slab_cache %s_slab_cache;\n"
+				"#endif\n\n", name, type, name);
+}
+
+/**
+ * @brief Write the allocators of the structs selected
+ * @param filename The header to generate
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult slab_write(const char *filename)
+{
+	GPtrArray	*gens = gen_structs();
+	GHashTable	*names;
+	FILE		*fd;
+	guint		i;
+
+	fd = gen_open(filename, "Slab allocators of the parsed structs", gens, 0);
+	if (fd == NULL)
+		return SC_FAIL;
+
+	fputs(slab_helpers, fd);
+
+	names = g_hash_table_new(g_str_hash, g_str_equal);
+	for (i = 0; i < gens->len; i++) {
+		SCGenStruct *gen = g_ptr_array_index(gens, i);
+
+		if (g_hash_table_lookup(names, gen->name)) {
+			log_error(LOG_WARN, "%s(): '%s' is defined again in '%s', skipping it",
+				__func__, gen->name, gen->header);
+			continue;
+		}
+		g_hash_table_insert(names, gen->name, gen);
+		slab_struct(fd, gen);
+	}
+	g_hash_table_destroy(names);
+
+	return gen_close(fd, filename);
+}
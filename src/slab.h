@@ -0,0 +1,20 @@
+/**
+ * @file slab.h
+ *
+ * @brief Defines for slab.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#ifndef _SLAB_H
+#define _SLAB_H
+
+#include "sc2xml.h"
+
+SCResult	slab_write(const char *);
+
+#endif	/* _SLAB_H */
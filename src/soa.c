@@ -0,0 +1,252 @@
+/**
+ * @file soa.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * @brief Structure of arrays generator (--soa). For every struct selected
+ *        it writes a container with one array per member, aligned to
+ *        SC2XML_SOA_ALIGN bytes, and the functions to handle it:
+ *
+ *        struct NAME_soa				count, capacity and the arrays
+ *        NAME_soa_init/resize/free	allocation
+ *        NAME_soa_gather				element i to a struct
+ *        NAME_soa_scatter			a struct to element i
+ *        NAME_soa_push				a struct appended at the end
+ *
+ *        Arrays are stored as arrays of arrays, with as many elements as
+ *        the compiler says, and copied with memcpy(). Bit fields have no
+ *        address, so they are stored widened to their declared type and
+ *        copied by assignment. Named nested structs/unions are stored as a
+ *        whole, with their type if it has a tag and as bytes otherwise.
+ *        Flexible array members are not stored.
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "config.h"
+#include "sc2xml.h"
+#include "misc.h"
+#include "model.h"
+#include "gen.h"
+#include "soa.h"
+
+/* Allocation shared by all the generated containers */
+static const char *soa_helpers =
+	"#ifndef SC2XML_SOA_ALIGN\n"
+	"#define SC2XML_SOA_ALIGN\t64\t/* Alignment of the arrays */\n"
+	"#endif\n"
+	"\n"
+	"#ifndef SC2XML_SOA_HELPERS\n"
+	"#define SC2XML_SOA_HELPERS\n"
+	"/* Replace an array by an aligned one of 'bytes', keeping 'used' bytes.\n"
+	" * aligned_alloc() wants a multiple of the alignment */\n"
+	"static inline int sc2xml_soa_realloc(void **array, size_t used, size_t bytes)\n"
+	"{\n"
+	"\tsize_t size = (bytes + SC2XML_SOA_ALIGN - 1) / SC2XML_SOA_ALIGN * SC2XML_SOA_ALIGN;\n"
+	"\tvoid *p;\n"
+	"\n"
+	"\tif (size < bytes || (p = aligned_alloc(SC2XML_SOA_ALIGN, size ? size : SC2XML_SOA_ALIGN)) == NULL)\n"
+	"\t\treturn -1;\n"
+	"\tif (*array != NULL) {\n"
+	"\t\tmemcpy(p, *array, used);\n"
+	"\t\tfree(*array);\n"
+	"\t}\n"
+	"\t*array = p;\n"
+	"\n"
+	"\treturn 0;\n"
+	"}\n"
+	"#endif\n\n";
+
+/**
+ * @brief Write the declaration of the array of a member
+ * @param fd The generated header
+ * @param gen The struct
+ * @param member The member
+ */
+static void soa_declare(FILE *fd, SCGenStruct *gen, SCGenMember *member)
+{
+	gchar *type = member->type ? gen_value_type(member->type) : NULL;
+
+	switch (member->kind) {
+	case GEN_FLEXIBLE:
+		fprintf(fd, "\t/* %s: flexible array member, not stored */\n", member->path);
+		break;
+
+	case GEN_BITS:
+		fprintf(fd, "\t%s *%s;\t/* Bit field : %s */\n", type, member->id,
+			member->field->bits);
+		break;
+
+	case GEN_FUNC_PTR:
+		if (!member->array) {
+			fprintf(fd, "\t%s (**%s)(%s);\n", type, member->id,
+				member->field->input_args ? member->field->input_args : "");
+			break;
+		}
+		/* An array of function pointers is stored as bytes */
+		fprintf(fd, "\tunsigned char (*%s)[sizeof(((%s *)0)->%s)];\n",
+			member->id, gen->type, member->path);
+		break;
+
+	case GEN_NESTED:
+		if (type == NULL) {
+			fprintf(fd, "\tunsigned char (*%s)[sizeof(((%s *)0)->%s)];\n",
+				member->id, gen->type, member->path);
+			break;
+		}
+		/* Fall through */
+
+	case GEN_SCALAR:
+		if (member->array)
+			fprintf(fd, "\t%s (*%s)[sizeof(((%s *)0)->%s) / sizeof(%s)];\n",
+				type, member->id, gen->type, member->path, type);
+		else
+			fprintf(fd, "\t%s *%s;\n", type, member->id);
+		break;
+	}
+
+	g_free(type);
+}
+
+/**
+ * @brief Write the container and the functions of a struct
+ * @param fd The generated header
+ * @param gen The struct
+ */
+static void soa_struct(FILE *fd, SCGenStruct *gen)
+{
+	GPtrArray	*members = gen_members(gen->st);
+	const char	*name = gen->name,
+				*type = gen->type;
+	guint		i;
+
+	fprintf(fd, "/* Structure of arrays of %s (%s) */\n", type, gen->header);
+	fprintf(fd, "struct %s_soa {\n", name);
+	fprintf(fd, "\tsize_t count;\t\t/* Elements in use */\n");
+	fprintf(fd, "\tsize_t capacity;\t/* Elements allocated */\n");
+	for (i = 0; i < members->len; i++)
+		soa_declare(fd, gen, g_ptr_array_index(members, i));
+	fprintf(fd, "};\n\n");
+
+	/* NAME_soa_resize() */
+	fprintf(fd, "static inline int %s_soa_resize(struct %s_soa *soa, size_t capacity)\n{\n",
+		name, name);
+	fprintf(fd, "\tsize_t used = soa->count < capacity ? soa->count : capacity,\n"
+				"\t       keep = soa->capacity < capacity ? soa->capacity : capacity;\n\n");
+	for (i = 0; i < members->len; i++) {
+		SCGenMember *member = g_ptr_array_index(members, i);
+
+		if (member->kind == GEN_FLEXIBLE)
+			continue;
+		fprintf(fd, "\tif (sc2xml_soa_realloc((void **)&soa->%s, used * sizeof(*soa->%s),\n"
+					"\t\t\tcapacity * sizeof(*soa->%s)) != 0)\n\t\tgoto error;\n",
+			member->id, member->id, member->id);
+	}
+	fprintf(fd, "\tsoa->capacity = capacity;\n\tsoa->count = used;\n\n\treturn 0;\n\n");
+	fprintf(fd, "error:\n\t/* Every array has at least 'keep' elements */\n"
+				"\tsoa->capacity = keep;\n"
+				"\tif (soa->count > keep)\n\t\tsoa->count = keep;\n\n\treturn -1;\n}\n\n");
+
+	/* NAME_soa_init() */
+	fprintf(fd, "static inline int %s_soa_init(struct %s_soa *soa, size_t capacity)\n{\n"
+				"\tmemset(soa, 0, sizeof(*soa));\n\n"
+				"\treturn %s_soa_resize(soa, capacity);\n}\n\n", name, name, name);
+
+	/* NAME_soa_free() */
+	fprintf(fd, "static inline void %s_soa_free(struct %s_soa *soa)\n{\n", name, name);
+	for (i = 0; i < members->len; i++) {
+		SCGenMember *member = g_ptr_array_index(members, i);
+
+		if (member->kind != GEN_FLEXIBLE)
+			fprintf(fd, "\tfree(soa->%s);\n", member->id);
+	}
+	fprintf(fd, "\tmemset(soa, 0, sizeof(*soa));\n}\n\n");
+
+	/* NAME_soa_gather() */
+	fprintf(fd, "static inline void %s_soa_gather(const struct %s_soa *soa, size_t i, %s *out)\n{\n",
+		name, name, type);
+	for (i = 0; i < members->len; i++) {
+		SCGenMember *member = g_ptr_array_index(members, i);
+
+		if (member->kind == GEN_BITS)
+			fprintf(fd, "\tout->%s = soa->%s[i];\n", member->path, member->id);
+		else if (member->kind != GEN_FLEXIBLE)
+			fprintf(fd, "\tmemcpy((void *)&out->%s, &soa->%s[i], sizeof(soa->%s[i]));\n",
+				member->path, member->id, member->id);
+	}
+	fprintf(fd, "}\n\n");
+
+	/* NAME_soa_scatter() */
+	fprintf(fd, "static inline void %s_soa_scatter(struct %s_soa *soa, size_t i, const %s *in)\n{\n",
+		name, name, type);
+	for (i = 0; i < members->len; i++) {
+		SCGenMember *member = g_ptr_array_index(members, i);
+
+		if (member->kind == GEN_BITS)
+			fprintf(fd, "\tsoa->%s[i] = in->%s;\n", member->id, member->path);
+		else if (member->kind != GEN_FLEXIBLE)
+			fprintf(fd, "\tmemcpy(&soa->%s[i], &in->%s, sizeof(soa->%s[i]));\n",
+				member->id, member->path, member->id);
+	}
+	fprintf(fd, "}\n\n");
+
+	/* NAME_soa_push() */
+	fprintf(fd, "static inline int %s_soa_push(struct %s_soa *soa, const %s *in)\n{\n",
+		name, name, type);
+	fprintf(fd, "\tif (soa->count == soa->capacity &&\n"
+				"\t\t\t%s_soa_resize(soa, soa->capacity ? 2 * soa->capacity : 16) != 0)\n"
+				"\t\treturn -1;\n\n"
+				"\t%s_soa_scatter(soa, soa->count++, in);\n\n"
+				"\treturn 0;\n}\n\n", name, name);
+
+	g_ptr_array_free(members, TRUE);
+}
+
+/**
+ * @brief Write the structure of arrays of the structs selected
+ * @param filename The header to generate
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult soa_write(const char *filename)
+{
+	GPtrArray	*gens = gen_structs();
+	GHashTable	*names;
+	FILE		*fd;
+	guint		i;
+
+	fd = gen_open(filename, "Structures of arrays of the parsed structs", gens, 0);
+	if (fd == NULL)
+		return SC_FAIL;
+
+	fputs(soa_helpers, fd);
+
+	names = g_hash_table_new(g_str_hash, g_str_equal);
+	for (i = 0; i < gens->len; i++) {
+		SCGenStruct *gen = g_ptr_array_index(gens, i);
+
+		if (gen->st->is_union) {
+			log_error(LOG_WARN, "%s(): '%s' is a union, skipping it", __func__, gen->name);
+			continue;
+		}
+
+		/* The code is named after the struct */
+		if (g_hash_table_lookup(names, gen->name)) {
+			log_error(LOG_WARN, "%s(): '%s' is defined again in '%s', skipping it",
+				__func__, gen->name, gen->header);
+			continue;
+		}
+		g_hash_table_insert(names, gen->name, gen);
+
+		soa_struct(fd, gen);
+	}
+	g_hash_table_destroy(names);
+
+	return gen_close(fd, filename);
+}
@@ -0,0 +1,20 @@
+/**
+ * @file soa.h
+ *
+ * @brief Defines for soa.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#ifndef _SOA_H
+#define _SOA_H
+
+#include "sc2xml.h"
+
+SCResult	soa_write(const char *);
+
+#endif	/* _SOA_H */
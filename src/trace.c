@@ -0,0 +1,315 @@
+/**
+ * @file trace.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * @brief Binary trace loggers generator (--tracers). For every struct
+ *        selected it writes NAME_trace(), which copies an instance with its
+ *        type id and a timestamp into a ring of the calling thread:
+ *
+ *        my_st_trace(&value);
+ *
+ *        The ring has a single writer, the thread, and a single reader,
+ *        sc2xml_trace_drain(), so the hot path is a memcpy() and a store
+ *        with release semantics, without locks nor atomic read-modify-write.
+ *        A record that does not fit because the ring is full is counted as
+ *        dropped, the thread never waits. sc2xml_trace_drain() writes the
+ *        records of every thread to a trace file, which `sc2xml trace`
+ *        formats later as XML, with the descriptions of the parsed headers
+ *        (see decode.c). A thread calls sc2xml_trace_detach() before it
+ *        exits, its ring is then given to the next thread that attaches
+ *        once drained, so the rings follow the threads alive at the same
+ *        time and not all the threads ever created.
+ *
+ *        The type id of a struct is a hash of its name, see trace_type_id(),
+ *        so the trace files are decoded without anything else than the
+ *        headers. The generated code needs C11 and exactly one source file
+ *        that defines SC2XML_TRACE_IMPLEMENTATION before including it.
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "config.h"
+#include "sc2xml.h"
+#include "misc.h"
+#include "model.h"
+#include "gen.h"
+#include "trace.h"
+
+/* Rings and trace files shared by all the generated loggers */
+static const char *trace_helpers =
+	"#ifndef SC2XML_TRACE_HELPERS\n"
+	"#define SC2XML_TRACE_HELPERS\n"
+	"#include <stdatomic.h>\n"
+	"#include <stdint.h>\n"
+	"#include <stdio.h>\n"
+	"#include <time.h>\n"
+	"\n"
+	"/* Bytes of the ring of every thread, a power of 2 */\n"
+	"#ifndef SC2XML_TRACE_RING\n"
+	"#define SC2XML_TRACE_RING (1u << 20)\n"
+	"#endif\n"
+	"\n"
+	"/* Timestamp of the records, nanoseconds of timespec_get() by default */\n"
+	"#ifndef SC2XML_TRACE_CLOCK\n"
+	"static inline uint64_t sc2xml_trace_clock(void)\n"
+	"{\n"
+	"\tstruct timespec ts;\n"
+	"\n"
+	"\ttimespec_get(&ts, TIME_UTC);\n"
+	"\treturn (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;\n"
+	"}\n"
+	"#define SC2XML_TRACE_CLOCK() sc2xml_trace_clock()\n"
+	"#endif\n"
+	"\n"
+	"/* A record, followed by the struct and padded to 8 bytes. Type 0 is a\n"
+	" * control record of sc2xml_trace_drain() */\n"
+	"struct sc2xml_trace_rec {\n"
+	"\tuint32_t type;\n"
+	"\tuint32_t size;\n"
+	"\tuint64_t time;\n"
+	"};\n"
+	"\n"
+	"/* States of a ring: used by a thread, given back by sc2xml_trace_detach()\n"
+	" * but not drained yet, free for the next thread that attaches */\n"
+	"enum { SC2XML_TRACE_LIVE, SC2XML_TRACE_RETIRED, SC2XML_TRACE_FREE };\n"
+	"\n"
+	"/* The ring of a thread, written only by it and read by the drainer */\n"
+	"struct sc2xml_trace_ring {\n"
+	"\t_Atomic uint64_t head;\n"
+	"\tuint64_t tail_seen;\n"
+	"\tchar pad[48];\n"
+	"\t_Atomic uint64_t tail;\n"
+	"\t_Atomic uint64_t dropped;\n"
+	"\t_Atomic int state;\n"
+	"\tuint64_t id;\n"
+	"\tstruct sc2xml_trace_ring *next;\n"
+	"\tunsigned char buf[SC2XML_TRACE_RING];\n"
+	"};\n"
+	"\n"
+	"extern _Atomic(struct sc2xml_trace_ring *) sc2xml_trace_rings;\n"
+	"extern _Thread_local struct sc2xml_trace_ring *sc2xml_trace_self;\n"
+	"\n"
+	"struct sc2xml_trace_ring *sc2xml_trace_attach(void);\n"
+	"void sc2xml_trace_detach(void);\n"
+	"int sc2xml_trace_begin(FILE *out);\n"
+	"size_t sc2xml_trace_drain(FILE *out);\n"
+	"\n"
+	"static inline void sc2xml_trace_copy(struct sc2xml_trace_ring *r, uint64_t pos,\n"
+	"\t\tconst void *src, size_t len)\n"
+	"{\n"
+	"\tsize_t off = pos & (SC2XML_TRACE_RING - 1),\n"
+	"\t\t   n = len < SC2XML_TRACE_RING - off ? len : SC2XML_TRACE_RING - off;\n"
+	"\n"
+	"\tmemcpy(r->buf + off, src, n);\n"
+	"\tif (n < len)\n"
+	"\t\tmemcpy(r->buf, (const unsigned char *)src + n, len - n);\n"
+	"}\n"
+	"\n"
+	"/* Log a struct, dropped if the ring of the thread is full */\n"
+	"static inline void sc2xml_trace_put(uint32_t type, const void *v, uint32_t size)\n"
+	"{\n"
+	"\tstruct sc2xml_trace_ring *r = sc2xml_trace_self;\n"
+	"\tstruct sc2xml_trace_rec rec;\n"
+	"\tuint64_t head, need = (sizeof(rec) + size + 7) & ~(uint64_t)7;\n"
+	"\n"
+	"\tif (r == NULL && (r = sc2xml_trace_attach()) == NULL)\n"
+	"\t\treturn;\n"
+	"\n"
+	"\thead = atomic_load_explicit(&r->head, memory_order_relaxed);\n"
+	"\tif (head + need - r->tail_seen > SC2XML_TRACE_RING) {\n"
+	"\t\tr->tail_seen = atomic_load_explicit(&r->tail, memory_order_acquire);\n"
+	"\t\tif (head + need - r->tail_seen > SC2XML_TRACE_RING) {\n"
+	"\t\t\tatomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);\n"
+	"\t\t\treturn;\n"
+	"\t\t}\n"
+	"\t}\n"
+	"\n"
+	"\trec.type = type;\n"
+	"\trec.size = size;\n"
+	"\trec.time = SC2XML_TRACE_CLOCK();\n"
+	"\tsc2xml_trace_copy(r, head, &rec, sizeof(rec));\n"
+	"\tsc2xml_trace_copy(r, head + sizeof(rec), v, size);\n"
+	"\tatomic_store_explicit(&r->head, head + need, memory_order_release);\n"
+	"}\n"
+	"\n"
+	"#ifdef SC2XML_TRACE_IMPLEMENTATION\n"
+	"_Atomic(struct sc2xml_trace_ring *) sc2xml_trace_rings;\n"
+	"_Thread_local struct sc2xml_trace_ring *sc2xml_trace_self;\n"
+	"\n"
+	"/* Give the thread a ring, called on its first record. A ring given back\n"
+	" * by a thread that detached is used again once drained */\n"
+	"struct sc2xml_trace_ring *sc2xml_trace_attach(void)\n"
+	"{\n"
+	"\tstatic _Atomic uint64_t ids;\n"
+	"\tstruct sc2xml_trace_ring *r;\n"
+	"\n"
+	"\tfor (r = atomic_load(&sc2xml_trace_rings); r != NULL; r = r->next) {\n"
+	"\t\tint state = SC2XML_TRACE_FREE;\n"
+	"\n"
+	"\t\tif (atomic_compare_exchange_strong(&r->state, &state, SC2XML_TRACE_LIVE)) {\n"
+	"\t\t\tr->tail_seen = atomic_load(&r->tail);\n"
+	"\t\t\tr->id = atomic_fetch_add(&ids, 1) + 1;\n"
+	"\t\t\tsc2xml_trace_self = r;\n"
+	"\t\t\treturn r;\n"
+	"\t\t}\n"
+	"\t}\n"
+	"\n"
+	"\tif ((r = calloc(1, sizeof(*r))) == NULL)\n"
+	"\t\treturn NULL;\n"
+	"\tr->id = atomic_fetch_add(&ids, 1) + 1;\n"
+	"\tr->next = atomic_load(&sc2xml_trace_rings);\n"
+	"\twhile (!atomic_compare_exchange_weak(&sc2xml_trace_rings, &r->next, r))\n"
+	"\t\t;\n"
+	"\tsc2xml_trace_self = r;\n"
+	"\n"
+	"\treturn r;\n"
+	"}\n"
+	"\n"
+	"/* Give the ring of the thread back, before it exits. Its records are\n"
+	" * still written by the next sc2xml_trace_drain() */\n"
+	"void sc2xml_trace_detach(void)\n"
+	"{\n"
+	"\tstruct sc2xml_trace_ring *r = sc2xml_trace_self;\n"
+	"\n"
+	"\tif (r == NULL)\n"
+	"\t\treturn;\n"
+	"\tsc2xml_trace_self = NULL;\n"
+	"\tatomic_store_explicit(&r->state, SC2XML_TRACE_RETIRED, memory_order_release);\n"
+	"}\n"
+	"\n"
+	"/* Start a trace file */\n"
+	"int sc2xml_trace_begin(FILE *out)\n"
+	"{\n"
+	"\tuint32_t header[2] = { 0x01020304u, 1 };\n"
+	"\n"
+	"\tif (fwrite(\"SC2XTRC1\", 8, 1, out) != 1 || fwrite(header, sizeof(header), 1, out) != 1)\n"
+	"\t\treturn -1;\n"
+	"\treturn 0;\n"
+	"}\n"
+	"\n"
+	"static void sc2xml_trace_control(FILE *out, uint64_t what, uint64_t value)\n"
+	"{\n"
+	"\tstruct sc2xml_trace_rec rec = { 0, 16, SC2XML_TRACE_CLOCK() };\n"
+	"\tuint64_t payload[2] = { what, value };\n"
+	"\n"
+	"\tfwrite(&rec, sizeof(rec), 1, out);\n"
+	"\tfwrite(payload, sizeof(payload), 1, out);\n"
+	"}\n"
+	"\n"
+	"/* Write the records of every thread to out, from a single thread at a\n"
+	" * time. Returns the number of bytes written */\n"
+	"size_t sc2xml_trace_drain(FILE *out)\n"
+	"{\n"
+	"\tstruct sc2xml_trace_ring *r;\n"
+	"\tsize_t total = 0;\n"
+	"\n"
+	"\tfor (r = atomic_load(&sc2xml_trace_rings); r != NULL; r = r->next) {\n"
+	"\t\tint state = atomic_load_explicit(&r->state, memory_order_acquire);\n"
+	"\t\tuint64_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed),\n"
+	"\t\t\t\t head = atomic_load_explicit(&r->head, memory_order_acquire),\n"
+	"\t\t\t\t dropped = atomic_exchange_explicit(&r->dropped, 0, memory_order_relaxed);\n"
+	"\n"
+	"\t\tif (state == SC2XML_TRACE_FREE)\n"
+	"\t\t\tcontinue;\n"
+	"\n"
+	"\t\t/* Nothing more is coming from a retired ring once drained */\n"
+	"\t\tif (tail == head && dropped == 0) {\n"
+	"\t\t\tif (state == SC2XML_TRACE_RETIRED)\n"
+	"\t\t\t\tatomic_store_explicit(&r->state, SC2XML_TRACE_FREE, memory_order_release);\n"
+	"\t\t\tcontinue;\n"
+	"\t\t}\n"
+	"\n"
+	"\t\t/* The records that follow are of this thread */\n"
+	"\t\tsc2xml_trace_control(out, 1, r->id);\n"
+	"\t\tif (dropped)\n"
+	"\t\t\tsc2xml_trace_control(out, 2, dropped);\n"
+	"\n"
+	"\t\twhile (tail < head) {\n"
+	"\t\t\tsize_t off = tail & (SC2XML_TRACE_RING - 1),\n"
+	"\t\t\t\t   n = head - tail < SC2XML_TRACE_RING - off ? head - tail : SC2XML_TRACE_RING - off;\n"
+	"\n"
+	"\t\t\tfwrite(r->buf + off, 1, n, out);\n"
+	"\t\t\ttail += n;\n"
+	"\t\t\ttotal += n;\n"
+	"\t\t}\n"
+	"\t\tatomic_store_explicit(&r->tail, tail, memory_order_release);\n"
+	"\t\tif (state == SC2XML_TRACE_RETIRED)\n"
+	"\t\t\tatomic_store_explicit(&r->state, SC2XML_TRACE_FREE, memory_order_release);\n"
+	"\t}\n"
+	"\n"
+	"\treturn total;\n"
+	"}\n"
+	"#endif\t/* SC2XML_TRACE_IMPLEMENTATION */\n"
+	"#endif\t/* SC2XML_TRACE_HELPERS */\n";
+
+/**
+ * @brief Get the type id of a struct in the trace files: the FNV-1a hash
+ *        of its name, 0 being the control records
+ * @param name The name of the struct, see model_struct_name()
+ * @return The type id
+ */
+guint32 trace_type_id(const char *name)
+{
+	guint32 hash = 2166136261u;
+
+	for (; *name; name++)
+		hash = (hash ^ (guchar)*name) * 16777619u;
+
+	return hash ? hash : 1;
+}
+
+/**
+ * @brief Write the loggers of the structs selected
+ * @param filename The header to generate
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult trace_write(const char *filename)
+{
+	GPtrArray	*gens = gen_structs();
+	GHashTable	*ids;
+	FILE		*fd;
+	guint		i;
+
+	fd = gen_open(filename, "Binary trace loggers of the parsed structs", gens, 0);
+	if (fd == NULL)
+		return SC_FAIL;
+
+	fputs(trace_helpers, fd);
+	fputs("\n\n", fd);
+
+	ids = g_hash_table_new(g_direct_hash, g_direct_equal);
+	for (i = 0; i < gens->len; i++) {
+		SCGenStruct	*gen = g_ptr_array_index(gens, i);
+		guint32		id = trace_type_id(gen->name);
+		const char	*other = g_hash_table_lookup(ids, GUINT_TO_POINTER(id));
+
+		/* Two structs with the same id could not be told apart */
+		if (other) {
+			if (strcmp(other, gen->name) == 0)
+				log_error(LOG_WARN, "%s(): '%s' is defined again in '%s', skipping it",
+					__func__, gen->name, gen->header);
+			else
+				log_error(LOG_WARN, "%s(): '%s' has the type id of '%s', skipping it",
+					__func__, gen->name, other);
+			continue;
+		}
+		g_hash_table_insert(ids, GUINT_TO_POINTER(id), gen->name);
+
+		fprintf(fd, "/* %s (%s) */\n", gen->type, gen->header);
+		fprintf(fd, "#define %s_TRACE_ID 0x%08xu\n\n", gen->name, id);
+		fprintf(fd, "static inline void %s_trace(const %s *v)\n{\n"
+					"\tsc2xml_trace_put(%s_TRACE_ID, v, sizeof(*v));\n}\n\n",
+			gen->name, gen->type, gen->name);
+	}
+	g_hash_table_destroy(ids);
+
+	return gen_close(fd, filename);
+}
@@ -0,0 +1,33 @@
+/**
+ * @file trace.h
+ *
+ * @brief Defines for trace.c
+ *
+ * Copyright (c) 2011 Pedro Aguilar
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License. See the file COPYING in the main directory of this archive for
+ * more details.
+ */
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <glib.h>
+
+#include "sc2xml.h"
+
+/* Trace files written by sc2xml_trace_drain(), in the byte order of the
+ * traced process. Every record is padded to 8 bytes. */
+#define TRACE_MAGIC		"SC2XTRC1"	/**< First bytes of a trace file */
+#define TRACE_BOM		0x01020304	/**< Follows the magic, then the version */
+#define TRACE_VERSION	1
+#define TRACE_HEADER	16			/**< Magic, byte order mark and version */
+#define TRACE_RECORD	16			/**< Type id, size and time before a struct */
+#define TRACE_THREAD	1			/**< Control record: thread of the next records */
+#define TRACE_DROPPED	2			/**< Control record: records dropped by the thread */
+
+guint32		trace_type_id(const char *);
+SCResult	trace_write(const char *);
+
+#endif	/* _TRACE_H */
@@ -22,14 +22,50 @@
 
 #include "config.h"
 #include "misc.h"
+#include "index.h"
+#include "archive.h"
+#include "model.h"
+#include "manifest.h"
+#include "graph.h"
+#include "resolve.h"
+#include "layout.h"
+#include "padding.h"
+#include "gen.h"
+#include "decode.h"
+#include "convert.h"
+#include "migrate.h"
+#include "equal.h"
+#include "consts.h"
 #include "xml.h"
 
 #define MY_ENCODING "ISO-8859-1"		/**< Encoded XML text */
 
 SC2XMLPtr   xml_ptr;
 
+/* With --aggregate, all the headers are written to this document */
+static struct xml_ptr_st *aggregate = NULL;
+
+/* Key of every top-level struct written in the document -> its id */
+static GHashTable *struct_ids = NULL;
+
+/* With --resolve, the headers parsed and not written yet */
+static GPtrArray *deferred = NULL;
+static int resolving = 0;
+
 extern GList *my_list;
 
+/**
+ * @brief Get the current byte offset in the XML file. The writer is
+ *        flushed first so the offset accounts for everything written so far.
+ * @return The number of bytes written to the XML file
+ */
+static long xml_output_offset(void)
+{
+	xmlTextWriterFlush(xml_ptr->writer);
+
+	return xml_ptr->out->written;
+}
+
 /** 
  * @brief Sets a flag that indicates if we have a struct or an union
  * @param id 0 if we have a struct, 1 if we have a union
@@ -117,13 +153,15 @@ SCResult xml_typedef_set()
 
 /**
  * @brief Get the size of an array (whatever it finds between 
- *        the square brackets).
+ *        the square brackets). Called once per dimension, the size of
+ *        int x[K][DIM] is "K][DIM".
  */
 SCResult xml_array_size_add(int size_flag)
 {
-	GList 	*ptr, *ptr_start, *ptr_end;
-	int		inside_array = 0, 
-			size = 0;
+	GList 	*ptr;
+	GString	*size;
+	int		inside_array = 0,
+			dims = 0;
 
 	if (!xml_ptr->struct_cnt)
 		return SC_OK;
@@ -131,49 +169,40 @@ SCResult xml_array_size_add(int size_flag)
 	debug_info("%s(): list len: %d\n", __func__, g_list_length(my_list));
 
 	/* If size_flag is zero, the array size was not specified */
-	if (!size_flag) {
+	if (!size_flag && xml_ptr->size == NULL) {
 		debug_info("%s(): Array size: undefined\n", __func__);
 		xml_ptr->size = g_new(char, 1);
 		*(xml_ptr->size) = '\0';
-		xml_ptr->size = xml_ptr->size;
 		return SC_OK;
 	}
 
-	ptr = my_list;
-	while (ptr) {
-		if ((inside_array == 0) && (strcmp((char *)ptr->data, "["))) {
-			ptr = ptr->next;
-			continue;
-		}
-		else if ((inside_array == 0) && (!strcmp((char *)ptr->data, "["))) {
-			inside_array = 1;
-			ptr = ptr->next;
-			ptr_start = ptr;
+	/* Every dimension closed so far */
+	size = g_string_new(NULL);
+	for (ptr = my_list; ptr; ptr = ptr->next) {
+		const char *token = ptr->data;
+
+		if (!inside_array) {
+			if (strcmp(token, "[") == 0) {
+				inside_array = 1;
+				if (dims++)
+					g_string_append(size, "][");
+			}
 			continue;
 		}
 
-		if (!strcmp((char *)ptr->data, "]")) {
-			ptr_end = ptr;
-			break;
+		if (strcmp(token, "]") == 0) {
+			inside_array = 0;
+			continue;
 		}
-		size += strlen((char *)ptr->data) + 1;
-		ptr = ptr->next;
+		if (size->len && size->str[size->len - 1] != '[')
+			g_string_append_c(size, ' ');
+		g_string_append(size, token);
 	}
-	size++;
-
-	debug_info("Size to allocate: %d\n", size);
-	debug_info("start: %s, end: %s\n", (char *)ptr_start->data, (char *)ptr_end->data);
-
-	xml_ptr->size = g_new(char, size);
-	reset_buff(xml_ptr->size, size);
 
-	for (ptr = ptr_start; ptr != ptr_end; ptr = ptr->next) {
-		sprintf(xml_ptr->size, "%s%s ", xml_ptr->size, (char *)ptr->data);
-		debug_info("%s(): SIZE: '%s'\n", __func__, xml_ptr->size);
-	}
+	debug_info("%s(): SIZE: '%s'\n", __func__, size->str);
 
-	*(xml_ptr->size + size - 2) = '\0';
-	xml_ptr->size = xml_ptr->size;
+	g_free(xml_ptr->size);
+	xml_ptr->size = g_string_free(size, FALSE);
 
 	return SC_OK;
 }
@@ -346,13 +375,339 @@ static void free_tokens(gpointer data, gpointer user_data)
 }
 
 /**
- *
+ * @brief Forget the ids of the structs already written. 
+ *        Called when a new document starts.
+ */
+static void xml_struct_ids_reset(void)
+{
+	if (struct_ids)
+		g_hash_table_destroy(struct_ids);
+
+	struct_ids = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+}
+
+/**
+ * @brief Write a <layout> element for every ABI given to --layout
+ * @param layout The layout of a struct or a member, for all the ABIs
+ * @param member 1 to write the offset of a member
+ * @param bit_field 1 to write the offset in bits within the byte
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+static SCResult xml_layout_write(SCLayout *layout, int member, int bit_field)
+{
+	xmlTextWriterPtr	writer = xml_ptr->writer;
+	int					abi,
+						rc;
+
+	for (abi = 0; abi < ABI_COUNT; abi++) {
+		if (!(sc_opts.abis & (1 << abi)) || !layout[abi].known)
+			continue;
+
+		rc = xmlTextWriterStartElement(writer, (xmlChar *)"layout");
+		if (rc >= 0)
+			rc = xmlTextWriterWriteAttribute(writer, (xmlChar *)"abi", 
+					(xmlChar *)layout_abi_name(abi));
+		if (rc >= 0 && member)
+			rc = xmlTextWriterWriteFormatAttribute(writer, (xmlChar *)"offset", 
+					"%" G_GUINT64_FORMAT, layout[abi].offset / 8);
+		if (rc >= 0 && bit_field)
+			rc = xmlTextWriterWriteFormatAttribute(writer, (xmlChar *)"bit_offset", 
+					"%" G_GUINT64_FORMAT, layout[abi].offset % 8);
+		if (rc >= 0)
+			rc = xmlTextWriterWriteFormatAttribute(writer, (xmlChar *)"size", 
+					"%" G_GUINT64_FORMAT, layout[abi].size);
+		if (rc >= 0)
+			rc = xmlTextWriterWriteFormatAttribute(writer, (xmlChar *)"align", 
+					"%" G_GUINT64_FORMAT, layout[abi].align);
+		if (rc >= 0)
+			rc = xmlTextWriterEndElement(writer);
+		if (rc < 0) {
+			log_error(LOG_ERR, "%s(): Could not write <layout> XML node", __func__);
+			return SC_FAIL;
+		}
+	}
+
+	return SC_OK;
+}
+
+/**
+ * @brief Write the value of an array size or a bit width if it is not
+ *        written as a number
+ * @param attribute The attribute for the value
+ * @param expr The array size or the bit width, can be NULL
+ * @param eval Evaluates expr
+ * @return SC_OK on success, SC_FAIL otherwise
+ */
+static SCResult xml_value_write(const char *attribute, const char *expr,
+	SCResult (*eval)(const char *, gint64 *))
+{
+	gint64	value;
+	gchar	*text;
+	int		rc = SC_OK;
+
+	if (expr == NULL || *expr == '\0' || eval(expr, &value) != SC_OK)
+		return SC_OK;
+
+	text = g_strdup_printf("%" G_GINT64_FORMAT, value);
+	if (strcmp(text, expr) != 0 && xmlTextWriterWriteAttribute(xml_ptr->writer, 
+			(xmlChar *)attribute, (xmlChar *)text) < 0)
+		rc = SC_FAIL;
+	g_free(text);
+
+	return rc;
+}
+
+/**
+ * @brief Write a <field> element
+ * @param field The field
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+static SCResult xml_field_write(SCField *field)
+{
+	xmlTextWriterPtr writer = xml_ptr->writer;
+
+	if (xmlTextWriterStartElement(writer, (xmlChar *)"field") < 0)
+		goto error;
+
+	if (field->type && xmlTextWriterWriteAttribute(writer, 
+			(xmlChar *)"type", (xmlChar *)field->type) < 0)
+		goto error;
+
+	if (field->bits && xmlTextWriterWriteAttribute(writer, 
+			(xmlChar *)"bits", (xmlChar *)field->bits) < 0)
+		goto error;
+
+	/* An array whose size was not specified */
+	if (field->size && xmlTextWriterWriteAttribute(writer, (xmlChar *)"size", 
+			(xmlChar *)(*field->size ? field->size : "N/A")) < 0)
+		goto error;
+
+	/* The values of the sizes written with constants, the number of
+	 * elements of all the dimensions of an array */
+	if (sc_opts.abis && (xml_value_write("bits_value", field->bits, consts_eval) != SC_OK ||
+			xml_value_write("size_value", field->size, layout_count) != SC_OK))
+		goto error;
+
+	/* Where the type is defined */
+	if (sc_opts.resolve && !field->func_ptr) {
+		SCDefinition *def = resolve_type(xml_ptr->header, field->type);
+
+		if (def && xmlTextWriterWriteAttribute(writer, 
+				(xmlChar *)"ref", (xmlChar *)def->id) < 0)
+			goto error;
+
+		if (def && strcmp(def->header, xml_ptr->header) != 0 && 
+				xmlTextWriterWriteAttribute(writer, (xmlChar *)"ref_header", 
+					(xmlChar *)def->header) < 0)
+			goto error;
+	}
+
+	if (field->func_ptr) {
+		if (xmlTextWriterWriteAttribute(writer, 
+				(xmlChar *)"function_pointer", (xmlChar *)"1") < 0)
+			goto error;
+
+		if (field->input_args && xmlTextWriterWriteElement(writer, 
+				(xmlChar *)"input_args", (xmlChar *)field->input_args) < 0)
+			goto error;
+	}
+
+	if (xmlTextWriterWriteElement(writer, (xmlChar *)"name", (xmlChar *)field->name) < 0)
+		goto error;
+
+	if (sc_opts.abis && xml_layout_write(field->layout, 1, field->bits != NULL) != SC_OK)
+		return SC_FAIL;
+
+	if (xmlTextWriterEndElement(writer) < 0)
+		goto error;
+
+	return SC_OK;
+
+error:
+	log_error(LOG_ERR, "%s(): Could not write field '%s'", 
+		__func__, field->name ? field->name : "");
+	return SC_FAIL;
+}
+
+/**
+ * @brief Write a <struct>/<union> element with all its members.
+ *        The offsets of top-level elements go to the index.
+ * @param st The struct
+ * @param id Value of the 'id' attribute or NULL
+ * @param member The member of the enclosing struct for a nested struct
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+static SCResult xml_struct_write(SCStruct *st, const char *id, SCField *member)
+{
+	xmlTextWriterPtr	writer = xml_ptr->writer;
+	const char			*element;
+	int					top = (st->parent == NULL),
+						index = sc_opts.index && top;
+	guint				i;
+
+	element = st->is_union ? "union" : "struct";
+
+	if (xmlTextWriterStartElement(writer, (xmlChar *)element) < 0)
+		goto error;
+
+	/* Top-level element: it starts at the '<' just written */
+	if (index)
+		index_element_start(element, xml_output_offset() - strlen(element) - 1);
+
+	if (id && xmlTextWriterWriteAttribute(writer, (xmlChar *)"id", (xmlChar *)id) < 0)
+		goto error;
+
+	if (sc_opts.hash && xmlTextWriterWriteAttribute(writer, 
+			(xmlChar *)"hash", (xmlChar *)model_struct_hash(st)) < 0)
+		goto error;
+
+	if (sc_opts.resolve && top && resolve_struct_id(st) && 
+			xmlTextWriterWriteAttribute(writer, (xmlChar *)"def", 
+				(xmlChar *)resolve_struct_id(st)) < 0)
+		goto error;
+
+	if (st->name) {
+		if (xmlTextWriterWriteElement(writer, 
+				(xmlChar *)"struct_name", (xmlChar *)st->name) < 0)
+			goto error;
+		if (index)
+			index_element_name(NULL, st->name);
+	}
+
+	for (i = 0; i < st->fields->len; i++) {
+		SCField *field = g_ptr_array_index(st->fields, i);
+
+		if (field->nested) {
+			if (xml_struct_write(field->nested, NULL, field) != SC_OK)
+				return SC_FAIL;
+		}
+		else if (xml_field_write(field) != SC_OK) {
+			return SC_FAIL;
+		}
+	}
+
+	if (st->typedef_name) {
+		if (xmlTextWriterWriteElement(writer, 
+				(xmlChar *)"typedef_name", (xmlChar *)st->typedef_name) < 0)
+			goto error;
+		if (index)
+			index_element_name("typedef", st->typedef_name);
+	}
+
+	if (st->tail_name) {
+		if (xmlTextWriterWriteElement(writer, 
+				(xmlChar *)"struct_name", (xmlChar *)st->tail_name) < 0)
+			goto error;
+		if (index)
+			index_element_name(NULL, st->tail_name);
+	}
+
+	if (st->attributes && xmlTextWriterWriteElement(writer, 
+			(xmlChar *)"struct_attributes", (xmlChar *)st->attributes) < 0)
+		goto error;
+
+	if (st->nested_name && xmlTextWriterWriteElement(writer, 
+			(xmlChar *)"struct_nested_name", (xmlChar *)st->nested_name) < 0)
+		goto error;
+
+	/* Size of the struct, or where the nested struct is in its parent */
+	if (sc_opts.abis && xml_layout_write(member ? member->layout : st->layout, 
+			member != NULL, 0) != SC_OK)
+		return SC_FAIL;
+
+	/* </struct> */
+	if (xmlTextWriterEndElement(writer) < 0)
+		goto error;
+
+	/* The top-level element is complete */
+	if (index)
+		index_element_end(xml_output_offset());
+
+	return SC_OK;
+
+error:
+	log_error(LOG_ERR, "%s(): Could not write <%s> XML node", __func__, element);
+	return SC_FAIL;
+}
+
+/**
+ * @brief Write a complete top-level struct. With --dedup-structs, a struct
+ *        identical to one already written in the document is written as a
+ *        reference to its id.
+ * @param st The struct
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+static SCResult xml_struct_write_top(SCStruct *st)
+{
+	gchar	*key,
+			*id;
+	int		rc;
+
+	if (sc_opts.abis)
+		layout_struct(st, xml_ptr->header);
+
+	if (sc_opts.padding)
+		padding_add(xml_ptr->header, st);
+
+	if (sc_opts.migrate)
+		migrate_add(xml_ptr->header, st);
+	else if (sc_opts.convert_abi)
+		convert_add(xml_ptr->header, st);
+	else if (sc_opts.decode_struct || sc_opts.decode_all)
+		decode_add(xml_ptr->header, st);
+
+	if (sc_opts.generate)
+		gen_add(xml_ptr->header, st);
+
+	if (sc_opts.equality)
+		equal_add(xml_ptr->header, st);
+
+	if (sc_opts.manifest)
+		manifest_add(xml_ptr->filename, st);
+
+	if (sc_opts.graph)
+		graph_add_struct(xml_ptr->filename, st);
+
+	if (!sc_opts.dedup_structs)
+		return xml_struct_write(st, NULL, NULL);
+
+	key = model_struct_key(st);
+	id = g_hash_table_lookup(struct_ids, key);
+
+	if (id == NULL) {
+		id = g_strdup_printf("s%u", g_hash_table_size(struct_ids) + 1);
+		g_hash_table_insert(struct_ids, key, id);
+		return xml_struct_write(st, id, NULL);
+	}
+
+	g_free(key);
+
+	/* <struct_ref ref="sN"/> */
+	rc = xmlTextWriterStartElement(xml_ptr->writer, 
+			(xmlChar *)(st->is_union ? "union_ref" : "struct_ref"));
+	if (rc >= 0)
+		rc = xmlTextWriterWriteAttribute(xml_ptr->writer, (xmlChar *)"ref", (xmlChar *)id);
+	if (rc >= 0)
+		rc = xmlTextWriterEndElement(xml_ptr->writer);
+	if (rc < 0) {
+		log_error(LOG_ERR, "%s(): Could not write the reference to '%s'", __func__, id);
+		return SC_FAIL;
+	}
+
+	return SC_OK;
+}
+
+/**
+ * @brief Add the field described by the tokens of the line to the struct
+ *        being parsed. It also closes the struct if the parser said so.
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
  */
 SCResult xml_field_add()
 {
 	int rc = SC_FAIL;
 	GList *ptr;
 	int bits_field = 0;
+	SCField *field;
 
 	/*debug_info("%s(): Inside: xml_ptr->struct_cnt: %d\n", __func__, xml_ptr->struct_cnt);*/
 	if (!xml_ptr->struct_cnt)
@@ -364,15 +719,9 @@ SCResult xml_field_add()
 		goto clean;
 	}
 
-	/* Write 'field' element */
-	rc = xmlTextWriterStartElement(xml_ptr->writer, (xmlChar *)"field");
-    if (rc < 0) {
-        log_error(LOG_ERR, "%s(): Could not add element 'field' to XML tree",
-			__func__);
-        goto clean;
-    }
+	field = model_field_new(xml_ptr->current);
 
-	/* Write 'type' attribute. 
+	/* The 'type' attribute. 
 	 * It could be a pointer (but not a function pointer) */
 	/*if (xml_ptr->pointer && !xml_ptr->func_ptr) {*/
 	if (xml_ptr->pointer) {
@@ -382,23 +731,15 @@ SCResult xml_field_add()
 		sprintf(type_specifier, "%s ", xml_ptr->type_specifier);
 		for (i = 0; i < xml_ptr->pointer; i++)
 			sprintf(type_specifier, "%s*", type_specifier);
-		rc = xmlTextWriterWriteAttribute(xml_ptr->writer, 
-			(xmlChar *)"type", (xmlChar *)type_specifier);
-		g_free(type_specifier);
+		field->type = type_specifier;
 		g_free(xml_ptr->type_specifier); 
 	}
 	/* or a standard data type like 'int', 'char', ... */
 	else {
-		rc = xmlTextWriterWriteAttribute(xml_ptr->writer, 
-			(xmlChar *)"type", (xmlChar *)xml_ptr->type_specifier);
-		g_free(xml_ptr->type_specifier);
-	}
-	if (rc != SC_OK) {
-		log_error(LOG_ERR, "%s(): Could not add attribute 'type'", __func__);
-		goto clean;
+		field->type = xml_ptr->type_specifier;
 	}
 
-	/* Write 'bits' attribute if any */
+	/* The 'bits' attribute if any */
 	ptr = my_list;
 	/*debug_info("%s(): list len: %d\n", __func__, g_list_length(ptr));*/
 	while (ptr) {
@@ -411,64 +752,32 @@ SCResult xml_field_add()
 	}
 	/*putchar('\n');*/
 
-	if (bits_field) {
-		ptr = ptr->next;
+	/* The width may be an expression, e.g. 'FLAG_BITS + 1' */
+	if (bits_field && ptr->next) {
+		GString *bits = g_string_new((char *)ptr->next->data);
 
-		if (ptr) {
-			rc = xmlTextWriterWriteAttribute(xml_ptr->writer, 
-					(xmlChar *)"bits", (xmlChar *)ptr->data);
-			if (rc != SC_OK) {
-				log_error(LOG_ERR, "%s(): Could not add attribute 'bits': '%s'", 
-					__func__, xml_ptr->bits);
-				goto clean;
-			}
-		}
+		for (ptr = ptr->next->next; ptr && strcmp((char *)ptr->data, ";") &&
+				strcmp((char *)ptr->data, ","); ptr = ptr->next)
+			g_string_append_printf(bits, " %s", (char *)ptr->data);
+		field->bits = g_string_free(bits, FALSE);
 	}
 
-	/* Write array size if any */
-	if ((xml_ptr->size != NULL) && (!xml_ptr->func_ptr)) {
-		/* The size was not specified */
-		if (strlen(xml_ptr->size) == 0) {
-			rc = xmlTextWriterWriteFormatAttribute(xml_ptr->writer, 
-				(xmlChar *)"size", "N/A");
-		}
-		else {
-			rc = xmlTextWriterWriteFormatAttribute(xml_ptr->writer, 
-				(xmlChar *)"size", "%s", xml_ptr->size);
-		}
-		if (rc != SC_OK) {
-			log_error(LOG_ERR, "%s(): Could not add attribute 'size': '%s'", 
-				__func__, xml_ptr->bits);
-			goto clean;
-		}
-	}
+	/* The array size if any */
+	if ((xml_ptr->size != NULL) && (!xml_ptr->func_ptr))
+		field->size = g_strdup(xml_ptr->size);
 
-	/* Write function pointer if any */
+	/* The function pointer if any */
 	if (xml_ptr->func_ptr) {
 		int size = 0;
 		char *str;
 
-		if (xml_ptr->func_ptr_args_start == NULL || xml_ptr->func_ptr_args_start == NULL) {
-			log_error(LOG_ERR, "%s(): Could not add func ptr element", __func__);
-			goto clean;
-		}
+		field->func_ptr = 1;
 
-		rc = xmlTextWriterWriteFormatAttribute(xml_ptr->writer, 
-			(xmlChar *)"function_pointer", "1");
-		if (rc != SC_OK) {
-			log_error(LOG_ERR, "%s(): Could not add element 'function_pointer'", 
-				__func__);
-			goto clean;
+		if (xml_ptr->func_ptr_args_start == NULL || xml_ptr->func_ptr_args_end == NULL) {
+			log_error(LOG_ERR, "%s(): Could not add func ptr element", __func__);
 		}
-
-		if (xml_ptr->func_ptr_args_start == xml_ptr->func_ptr_args_end) {
-			rc = xmlTextWriterWriteElement(xml_ptr->writer, 
-					(xmlChar *)"input_args", (xmlChar *)"void");
-			if (rc != SC_OK) {
-				log_error(LOG_ERR, "%s(): Could not add element 'input_args': 'void'", 
-					__func__);
-				goto clean;
-			}
+		else if (xml_ptr->func_ptr_args_start == xml_ptr->func_ptr_args_end) {
+			field->input_args = g_strdup("void");
 		}	
 		else {
 			for (ptr = xml_ptr->func_ptr_args_start; 
@@ -489,31 +798,12 @@ SCResult xml_field_add()
 			
 			*(str + size - 2) = '\0';
 
-			rc = xmlTextWriterWriteElement(xml_ptr->writer, 
-					(xmlChar *)"input_args", (xmlChar *)str);
-			if (rc != SC_OK) {
-				log_error(LOG_ERR, "%s(): Could not add element 'input_args': '%s'", 
-						__func__, str);
-				goto clean;
-			}
-			g_free(str);
+			field->input_args = str;
 		}
 	}
 
-	rc = xmlTextWriterWriteElement(xml_ptr->writer, 
-			(xmlChar *)"name", (xmlChar *)xml_ptr->id);
-	if (rc != SC_OK) {
-		log_error(LOG_ERR, "%s(): Could not add element 'name': '%s'", 
-				__func__, xml_ptr->id);
-		goto clean;
-	}
-
-	/* Close element 'field' */
-    rc = xmlTextWriterEndElement(xml_ptr->writer);
-    if (rc < 0) {
-        log_error(LOG_ERR, "%s(): Could not close 'field' element", __func__);
-        goto clean;
-    }
+	/* The tokens are freed below */
+	field->name = g_strdup(xml_ptr->id);
 
 	rc = SC_OK;
 
@@ -536,10 +826,16 @@ clean:
 }
 
 
+/**
+ * @brief Close the struct being parsed. What follows the '}' is its 
+ *        typedef name, its name or its attributes.
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
 SCResult xml_struct_close()
 {
 	int 		rc;
 	GList 		*ptr;
+	SCStruct	*st = xml_ptr->current;
 
 	if (!xml_ptr->struct_cnt)
 		return SC_OK;
@@ -607,46 +903,36 @@ SCResult xml_struct_close()
 
 		/* <typedef_name>  */
 		if (xml_ptr->type_def > 0) {
-			rc = xmlTextWriterWriteElement(xml_ptr->writer, 
-					(xmlChar *)"typedef_name", (xmlChar *)specifier);
+			st->typedef_name = specifier;
 			xml_ptr->type_def--;
 		}
 		/* struct name is at the end: struct {}my_name; */
 		else if (xml_ptr->struct_has_name) {
-			rc = xmlTextWriterWriteElement(xml_ptr->writer, 
-					(xmlChar *)"struct_name", (xmlChar *)specifier);
+			st->tail_name = specifier;
 			xml_ptr->struct_has_name--;
 		}
 		/* or <struct_attributes> like '__attribute__' */
 		else {
+			st->attributes = specifier;
 			if (xml_ptr->nested_name) {
-				rc = xmlTextWriterWriteElement(xml_ptr->writer, 
-					(xmlChar *)"struct_attributes", (xmlChar *)specifier);
-
-				rc = xmlTextWriterWriteElement(xml_ptr->writer, 
-					(xmlChar *)"struct_nested_name", (xmlChar *)nested_name);
+				st->nested_name = nested_name;
 				xml_ptr->nested_name--;
 			}
-			else {
-				rc = xmlTextWriterWriteElement(xml_ptr->writer, 
-					(xmlChar *)"struct_attributes", (xmlChar *)specifier);
-			}
-		}
-		if (rc != SC_OK) {
-			log_error(LOG_ERR, "%s(): Could not write struct name", __func__);
-			return SC_FAIL;
 		}
 	}
 
-	/* </struct> */
-	rc = xmlTextWriterEndElement(xml_ptr->writer);
-    if (rc < 0) {
-        log_error(LOG_ERR, "%s(): Could not close <struct> XML node",
-			__func__);
-        return SC_FAIL;
-    }
-
 	xml_ptr->struct_cnt--;
+	xml_ptr->current = st->parent;
+
+	/* The top-level struct is complete, write it */
+	if (st->parent == NULL && xml_ptr->deferred) {
+		g_ptr_array_add(xml_ptr->deferred->structs, st);
+	}
+	else if (st->parent == NULL) {
+		rc = xml_struct_write_top(st);
+		model_struct_free(st);
+		return rc;
+	}
 
 	return SC_OK;
 }
@@ -666,36 +952,28 @@ SCResult xml_struct_prepare_close()
 	return SC_OK;
 }
 
+/**
+ * @brief A struct/union starts. It is added to the struct being parsed, if
+ *        any, and becomes the current one.
+ * @return SC_OK
+ */
 SCResult xml_struct_open()
 {
-	int rc, pos;
+	int pos;
 	GList *ptr;
 
 	debug_info("%s(): Inside\n", __func__);
 	xml_ptr->struct_cnt++;
 
-	if (xml_ptr->struct_union == 0)
-		rc = xmlTextWriterStartElement(xml_ptr->writer, (xmlChar *)"struct");
-	else
-		rc = xmlTextWriterStartElement(xml_ptr->writer, (xmlChar *)"union");
-    if (rc < 0) {
-        log_error(LOG_ERR, "%s(): Error at xmlTextWriterStartElement",
-			__func__);
-        return SC_FAIL;
-    }
+	xml_ptr->current = model_struct_new(xml_ptr->struct_union, xml_ptr->current);
 
 	pos = g_list_length(my_list) - 2;
 	ptr = g_list_nth(my_list, pos);
 
-	/* Write 'struct_name' element if data is not 'struct'/'union' itself. 
+	/* The 'struct_name' element if data is not 'struct'/'union' itself. 
      * It can happen with typedefs */
 	if (strcmp((char *)ptr->data, "struct") && strcmp((char *)ptr->data, "union")) {
-		rc = xmlTextWriterWriteElement(xml_ptr->writer, 
-				(xmlChar *)"struct_name", (xmlChar *)ptr->data);
-		if (rc != SC_OK) {
-			log_error(LOG_ERR, "%s(): Could not write struct name", __func__);
-			return SC_FAIL;
-		}
+		xml_ptr->current->name = g_strdup((char *)ptr->data);
 	}
 	else {
 		xml_ptr->struct_has_name++;
@@ -707,47 +985,51 @@ SCResult xml_struct_open()
 	return SC_OK;
 }
 
-SCResult xml_file_close(void)
-{
-	int rc;
-
-	rc = xmlTextWriterEndDocument(xml_ptr->writer);
-    if (rc < 0) {
-        log_error(LOG_ERR, "%s(): Error at xmlTextWriterEndDocument", __func__);
-        return SC_FAIL;
-    }
-
-    xmlFreeTextWriter(xml_ptr->writer);
-
-	g_free(xml_ptr);
-
-	return SC_OK;
-}
-
 /**
- * @brief Create the XML file with the XML document header and encoding
- * @param filename File being parsed.
+ * @brief Create an XML document with the XML document header, encoding
+ *        and the root element.
+ * @param doc Where the writer is kept
+ * @param xml_filename The XML file. When writing an archive, it is
+ *        the name of the entry.
  * @return SC_OK if everything is ok, SC_FAIL otherwise
  */
-SCResult xml_file_create(char *filename)
+static SCResult xml_document_open(struct xml_ptr_st *doc, char *xml_filename)
 {
 	int rc;
-	char xml_filename[NAME_SIZE + 4];
 
-	xml_ptr = g_new0(struct xml_ptr_st, 1);
+	doc->filename = g_strdup(xml_filename);
 
-	sprintf(xml_filename, "%s.xml", filename);
+	/* Create a new XmlWriter with no compression. The output buffer is kept
+	 * for knowing the byte offsets of the elements. 
+	 * Documents that go to an archive or that replace the XML file only 
+	 * if it changed are rendered in memory */
+	if (sc_opts.archive || sc_opts.if_changed) {
+		doc->buffer = xmlBufferCreate();
+		doc->out = xmlOutputBufferCreateBuffer(doc->buffer, NULL);
+	}
+	else {
+		/* With --dedup the file may be a hardlink shared with identical 
+		 * headers, never rewrite it in place */
+		if (sc_opts.dedup)
+			unlink(xml_filename);
+		doc->out = xmlOutputBufferCreateFilename((const char *)xml_filename, NULL, 0);
+	}
+	if (doc->out == NULL) {
+		log_error(LOG_ERR, "%s(): Error creating the xml file '%s' ",
+			__func__, xml_filename);
+		return SC_FAIL;
+	}
 
-	/* Create a new XmlWriter with no compression. */
-	xml_ptr->writer = xmlNewTextWriterFilename((const char *)xml_filename, 0);
-	if (xml_ptr->writer == NULL) {
+	doc->writer = xmlNewTextWriter(doc->out);
+	if (doc->writer == NULL) {
 		log_error(LOG_ERR, "%s(): Error creating the xml file '%s' ",
 			__func__, xml_filename);
+		xmlOutputBufferClose(doc->out);
 		return SC_FAIL;
 	}
 
 	/* Start the document with the XML default version ("1.0") */
-    rc = xmlTextWriterStartDocument(xml_ptr->writer, NULL, MY_ENCODING, NULL);
+    rc = xmlTextWriterStartDocument(doc->writer, NULL, MY_ENCODING, NULL);
     if (rc < 0) {
         log_error(LOG_ERR, "%s(): Error at xmlTextWriterStartDocument",
 			__func__);
@@ -755,7 +1037,7 @@ SCResult xml_file_create(char *filename)
     }
 
 	/* This is the root element */
-    rc = xmlTextWriterStartElement(xml_ptr->writer, (xmlChar *)"sc2xml");
+    rc = xmlTextWriterStartElement(doc->writer, (xmlChar *)"sc2xml");
     if (rc < 0) {
         log_error(LOG_ERR, "%s(): Error at xmlTextWriterStartElement\n",
 			__func__);
@@ -765,3 +1047,230 @@ SCResult xml_file_create(char *filename)
 	return SC_OK;
 }
 
+/**
+ * @brief Finish an XML document and write its index
+ * @param doc The document created with xml_document_open()
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+static SCResult xml_document_close(struct xml_ptr_st *doc)
+{
+	SCResult	result = SC_OK;
+	int			rc;
+
+	rc = xmlTextWriterEndDocument(doc->writer);
+    if (rc < 0) {
+        log_error(LOG_ERR, "%s(): Error at xmlTextWriterEndDocument", __func__);
+        return SC_FAIL;
+    }
+
+    xmlFreeTextWriter(doc->writer);
+
+	/* The document was rendered in memory, hand it to the archive 
+	 * or replace the XML file if it changed */
+	if (doc->buffer) {
+		const char *content = (const char *)xmlBufferContent(doc->buffer);
+		int changed;
+
+		if (sc_opts.archive) {
+			rc = archive_add(doc->filename, content, 
+					xmlBufferLength(doc->buffer));
+		}
+		else {
+			rc = write_if_changed(doc->filename, content, 
+					xmlBufferLength(doc->buffer), &changed);
+			if (rc == SC_OK && !changed)
+				log_error(LOG_INFO, "'%s' is up to date", doc->filename);
+		}
+		xmlBufferFree(doc->buffer);
+		if (rc != SC_OK) {
+			log_error(LOG_ERR, "%s(): Could not write '%s'", 
+				__func__, doc->filename);
+			result = SC_FAIL;
+		}
+	}
+
+	if (result == SC_OK && sc_opts.index)
+		index_write(doc->filename);
+
+	g_free(doc->filename);
+
+	return result;
+}
+
+SCResult xml_file_close(void)
+{
+	SCResult rc = SC_OK;
+
+	/* A struct left open by a parse error is discarded */
+	if (xml_ptr->current) {
+		while (xml_ptr->current->parent)
+			xml_ptr->current = xml_ptr->current->parent;
+		model_struct_free(xml_ptr->current);
+	}
+
+	/* Written by xml_resolve_flush() */
+	if (xml_ptr->deferred) {
+		if (deferred == NULL)
+			deferred = g_ptr_array_new_with_free_func((GDestroyNotify)model_header_free);
+		g_ptr_array_add(deferred, xml_ptr->deferred);
+		g_free(xml_ptr->header);
+		g_free(xml_ptr->filename);
+		g_free(xml_ptr);
+		return SC_OK;
+	}
+
+	/* </header> */
+	if (aggregate) {
+		if (xmlTextWriterEndElement(xml_ptr->writer) < 0) {
+			log_error(LOG_ERR, "%s(): Could not close <header> XML node", __func__);
+			rc = SC_FAIL;
+		}
+		g_free(xml_ptr->filename);
+	}
+	else {
+		rc = xml_document_close(xml_ptr);
+	}
+
+	g_free(xml_ptr->header);
+	g_free(xml_ptr);
+
+	return rc;
+}
+
+/**
+ * @brief Create the XML file with the XML document header and encoding.
+ *        With --aggregate, start the <header> element of the file instead.
+ * @param xml_filename The XML file. When writing an archive, it is
+ *        the name of the entry.
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult xml_file_create(char *xml_filename)
+{
+	int rc;
+
+	xml_ptr = g_new0(struct xml_ptr_st, 1);
+
+	/* The header is the XML filename without '.xml' */
+	xml_ptr->header = g_strndup(xml_filename, strlen(xml_filename) - 4);
+
+	/* Every header has its own constants and layouts, once parsed with
+	 * --resolve the constants are kept until all of them are written */
+	if (resolving)
+		consts_use(xml_ptr->header);
+	else
+		consts_begin(xml_ptr->header);
+	layout_reset();
+
+	/* With --resolve, nothing is written until all the headers are parsed */
+	if (sc_opts.resolve && !resolving) {
+		xml_ptr->filename = g_strdup(xml_filename);
+		xml_ptr->deferred = model_header_new(xml_ptr->header);
+		return SC_OK;
+	}
+
+	if (aggregate) {
+		xml_ptr->writer = aggregate->writer;
+		xml_ptr->out = aggregate->out;
+		xml_ptr->filename = g_strdup(xml_filename);
+
+		rc = xmlTextWriterStartElement(xml_ptr->writer, (xmlChar *)"header");
+		if (rc >= 0)
+			rc = xmlTextWriterWriteAttribute(xml_ptr->writer, 
+					(xmlChar *)"name", (xmlChar *)xml_ptr->header);
+		if (rc < 0) {
+			log_error(LOG_ERR, "%s(): Could not write <header> for '%s'", 
+				__func__, xml_filename);
+			return SC_FAIL;
+		}
+
+		return SC_OK;
+	}
+
+	index_reset();
+	xml_struct_ids_reset();
+
+	return xml_document_open(xml_ptr, xml_filename);
+}
+
+/**
+ * @brief Start the document where all the headers are written
+ * @param xml_filename The XML file
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult xml_aggregate_open(char *xml_filename)
+{
+	aggregate = g_new0(struct xml_ptr_st, 1);
+
+	index_reset();
+	xml_struct_ids_reset();
+
+	if (xml_document_open(aggregate, xml_filename) != SC_OK) {
+		g_free(aggregate);
+		aggregate = NULL;
+		return SC_FAIL;
+	}
+
+	return SC_OK;
+}
+
+/**
+ * @brief Finish the document where all the headers were written
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult xml_aggregate_close(void)
+{
+	SCResult rc;
+
+	if (aggregate == NULL)
+		return SC_FAIL;
+
+	rc = xml_document_close(aggregate);
+	g_free(aggregate);
+	aggregate = NULL;
+
+	return rc;
+}
+
+/**
+ * @brief With --resolve, write the headers kept by xml_file_close() once 
+ *        the definitions of all of them are known
+ * @return SC_OK if everything is ok, SC_FAIL otherwise
+ */
+SCResult xml_resolve_flush(void)
+{
+	SCResult	rc = SC_OK;
+	gchar		*xml_filename;
+	guint		i, j;
+
+	if (deferred == NULL)
+		return SC_OK;
+
+	resolve_index(deferred);
+	resolving = 1;
+
+	for (i = 0; i < deferred->len; i++) {
+		SCHeader *header = g_ptr_array_index(deferred, i);
+
+		xml_filename = g_strconcat(header->name, ".xml", NULL);
+		if (xml_file_create(xml_filename) != SC_OK) {
+			g_free(xml_filename);
+			rc = SC_FAIL;
+			continue;
+		}
+
+		for (j = 0; j < header->structs->len; j++)
+			if (xml_struct_write_top(g_ptr_array_index(header->structs, j)) != SC_OK)
+				rc = SC_FAIL;
+
+		if (xml_file_close() != SC_OK)
+			rc = SC_FAIL;
+		g_free(xml_filename);
+	}
+
+	resolving = 0;
+	resolve_reset();
+	g_ptr_array_free(deferred, TRUE);
+	deferred = NULL;
+
+	return rc;
+}
@@ -20,11 +20,17 @@
 #include <libxml/xmlwriter.h>
 
 #include "sc2xml.h"
+#include "model.h"
 
 typedef struct xml_ptr_st * SC2XMLPtr;
 
 struct xml_ptr_st {
 	xmlTextWriterPtr writer;	/**< A ptr to an XML writer struct */
+	xmlOutputBufferPtr out;		/**< The writer's output, for byte offsets */
+	xmlBufferPtr buffer;		/**< In-memory output (archive or --if-changed) */
+	char *filename;				/**< The XML file being written */
+	char *header;				/**< The XML filename without '.xml' */
+	SCHeader *deferred;			/**< With --resolve, the structs to write later */
 	int struct_cnt;				/**< Add/Substract each time we enter/exit an struct */
 	int set_close;				/**< Flag to indicate the end of the struct/union */
 	int struct_union;			/**< Indicates struct or union */
@@ -39,6 +45,7 @@ struct xml_ptr_st {
 	int nested_name;			/**< Name of nested struct with possible attributes */
 	GList *func_ptr_args_start;	/**< Ptr where the func ptr args start */
 	GList *func_ptr_args_end;	/**< Ptr where the func ptr args end */
+	SCStruct *current;			/**< The struct being parsed */
 };
 
 SCResult xml_storage_class_specifier_add(void);
@@ -60,4 +67,7 @@ SCResult xml_struct_close(void);
 SCResult xml_struct_open(void);
 SCResult xml_file_close(void);
 SCResult xml_file_create(char *);
+SCResult xml_aggregate_open(char *);
+SCResult xml_aggregate_close(void);
+SCResult xml_resolve_flush(void);
 